@@ -0,0 +1,467 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2013 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+package com.google.protobuf.nano;
+
+import java.io.IOException;
+import java.nio.ByteBuffer;
+
+/**
+ * Decodes protocol message fields straight out of a byte array for the
+ * {@code mergeFrom(byte[], int, int, ArrayDecoderNano)} methods generated
+ * with the array_parser option, which keep their position in the array in a
+ * local variable and hand it on to the methods of nested messages.
+ *
+ * <p>Each read method takes the position of a value and the limit of the
+ * message being parsed, leaves the value in one of the public fields below
+ * and returns the position after it. Varints far enough from the limit are
+ * decoded without checking it for each byte.
+ *
+ * @hide
+ */
+public final class ArrayDecoderNano {
+  private static final int MAX_VARINT_SIZE = 10;
+  private static final int RECURSION_LIMIT = 64;
+
+  // The values read by the last call to a read method of each type.
+  public int intValue;
+  public long longValue;
+  public float floatValue;
+  public double doubleValue;
+  public boolean booleanValue;
+  public String stringValue;
+  public byte[] bytesValue;
+
+  /**
+   * The end group tag at which the last mergeFrom() returned, or 0 if it
+   * parsed up to its limit.
+   */
+  public int lastTag;
+
+  private int recursionDepth;
+
+  // A view of the array for countVarints(), made when it is first needed.
+  private ByteBuffer words;
+
+  /** Returns how many more messages may be nested in the current one. */
+  int remainingRecursionDepth() {
+    return RECURSION_LIMIT - recursionDepth;
+  }
+
+  // -----------------------------------------------------------------
+
+  /** Reads a field tag, which is never 0, into {@code intValue}. */
+  public int readTag(final byte[] buffer, final int position, final int limit)
+      throws IOException {
+    final int result = readRawVarint32(buffer, position, limit);
+    if (intValue == 0) {
+      // If we actually read zero, that's not a valid tag.
+      throw InvalidProtocolBufferNanoException.invalidTag();
+    }
+    return result;
+  }
+
+  /**
+   * Skips a single field, given its tag. Returns the same position for an end
+   * group tag, leaving it in {@code lastTag}.
+   */
+  public int skipField(final byte[] buffer, final int position, final int limit,
+      final int tag) throws IOException {
+    switch (WireFormatNano.getTagWireType(tag)) {
+      case WireFormatNano.WIRETYPE_VARINT:
+        return readRawVarint64(buffer, position, limit);
+      case WireFormatNano.WIRETYPE_FIXED64:
+        return skipRawBytes(position, limit, 8);
+      case WireFormatNano.WIRETYPE_LENGTH_DELIMITED:
+        final int start = readLength(buffer, position, limit);
+        return start + intValue;
+      case WireFormatNano.WIRETYPE_START_GROUP:
+        return skipGroup(buffer, position, limit,
+            WireFormatNano.makeTag(WireFormatNano.getTagFieldNumber(tag),
+                                   WireFormatNano.WIRETYPE_END_GROUP));
+      case WireFormatNano.WIRETYPE_END_GROUP:
+        lastTag = tag;
+        return position;
+      case WireFormatNano.WIRETYPE_FIXED32:
+        return skipRawBytes(position, limit, 4);
+      default:
+        throw InvalidProtocolBufferNanoException.invalidWireType();
+    }
+  }
+
+  private int skipGroup(final byte[] buffer, int position, final int limit,
+      final int endTag) throws IOException {
+    // Unlike CodedInputByteBufferNano, count the nesting of skipped groups
+    // too, as each one is a recursive call.
+    if (recursionDepth >= RECURSION_LIMIT) {
+      throw InvalidProtocolBufferNanoException.recursionLimitExceeded();
+    }
+    ++recursionDepth;
+    while (true) {
+      if (position == limit) {
+        throw InvalidProtocolBufferNanoException.invalidEndTag();
+      }
+      position = readTag(buffer, position, limit);
+      final int tag = intValue;
+      if (tag == endTag) {
+        break;
+      }
+      if (WireFormatNano.getTagWireType(tag) == WireFormatNano.WIRETYPE_END_GROUP) {
+        throw InvalidProtocolBufferNanoException.invalidEndTag();
+      }
+      position = skipField(buffer, position, limit, tag);
+    }
+    --recursionDepth;
+    return position;
+  }
+
+  // -----------------------------------------------------------------
+
+  /** Reads a {@code double} field value into {@code doubleValue}. */
+  public int readDouble(final byte[] buffer, final int position, final int limit)
+      throws IOException {
+    final int result = readRawLittleEndian64(buffer, position, limit);
+    doubleValue = Double.longBitsToDouble(longValue);
+    return result;
+  }
+
+  /** Reads a {@code float} field value into {@code floatValue}. */
+  public int readFloat(final byte[] buffer, final int position, final int limit)
+      throws IOException {
+    final int result = readRawLittleEndian32(buffer, position, limit);
+    floatValue = Float.intBitsToFloat(intValue);
+    return result;
+  }
+
+  /** Reads a {@code uint64} field value into {@code longValue}. */
+  public int readUInt64(final byte[] buffer, final int position, final int limit)
+      throws IOException {
+    return readRawVarint64(buffer, position, limit);
+  }
+
+  /** Reads an {@code int64} field value into {@code longValue}. */
+  public int readInt64(final byte[] buffer, final int position, final int limit)
+      throws IOException {
+    return readRawVarint64(buffer, position, limit);
+  }
+
+  /** Reads an {@code int32} field value into {@code intValue}. */
+  public int readInt32(final byte[] buffer, final int position, final int limit)
+      throws IOException {
+    return readRawVarint32(buffer, position, limit);
+  }
+
+  /** Reads a {@code fixed64} field value into {@code longValue}. */
+  public int readFixed64(final byte[] buffer, final int position, final int limit)
+      throws IOException {
+    return readRawLittleEndian64(buffer, position, limit);
+  }
+
+  /** Reads a {@code fixed32} field value into {@code intValue}. */
+  public int readFixed32(final byte[] buffer, final int position, final int limit)
+      throws IOException {
+    return readRawLittleEndian32(buffer, position, limit);
+  }
+
+  /** Reads a {@code bool} field value into {@code booleanValue}. */
+  public int readBool(final byte[] buffer, final int position, final int limit)
+      throws IOException {
+    final int result = readRawVarint32(buffer, position, limit);
+    booleanValue = intValue != 0;
+    return result;
+  }
+
+  /** Reads a {@code string} field value into {@code stringValue}. */
+  public int readString(final byte[] buffer, final int position, final int limit)
+      throws IOException {
+    final int start = readLength(buffer, position, limit);
+    final int size = intValue;
+    stringValue = size == 0 ? "" : new String(buffer, start, size, InternalNano.UTF_8);
+    return start + size;
+  }
+
+  /** Reads a {@code bytes} field value into {@code bytesValue}. */
+  public int readBytes(final byte[] buffer, final int position, final int limit)
+      throws IOException {
+    final int start = readLength(buffer, position, limit);
+    final int size = intValue;
+    if (size == 0) {
+      bytesValue = WireFormatNano.EMPTY_BYTES;
+    } else {
+      bytesValue = new byte[size];
+      System.arraycopy(buffer, start, bytesValue, 0, size);
+    }
+    return start + size;
+  }
+
+  /** Reads a {@code uint32} field value into {@code intValue}. */
+  public int readUInt32(final byte[] buffer, final int position, final int limit)
+      throws IOException {
+    return readRawVarint32(buffer, position, limit);
+  }
+
+  /** Reads an enum field value into {@code intValue}. */
+  public int readEnum(final byte[] buffer, final int position, final int limit)
+      throws IOException {
+    return readRawVarint32(buffer, position, limit);
+  }
+
+  /** Reads an {@code sfixed32} field value into {@code intValue}. */
+  public int readSFixed32(final byte[] buffer, final int position, final int limit)
+      throws IOException {
+    return readRawLittleEndian32(buffer, position, limit);
+  }
+
+  /** Reads an {@code sfixed64} field value into {@code longValue}. */
+  public int readSFixed64(final byte[] buffer, final int position, final int limit)
+      throws IOException {
+    return readRawLittleEndian64(buffer, position, limit);
+  }
+
+  /** Reads an {@code sint32} field value into {@code intValue}. */
+  public int readSInt32(final byte[] buffer, final int position, final int limit)
+      throws IOException {
+    final int result = readRawVarint32(buffer, position, limit);
+    intValue = CodedInputByteBufferNano.decodeZigZag32(intValue);
+    return result;
+  }
+
+  /** Reads an {@code sint64} field value into {@code longValue}. */
+  public int readSInt64(final byte[] buffer, final int position, final int limit)
+      throws IOException {
+    final int result = readRawVarint64(buffer, position, limit);
+    longValue = CodedInputByteBufferNano.decodeZigZag64(longValue);
+    return result;
+  }
+
+  /**
+   * Reads an embedded message field value into {@code msg}, returning the
+   * position after it.
+   */
+  public int readMessage(final MessageNano msg, final byte[] buffer,
+      final int position, final int limit) throws IOException {
+    final int start = readLength(buffer, position, limit);
+    final int end = start + intValue;
+    if (recursionDepth >= RECURSION_LIMIT) {
+      throw InvalidProtocolBufferNanoException.recursionLimitExceeded();
+    }
+    ++recursionDepth;
+    msg.mergeFrom(buffer, start, end, this);
+    if (lastTag != 0) {
+      throw InvalidProtocolBufferNanoException.invalidEndTag();
+    }
+    --recursionDepth;
+    return end;
+  }
+
+  /**
+   * Reads a group field value into {@code msg}, returning the position after
+   * its end group tag.
+   */
+  public int readGroup(final MessageNano msg, final byte[] buffer,
+      final int position, final int limit, final int fieldNumber)
+      throws IOException {
+    if (recursionDepth >= RECURSION_LIMIT) {
+      throw InvalidProtocolBufferNanoException.recursionLimitExceeded();
+    }
+    ++recursionDepth;
+    final int result = msg.mergeFrom(buffer, position, limit, this);
+    if (lastTag != WireFormatNano.makeTag(fieldNumber, WireFormatNano.WIRETYPE_END_GROUP)) {
+      throw InvalidProtocolBufferNanoException.invalidEndTag();
+    }
+    lastTag = 0;
+    --recursionDepth;
+    return result;
+  }
+
+  /**
+   * Reads the length of a length-delimited value into {@code intValue},
+   * checking that it fits before the limit, and returns the position of the
+   * value.
+   */
+  public int readLength(final byte[] buffer, final int position, final int limit)
+      throws IOException {
+    final int result = readRawVarint32(buffer, position, limit);
+    if (intValue < 0) {
+      throw InvalidProtocolBufferNanoException.negativeSize();
+    }
+    if (intValue > limit - result) {
+      throw InvalidProtocolBufferNanoException.truncatedMessage();
+    }
+    return result;
+  }
+
+  /**
+   * Returns the number of varints from {@code position} up to {@code end},
+   * as {@link CodedInputByteBufferNano#countVarints} does, rejecting bytes
+   * which end inside a varint. The caller has checked that end is within the
+   * array.
+   */
+  public int countVarints(final byte[] buffer, final int position, final int end)
+      throws IOException {
+    if (end - position >= 8 && (words == null || words.array() != buffer)) {
+      words = ByteBuffer.wrap(buffer);
+    }
+    return CodedInputByteBufferNano.countVarints(buffer, words, position, end);
+  }
+
+  /**
+   * Checks that the values of a packed field, read up to {@code position},
+   * end at {@code end} as its length said: the bytes of a partial value left
+   * over would otherwise be read as the next tag.
+   */
+  public void checkPackedEnd(final int position, final int end)
+      throws IOException {
+    if (position != end) {
+      throw InvalidProtocolBufferNanoException.truncatedMessage();
+    }
+  }
+
+  // -----------------------------------------------------------------
+
+  /**
+   * Reads a varint into {@code intValue}. If it is longer than 32 bits, the
+   * upper bits are discarded, as by
+   * {@link CodedInputByteBufferNano#readRawVarint32}.
+   */
+  public int readRawVarint32(final byte[] buffer, int position, final int limit)
+      throws IOException {
+    if (limit - position < MAX_VARINT_SIZE) {
+      if (position < limit && buffer[position] >= 0) {
+        intValue = buffer[position];
+        return position + 1;
+      }
+      position = readRawVarint64Slow(buffer, position, limit);
+      intValue = (int) longValue;
+      return position;
+    }
+
+    // At least MAX_VARINT_SIZE bytes remain, so no byte needs a check.
+    int tmp = buffer[position++];
+    if (tmp >= 0) {
+      intValue = tmp;
+      return position;
+    }
+    int result = tmp & 0x7f;
+    if ((tmp = buffer[position++]) >= 0) {
+      result |= tmp << 7;
+    } else {
+      result |= (tmp & 0x7f) << 7;
+      if ((tmp = buffer[position++]) >= 0) {
+        result |= tmp << 14;
+      } else {
+        result |= (tmp & 0x7f) << 14;
+        if ((tmp = buffer[position++]) >= 0) {
+          result |= tmp << 21;
+        } else {
+          result |= (tmp & 0x7f) << 21;
+          result |= (tmp = buffer[position++]) << 28;
+          if (tmp < 0) {
+            // Discard upper 32 bits.
+            int i = 0;
+            while (buffer[position++] < 0) {
+              if (++i == 5) {
+                throw InvalidProtocolBufferNanoException.malformedVarint();
+              }
+            }
+          }
+        }
+      }
+    }
+    intValue = result;
+    return position;
+  }
+
+  /** Reads a varint into {@code longValue}. */
+  public int readRawVarint64(final byte[] buffer, int position, final int limit)
+      throws IOException {
+    if (limit - position < MAX_VARINT_SIZE) {
+      return readRawVarint64Slow(buffer, position, limit);
+    }
+
+    // At least MAX_VARINT_SIZE bytes remain, so no byte needs a check.
+    long result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      final byte b = buffer[position++];
+      result |= (long) (b & 0x7F) << shift;
+      if (b >= 0) {
+        longValue = result;
+        return position;
+      }
+    }
+    throw InvalidProtocolBufferNanoException.malformedVarint();
+  }
+
+  private int readRawVarint64Slow(final byte[] buffer, int position,
+      final int limit) throws IOException {
+    long result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (position == limit) {
+        throw InvalidProtocolBufferNanoException.truncatedMessage();
+      }
+      final byte b = buffer[position++];
+      result |= (long) (b & 0x7F) << shift;
+      if (b >= 0) {
+        longValue = result;
+        return position;
+      }
+    }
+    throw InvalidProtocolBufferNanoException.malformedVarint();
+  }
+
+  /** Reads a 32-bit little-endian integer into {@code intValue}. */
+  public int readRawLittleEndian32(final byte[] buffer, final int position,
+      final int limit) throws IOException {
+    if (limit - position < 4) {
+      throw InvalidProtocolBufferNanoException.truncatedMessage();
+    }
+    intValue = ByteArrayAccessNano.INSTANCE.getIntLittleEndian(buffer, position);
+    return position + 4;
+  }
+
+  /** Reads a 64-bit little-endian integer into {@code longValue}. */
+  public int readRawLittleEndian64(final byte[] buffer, final int position,
+      final int limit) throws IOException {
+    if (limit - position < 8) {
+      throw InvalidProtocolBufferNanoException.truncatedMessage();
+    }
+    longValue = ByteArrayAccessNano.INSTANCE.getLongLittleEndian(buffer, position);
+    return position + 8;
+  }
+
+  private static int skipRawBytes(final int position, final int limit,
+      final int size) throws IOException {
+    if (limit - position < size) {
+      throw InvalidProtocolBufferNanoException.truncatedMessage();
+    }
+    return position + size;
+  }
+}
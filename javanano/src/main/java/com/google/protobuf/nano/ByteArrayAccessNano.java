@@ -0,0 +1,281 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2013 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+package com.google.protobuf.nano;
+
+import java.lang.invoke.MethodHandle;
+import java.lang.invoke.MethodHandles;
+import java.lang.invoke.MethodType;
+import java.lang.reflect.Field;
+import java.nio.ByteOrder;
+
+/**
+ * Reads and writes little-endian ints and longs at any index of a byte array,
+ * for the fixed-width values of CodedInputByteBufferNano,
+ * CodedOutputByteBufferNano and ArrayDecoderNano. The implementation is
+ * chosen once, when the class is initialized: where {@code sun.misc.Unsafe}
+ * can be found by reflection and the processor allows unaligned loads, each
+ * value is read or written with a single memory access; otherwise it is
+ * assembled from its bytes. Setting the system property {@value #BACKEND_PROPERTY} to
+ * {@code "unsafe"} or {@code "portable"} forces one, for benchmarking; an
+ * unavailable backend falls back to the portable one.
+ *
+ * <p>Like array accesses, the methods throw
+ * {@link ArrayIndexOutOfBoundsException} if the 4 or 8 bytes from the index
+ * on are not all in the array. Callers check their own limits first.
+ */
+abstract class ByteArrayAccessNano {
+
+  static final String BACKEND_PROPERTY = "com.google.protobuf.nano.byteArrayAccess";
+
+  private static final ByteArrayAccessNano PORTABLE = new Portable();
+  private static final ByteArrayAccessNano UNSAFE = createUnsafe();
+
+  static final ByteArrayAccessNano INSTANCE = select();
+
+  private static ByteArrayAccessNano createUnsafe() {
+    try {
+      return UnsafeAccess.create();
+    } catch (Throwable e) {
+      // No usable Unsafe: missing, hidden or denied by a security manager.
+      return null;
+    }
+  }
+
+  private static ByteArrayAccessNano select() {
+    String backend;
+    try {
+      backend = System.getProperty(BACKEND_PROPERTY);
+    } catch (SecurityException e) {
+      backend = null;
+    }
+    if ("portable".equals(backend) || UNSAFE == null) {
+      return PORTABLE;
+    }
+    return UNSAFE;
+  }
+
+  /** The backend assembling values from their bytes. */
+  static ByteArrayAccessNano portable() {
+    return PORTABLE;
+  }
+
+  /** The backend using {@code sun.misc.Unsafe}, or null if unavailable. */
+  static ByteArrayAccessNano unsafe() {
+    return UNSAFE;
+  }
+
+  /** The name of the backend, as accepted by {@value #BACKEND_PROPERTY}. */
+  abstract String name();
+
+  abstract int getIntLittleEndian(byte[] buffer, int index);
+  abstract long getLongLittleEndian(byte[] buffer, int index);
+  abstract void putIntLittleEndian(byte[] buffer, int index, int value);
+  abstract void putLongLittleEndian(byte[] buffer, int index, long value);
+
+  private static final class Portable extends ByteArrayAccessNano {
+    @Override
+    String name() {
+      return "portable";
+    }
+
+    @Override
+    int getIntLittleEndian(byte[] buffer, int index) {
+      return (buffer[index] & 0xff)
+          | ((buffer[index + 1] & 0xff) << 8)
+          | ((buffer[index + 2] & 0xff) << 16)
+          | ((buffer[index + 3] & 0xff) << 24);
+    }
+
+    @Override
+    long getLongLittleEndian(byte[] buffer, int index) {
+      return (buffer[index] & 0xffL)
+          | ((buffer[index + 1] & 0xffL) << 8)
+          | ((buffer[index + 2] & 0xffL) << 16)
+          | ((buffer[index + 3] & 0xffL) << 24)
+          | ((buffer[index + 4] & 0xffL) << 32)
+          | ((buffer[index + 5] & 0xffL) << 40)
+          | ((buffer[index + 6] & 0xffL) << 48)
+          | ((buffer[index + 7] & 0xffL) << 56);
+    }
+
+    @Override
+    void putIntLittleEndian(byte[] buffer, int index, int value) {
+      buffer[index] = (byte) value;
+      buffer[index + 1] = (byte) (value >>> 8);
+      buffer[index + 2] = (byte) (value >>> 16);
+      buffer[index + 3] = (byte) (value >>> 24);
+    }
+
+    @Override
+    void putLongLittleEndian(byte[] buffer, int index, long value) {
+      buffer[index] = (byte) value;
+      buffer[index + 1] = (byte) (value >>> 8);
+      buffer[index + 2] = (byte) (value >>> 16);
+      buffer[index + 3] = (byte) (value >>> 24);
+      buffer[index + 4] = (byte) (value >>> 32);
+      buffer[index + 5] = (byte) (value >>> 40);
+      buffer[index + 6] = (byte) (value >>> 48);
+      buffer[index + 7] = (byte) (value >>> 56);
+    }
+  }
+
+  /**
+   * Unaligned accesses through {@code sun.misc.Unsafe}, in the native byte
+   * order, reversed on big-endian processors. The class is looked up by name
+   * and its methods are called through method handles bound to the instance,
+   * so the library does not link against {@code sun.misc} and compiles
+   * without proprietary API warnings; the handles are static finals, which
+   * the JIT compiles to direct calls.
+   */
+  private static final class UnsafeAccess extends ByteArrayAccessNano {
+    private static final boolean BIG_ENDIAN =
+        ByteOrder.nativeOrder() == ByteOrder.BIG_ENDIAN;
+
+    private static final long BASE_OFFSET;
+    private static final MethodHandle GET_INT;
+    private static final MethodHandle GET_LONG;
+    private static final MethodHandle PUT_INT;
+    private static final MethodHandle PUT_LONG;
+
+    static {
+      try {
+        Class<?> unsafeClass = Class.forName("sun.misc.Unsafe");
+        Field field = unsafeClass.getDeclaredField("theUnsafe");
+        field.setAccessible(true);
+        Object unsafe = field.get(null);
+        if ((Integer) unsafeClass.getMethod("arrayIndexScale", Class.class)
+            .invoke(unsafe, byte[].class) != 1) {
+          throw new IllegalStateException("byte[] elements are not packed");
+        }
+        BASE_OFFSET = (Integer) unsafeClass.getMethod("arrayBaseOffset", Class.class)
+            .invoke(unsafe, byte[].class);
+        MethodHandles.Lookup lookup = MethodHandles.lookup();
+        GET_INT = lookup.findVirtual(unsafeClass, "getInt",
+            MethodType.methodType(int.class, Object.class, long.class)).bindTo(unsafe);
+        GET_LONG = lookup.findVirtual(unsafeClass, "getLong",
+            MethodType.methodType(long.class, Object.class, long.class)).bindTo(unsafe);
+        PUT_INT = lookup.findVirtual(unsafeClass, "putInt",
+            MethodType.methodType(void.class, Object.class, long.class, int.class))
+            .bindTo(unsafe);
+        PUT_LONG = lookup.findVirtual(unsafeClass, "putLong",
+            MethodType.methodType(void.class, Object.class, long.class, long.class))
+            .bindTo(unsafe);
+      } catch (Exception e) {
+        // Reported to createUnsafe() as an ExceptionInInitializerError.
+        throw new IllegalStateException(e);
+      }
+    }
+
+    private UnsafeAccess() {}
+
+    static ByteArrayAccessNano create() {
+      return supportsUnalignedAccess() ? new UnsafeAccess() : null;
+    }
+
+    private static boolean supportsUnalignedAccess() {
+      String arch = System.getProperty("os.arch");
+      return "amd64".equals(arch) || "x86_64".equals(arch)
+          || "x86".equals(arch) || "i386".equals(arch) || "i686".equals(arch)
+          || "aarch64".equals(arch) || "arm64".equals(arch)
+          || "ppc64le".equals(arch) || "s390x".equals(arch);
+    }
+
+    @Override
+    String name() {
+      return "unsafe";
+    }
+
+    // Unsafe does not check its accesses; one check here replaces the
+    // bounds checks of the 4 or 8 array accesses of the portable backend.
+    private static void checkBounds(byte[] buffer, int index, int size) {
+      if ((index | (buffer.length - size - index)) < 0) {
+        throw new ArrayIndexOutOfBoundsException(index);
+      }
+    }
+
+    @Override
+    int getIntLittleEndian(byte[] buffer, int index) {
+      checkBounds(buffer, index, 4);
+      int value;
+      try {
+        value = (int) GET_INT.invokeExact((Object) buffer, BASE_OFFSET + index);
+      } catch (Throwable e) {
+        throw rethrow(e);
+      }
+      return BIG_ENDIAN ? Integer.reverseBytes(value) : value;
+    }
+
+    @Override
+    long getLongLittleEndian(byte[] buffer, int index) {
+      checkBounds(buffer, index, 8);
+      long value;
+      try {
+        value = (long) GET_LONG.invokeExact((Object) buffer, BASE_OFFSET + index);
+      } catch (Throwable e) {
+        throw rethrow(e);
+      }
+      return BIG_ENDIAN ? Long.reverseBytes(value) : value;
+    }
+
+    @Override
+    void putIntLittleEndian(byte[] buffer, int index, int value) {
+      checkBounds(buffer, index, 4);
+      try {
+        PUT_INT.invokeExact((Object) buffer, BASE_OFFSET + index,
+            BIG_ENDIAN ? Integer.reverseBytes(value) : value);
+      } catch (Throwable e) {
+        throw rethrow(e);
+      }
+    }
+
+    @Override
+    void putLongLittleEndian(byte[] buffer, int index, long value) {
+      checkBounds(buffer, index, 8);
+      try {
+        PUT_LONG.invokeExact((Object) buffer, BASE_OFFSET + index,
+            BIG_ENDIAN ? Long.reverseBytes(value) : value);
+      } catch (Throwable e) {
+        throw rethrow(e);
+      }
+    }
+
+    // The Unsafe accessors throw nothing checked; anything else is a bug.
+    private static RuntimeException rethrow(Throwable e) {
+      if (e instanceof RuntimeException) {
+        return (RuntimeException) e;
+      }
+      if (e instanceof Error) {
+        throw (Error) e;
+      }
+      return new IllegalStateException(e);
+    }
+  }
+}
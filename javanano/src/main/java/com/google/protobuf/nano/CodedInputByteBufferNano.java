@@ -31,6 +31,8 @@
 package com.google.protobuf.nano;
 
 import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.util.Arrays;
 
 /**
  * Reads and decodes protocol message fields.
@@ -96,6 +98,29 @@ public final class CodedInputByteBufferNano {
     }
   }
 
+  /** Returns the tag last read by readTag(), or 0 if the input ended. */
+  int getLastTag() {
+    return lastTag;
+  }
+
+  /**
+   * Reads the next tag if it is the given one, as when parsing the values of
+   * an unpacked repeated field in a single pass; otherwise leaves the input
+   * where it was.
+   *
+   * @return whether the tag was read.
+   */
+  public boolean readTagIfEquals(final int tag) throws IOException {
+    final int position = bufferPos;
+    final int previousTag = lastTag;
+    if (readTag() == tag) {
+      return true;
+    }
+    bufferPos = position;
+    lastTag = previousTag;
+    return false;
+  }
+
   /**
    * Reads and discards a single field, given its tag value.
    *
@@ -284,6 +309,49 @@ public final class CodedInputByteBufferNano {
    * upper bits.
    */
   public int readRawVarint32() throws IOException {
+    fastpath: {
+      int position = bufferPos;
+      if (position == bufferSize) {
+        break fastpath;
+      }
+      final byte[] buffer = this.buffer;
+      int x;
+      if ((x = buffer[position++]) >= 0) {
+        bufferPos = position;
+        return x;
+      } else if (bufferSize - position < MAX_VARINT_SIZE - 1) {
+        break fastpath;
+      }
+      // The rest of the longest varint is in the buffer, so its bytes are
+      // read without checks. The bits of each byte are xor'ed in, and those
+      // of the continuation bits, known from the branch taken, xor'ed out.
+      if ((x ^= (buffer[position++] << 7)) < 0) {
+        x ^= (~0 << 7);
+      } else if ((x ^= (buffer[position++] << 14)) >= 0) {
+        x ^= (~0 << 7) ^ (~0 << 14);
+      } else if ((x ^= (buffer[position++] << 21)) < 0) {
+        x ^= (~0 << 7) ^ (~0 << 14) ^ (~0 << 21);
+      } else {
+        final int y = buffer[position++];
+        x ^= y << 28;
+        x ^= (~0 << 7) ^ (~0 << 14) ^ (~0 << 21) ^ (~0 << 28);
+        // Discard upper 32 bits.
+        if (y < 0
+            && buffer[position++] < 0
+            && buffer[position++] < 0
+            && buffer[position++] < 0
+            && buffer[position++] < 0
+            && buffer[position++] < 0) {
+          break fastpath;  // Malformed; thrown by the slow path.
+        }
+      }
+      bufferPos = position;
+      return x;
+    }
+    return readRawVarint32SlowPath();
+  }
+
+  private int readRawVarint32SlowPath() throws IOException {
     byte tmp = readRawByte();
     if (tmp >= 0) {
       return tmp;
@@ -319,6 +387,57 @@ public final class CodedInputByteBufferNano {
 
   /** Read a raw Varint from the stream. */
   public long readRawVarint64() throws IOException {
+    fastpath: {
+      int position = bufferPos;
+      if (position == bufferSize) {
+        break fastpath;
+      }
+      final byte[] buffer = this.buffer;
+      long x;
+      int y;
+      if ((y = buffer[position++]) >= 0) {
+        bufferPos = position;
+        return y;
+      } else if (bufferSize - position < MAX_VARINT_SIZE - 1) {
+        break fastpath;
+      }
+      // As in readRawVarint32(), fully unrolled: in int arithmetic up to 28
+      // bits, then in long arithmetic.
+      if ((y ^= (buffer[position++] << 7)) < 0) {
+        x = y ^ (~0 << 7);
+      } else if ((y ^= (buffer[position++] << 14)) >= 0) {
+        x = y ^ ((~0 << 7) ^ (~0 << 14));
+      } else if ((y ^= (buffer[position++] << 21)) < 0) {
+        x = y ^ ((~0 << 7) ^ (~0 << 14) ^ (~0 << 21));
+      } else if ((x = y ^ ((long) buffer[position++] << 28)) >= 0L) {
+        x ^= (~0L << 7) ^ (~0L << 14) ^ (~0L << 21) ^ (~0L << 28);
+      } else if ((x ^= ((long) buffer[position++] << 35)) < 0L) {
+        x ^= (~0L << 7) ^ (~0L << 14) ^ (~0L << 21) ^ (~0L << 28)
+            ^ (~0L << 35);
+      } else if ((x ^= ((long) buffer[position++] << 42)) >= 0L) {
+        x ^= (~0L << 7) ^ (~0L << 14) ^ (~0L << 21) ^ (~0L << 28)
+            ^ (~0L << 35) ^ (~0L << 42);
+      } else if ((x ^= ((long) buffer[position++] << 49)) < 0L) {
+        x ^= (~0L << 7) ^ (~0L << 14) ^ (~0L << 21) ^ (~0L << 28)
+            ^ (~0L << 35) ^ (~0L << 42) ^ (~0L << 49);
+      } else {
+        x ^= ((long) buffer[position++] << 56);
+        x ^= (~0L << 7) ^ (~0L << 14) ^ (~0L << 21) ^ (~0L << 28)
+            ^ (~0L << 35) ^ (~0L << 42) ^ (~0L << 49) ^ (~0L << 56);
+        // The last byte of a varint of 64 bits holds only the top bit, set
+        // above from the continuation bit of the previous byte. Leave any
+        // other last byte, if not malformed, to the slow path.
+        if (x < 0L && buffer[position++] != 1) {
+          break fastpath;
+        }
+      }
+      bufferPos = position;
+      return x;
+    }
+    return readRawVarint64SlowPath();
+  }
+
+  private long readRawVarint64SlowPath() throws IOException {
     int shift = 0;
     long result = 0;
     while (shift < 64) {
@@ -334,6 +453,11 @@ public final class CodedInputByteBufferNano {
 
   /** Read a 32-bit little-endian integer from the stream. */
   public int readRawLittleEndian32() throws IOException {
+    final int position = bufferPos;
+    if (bufferSize - position >= 4) {
+      bufferPos = position + 4;
+      return ByteArrayAccessNano.INSTANCE.getIntLittleEndian(buffer, position);
+    }
     final byte b1 = readRawByte();
     final byte b2 = readRawByte();
     final byte b3 = readRawByte();
@@ -346,6 +470,11 @@ public final class CodedInputByteBufferNano {
 
   /** Read a 64-bit little-endian integer from the stream. */
   public long readRawLittleEndian64() throws IOException {
+    final int position = bufferPos;
+    if (bufferSize - position >= 8) {
+      bufferPos = position + 8;
+      return ByteArrayAccessNano.INSTANCE.getLongLittleEndian(buffer, position);
+    }
     final byte b1 = readRawByte();
     final byte b2 = readRawByte();
     final byte b3 = readRawByte();
@@ -400,6 +529,8 @@ public final class CodedInputByteBufferNano {
   private int bufferSizeAfterLimit;
   private int bufferPos;
   private int lastTag;
+  // A view of the buffer for reading it a long at a time, created on demand.
+  private ByteBuffer words;
 
   /** The absolute position of the end of the current message. */
   private int currentLimit = Integer.MAX_VALUE;
@@ -412,6 +543,7 @@ public final class CodedInputByteBufferNano {
   private int sizeLimit = DEFAULT_SIZE_LIMIT;
 
   private static final int DEFAULT_RECURSION_LIMIT = 64;
+  private static final int MAX_VARINT_SIZE = 10;
   private static final int DEFAULT_SIZE_LIMIT = 64 << 20;  // 64MB
 
   private CodedInputByteBufferNano(final byte[] buffer, final int off, final int len) {
@@ -559,6 +691,21 @@ public final class CodedInputByteBufferNano {
     return copy;
   }
 
+  /**
+   * Returns the array being read. Message fields parsed lazily keep slices of it rather than
+   * copies, so it must not be modified while they are in use.
+   */
+  public byte[] getBuffer() {
+    return buffer;
+  }
+
+  /**
+   * Get current position in the array returned by {@link #getBuffer}, from the start of the array.
+   */
+  public int getBufferPosition() {
+    return bufferPos;
+  }
+
   /**
    * Rewind to previous position. Cannot go forward.
    */
@@ -641,6 +788,203 @@ public final class CodedInputByteBufferNano {
     }
   }
 
+  /**
+   * Returns the number of varints in the next {@code size} bytes without
+   * consuming them, by counting the bytes which end a varint: those with the
+   * most significant bit clear. Generated code uses it to size the arrays of
+   * packed repeated fields without decoding their values twice.
+   *
+   * @throws InvalidProtocolBufferNanoException The end of the stream or the current
+   *                                        limit is less than size bytes away,
+   *                                        or the bytes end inside a varint.
+   */
+  public int countVarints(final int size) throws IOException {
+    if (size < 0) {
+      throw InvalidProtocolBufferNanoException.negativeSize();
+    }
+    if (size > bufferSize - bufferPos) {
+      throw InvalidProtocolBufferNanoException.truncatedMessage();
+    }
+
+    if (size >= 8 && words == null) {
+      words = ByteBuffer.wrap(buffer);
+    }
+    return countVarints(buffer, words, bufferPos, bufferPos + size);
+  }
+
+  /**
+   * Counts the varints in {@code buffer} from {@code position} up to
+   * {@code end}, reading eight bytes at a time through {@code words}, a view
+   * of the same array which may be null if there are fewer than eight bytes.
+   * A varint cut off at the end would not be counted but its bytes would be
+   * read as the next tag, so it is rejected.
+   */
+  static int countVarints(final byte[] buffer, final ByteBuffer words,
+                          int position, final int end)
+      throws InvalidProtocolBufferNanoException {
+    if (end > position && buffer[end - 1] < 0) {
+      throw InvalidProtocolBufferNanoException.truncatedMessage();
+    }
+    int count = 0;
+    if (end - position >= 8) {
+      // Eight bytes at a time, counting the clear most significant bits of
+      // all of them at once.
+      for (; position <= end - 8; position += 8) {
+        count += Long.bitCount(~words.getLong(position) & 0x8080808080808080L);
+      }
+    }
+    for (; position < end; position++) {
+      if (buffer[position] >= 0) {
+        count++;
+      }
+    }
+    return count;
+  }
+
+  /**
+   * Checks that the values of a packed field, whose length is the current
+   * limit, end at that limit, as {@link ArrayDecoderNano#checkPackedEnd} does
+   * for the array parser: the bytes of a partial value left over would
+   * otherwise be read as the next tag.
+   *
+   * @throws InvalidProtocolBufferNanoException The values end before the limit.
+   */
+  public void checkPackedEnd() throws InvalidProtocolBufferNanoException {
+    if (bufferPos != currentLimit) {
+      throw InvalidProtocolBufferNanoException.truncatedMessage();
+    }
+  }
+
+  // -----------------------------------------------------------------
+  // Scratch arrays into which generated code parses the values of unpacked
+  // repeated fields in a single pass, before copying them into the field.
+  // Each is lent to one field at a time: a field of a message parsed in the
+  // meantime gets a new array, and whichever is given back last is kept.
+
+  private static final int MIN_SCRATCH_LENGTH = 16;
+
+  private int[] intScratch;
+  private long[] longScratch;
+  private float[] floatScratch;
+  private double[] doubleScratch;
+  private boolean[] booleanScratch;
+  private Object[] objectScratch;
+
+  public int[] takeIntScratch() {
+    final int[] scratch = intScratch;
+    if (scratch == null) {
+      return new int[MIN_SCRATCH_LENGTH];
+    }
+    intScratch = null;
+    return scratch;
+  }
+
+  public void releaseIntScratch(final int[] scratch) {
+    intScratch = scratch;
+  }
+
+  public long[] takeLongScratch() {
+    final long[] scratch = longScratch;
+    if (scratch == null) {
+      return new long[MIN_SCRATCH_LENGTH];
+    }
+    longScratch = null;
+    return scratch;
+  }
+
+  public void releaseLongScratch(final long[] scratch) {
+    longScratch = scratch;
+  }
+
+  public float[] takeFloatScratch() {
+    final float[] scratch = floatScratch;
+    if (scratch == null) {
+      return new float[MIN_SCRATCH_LENGTH];
+    }
+    floatScratch = null;
+    return scratch;
+  }
+
+  public void releaseFloatScratch(final float[] scratch) {
+    floatScratch = scratch;
+  }
+
+  public double[] takeDoubleScratch() {
+    final double[] scratch = doubleScratch;
+    if (scratch == null) {
+      return new double[MIN_SCRATCH_LENGTH];
+    }
+    doubleScratch = null;
+    return scratch;
+  }
+
+  public void releaseDoubleScratch(final double[] scratch) {
+    doubleScratch = scratch;
+  }
+
+  public boolean[] takeBooleanScratch() {
+    final boolean[] scratch = booleanScratch;
+    if (scratch == null) {
+      return new boolean[MIN_SCRATCH_LENGTH];
+    }
+    booleanScratch = null;
+    return scratch;
+  }
+
+  public void releaseBooleanScratch(final boolean[] scratch) {
+    booleanScratch = scratch;
+  }
+
+  public Object[] takeObjectScratch() {
+    final Object[] scratch = objectScratch;
+    if (scratch == null) {
+      return new Object[MIN_SCRATCH_LENGTH];
+    }
+    objectScratch = null;
+    return scratch;
+  }
+
+  /**
+   * Gives back the object scratch array, after clearing the given number of
+   * values at its start so as not to hold on to them.
+   */
+  public void releaseObjectScratch(final Object[] scratch, final int count) {
+    Arrays.fill(scratch, 0, count, null);
+    objectScratch = scratch;
+  }
+
+  // A stack of the lengths in use of the arrays of repeated fields, which
+  // the mergeFrom() methods split by max_method_size pass to their helpers
+  // rather than allocating an array on each call. Messages parsed by the
+  // helpers push their own lengths and may grow it, so the helpers fetch it
+  // again with mergeLengths() after parsing a field.
+
+  private int[] mergeLengths;
+  private int mergeLengthsTop;
+
+  /** Pushes count zero lengths and returns the index of the first. */
+  public int pushMergeLengths(final int count) {
+    final int base = mergeLengthsTop;
+    final int top = base + count;
+    if (mergeLengths == null) {
+      mergeLengths = new int[Math.max(top, MIN_SCRATCH_LENGTH)];
+    } else if (top > mergeLengths.length) {
+      mergeLengths = Arrays.copyOf(mergeLengths, Math.max(top, 2 * mergeLengths.length));
+    }
+    Arrays.fill(mergeLengths, base, top, 0);
+    mergeLengthsTop = top;
+    return base;
+  }
+
+  public int[] mergeLengths() {
+    return mergeLengths;
+  }
+
+  /** Pops the lengths pushed from the given index on. */
+  public void popMergeLengths(final int base) {
+    mergeLengthsTop = base;
+  }
+
   // Read a primitive type.
   Object readPrimitiveField(int type) throws IOException {
     switch (type) {
@@ -43,6 +43,9 @@ import java.nio.*;
  * writing encoded protocol messages, you should use the former methods, but if
  * you are writing some other format of your own design, use the latter.
  *
+ * <p>Instances writing to a byte array write to it directly; those writing
+ * to a {@link ByteBuffer} go through its methods.
+ *
  * <p>This class is totally unsynchronized.
  *
  * @author kneton@google.com Kenton Varda
@@ -50,14 +53,30 @@ import java.nio.*;
 public final class CodedOutputByteBufferNano {
   /* max bytes per java UTF-16 char in UTF-8 */
   private static final int MAX_UTF8_EXPANSION = 3;
+
+  // Instances writing to a byte array keep it with the position and limit
+  // in it, which are indices in the whole array as they would be in a
+  // ByteBuffer wrapping it, and have no buffer; those writing to a ByteBuffer
+  // only have the buffer. The raw writes check which it is, so that the
+  // class stays final and the calls of generated code are not virtual.
+  private final byte[] array;
+  private int position;
+  private int limit;
   private final ByteBuffer buffer;
 
-  private CodedOutputByteBufferNano(final byte[] buffer, final int offset,
-                            final int length) {
-    this(ByteBuffer.wrap(buffer, offset, length));
+  private CodedOutputByteBufferNano(final byte[] array, final int offset,
+                                    final int length) {
+    if ((offset | length | (array.length - offset - length)) < 0) {
+      throw new IndexOutOfBoundsException();
+    }
+    this.array = array;
+    this.position = offset;
+    this.limit = offset + length;
+    this.buffer = null;
   }
 
   private CodedOutputByteBufferNano(final ByteBuffer buffer) {
+    this.array = null;
     this.buffer = buffer;
     this.buffer.order(ByteOrder.LITTLE_ENDIAN);
   }
@@ -301,6 +320,43 @@ public final class CodedOutputByteBufferNano {
 
   /** Write a {@code string} field to the stream. */
   public void writeStringNoTag(final String value) throws IOException {
+    if (array != null) {
+      writeStringNoTagToArray(value);
+    } else {
+      writeStringNoTagToBuffer(value);
+    }
+  }
+
+  private void writeStringNoTagToArray(final String value) throws IOException {
+    // As when writing to a ByteBuffer: when the length of the UTF-8
+    // encoding takes the same number of bytes whatever it is, leave room for
+    // it, encode the string, then write the length in front of it.
+    try {
+      final int minLengthVarIntSize = computeRawVarint32Size(value.length());
+      final int maxLengthVarIntSize = computeRawVarint32Size(value.length() * MAX_UTF8_EXPANSION);
+      if (minLengthVarIntSize == maxLengthVarIntSize) {
+        final int oldPosition = position;
+        if (limit - oldPosition < minLengthVarIntSize) {
+          throw new OutOfSpaceException(oldPosition + minLengthVarIntSize, limit);
+        }
+        position = oldPosition + minLengthVarIntSize;
+        final int newPosition = encode(value, array, position, limit - position);
+        position = oldPosition;
+        writeRawVarint32(newPosition - oldPosition - minLengthVarIntSize);
+        position = newPosition;
+      } else {
+        writeRawVarint32(encodedLength(value));
+        position = encode(value, array, position, limit - position);
+      }
+    } catch (ArrayIndexOutOfBoundsException e) {
+      final OutOfSpaceException outOfSpaceException =
+          new OutOfSpaceException(position, limit);
+      outOfSpaceException.initCause(e);
+      throw outOfSpaceException;
+    }
+  }
+
+  private void writeStringNoTagToBuffer(final String value) throws IOException {
     // UTF-8 byte length of the string is at least its UTF-16 code unit length (value.length()),
     // and at most 3 times of it. Optimize for the case where we know this length results in a
     // constant varint length - saves measuring length of the string.
@@ -342,7 +398,7 @@ public final class CodedOutputByteBufferNano {
    * @throws IllegalArgumentException if {@code sequence} contains ill-formed UTF-16 (unpaired
    *     surrogates)
    */
-  private static int encodedLength(CharSequence sequence) {
+  static int encodedLength(CharSequence sequence) {
     // Warning to maintainers: this implementation is highly optimized.
     int utf16Length = sequence.length();
     int utf8Length = utf16Length;
@@ -460,7 +516,7 @@ public final class CodedOutputByteBufferNano {
     }
   }
 
-  private static int encode(CharSequence sequence, byte[] bytes, int offset, int length) {
+  static int encode(CharSequence sequence, byte[] bytes, int offset, int length) {
     int utf16Length = sequence.length();
     int j = offset;
     int i = 0;
@@ -899,6 +955,9 @@ public final class CodedOutputByteBufferNano {
    * Otherwise, throws {@code UnsupportedOperationException}.
    */
   public int spaceLeft() {
+    if (array != null) {
+      return limit - position;
+    }
     return buffer.remaining();
   }
 
@@ -920,6 +979,9 @@ public final class CodedOutputByteBufferNano {
    * Returns the position within the internal buffer.
    */
   public int position() {
+    if (array != null) {
+      return position;
+    }
     return buffer.position();
   }
 
@@ -930,7 +992,14 @@ public final class CodedOutputByteBufferNano {
    * @see #spaceLeft
    */
   public void reset() {
-    buffer.clear();
+    if (array != null) {
+      // As ByteBuffer.clear() does: the whole array, even when the instance
+      // was created for a slice of it.
+      position = 0;
+      limit = array.length;
+    } else {
+      buffer.clear();
+    }
   }
 
   /**
@@ -949,11 +1018,17 @@ public final class CodedOutputByteBufferNano {
 
   /** Write a single byte. */
   public void writeRawByte(final byte value) throws IOException {
+    if (array != null) {
+      if (position == limit) {
+        throw new OutOfSpaceException(position, limit);
+      }
+      array[position++] = value;
+      return;
+    }
     if (!buffer.hasRemaining()) {
       // We're writing to a single buffer.
       throw new OutOfSpaceException(buffer.position(), buffer.limit());
     }
-
     buffer.put(value);
   }
 
@@ -970,6 +1045,14 @@ public final class CodedOutputByteBufferNano {
   /** Write part of an array of bytes. */
   public void writeRawBytes(final byte[] value, int offset, int length)
                             throws IOException {
+    if (array != null) {
+      if (limit - position < length) {
+        throw new OutOfSpaceException(position, limit);
+      }
+      System.arraycopy(value, offset, array, position, length);
+      position += length;
+      return;
+    }
     if (buffer.remaining() >= length) {
       buffer.put(value, offset, length);
     } else {
@@ -984,6 +1067,43 @@ public final class CodedOutputByteBufferNano {
     writeRawVarint32(WireFormatNano.makeTag(fieldNumber, wireType));
   }
 
+  /**
+   * Write a tag of one byte, already encoded as a varint. Generated code
+   * writes the tags it knows of up to three bytes this way.
+   */
+  public void writeTagBytes(final int b0) throws IOException {
+    writeRawByte(b0);
+  }
+
+  /** Write a tag of two bytes, already encoded as a varint. */
+  public void writeTagBytes(final int b0, final int b1) throws IOException {
+    final int position = this.position;
+    if (array != null && limit - position >= 2) {
+      array[position] = (byte) b0;
+      array[position + 1] = (byte) b1;
+      this.position = position + 2;
+      return;
+    }
+    writeRawByte(b0);
+    writeRawByte(b1);
+  }
+
+  /** Write a tag of three bytes, already encoded as a varint. */
+  public void writeTagBytes(final int b0, final int b1, final int b2)
+                            throws IOException {
+    final int position = this.position;
+    if (array != null && limit - position >= 3) {
+      array[position] = (byte) b0;
+      array[position + 1] = (byte) b1;
+      array[position + 2] = (byte) b2;
+      this.position = position + 3;
+      return;
+    }
+    writeRawByte(b0);
+    writeRawByte(b1);
+    writeRawByte(b2);
+  }
+
   /** Compute the number of bytes that would be needed to encode a tag. */
   public static int computeTagSize(final int fieldNumber) {
     return computeRawVarint32Size(WireFormatNano.makeTag(fieldNumber, 0));
@@ -994,6 +1114,17 @@ public final class CodedOutputByteBufferNano {
    * unsigned, so it won't be sign-extended if negative.
    */
   public void writeRawVarint32(int value) throws IOException {
+    int position = this.position;
+    if (array != null && limit - position >= 5) {
+      // Room for the longest varint: no check per byte.
+      while ((value & ~0x7F) != 0) {
+        array[position++] = (byte) ((value & 0x7F) | 0x80);
+        value >>>= 7;
+      }
+      array[position++] = (byte) value;
+      this.position = position;
+      return;
+    }
     while (true) {
       if ((value & ~0x7F) == 0) {
         writeRawByte(value);
@@ -1020,6 +1151,16 @@ public final class CodedOutputByteBufferNano {
 
   /** Encode and write a varint. */
   public void writeRawVarint64(long value) throws IOException {
+    int position = this.position;
+    if (array != null && limit - position >= 10) {
+      while ((value & ~0x7FL) != 0) {
+        array[position++] = (byte) (((int) value & 0x7F) | 0x80);
+        value >>>= 7;
+      }
+      array[position++] = (byte) value;
+      this.position = position;
+      return;
+    }
     while (true) {
       if ((value & ~0x7FL) == 0) {
         writeRawByte((int)value);
@@ -1047,20 +1188,50 @@ public final class CodedOutputByteBufferNano {
 
   /** Write a little-endian 32-bit integer. */
   public void writeRawLittleEndian32(final int value) throws IOException {
+    if (array != null) {
+      if (limit - position < 4) {
+        throw new OutOfSpaceException(position, limit);
+      }
+      ByteArrayAccessNano.INSTANCE.putIntLittleEndian(array, position, value);
+      position += 4;
+      return;
+    }
     if (buffer.remaining() < 4) {
       throw new OutOfSpaceException(buffer.position(), buffer.limit());
     }
-    buffer.putInt(value);
+    if (buffer.hasArray()) {
+      final int position = buffer.position();
+      ByteArrayAccessNano.INSTANCE.putIntLittleEndian(
+          buffer.array(), buffer.arrayOffset() + position, value);
+      buffer.position(position + 4);
+    } else {
+      buffer.putInt(value);
+    }
   }
 
   public static final int LITTLE_ENDIAN_32_SIZE = 4;
 
   /** Write a little-endian 64-bit integer. */
   public void writeRawLittleEndian64(final long value) throws IOException {
+    if (array != null) {
+      if (limit - position < 8) {
+        throw new OutOfSpaceException(position, limit);
+      }
+      ByteArrayAccessNano.INSTANCE.putLongLittleEndian(array, position, value);
+      position += 8;
+      return;
+    }
     if (buffer.remaining() < 8) {
       throw new OutOfSpaceException(buffer.position(), buffer.limit());
     }
-    buffer.putLong(value);
+    if (buffer.hasArray()) {
+      final int position = buffer.position();
+      ByteArrayAccessNano.INSTANCE.putLongLittleEndian(
+          buffer.array(), buffer.arrayOffset() + position, value);
+      buffer.position(position + 8);
+    } else {
+      buffer.putLong(value);
+    }
   }
 
   public static final int LITTLE_ENDIAN_64_SIZE = 8;
@@ -1217,5 +1388,4 @@ public final class CodedOutputByteBufferNano {
         throw new IOException("Unknown type: " + type);
     }
   }
-
 }
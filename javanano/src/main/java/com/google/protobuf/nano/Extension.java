@@ -314,6 +314,27 @@ public class Extension<M extends ExtendableMessageNano<M>, T> {
         return size;
     }
 
+    /**
+     * Returns the data size of a value of a packed repeated extension, or -1 for other
+     * extensions. FieldData keeps it from computeSerializedSize() for the next writeTo().
+     */
+    int computePackedDataSize(Object value) {
+        return -1;
+    }
+
+    int computePackedSerializedSize(int dataSize) {
+        int payloadSize = dataSize + CodedOutputByteBufferNano.computeRawVarint32Size(dataSize);
+        return payloadSize + CodedOutputByteBufferNano.computeRawVarint32Size(tag);
+    }
+
+    /**
+     * Writes a value of a packed repeated extension whose data size is known.
+     */
+    void writePackedTo(Object value, int dataSize, CodedOutputByteBufferNano output)
+            throws IOException {
+        writeTo(value, output);
+    }
+
     protected int computeSingularSerializedSize(Object value) {
         // This implementation is for message/group extensions.
         int fieldNumber = WireFormatNano.getTagFieldNumber(tag);
@@ -467,92 +488,7 @@ public class Extension<M extends ExtendableMessageNano<M>, T> {
                 // Use base implementation for non-packed data
                 super.writeRepeatedData(array, output);
             } else if (tag == packedTag) {
-                // Packed. Note that the array element type is guaranteed to be primitive, so there
-                // won't be any null elements, so no null check in this block.
-                int arrayLength = Array.getLength(array);
-                int dataSize = computePackedDataSize(array);
-
-                try {
-                    output.writeRawVarint32(tag);
-                    output.writeRawVarint32(dataSize);
-                    switch (type) {
-                        case TYPE_BOOL:
-                            for (int i = 0; i < arrayLength; i++) {
-                                output.writeBoolNoTag(Array.getBoolean(array, i));
-                            }
-                            break;
-                        case TYPE_FIXED32:
-                            for (int i = 0; i < arrayLength; i++) {
-                                output.writeFixed32NoTag(Array.getInt(array, i));
-                            }
-                            break;
-                        case TYPE_SFIXED32:
-                            for (int i = 0; i < arrayLength; i++) {
-                                output.writeSFixed32NoTag(Array.getInt(array, i));
-                            }
-                            break;
-                        case TYPE_FLOAT:
-                            for (int i = 0; i < arrayLength; i++) {
-                                output.writeFloatNoTag(Array.getFloat(array, i));
-                            }
-                            break;
-                        case TYPE_FIXED64:
-                            for (int i = 0; i < arrayLength; i++) {
-                                output.writeFixed64NoTag(Array.getLong(array, i));
-                            }
-                            break;
-                        case TYPE_SFIXED64:
-                            for (int i = 0; i < arrayLength; i++) {
-                                output.writeSFixed64NoTag(Array.getLong(array, i));
-                            }
-                            break;
-                        case TYPE_DOUBLE:
-                            for (int i = 0; i < arrayLength; i++) {
-                                output.writeDoubleNoTag(Array.getDouble(array, i));
-                            }
-                            break;
-                        case TYPE_INT32:
-                            for (int i = 0; i < arrayLength; i++) {
-                                output.writeInt32NoTag(Array.getInt(array, i));
-                            }
-                            break;
-                        case TYPE_SINT32:
-                            for (int i = 0; i < arrayLength; i++) {
-                                output.writeSInt32NoTag(Array.getInt(array, i));
-                            }
-                            break;
-                        case TYPE_UINT32:
-                            for (int i = 0; i < arrayLength; i++) {
-                                output.writeUInt32NoTag(Array.getInt(array, i));
-                            }
-                            break;
-                        case TYPE_INT64:
-                            for (int i = 0; i < arrayLength; i++) {
-                                output.writeInt64NoTag(Array.getLong(array, i));
-                            }
-                            break;
-                        case TYPE_SINT64:
-                            for (int i = 0; i < arrayLength; i++) {
-                                output.writeSInt64NoTag(Array.getLong(array, i));
-                            }
-                            break;
-                        case TYPE_UINT64:
-                            for (int i = 0; i < arrayLength; i++) {
-                                output.writeUInt64NoTag(Array.getLong(array, i));
-                            }
-                            break;
-                        case TYPE_ENUM:
-                            for (int i = 0; i < arrayLength; i++) {
-                                output.writeEnumNoTag(Array.getInt(array, i));
-                            }
-                            break;
-                        default:
-                            throw new IllegalArgumentException("Unpackable type " + type);
-                    }
-                } catch (IOException e) {
-                    // Should not happen.
-                    throw new IllegalStateException(e);
-                }
+                writePackedTo(array, computePackedDataSize(array), output);
             } else {
                 throw new IllegalArgumentException("Unexpected repeated extension tag " + tag
                         + ", unequal to both non-packed variant " + nonPackedTag
@@ -560,7 +496,99 @@ public class Extension<M extends ExtendableMessageNano<M>, T> {
             }
         }
 
-        private int computePackedDataSize(Object array) {
+        @Override
+        void writePackedTo(Object array, int dataSize, CodedOutputByteBufferNano output) {
+            // Note that the array element type is guaranteed to be primitive, so there won't be
+            // any null elements, so no null check in this method.
+            int arrayLength = Array.getLength(array);
+            try {
+                output.writeRawVarint32(tag);
+                output.writeRawVarint32(dataSize);
+                switch (type) {
+                    case TYPE_BOOL:
+                        for (int i = 0; i < arrayLength; i++) {
+                            output.writeBoolNoTag(Array.getBoolean(array, i));
+                        }
+                        break;
+                    case TYPE_FIXED32:
+                        for (int i = 0; i < arrayLength; i++) {
+                            output.writeFixed32NoTag(Array.getInt(array, i));
+                        }
+                        break;
+                    case TYPE_SFIXED32:
+                        for (int i = 0; i < arrayLength; i++) {
+                            output.writeSFixed32NoTag(Array.getInt(array, i));
+                        }
+                        break;
+                    case TYPE_FLOAT:
+                        for (int i = 0; i < arrayLength; i++) {
+                            output.writeFloatNoTag(Array.getFloat(array, i));
+                        }
+                        break;
+                    case TYPE_FIXED64:
+                        for (int i = 0; i < arrayLength; i++) {
+                            output.writeFixed64NoTag(Array.getLong(array, i));
+                        }
+                        break;
+                    case TYPE_SFIXED64:
+                        for (int i = 0; i < arrayLength; i++) {
+                            output.writeSFixed64NoTag(Array.getLong(array, i));
+                        }
+                        break;
+                    case TYPE_DOUBLE:
+                        for (int i = 0; i < arrayLength; i++) {
+                            output.writeDoubleNoTag(Array.getDouble(array, i));
+                        }
+                        break;
+                    case TYPE_INT32:
+                        for (int i = 0; i < arrayLength; i++) {
+                            output.writeInt32NoTag(Array.getInt(array, i));
+                        }
+                        break;
+                    case TYPE_SINT32:
+                        for (int i = 0; i < arrayLength; i++) {
+                            output.writeSInt32NoTag(Array.getInt(array, i));
+                        }
+                        break;
+                    case TYPE_UINT32:
+                        for (int i = 0; i < arrayLength; i++) {
+                            output.writeUInt32NoTag(Array.getInt(array, i));
+                        }
+                        break;
+                    case TYPE_INT64:
+                        for (int i = 0; i < arrayLength; i++) {
+                            output.writeInt64NoTag(Array.getLong(array, i));
+                        }
+                        break;
+                    case TYPE_SINT64:
+                        for (int i = 0; i < arrayLength; i++) {
+                            output.writeSInt64NoTag(Array.getLong(array, i));
+                        }
+                        break;
+                    case TYPE_UINT64:
+                        for (int i = 0; i < arrayLength; i++) {
+                            output.writeUInt64NoTag(Array.getLong(array, i));
+                        }
+                        break;
+                    case TYPE_ENUM:
+                        for (int i = 0; i < arrayLength; i++) {
+                            output.writeEnumNoTag(Array.getInt(array, i));
+                        }
+                        break;
+                    default:
+                        throw new IllegalArgumentException("Unpackable type " + type);
+                }
+            } catch (IOException e) {
+                // Should not happen.
+                throw new IllegalStateException(e);
+            }
+        }
+
+        @Override
+        int computePackedDataSize(Object array) {
+            if (!repeated || tag != packedTag) {
+                return -1;
+            }
             int dataSize = 0;
             int arrayLength = Array.getLength(array);
             switch (type) {
@@ -633,10 +661,7 @@ public class Extension<M extends ExtendableMessageNano<M>, T> {
                 return super.computeRepeatedSerializedSize(array);
             } else if (tag == packedTag) {
                 // Packed.
-                int dataSize = computePackedDataSize(array);
-                int payloadSize =
-                        dataSize + CodedOutputByteBufferNano.computeRawVarint32Size(dataSize);
-                return payloadSize + CodedOutputByteBufferNano.computeRawVarint32Size(tag);
+                return computePackedSerializedSize(computePackedDataSize(array));
             } else {
                 throw new IllegalArgumentException("Unexpected repeated extension tag " + tag
                         + ", unequal to both non-packed variant " + nonPackedTag
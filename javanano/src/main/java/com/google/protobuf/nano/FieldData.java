@@ -44,6 +44,8 @@ class FieldData implements Cloneable {
     private Object value;
     /** The serialised values for this object. Will be cleared if getValue is called */
     private List<UnknownFieldData> unknownFieldData;
+    /** Data size of a packed repeated value from computeSerializedSize, used once by writeTo */
+    private int packedDataSize = -1;
 
     <T> FieldData(Extension<?, T> extension, T newValue) {
         cachedExtension = extension;
@@ -56,6 +58,7 @@ class FieldData implements Cloneable {
 
     void addUnknownField(UnknownFieldData unknownField) {
         unknownFieldData.add(unknownField);
+        packedDataSize = -1;
     }
 
     UnknownFieldData getUnknownField(int index) {
@@ -93,12 +96,17 @@ class FieldData implements Cloneable {
         cachedExtension = extension;
         value = newValue;
         unknownFieldData = null;
+        packedDataSize = -1;
     }
 
     int computeSerializedSize() {
         int size = 0;
         if (value != null) {
-            size = cachedExtension.computeSerializedSize(value);
+            int dataSize = cachedExtension.computePackedDataSize(value);
+            packedDataSize = dataSize;
+            size = dataSize >= 0
+                    ? cachedExtension.computePackedSerializedSize(dataSize)
+                    : cachedExtension.computeSerializedSize(value);
         } else {
             for (UnknownFieldData unknownField : unknownFieldData) {
                 size += unknownField.computeSerializedSize();
@@ -109,7 +117,13 @@ class FieldData implements Cloneable {
 
     void writeTo(CodedOutputByteBufferNano output) throws IOException {
         if (value != null) {
-            cachedExtension.writeTo(value, output);
+            int dataSize = packedDataSize;
+            if (dataSize >= 0) {
+                packedDataSize = -1;
+                cachedExtension.writePackedTo(value, dataSize, output);
+            } else {
+                cachedExtension.writeTo(value, output);
+            }
         } else {
             for (UnknownFieldData unknownField : unknownFieldData) {
                 unknownField.writeTo(output);
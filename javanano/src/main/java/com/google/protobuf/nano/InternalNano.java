@@ -136,6 +136,24 @@ public final class InternalNano {
     return text.getBytes(InternalNano.UTF_8);
   }
 
+  /**
+   * Helper called by generated code to build the table mergeFrom() uses to
+   * map field numbers to the dense indexes of its switch. The entry of each
+   * of the given field numbers is one plus its position in the array; all
+   * other entries are 0. Up to 255 fields are supported.
+   */
+  public static byte[] fieldIndexes(int[] numbers) {
+    int max = 0;
+    for (int number : numbers) {
+      max = Math.max(max, number);
+    }
+    byte[] indexes = new byte[max + 1];
+    for (int i = 0; i < numbers.length; i++) {
+      indexes[numbers[i]] = (byte) (i + 1);
+    }
+    return indexes;
+  }
+
   /**
    * Checks repeated int field equality; null-value and 0-length fields are
    * considered equal.
@@ -39,6 +39,14 @@ import java.util.Arrays;
  * @author wink@google.com Wink Saville
  */
 public abstract class MessageNano {
+    /**
+     * The size from the last {@link #getSerializedSize}, or -1. It is not invalidated when fields
+     * are assigned, and neither are the data sizes of packed repeated fields of varints, which
+     * {@link #computeSerializedSize} keeps in the generated {@code <name>DataSize_} fields for
+     * the next {@link #writeTo}: call getSerializedSize() again after changing a message, before
+     * writing it. writeTo() uses a kept data size once and computes it when none is kept;
+     * clear() and mergeFrom() drop the kept data sizes.
+     */
     protected volatile int cachedSize = -1;
 
     /**
@@ -86,12 +94,65 @@ public abstract class MessageNano {
         // Does nothing by default. Overridden by subclasses which have data to write.
     }
 
+    /**
+     * Serializes the message in front of what has been written to {@code output}, writing its
+     * fields in reverse order, so that the sizes of nested messages need not be computed first.
+     * Messages generated with the reverse_serializer option override it; by default it
+     * serializes the message with {@link #writeTo} and copies the bytes.
+     *
+     * @param output the output to receive the serialized form.
+     * @throws IOException if an error occurred writing to {@code output}.
+     */
+    public void writeToReverse(ReverseCodedOutputNano output) throws IOException {
+        output.writeRawBytes(toByteArray(this));
+    }
+
+    /**
+     * Returns a number of bytes at least the size of the serialized message, computed without
+     * encoding any value: messages generated with the reverse_serializer option count every
+     * field as set, and every varint and every char of a string at its largest. By default it
+     * returns the serialized size.
+     */
+    public int maxSerializedSizeUpperBound() {
+        return getSerializedSize();
+    }
+
     /**
      * Parse {@code input} as a message of this type and merge it with the
      * message being built.
      */
     public abstract MessageNano mergeFrom(CodedInputByteBufferNano input) throws IOException;
 
+    /**
+     * Parses the fields in {@code buffer} from {@code position} up to {@code limit}, or up to an
+     * end group tag which is then left in {@code decoder.lastTag}, merging them with the message
+     * being built, and returns the position after the last field parsed. Messages generated with
+     * the array_parser option override it to read the array directly; by default it reads
+     * through a {@link CodedInputByteBufferNano}.
+     *
+     * @hide
+     */
+    public int mergeFrom(byte[] buffer, int position, int limit, ArrayDecoderNano decoder)
+            throws IOException {
+        final CodedInputByteBufferNano input =
+            CodedInputByteBufferNano.newInstance(buffer, position, limit - position);
+        input.setRecursionLimit(decoder.remainingRecursionDepth());
+        mergeFrom(input);
+        decoder.lastTag = input.getLastTag();
+        return position + input.getPosition();
+    }
+
+    /**
+     * Whether the message overrides {@link #mergeFrom(byte[], int, int, ArrayDecoderNano)}, as
+     * messages generated with the array_parser option do. Other messages are parsed from arrays
+     * through a {@link CodedInputByteBufferNano} alone, without an {@link ArrayDecoderNano}.
+     *
+     * @hide
+     */
+    protected boolean hasArrayParser() {
+        return false;
+    }
+
     /**
      * Resets all the message fields to their default values
      */
@@ -110,6 +171,42 @@ public abstract class MessageNano {
         return result;
     }
 
+    /**
+     * Serialize to a byte array in a single pass with {@link #writeToReverse}, without
+     * computing the serialized size first. Messages generated with the reverse_serializer option
+     * leave their cached sizes as they are.
+     * @return byte array with the serialized data.
+     */
+    public static final byte[] toByteArrayReverse(MessageNano msg) {
+        try {
+            final ReverseCodedOutputNano output = new ReverseCodedOutputNano();
+            msg.writeToReverse(output);
+            return output.toByteArray();
+        } catch (IOException e) {
+            throw new RuntimeException("Serializing to a byte array threw an IOException "
+                    + "(should never happen).", e);
+        }
+    }
+
+    /**
+     * Serialize to a byte array in a single pass with {@link #writeToReverse}, into an output
+     * allocated at {@link #maxSerializedSizeUpperBound} so that it need not grow, then copied
+     * to an array of the exact size.
+     * @return byte array with the serialized data.
+     */
+    public static final byte[] toByteArrayFast(MessageNano msg) {
+        try {
+            // The bound overflows for huge messages; the output then grows as needed.
+            final ReverseCodedOutputNano output =
+                    new ReverseCodedOutputNano(Math.max(msg.maxSerializedSizeUpperBound(), 0));
+            msg.writeToReverse(output);
+            return output.toByteArray();
+        } catch (IOException e) {
+            throw new RuntimeException("Serializing to a byte array threw an IOException "
+                    + "(should never happen).", e);
+        }
+    }
+
     /**
      * Serialize to a byte array starting at offset through length. The
      * method getSerializedSize must have been called prior to calling
@@ -146,10 +243,18 @@ public abstract class MessageNano {
     public static final <T extends MessageNano> T mergeFrom(T msg, final byte[] data,
             final int off, final int len) throws InvalidProtocolBufferNanoException {
         try {
-            final CodedInputByteBufferNano input =
-                CodedInputByteBufferNano.newInstance(data, off, len);
-            msg.mergeFrom(input);
-            input.checkLastTagWas(0);
+            if (!msg.hasArrayParser()) {
+                final CodedInputByteBufferNano input =
+                    CodedInputByteBufferNano.newInstance(data, off, len);
+                msg.mergeFrom(input);
+                input.checkLastTagWas(0);
+                return msg;
+            }
+            final ArrayDecoderNano decoder = new ArrayDecoderNano();
+            msg.mergeFrom(data, off, off + len, decoder);
+            if (decoder.lastTag != 0) {
+                throw InvalidProtocolBufferNanoException.invalidEndTag();
+            }
             return msg;
         } catch (InvalidProtocolBufferNanoException e) {
             throw e;
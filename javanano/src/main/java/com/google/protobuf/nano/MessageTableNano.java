@@ -0,0 +1,1068 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2013 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+package com.google.protobuf.nano;
+
+import java.io.IOException;
+import java.lang.reflect.Array;
+import java.util.Arrays;
+
+/**
+ * Interprets the static field table of a message generated with
+ * {@code codegen_style=table}, which delegates its writeTo(),
+ * computeSerializedSize() and mergeFrom() methods here instead of having
+ * them unrolled for each field.
+ *
+ * <p>The table holds four ints per field, sorted by field number: the field
+ * number, the wire type of a single (unpacked) value, the kind and the slot.
+ * The kind is one of the {@code InternalNano.TYPE_*} constants combined with
+ * the {@code KIND_*} flags below. The slot numbers the fields in declaration
+ * order; the generated {@link FieldAccessor} of the message reads and writes
+ * the field of each slot, and the valid values of enum fields are given by
+ * slot.
+ *
+ * <p>Singular fields are read and written through the accessor method of
+ * their Java type, and repeated fields as arrays of their element type, so
+ * that values are not boxed, except for the members of oneofs, which the
+ * generated classes hold boxed. The accessors use the fields directly, so
+ * obfuscators may rename them.
+ *
+ * @hide
+ */
+public final class MessageTableNano {
+
+  public static final int KIND_TYPE_MASK = 0x1f;
+  public static final int KIND_REQUIRED = 0x20;
+  public static final int KIND_REPEATED = 0x40;
+  public static final int KIND_PACKED = 0x80;
+  public static final int KIND_ONEOF = 0x100;
+
+  private static final int ENTRY_SIZE = 4;
+
+  /**
+   * Reads and writes the fields of one message class by slot. The generated
+   * code of each message overrides the methods it needs with a switch over
+   * its slots; the others are never called for its table.
+   *
+   * <p>Oneof members are read and written with {@link #getObject} and
+   * {@link #setObject}, boxed, and their case with {@link #getOneofCase} and
+   * {@link #setOneofCase}.
+   */
+  public abstract static class FieldAccessor {
+    public int getInt(MessageNano message, int slot) {
+      throw noSuchSlot(slot);
+    }
+
+    public void setInt(MessageNano message, int slot, int value) {
+      throw noSuchSlot(slot);
+    }
+
+    public long getLong(MessageNano message, int slot) {
+      throw noSuchSlot(slot);
+    }
+
+    public void setLong(MessageNano message, int slot, long value) {
+      throw noSuchSlot(slot);
+    }
+
+    public float getFloat(MessageNano message, int slot) {
+      throw noSuchSlot(slot);
+    }
+
+    public void setFloat(MessageNano message, int slot, float value) {
+      throw noSuchSlot(slot);
+    }
+
+    public double getDouble(MessageNano message, int slot) {
+      throw noSuchSlot(slot);
+    }
+
+    public void setDouble(MessageNano message, int slot, double value) {
+      throw noSuchSlot(slot);
+    }
+
+    public boolean getBoolean(MessageNano message, int slot) {
+      throw noSuchSlot(slot);
+    }
+
+    public void setBoolean(MessageNano message, int slot, boolean value) {
+      throw noSuchSlot(slot);
+    }
+
+    /** Strings, bytes, messages, arrays of repeated fields and oneof values. */
+    public Object getObject(MessageNano message, int slot) {
+      throw noSuchSlot(slot);
+    }
+
+    public void setObject(MessageNano message, int slot, Object value) {
+      throw noSuchSlot(slot);
+    }
+
+    public int getOneofCase(MessageNano message, int slot) {
+      throw noSuchSlot(slot);
+    }
+
+    public void setOneofCase(MessageNano message, int slot, int number) {
+      throw noSuchSlot(slot);
+    }
+
+    /** Returns a new message of the type of a message or group field. */
+    public MessageNano newMessage(int slot) {
+      throw noSuchSlot(slot);
+    }
+
+    /** Returns a new array for a repeated message or group field. */
+    public MessageNano[] newMessageArray(int slot, int length) {
+      throw noSuchSlot(slot);
+    }
+
+    private static IllegalArgumentException noSuchSlot(int slot) {
+      return new IllegalArgumentException("No field of this type in slot " + slot);
+    }
+  }
+
+  // Per field, in field number order.
+  private final int[] numbers;
+  private final int[] tags;
+  private final int[] tagSizes;
+  private final int[] kinds;
+  private final int[] slots;
+  // The values of the singular fields in a new message, compared against to
+  // decide whether they are written: the bits of numeric and bool values,
+  // and strings and bytes.
+  private final long[] defaultBits;
+  private final Object[] defaultObjects;
+  // Sorted valid values of enum fields, null for other fields.
+  private final int[][] validEnumValues;
+  private final FieldAccessor accessor;
+
+  /**
+   * @param defaultInstance a newly constructed message of the described type
+   * @param table four ints per field: number, wire type, kind and slot
+   * @param validEnumValues the sorted valid values of enum fields, by slot;
+   *     null if the message has no enum fields
+   * @param accessor reads and writes the fields of the message by slot
+   */
+  public MessageTableNano(MessageNano defaultInstance, int[] table,
+      int[][] validEnumValues, FieldAccessor accessor) {
+    int count = table.length / ENTRY_SIZE;
+    numbers = new int[count];
+    tags = new int[count];
+    tagSizes = new int[count];
+    kinds = new int[count];
+    slots = new int[count];
+    defaultBits = new long[count];
+    defaultObjects = new Object[count];
+    this.validEnumValues = new int[count][];
+    this.accessor = accessor;
+    for (int i = 0; i < count; i++) {
+      int number = table[i * ENTRY_SIZE];
+      int wireType = table[i * ENTRY_SIZE + 1];
+      int kind = table[i * ENTRY_SIZE + 2];
+      int slot = table[i * ENTRY_SIZE + 3];
+      numbers[i] = number;
+      tags[i] = WireFormatNano.makeTag(number, wireType);
+      tagSizes[i] = CodedOutputByteBufferNano.computeRawVarint32Size(tags[i]);
+      kinds[i] = kind;
+      slots[i] = slot;
+      if ((kind & KIND_ONEOF) != 0) {
+        continue;
+      }
+      if (validEnumValues != null) {
+        this.validEnumValues[i] = validEnumValues[slot];
+      }
+      if ((kind & KIND_REPEATED) == 0) {
+        storeDefault(i, defaultInstance);
+      }
+    }
+  }
+
+  private void storeDefault(int i, MessageNano defaultInstance) {
+    int slot = slots[i];
+    switch (kinds[i] & KIND_TYPE_MASK) {
+      case InternalNano.TYPE_DOUBLE:
+        defaultBits[i] = Double.doubleToLongBits(
+            accessor.getDouble(defaultInstance, slot));
+        break;
+      case InternalNano.TYPE_FLOAT:
+        defaultBits[i] = Float.floatToIntBits(
+            accessor.getFloat(defaultInstance, slot));
+        break;
+      case InternalNano.TYPE_BOOL:
+        defaultBits[i] = accessor.getBoolean(defaultInstance, slot) ? 1 : 0;
+        break;
+      case InternalNano.TYPE_STRING:
+      case InternalNano.TYPE_BYTES:
+        defaultObjects[i] = accessor.getObject(defaultInstance, slot);
+        break;
+      case InternalNano.TYPE_MESSAGE:
+      case InternalNano.TYPE_GROUP:
+        break;
+      case InternalNano.TYPE_INT64:
+      case InternalNano.TYPE_UINT64:
+      case InternalNano.TYPE_FIXED64:
+      case InternalNano.TYPE_SFIXED64:
+      case InternalNano.TYPE_SINT64:
+        defaultBits[i] = accessor.getLong(defaultInstance, slot);
+        break;
+      default:
+        defaultBits[i] = accessor.getInt(defaultInstance, slot);
+        break;
+    }
+  }
+
+  public void writeTo(MessageNano message, CodedOutputByteBufferNano output)
+      throws IOException {
+    for (int i = 0; i < kinds.length; i++) {
+      int kind = kinds[i];
+      if ((kind & KIND_ONEOF) != 0) {
+        if (accessor.getOneofCase(message, slots[i]) == numbers[i]) {
+          output.writeField(numbers[i], kind & KIND_TYPE_MASK,
+              accessor.getObject(message, slots[i]));
+        }
+      } else if ((kind & KIND_REPEATED) == 0) {
+        writeSingular(i, message, output);
+      } else {
+        Object array = accessor.getObject(message, slots[i]);
+        int length = array == null ? 0 : Array.getLength(array);
+        if (length == 0) {
+          continue;
+        }
+        if ((kind & KIND_PACKED) != 0) {
+          output.writeTag(numbers[i], WireFormatNano.WIRETYPE_LENGTH_DELIMITED);
+          output.writeRawVarint32(computePackedDataSize(i, array, length));
+          writeElements(i, array, length, output, false);
+        } else {
+          writeElements(i, array, length, output, true);
+        }
+      }
+    }
+  }
+
+  private void writeSingular(int i, MessageNano message,
+      CodedOutputByteBufferNano output) throws IOException {
+    int type = kinds[i] & KIND_TYPE_MASK;
+    int slot = slots[i];
+    boolean required = (kinds[i] & KIND_REQUIRED) != 0;
+    switch (type) {
+      case InternalNano.TYPE_DOUBLE: {
+        double value = accessor.getDouble(message, slot);
+        if (required || Double.doubleToLongBits(value) != defaultBits[i]) {
+          output.writeRawVarint32(tags[i]);
+          output.writeDoubleNoTag(value);
+        }
+        break;
+      }
+      case InternalNano.TYPE_FLOAT: {
+        float value = accessor.getFloat(message, slot);
+        if (required || Float.floatToIntBits(value) != defaultBits[i]) {
+          output.writeRawVarint32(tags[i]);
+          output.writeFloatNoTag(value);
+        }
+        break;
+      }
+      case InternalNano.TYPE_BOOL: {
+        boolean value = accessor.getBoolean(message, slot);
+        if (required || (value ? 1 : 0) != defaultBits[i]) {
+          output.writeRawVarint32(tags[i]);
+          output.writeBoolNoTag(value);
+        }
+        break;
+      }
+      case InternalNano.TYPE_STRING: {
+        String value = (String) accessor.getObject(message, slot);
+        if (value != null && (required || !value.equals(defaultObjects[i]))) {
+          output.writeRawVarint32(tags[i]);
+          output.writeStringNoTag(value);
+        }
+        break;
+      }
+      case InternalNano.TYPE_BYTES: {
+        byte[] value = (byte[]) accessor.getObject(message, slot);
+        if (value != null
+            && (required || !Arrays.equals(value, (byte[]) defaultObjects[i]))) {
+          output.writeRawVarint32(tags[i]);
+          output.writeBytesNoTag(value);
+        }
+        break;
+      }
+      case InternalNano.TYPE_MESSAGE:
+      case InternalNano.TYPE_GROUP: {
+        MessageNano value = (MessageNano) accessor.getObject(message, slot);
+        if (value != null) {
+          writeMessage(i, value, output);
+        }
+        break;
+      }
+      case InternalNano.TYPE_INT64:
+      case InternalNano.TYPE_UINT64:
+      case InternalNano.TYPE_FIXED64:
+      case InternalNano.TYPE_SFIXED64:
+      case InternalNano.TYPE_SINT64: {
+        long value = accessor.getLong(message, slot);
+        if (required || value != defaultBits[i]) {
+          output.writeRawVarint32(tags[i]);
+          writeLongNoTag(output, type, value);
+        }
+        break;
+      }
+      default: {
+        int value = accessor.getInt(message, slot);
+        if (required || value != defaultBits[i]) {
+          output.writeRawVarint32(tags[i]);
+          writeIntNoTag(output, type, value);
+        }
+        break;
+      }
+    }
+  }
+
+  /**
+   * Writes the values of repeated field i, each with its tag or, for the
+   * data of a packed field, without.
+   */
+  private void writeElements(int i, Object array, int length,
+      CodedOutputByteBufferNano output, boolean withTags) throws IOException {
+    int type = kinds[i] & KIND_TYPE_MASK;
+    int tag = tags[i];
+    switch (type) {
+      case InternalNano.TYPE_DOUBLE: {
+        double[] values = (double[]) array;
+        for (int j = 0; j < length; j++) {
+          if (withTags) {
+            output.writeRawVarint32(tag);
+          }
+          output.writeDoubleNoTag(values[j]);
+        }
+        break;
+      }
+      case InternalNano.TYPE_FLOAT: {
+        float[] values = (float[]) array;
+        for (int j = 0; j < length; j++) {
+          if (withTags) {
+            output.writeRawVarint32(tag);
+          }
+          output.writeFloatNoTag(values[j]);
+        }
+        break;
+      }
+      case InternalNano.TYPE_BOOL: {
+        boolean[] values = (boolean[]) array;
+        for (int j = 0; j < length; j++) {
+          if (withTags) {
+            output.writeRawVarint32(tag);
+          }
+          output.writeBoolNoTag(values[j]);
+        }
+        break;
+      }
+      case InternalNano.TYPE_STRING: {
+        String[] values = (String[]) array;
+        for (int j = 0; j < length; j++) {
+          if (values[j] != null) {
+            output.writeRawVarint32(tag);
+            output.writeStringNoTag(values[j]);
+          }
+        }
+        break;
+      }
+      case InternalNano.TYPE_BYTES: {
+        byte[][] values = (byte[][]) array;
+        for (int j = 0; j < length; j++) {
+          if (values[j] != null) {
+            output.writeRawVarint32(tag);
+            output.writeBytesNoTag(values[j]);
+          }
+        }
+        break;
+      }
+      case InternalNano.TYPE_MESSAGE:
+      case InternalNano.TYPE_GROUP: {
+        MessageNano[] values = (MessageNano[]) array;
+        for (int j = 0; j < length; j++) {
+          if (values[j] != null) {
+            writeMessage(i, values[j], output);
+          }
+        }
+        break;
+      }
+      case InternalNano.TYPE_INT64:
+      case InternalNano.TYPE_UINT64:
+      case InternalNano.TYPE_FIXED64:
+      case InternalNano.TYPE_SFIXED64:
+      case InternalNano.TYPE_SINT64: {
+        long[] values = (long[]) array;
+        for (int j = 0; j < length; j++) {
+          if (withTags) {
+            output.writeRawVarint32(tag);
+          }
+          writeLongNoTag(output, type, values[j]);
+        }
+        break;
+      }
+      default: {
+        int[] values = (int[]) array;
+        for (int j = 0; j < length; j++) {
+          if (withTags) {
+            output.writeRawVarint32(tag);
+          }
+          writeIntNoTag(output, type, values[j]);
+        }
+        break;
+      }
+    }
+  }
+
+  private void writeMessage(int i, MessageNano value,
+      CodedOutputByteBufferNano output) throws IOException {
+    if ((kinds[i] & KIND_TYPE_MASK) == InternalNano.TYPE_GROUP) {
+      output.writeGroup(numbers[i], value);
+    } else {
+      output.writeRawVarint32(tags[i]);
+      output.writeMessageNoTag(value);
+    }
+  }
+
+  public int computeSerializedSize(MessageNano message) {
+    int size = 0;
+    for (int i = 0; i < kinds.length; i++) {
+      int kind = kinds[i];
+      if ((kind & KIND_ONEOF) != 0) {
+        if (accessor.getOneofCase(message, slots[i]) == numbers[i]) {
+          size += CodedOutputByteBufferNano.computeFieldSize(numbers[i],
+              kind & KIND_TYPE_MASK, accessor.getObject(message, slots[i]));
+        }
+      } else if ((kind & KIND_REPEATED) == 0) {
+        size += computeSingularSize(i, message);
+      } else {
+        Object array = accessor.getObject(message, slots[i]);
+        int length = array == null ? 0 : Array.getLength(array);
+        if (length == 0) {
+          continue;
+        }
+        if ((kind & KIND_PACKED) != 0) {
+          int dataSize = computePackedDataSize(i, array, length);
+          size += CodedOutputByteBufferNano.computeTagSize(numbers[i])
+              + CodedOutputByteBufferNano.computeRawVarint32Size(dataSize)
+              + dataSize;
+        } else {
+          size += computeElementsSize(i, array, length);
+        }
+      }
+    }
+    return size;
+  }
+
+  private int computeSingularSize(int i, MessageNano message) {
+    int type = kinds[i] & KIND_TYPE_MASK;
+    int slot = slots[i];
+    boolean required = (kinds[i] & KIND_REQUIRED) != 0;
+    switch (type) {
+      case InternalNano.TYPE_DOUBLE: {
+        double value = accessor.getDouble(message, slot);
+        return required || Double.doubleToLongBits(value) != defaultBits[i]
+            ? tagSizes[i] + 8 : 0;
+      }
+      case InternalNano.TYPE_FLOAT: {
+        float value = accessor.getFloat(message, slot);
+        return required || Float.floatToIntBits(value) != defaultBits[i]
+            ? tagSizes[i] + 4 : 0;
+      }
+      case InternalNano.TYPE_BOOL: {
+        boolean value = accessor.getBoolean(message, slot);
+        return required || (value ? 1 : 0) != defaultBits[i]
+            ? tagSizes[i] + 1 : 0;
+      }
+      case InternalNano.TYPE_STRING: {
+        String value = (String) accessor.getObject(message, slot);
+        return value != null && (required || !value.equals(defaultObjects[i]))
+            ? tagSizes[i] + CodedOutputByteBufferNano.computeStringSizeNoTag(value)
+            : 0;
+      }
+      case InternalNano.TYPE_BYTES: {
+        byte[] value = (byte[]) accessor.getObject(message, slot);
+        return value != null
+            && (required || !Arrays.equals(value, (byte[]) defaultObjects[i]))
+            ? tagSizes[i] + CodedOutputByteBufferNano.computeBytesSizeNoTag(value)
+            : 0;
+      }
+      case InternalNano.TYPE_MESSAGE:
+      case InternalNano.TYPE_GROUP: {
+        MessageNano value = (MessageNano) accessor.getObject(message, slot);
+        return value != null ? computeMessageSize(i, value) : 0;
+      }
+      case InternalNano.TYPE_INT64:
+      case InternalNano.TYPE_UINT64:
+      case InternalNano.TYPE_FIXED64:
+      case InternalNano.TYPE_SFIXED64:
+      case InternalNano.TYPE_SINT64: {
+        long value = accessor.getLong(message, slot);
+        return required || value != defaultBits[i]
+            ? tagSizes[i] + computeLongSizeNoTag(type, value) : 0;
+      }
+      default: {
+        int value = accessor.getInt(message, slot);
+        return required || value != defaultBits[i]
+            ? tagSizes[i] + computeIntSizeNoTag(type, value) : 0;
+      }
+    }
+  }
+
+  /** Returns the size of the values of unpacked repeated field i. */
+  private int computeElementsSize(int i, Object array, int length) {
+    int type = kinds[i] & KIND_TYPE_MASK;
+    int size = 0;
+    switch (type) {
+      case InternalNano.TYPE_STRING: {
+        String[] values = (String[]) array;
+        for (int j = 0; j < length; j++) {
+          if (values[j] != null) {
+            size += tagSizes[i]
+                + CodedOutputByteBufferNano.computeStringSizeNoTag(values[j]);
+          }
+        }
+        return size;
+      }
+      case InternalNano.TYPE_BYTES: {
+        byte[][] values = (byte[][]) array;
+        for (int j = 0; j < length; j++) {
+          if (values[j] != null) {
+            size += tagSizes[i]
+                + CodedOutputByteBufferNano.computeBytesSizeNoTag(values[j]);
+          }
+        }
+        return size;
+      }
+      case InternalNano.TYPE_MESSAGE:
+      case InternalNano.TYPE_GROUP: {
+        MessageNano[] values = (MessageNano[]) array;
+        for (int j = 0; j < length; j++) {
+          if (values[j] != null) {
+            size += computeMessageSize(i, values[j]);
+          }
+        }
+        return size;
+      }
+      default:
+        return tagSizes[i] * length + computePackedDataSize(i, array, length);
+    }
+  }
+
+  private int computeMessageSize(int i, MessageNano value) {
+    if ((kinds[i] & KIND_TYPE_MASK) == InternalNano.TYPE_GROUP) {
+      return CodedOutputByteBufferNano.computeGroupSize(numbers[i], value);
+    }
+    return tagSizes[i] + CodedOutputByteBufferNano.computeMessageSizeNoTag(value);
+  }
+
+  /** Returns the size of the values of repeated scalar field i, untagged. */
+  private int computePackedDataSize(int i, Object array, int length) {
+    int type = kinds[i] & KIND_TYPE_MASK;
+    switch (type) {
+      case InternalNano.TYPE_DOUBLE:
+      case InternalNano.TYPE_FIXED64:
+      case InternalNano.TYPE_SFIXED64:
+        return 8 * length;
+      case InternalNano.TYPE_FLOAT:
+      case InternalNano.TYPE_FIXED32:
+      case InternalNano.TYPE_SFIXED32:
+        return 4 * length;
+      case InternalNano.TYPE_BOOL:
+        return length;
+      case InternalNano.TYPE_INT64:
+      case InternalNano.TYPE_UINT64:
+      case InternalNano.TYPE_SINT64: {
+        long[] values = (long[]) array;
+        int dataSize = 0;
+        for (int j = 0; j < length; j++) {
+          dataSize += computeLongSizeNoTag(type, values[j]);
+        }
+        return dataSize;
+      }
+      default: {
+        int[] values = (int[]) array;
+        int dataSize = 0;
+        for (int j = 0; j < length; j++) {
+          dataSize += computeIntSizeNoTag(type, values[j]);
+        }
+        return dataSize;
+      }
+    }
+  }
+
+  public void mergeFrom(MessageNano message, CodedInputByteBufferNano input)
+      throws IOException {
+    // The lengths in use of the arrays of repeated fields, which get spare
+    // capacity while merging and are trimmed at the end, even if parsing
+    // throws; 0 until values are appended.
+    int[] lengths = null;
+    try {
+      while (true) {
+        int tag = input.readTag();
+        if (tag == 0) {
+          break;
+        }
+        int i = findField(WireFormatNano.getTagFieldNumber(tag));
+        if (i >= 0) {
+          if ((kinds[i] & KIND_REPEATED) != 0 && lengths == null) {
+            lengths = new int[numbers.length];
+          }
+          if (tag == tags[i]) {
+            mergeField(i, message, input, tag, lengths);
+            continue;
+          }
+          // To make packed = true wire compatible, packed values are accepted
+          // regardless of the packed option.
+          if ((kinds[i] & KIND_REPEATED) != 0
+              && WireFormatNano.getTagWireType(tag)
+                  == WireFormatNano.WIRETYPE_LENGTH_DELIMITED
+              && isPackable(kinds[i] & KIND_TYPE_MASK)) {
+            mergePackedField(i, message, input, lengths);
+            continue;
+          }
+        }
+        if (message instanceof ExtendableMessageNano) {
+          if (!((ExtendableMessageNano<?>) message).storeUnknownField(input, tag)) {
+            break;
+          }
+        } else if (!WireFormatNano.parseUnknownField(input, tag)) {
+          break;  // it's an endgroup tag
+        }
+      }
+    } finally {
+      if (lengths != null) {
+        for (int i = 0; i < lengths.length; i++) {
+          if (lengths[i] != 0) {
+            accessor.setObject(message, slots[i],
+                truncate(i, accessor.getObject(message, slots[i]), lengths[i]));
+          }
+        }
+      }
+    }
+  }
+
+  private void mergeField(int i, MessageNano message,
+      CodedInputByteBufferNano input, int tag, int[] lengths)
+      throws IOException {
+    int type = kinds[i] & KIND_TYPE_MASK;
+    int slot = slots[i];
+    if ((kinds[i] & KIND_ONEOF) != 0) {
+      if (type == InternalNano.TYPE_MESSAGE || type == InternalNano.TYPE_GROUP) {
+        MessageNano value = null;
+        if (accessor.getOneofCase(message, slot) == numbers[i]) {
+          value = (MessageNano) accessor.getObject(message, slot);
+        }
+        if (value == null) {
+          value = accessor.newMessage(slot);
+          accessor.setObject(message, slot, value);
+        }
+        readMessage(i, input, value);
+      } else {
+        accessor.setObject(message, slot, input.readPrimitiveField(type));
+      }
+      accessor.setOneofCase(message, slot, numbers[i]);
+      return;
+    }
+
+    if ((kinds[i] & KIND_REPEATED) == 0) {
+      mergeSingular(i, message, input);
+      return;
+    }
+
+    int length = WireFormatNano.getRepeatedFieldArrayLength(input, tag);
+    Object array = accessor.getObject(message, slot);
+    int start = lengthInUse(i, array, lengths);
+    Object newArray = ensureCapacity(i, array, start, length, lengths);
+    int count = start;
+    for (int j = 0; j < length; j++) {
+      if (j != 0) {  // tag for first value already consumed.
+        input.readTag();
+      }
+      count = readElement(i, input, newArray, count);
+    }
+    if (count != start) {
+      accessor.setObject(message, slot, newArray);
+      lengths[i] = count;
+    }
+  }
+
+  private void mergeSingular(int i, MessageNano message,
+      CodedInputByteBufferNano input) throws IOException {
+    int type = kinds[i] & KIND_TYPE_MASK;
+    int slot = slots[i];
+    switch (type) {
+      case InternalNano.TYPE_DOUBLE:
+        accessor.setDouble(message, slot, input.readDouble());
+        break;
+      case InternalNano.TYPE_FLOAT:
+        accessor.setFloat(message, slot, input.readFloat());
+        break;
+      case InternalNano.TYPE_BOOL:
+        accessor.setBoolean(message, slot, input.readBool());
+        break;
+      case InternalNano.TYPE_STRING:
+        accessor.setObject(message, slot, input.readString());
+        break;
+      case InternalNano.TYPE_BYTES:
+        accessor.setObject(message, slot, input.readBytes());
+        break;
+      case InternalNano.TYPE_MESSAGE:
+      case InternalNano.TYPE_GROUP: {
+        MessageNano value = (MessageNano) accessor.getObject(message, slot);
+        if (value == null) {
+          value = accessor.newMessage(slot);
+          accessor.setObject(message, slot, value);
+        }
+        readMessage(i, input, value);
+        break;
+      }
+      case InternalNano.TYPE_INT64:
+      case InternalNano.TYPE_UINT64:
+      case InternalNano.TYPE_FIXED64:
+      case InternalNano.TYPE_SFIXED64:
+      case InternalNano.TYPE_SINT64:
+        accessor.setLong(message, slot, readLong(input, type));
+        break;
+      default: {
+        int value = readInt(input, type);
+        // An invalid enum value from the wire preserves the old field value.
+        if (isValid(i, value)) {
+          accessor.setInt(message, slot, value);
+        }
+        break;
+      }
+    }
+  }
+
+  private void mergePackedField(int i, MessageNano message,
+      CodedInputByteBufferNano input, int[] lengths) throws IOException {
+    int bytes = input.readRawVarint32();
+    int limit = input.pushLimit(bytes);
+    // The number of values, counting the invalid enum values which are
+    // dropped.
+    int wireType = WireFormatNano.getTagWireType(tags[i]);
+    int arrayLength = wireType == WireFormatNano.WIRETYPE_FIXED32 ? bytes / 4
+        : wireType == WireFormatNano.WIRETYPE_FIXED64 ? bytes / 8
+        : input.countVarints(bytes);
+    if (arrayLength != 0) {
+      Object array = accessor.getObject(message, slots[i]);
+      int start = lengthInUse(i, array, lengths);
+      Object newArray = ensureCapacity(i, array, start, arrayLength, lengths);
+      int count = start;
+      while (input.getBytesUntilLimit() > 0) {
+        count = readElement(i, input, newArray, count);
+      }
+      if (count != start) {
+        accessor.setObject(message, slots[i], newArray);
+        lengths[i] = count;
+      }
+    }
+    input.popLimit(limit);
+  }
+
+  /**
+   * Reads a value of repeated field i into {@code array} at {@code count},
+   * and returns the number of values in the array after it: count if it was
+   * an invalid enum value, which is dropped.
+   */
+  private int readElement(int i, CodedInputByteBufferNano input, Object array,
+      int count) throws IOException {
+    int type = kinds[i] & KIND_TYPE_MASK;
+    switch (type) {
+      case InternalNano.TYPE_DOUBLE:
+        ((double[]) array)[count] = input.readDouble();
+        return count + 1;
+      case InternalNano.TYPE_FLOAT:
+        ((float[]) array)[count] = input.readFloat();
+        return count + 1;
+      case InternalNano.TYPE_BOOL:
+        ((boolean[]) array)[count] = input.readBool();
+        return count + 1;
+      case InternalNano.TYPE_STRING:
+        ((String[]) array)[count] = input.readString();
+        return count + 1;
+      case InternalNano.TYPE_BYTES:
+        ((byte[][]) array)[count] = input.readBytes();
+        return count + 1;
+      case InternalNano.TYPE_MESSAGE:
+      case InternalNano.TYPE_GROUP: {
+        MessageNano element = accessor.newMessage(slots[i]);
+        readMessage(i, input, element);
+        ((MessageNano[]) array)[count] = element;
+        return count + 1;
+      }
+      case InternalNano.TYPE_INT64:
+      case InternalNano.TYPE_UINT64:
+      case InternalNano.TYPE_FIXED64:
+      case InternalNano.TYPE_SFIXED64:
+      case InternalNano.TYPE_SINT64:
+        ((long[]) array)[count] = readLong(input, type);
+        return count + 1;
+      default: {
+        int value = readInt(input, type);
+        if (!isValid(i, value)) {
+          return count;
+        }
+        ((int[]) array)[count] = value;
+        return count + 1;
+      }
+    }
+  }
+
+  /** Returns the number of values in the array of repeated field i. */
+  private static int lengthInUse(int i, Object array, int[] lengths) {
+    if (lengths[i] != 0) {
+      return lengths[i];
+    }
+    return array == null ? 0 : Array.getLength(array);
+  }
+
+  /**
+   * Returns the array of repeated field i, or a copy of its first count
+   * values, with room for more values. Once values were appended in this
+   * mergeFrom(), the capacity at least doubles, so that runs of the field
+   * interleaved with other fields are merged in linear time.
+   */
+  private Object ensureCapacity(int i, Object array, int count, int more,
+      int[] lengths) {
+    if (array != null && Array.getLength(array) - count >= more) {
+      return array;
+    }
+    int capacity = lengths[i] == 0
+        ? count + more : Math.max(count + more, 2 * count);
+    Object newArray = newArray(i, capacity);
+    if (count != 0) {
+      System.arraycopy(array, 0, newArray, 0, count);
+    }
+    return newArray;
+  }
+
+  private Object truncate(int i, Object array, int length) {
+    if (Array.getLength(array) == length) {
+      return array;
+    }
+    Object newArray = newArray(i, length);
+    System.arraycopy(array, 0, newArray, 0, length);
+    return newArray;
+  }
+
+  private Object newArray(int i, int length) {
+    switch (kinds[i] & KIND_TYPE_MASK) {
+      case InternalNano.TYPE_DOUBLE:
+        return new double[length];
+      case InternalNano.TYPE_FLOAT:
+        return new float[length];
+      case InternalNano.TYPE_BOOL:
+        return new boolean[length];
+      case InternalNano.TYPE_STRING:
+        return new String[length];
+      case InternalNano.TYPE_BYTES:
+        return new byte[length][];
+      case InternalNano.TYPE_MESSAGE:
+      case InternalNano.TYPE_GROUP:
+        return accessor.newMessageArray(slots[i], length);
+      case InternalNano.TYPE_INT64:
+      case InternalNano.TYPE_UINT64:
+      case InternalNano.TYPE_FIXED64:
+      case InternalNano.TYPE_SFIXED64:
+      case InternalNano.TYPE_SINT64:
+        return new long[length];
+      default:
+        return new int[length];
+    }
+  }
+
+  /** Returns the index of the field with the given number, or -1. */
+  private int findField(int number) {
+    int low = 0;
+    int high = numbers.length - 1;
+    while (low <= high) {
+      int mid = (low + high) >>> 1;
+      if (numbers[mid] < number) {
+        low = mid + 1;
+      } else if (numbers[mid] > number) {
+        high = mid - 1;
+      } else {
+        return mid;
+      }
+    }
+    return -1;
+  }
+
+  private boolean isValid(int i, int value) {
+    return validEnumValues[i] == null
+        || Arrays.binarySearch(validEnumValues[i], value) >= 0;
+  }
+
+  private void readMessage(int i, CodedInputByteBufferNano input,
+      MessageNano value) throws IOException {
+    if ((kinds[i] & KIND_TYPE_MASK) == InternalNano.TYPE_GROUP) {
+      input.readGroup(value, numbers[i]);
+    } else {
+      input.readMessage(value);
+    }
+  }
+
+  private static boolean isPackable(int type) {
+    switch (type) {
+      case InternalNano.TYPE_STRING:
+      case InternalNano.TYPE_BYTES:
+      case InternalNano.TYPE_MESSAGE:
+      case InternalNano.TYPE_GROUP:
+        return false;
+      default:
+        return true;
+    }
+  }
+
+  // The types held in Java ints are the 32-bit integer types and enums, and
+  // those held in longs the 64-bit integer types.
+
+  private static int readInt(CodedInputByteBufferNano input, int type)
+      throws IOException {
+    switch (type) {
+      case InternalNano.TYPE_INT32:
+        return input.readInt32();
+      case InternalNano.TYPE_UINT32:
+        return input.readUInt32();
+      case InternalNano.TYPE_FIXED32:
+        return input.readFixed32();
+      case InternalNano.TYPE_SFIXED32:
+        return input.readSFixed32();
+      case InternalNano.TYPE_SINT32:
+        return input.readSInt32();
+      case InternalNano.TYPE_ENUM:
+        return input.readEnum();
+      default:
+        throw new IllegalArgumentException("Not an int type: " + type);
+    }
+  }
+
+  private static long readLong(CodedInputByteBufferNano input, int type)
+      throws IOException {
+    switch (type) {
+      case InternalNano.TYPE_INT64:
+        return input.readInt64();
+      case InternalNano.TYPE_UINT64:
+        return input.readUInt64();
+      case InternalNano.TYPE_FIXED64:
+        return input.readFixed64();
+      case InternalNano.TYPE_SFIXED64:
+        return input.readSFixed64();
+      case InternalNano.TYPE_SINT64:
+        return input.readSInt64();
+      default:
+        throw new IllegalArgumentException("Not a long type: " + type);
+    }
+  }
+
+  private static int computeIntSizeNoTag(int type, int value) {
+    switch (type) {
+      case InternalNano.TYPE_INT32:
+        return CodedOutputByteBufferNano.computeInt32SizeNoTag(value);
+      case InternalNano.TYPE_UINT32:
+        return CodedOutputByteBufferNano.computeUInt32SizeNoTag(value);
+      case InternalNano.TYPE_FIXED32:
+      case InternalNano.TYPE_SFIXED32:
+        return 4;
+      case InternalNano.TYPE_SINT32:
+        return CodedOutputByteBufferNano.computeSInt32SizeNoTag(value);
+      case InternalNano.TYPE_ENUM:
+        return CodedOutputByteBufferNano.computeEnumSizeNoTag(value);
+      default:
+        throw new IllegalArgumentException("Not an int type: " + type);
+    }
+  }
+
+  private static int computeLongSizeNoTag(int type, long value) {
+    switch (type) {
+      case InternalNano.TYPE_INT64:
+        return CodedOutputByteBufferNano.computeInt64SizeNoTag(value);
+      case InternalNano.TYPE_UINT64:
+        return CodedOutputByteBufferNano.computeUInt64SizeNoTag(value);
+      case InternalNano.TYPE_FIXED64:
+      case InternalNano.TYPE_SFIXED64:
+        return 8;
+      case InternalNano.TYPE_SINT64:
+        return CodedOutputByteBufferNano.computeSInt64SizeNoTag(value);
+      default:
+        throw new IllegalArgumentException("Not a long type: " + type);
+    }
+  }
+
+  private static void writeIntNoTag(CodedOutputByteBufferNano output,
+      int type, int value) throws IOException {
+    switch (type) {
+      case InternalNano.TYPE_INT32:
+        output.writeInt32NoTag(value);
+        break;
+      case InternalNano.TYPE_UINT32:
+        output.writeUInt32NoTag(value);
+        break;
+      case InternalNano.TYPE_FIXED32:
+        output.writeFixed32NoTag(value);
+        break;
+      case InternalNano.TYPE_SFIXED32:
+        output.writeSFixed32NoTag(value);
+        break;
+      case InternalNano.TYPE_SINT32:
+        output.writeSInt32NoTag(value);
+        break;
+      case InternalNano.TYPE_ENUM:
+        output.writeEnumNoTag(value);
+        break;
+      default:
+        throw new IllegalArgumentException("Not an int type: " + type);
+    }
+  }
+
+  private static void writeLongNoTag(CodedOutputByteBufferNano output,
+      int type, long value) throws IOException {
+    switch (type) {
+      case InternalNano.TYPE_INT64:
+        output.writeInt64NoTag(value);
+        break;
+      case InternalNano.TYPE_UINT64:
+        output.writeUInt64NoTag(value);
+        break;
+      case InternalNano.TYPE_FIXED64:
+        output.writeFixed64NoTag(value);
+        break;
+      case InternalNano.TYPE_SFIXED64:
+        output.writeSFixed64NoTag(value);
+        break;
+      case InternalNano.TYPE_SINT64:
+        output.writeSInt64NoTag(value);
+        break;
+      default:
+        throw new IllegalArgumentException("Not a long type: " + type);
+    }
+  }
+}
@@ -0,0 +1,288 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2013 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+package com.google.protobuf.nano;
+
+import java.io.IOException;
+
+/**
+ * Writes protocol message fields back to front into a growing byte array.
+ * Each write puts its bytes in front of everything written before, so
+ * {@link MessageNano#writeToReverse} writes the fields of a message in
+ * reverse order, and a nested message is written before its length, which
+ * is then known without computing the size of the message first.
+ *
+ * <p>The methods are named after the methods of
+ * {@link CodedOutputByteBufferNano} writing the same values.
+ *
+ * <p>This class is totally unsynchronized.
+ */
+public final class ReverseCodedOutputNano {
+  private static final int DEFAULT_CAPACITY = 256;
+
+  // What has been written is buffer[position, buffer.length).
+  private byte[] buffer;
+  private int position;
+
+  public ReverseCodedOutputNano() {
+    this(DEFAULT_CAPACITY);
+  }
+
+  /** Creates an output starting with room for {@code capacity} bytes. */
+  public ReverseCodedOutputNano(int capacity) {
+    if (capacity < 0) {
+      throw new IllegalArgumentException("Negative capacity: " + capacity);
+    }
+    buffer = new byte[capacity];
+    position = capacity;
+  }
+
+  /** Returns the number of bytes written so far. */
+  public int size() {
+    return buffer.length - position;
+  }
+
+  /** Discards what has been written, keeping the buffer for reuse. */
+  public void reset() {
+    position = buffer.length;
+  }
+
+  /** Returns a copy of the bytes written so far. */
+  public byte[] toByteArray() {
+    final byte[] result = new byte[buffer.length - position];
+    System.arraycopy(buffer, position, result, 0, result.length);
+    return result;
+  }
+
+  /**
+   * Makes room for {@code length} bytes in front of what has been written,
+   * growing the buffer if needed, and returns where they go. Callers must
+   * read {@link #buffer} after calling it.
+   */
+  private int reserve(final int length) {
+    if (position < length) {
+      final int size = buffer.length - position;
+      final int capacity = Math.max(buffer.length * 2, size + length);
+      final byte[] newBuffer = new byte[capacity];
+      System.arraycopy(buffer, position, newBuffer, capacity - size, size);
+      buffer = newBuffer;
+      position = capacity - size;
+    }
+    position -= length;
+    return position;
+  }
+
+  // -----------------------------------------------------------------
+
+  /** Write a {@code double} field to the stream. */
+  public void writeDoubleNoTag(final double value) {
+    writeRawLittleEndian64(Double.doubleToLongBits(value));
+  }
+
+  /** Write a {@code float} field to the stream. */
+  public void writeFloatNoTag(final float value) {
+    writeRawLittleEndian32(Float.floatToIntBits(value));
+  }
+
+  /** Write a {@code uint64} field to the stream. */
+  public void writeUInt64NoTag(final long value) {
+    writeRawVarint64(value);
+  }
+
+  /** Write an {@code int64} field to the stream. */
+  public void writeInt64NoTag(final long value) {
+    writeRawVarint64(value);
+  }
+
+  /** Write an {@code int32} field to the stream. */
+  public void writeInt32NoTag(final int value) {
+    if (value >= 0) {
+      writeRawVarint32(value);
+    } else {
+      // Must sign-extend.
+      writeRawVarint64(value);
+    }
+  }
+
+  /** Write a {@code fixed64} field to the stream. */
+  public void writeFixed64NoTag(final long value) {
+    writeRawLittleEndian64(value);
+  }
+
+  /** Write a {@code fixed32} field to the stream. */
+  public void writeFixed32NoTag(final int value) {
+    writeRawLittleEndian32(value);
+  }
+
+  /** Write a {@code bool} field to the stream. */
+  public void writeBoolNoTag(final boolean value) {
+    writeRawByte(value ? 1 : 0);
+  }
+
+  /** Write a {@code string} field to the stream. */
+  public void writeStringNoTag(final String value) {
+    final int length = CodedOutputByteBufferNano.encodedLength(value);
+    final int position = reserve(length);
+    CodedOutputByteBufferNano.encode(value, buffer, position, length);
+    writeRawVarint32(length);
+  }
+
+  /** Write a {@code group} field to the stream. */
+  public void writeGroupNoTag(final MessageNano value) throws IOException {
+    value.writeToReverse(this);
+  }
+
+  /** Write an embedded message field to the stream. */
+  public void writeMessageNoTag(final MessageNano value) throws IOException {
+    final int sizeBefore = size();
+    value.writeToReverse(this);
+    writeRawVarint32(size() - sizeBefore);
+  }
+
+  /** Write a {@code bytes} field to the stream. */
+  public void writeBytesNoTag(final byte[] value) {
+    writeRawBytes(value);
+    writeRawVarint32(value.length);
+  }
+
+  /** Write a {@code uint32} field to the stream. */
+  public void writeUInt32NoTag(final int value) {
+    writeRawVarint32(value);
+  }
+
+  /**
+   * Write an enum field to the stream.  Caller is responsible
+   * for converting the enum value to its numeric value.
+   */
+  public void writeEnumNoTag(final int value) {
+    writeRawVarint32(value);
+  }
+
+  /** Write an {@code sfixed32} field to the stream. */
+  public void writeSFixed32NoTag(final int value) {
+    writeRawLittleEndian32(value);
+  }
+
+  /** Write an {@code sfixed64} field to the stream. */
+  public void writeSFixed64NoTag(final long value) {
+    writeRawLittleEndian64(value);
+  }
+
+  /** Write an {@code sint32} field to the stream. */
+  public void writeSInt32NoTag(final int value) {
+    writeRawVarint32(CodedOutputByteBufferNano.encodeZigZag32(value));
+  }
+
+  /** Write an {@code sint64} field to the stream. */
+  public void writeSInt64NoTag(final long value) {
+    writeRawVarint64(CodedOutputByteBufferNano.encodeZigZag64(value));
+  }
+
+  // =================================================================
+
+  /** Write a single byte, represented by an integer value. */
+  public void writeRawByte(final int value) {
+    final int position = reserve(1);
+    buffer[position] = (byte) value;
+  }
+
+  /** Write an array of bytes. */
+  public void writeRawBytes(final byte[] value) {
+    writeRawBytes(value, 0, value.length);
+  }
+
+  /** Write part of an array of bytes. */
+  public void writeRawBytes(final byte[] value, int offset, int length) {
+    final int position = reserve(length);
+    System.arraycopy(value, offset, buffer, position, length);
+  }
+
+  /** Encode and write a tag. */
+  public void writeTag(final int fieldNumber, final int wireType) {
+    writeRawVarint32(WireFormatNano.makeTag(fieldNumber, wireType));
+  }
+
+  /** Write a tag of one byte, already encoded as a varint. */
+  public void writeTagBytes(final int b0) {
+    final int position = reserve(1);
+    buffer[position] = (byte) b0;
+  }
+
+  /** Write a tag of two bytes, already encoded as a varint. */
+  public void writeTagBytes(final int b0, final int b1) {
+    final int position = reserve(2);
+    buffer[position] = (byte) b0;
+    buffer[position + 1] = (byte) b1;
+  }
+
+  /** Write a tag of three bytes, already encoded as a varint. */
+  public void writeTagBytes(final int b0, final int b1, final int b2) {
+    final int position = reserve(3);
+    buffer[position] = (byte) b0;
+    buffer[position + 1] = (byte) b1;
+    buffer[position + 2] = (byte) b2;
+  }
+
+  /**
+   * Encode and write a varint.  {@code value} is treated as
+   * unsigned, so it won't be sign-extended if negative.
+   */
+  public void writeRawVarint32(int value) {
+    int position = reserve(CodedOutputByteBufferNano.computeRawVarint32Size(value));
+    while ((value & ~0x7F) != 0) {
+      buffer[position++] = (byte) ((value & 0x7F) | 0x80);
+      value >>>= 7;
+    }
+    buffer[position] = (byte) value;
+  }
+
+  /** Encode and write a varint. */
+  public void writeRawVarint64(long value) {
+    int position = reserve(CodedOutputByteBufferNano.computeRawVarint64Size(value));
+    while ((value & ~0x7FL) != 0) {
+      buffer[position++] = (byte) (((int) value & 0x7F) | 0x80);
+      value >>>= 7;
+    }
+    buffer[position] = (byte) value;
+  }
+
+  /** Write a little-endian 32-bit integer. */
+  public void writeRawLittleEndian32(final int value) {
+    final int position = reserve(4);
+    ByteArrayAccessNano.INSTANCE.putIntLittleEndian(buffer, position, value);
+  }
+
+  /** Write a little-endian 64-bit integer. */
+  public void writeRawLittleEndian64(final long value) {
+    final int position = reserve(8);
+    ByteArrayAccessNano.INSTANCE.putLongLittleEndian(buffer, position, value);
+  }
+}
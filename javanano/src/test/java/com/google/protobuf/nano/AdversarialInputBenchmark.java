@@ -0,0 +1,183 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2013 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+package com.google.protobuf.nano;
+
+import com.google.protobuf.nano.Benchmarks.Operation;
+import com.google.protobuf.nano.NanoOuterClass.TestAllTypesNano;
+
+import java.io.IOException;
+
+/**
+ * Measures parsing pathological payloads of n and 4n values with the
+ * unrolled and the table-driven code, and fails if the time per value grows
+ * by more than half from one to the other, which is what a parser copying
+ * arrays for each run of a repeated field does. It is not run by the tests;
+ * after {@code mvn test-compile}, run
+ *
+ * <pre>
+ * java -cp target/classes:target/test-classes \
+ *     com.google.protobuf.nano.AdversarialInputBenchmark [seconds]
+ * </pre>
+ *
+ * where seconds is the minimum time spent on each measurement (default 1).
+ */
+public class AdversarialInputBenchmark {
+
+  private static final int N = 2000;
+  private static final double MAX_GROWTH = 1.5;
+  // Nesting of the unknown groups, within the default recursion limit.
+  private static final int GROUP_DEPTH = 32;
+
+  abstract static class Payload {
+    abstract void write(CodedOutputByteBufferNano output, int n)
+        throws IOException;
+
+    byte[] build(int n) throws IOException {
+      byte[] buffer = new byte[n * (20 + GROUP_DEPTH * 6)];
+      CodedOutputByteBufferNano output =
+          CodedOutputByteBufferNano.newInstance(buffer);
+      write(output, n);
+      byte[] bytes = new byte[output.position()];
+      System.arraycopy(buffer, 0, bytes, 0, bytes.length);
+      return bytes;
+    }
+  }
+
+  public static void main(String[] args) throws Exception {
+    double seconds = args.length > 0 ? Double.parseDouble(args[0]) : 1;
+    boolean linear = true;
+
+    // Single values of two repeated fields, alternating.
+    linear &= report("alternating", new Payload() {
+      @Override void write(CodedOutputByteBufferNano output, int n)
+          throws IOException {
+        for (int i = 0; i < n; i++) {
+          output.writeInt32(31, i);
+          output.writeString(44, "s");
+        }
+      }
+    }, seconds);
+
+    // One packed run of all the values.
+    linear &= report("packed run", new Payload() {
+      @Override void write(CodedOutputByteBufferNano output, int n)
+          throws IOException {
+        int size = 0;
+        for (int i = 0; i < n; i++) {
+          size += CodedOutputByteBufferNano.computeInt32SizeNoTag(i);
+        }
+        output.writeTag(87, WireFormatNano.WIRETYPE_LENGTH_DELIMITED);
+        output.writeRawVarint32(size);
+        for (int i = 0; i < n; i++) {
+          output.writeInt32NoTag(i);
+        }
+      }
+    }, seconds);
+
+    // Packed runs of one value, alternating with another field.
+    linear &= report("packed runs", new Payload() {
+      @Override void write(CodedOutputByteBufferNano output, int n)
+          throws IOException {
+        for (int i = 0; i < n; i++) {
+          output.writeTag(87, WireFormatNano.WIRETYPE_LENGTH_DELIMITED);
+          output.writeRawVarint32(1);
+          output.writeInt32NoTag(1);
+          output.writeInt64(32, i);
+        }
+      }
+    }, seconds);
+
+    // Repeated groups and messages, alternating, each followed by deeply
+    // nested unknown groups to skip.
+    linear &= report("deep groups", new Payload() {
+      @Override void write(CodedOutputByteBufferNano output, int n)
+          throws IOException {
+        TestAllTypesNano.RepeatedGroup group = new TestAllTypesNano.RepeatedGroup();
+        TestAllTypesNano.NestedMessage nested = new TestAllTypesNano.NestedMessage();
+        for (int i = 0; i < n; i++) {
+          group.a = i;
+          nested.bb = i;
+          output.writeGroup(46, group);
+          output.writeMessage(48, nested);
+          for (int j = 0; j < GROUP_DEPTH; j++) {
+            output.writeTag(1000 + j, WireFormatNano.WIRETYPE_START_GROUP);
+          }
+          for (int j = GROUP_DEPTH - 1; j >= 0; j--) {
+            output.writeTag(1000 + j, WireFormatNano.WIRETYPE_END_GROUP);
+          }
+        }
+      }
+    }, seconds);
+
+    if (!linear) {
+      throw new IllegalStateException("Parsing time grows faster than the input");
+    }
+  }
+
+  /** Prints the timings for n and 4n values; returns whether they scale. */
+  private static boolean report(String name, Payload payload, double seconds)
+      throws IOException {
+    byte[] small = payload.build(N);
+    byte[] large = payload.build(4 * N);
+    double unrolledGrowth = growth(name, "unrolled", small, large, false, seconds);
+    double tableGrowth = growth(name, "table", small, large, true, seconds);
+    return unrolledGrowth <= MAX_GROWTH && tableGrowth <= MAX_GROWTH;
+  }
+
+  private static double growth(String name, String parser, byte[] small,
+      byte[] large, boolean table, double seconds) throws IOException {
+    double smallNanos = measureParse(small, table, seconds);
+    double largeNanos = measureParse(large, table, seconds);
+    double growth = largeNanos / (4 * smallNanos);
+    System.out.println(String.format(
+        "%-12s %-8s n %9.1f us/op  4n %9.1f us/op  per-value growth %5.2f%s",
+        name, parser, smallNanos / 1e3, largeNanos / 1e3, growth,
+        growth <= MAX_GROWTH ? "" : "  NOT LINEAR"));
+    return growth;
+  }
+
+  private static double measureParse(final byte[] data, boolean table,
+      double seconds) throws IOException {
+    if (table) {
+      return Benchmarks.measure(new Operation() {
+        @Override void run() throws IOException {
+          Benchmarks.sink +=
+              NanoTableDriven.TestAllTypesNano.parseFrom(data).optionalInt32;
+        }
+      }, seconds);
+    }
+    return Benchmarks.measure(new Operation() {
+      @Override void run() throws IOException {
+        Benchmarks.sink += TestAllTypesNano.parseFrom(data).optionalInt32;
+      }
+    }, seconds);
+  }
+}
@@ -0,0 +1,104 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2013 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+package com.google.protobuf.nano;
+
+import com.google.protobuf.nano.Benchmarks.Operation;
+import com.google.protobuf.nano.NanoOuterClass.TestAllTypesNano;
+
+import java.io.IOException;
+
+/**
+ * Measures parsing byte arrays with the default generated code, which reads
+ * through a CodedInputByteBufferNano, and with that of NanoArrayParser,
+ * generated with array_parser=true, which reads the array directly. It is
+ * not run by the tests; after {@code mvn test-compile}, run
+ *
+ * <pre>
+ * java -cp target/classes:target/test-classes \
+ *     com.google.protobuf.nano.ArrayParserBenchmark [seconds]
+ * </pre>
+ *
+ * where seconds is the minimum time spent on each measurement (default 1).
+ */
+public class ArrayParserBenchmark {
+
+  public static void main(String[] args) throws Exception {
+    double seconds = args.length > 0 ? Double.parseDouble(args[0]) : 1;
+
+    TestAllTypesNano scalars = new TestAllTypesNano();
+    scalars.optionalInt32 = 1;
+    scalars.optionalInt64 = 1L << 40;
+    scalars.optionalFixed32 = 3;
+    scalars.optionalDouble = 0.5;
+    scalars.optionalBool = true;
+    scalars.optionalString = "scalars";
+    scalars.optionalNestedEnum = TestAllTypesNano.BAR;
+    report("scalars", MessageNano.toByteArray(scalars), seconds);
+
+    TestAllTypesNano nested = new TestAllTypesNano();
+    nested.repeatedNestedMessage = new TestAllTypesNano.NestedMessage[100];
+    nested.repeatedGroup = new TestAllTypesNano.RepeatedGroup[100];
+    for (int i = 0; i < 100; i++) {
+      nested.repeatedNestedMessage[i] = new TestAllTypesNano.NestedMessage();
+      nested.repeatedNestedMessage[i].bb = i;
+      nested.repeatedGroup[i] = new TestAllTypesNano.RepeatedGroup();
+      nested.repeatedGroup[i].a = -i;
+    }
+    report("nested", MessageNano.toByteArray(nested), seconds);
+
+    TestAllTypesNano packed = new TestAllTypesNano();
+    packed.repeatedPackedInt32 = new int[1000];
+    packed.repeatedPackedSfixed64 = new long[1000];
+    for (int i = 0; i < 1000; i++) {
+      packed.repeatedPackedInt32[i] = i * i;
+      packed.repeatedPackedSfixed64[i] = -i;
+    }
+    report("packed", MessageNano.toByteArray(packed), seconds);
+  }
+
+  private static void report(String name, final byte[] data, double seconds)
+      throws IOException {
+    double stream = Benchmarks.measure(new Operation() {
+      @Override void run() throws IOException {
+        Benchmarks.sink += TestAllTypesNano.parseFrom(data).optionalInt32;
+      }
+    }, seconds);
+    double array = Benchmarks.measure(new Operation() {
+      @Override void run() throws IOException {
+        Benchmarks.sink +=
+            NanoArrayParser.TestAllTypesNano.parseFrom(data).optionalInt32;
+      }
+    }, seconds);
+    System.out.println(String.format(
+        "%-10s %7d bytes  coded input %9.1f us/op  array %9.1f us/op",
+        name, data.length, stream / 1e3, array / 1e3));
+  }
+}
@@ -0,0 +1,101 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2013 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+package com.google.protobuf.nano;
+
+import com.google.protobuf.nano.NanoOuterClass.TestAllTypesNano;
+
+import java.io.IOException;
+
+/**
+ * Timing helpers shared by the main()-driven benchmarks in this directory,
+ * which are not run by the tests.
+ */
+final class Benchmarks {
+
+  private Benchmarks() {}
+
+  abstract static class Operation {
+    abstract void run() throws IOException;
+  }
+
+  // Keeps the JIT from discarding the results of the operations.
+  static volatile int sink;
+
+  /** Returns the average nanoseconds per run, after as long a warm-up. */
+  static double measure(Operation operation, double seconds)
+      throws IOException {
+    long minNanos = (long) (seconds * 1e9);
+    long start = System.nanoTime();
+    while (System.nanoTime() - start < minNanos) {
+      operation.run();
+    }
+    long runs = 0;
+    start = System.nanoTime();
+    long elapsed;
+    do {
+      for (int i = 0; i < 1000; i++) {
+        operation.run();
+      }
+      runs += 1000;
+      elapsed = System.nanoTime() - start;
+    } while (elapsed < minNanos);
+    return (double) elapsed / runs;
+  }
+
+  /** Returns a message with a typical mix of set fields. */
+  static TestAllTypesNano newTestAllTypes() {
+    TestAllTypesNano msg = new TestAllTypesNano();
+    msg.optionalInt32 = 123;
+    msg.optionalInt64 = 1L << 40;
+    msg.optionalSint32 = -5;
+    msg.optionalFixed32 = 77;
+    msg.optionalDouble = 3.25;
+    msg.optionalBool = true;
+    msg.optionalString = "optional string";
+    msg.optionalBytes = new byte[] { 1, 2, 3, 4 };
+    msg.optionalNestedMessage = new TestAllTypesNano.NestedMessage();
+    msg.optionalNestedMessage.bb = 5;
+    msg.optionalNestedEnum = TestAllTypesNano.BAR;
+    msg.repeatedInt32 = new int[] { 1, 2, 3, 4, 5, 6, 7, 8 };
+    msg.repeatedInt64 = new long[] { 1L << 33, -1, 0 };
+    msg.repeatedFloat = new float[] { 0.5f, 1.5f };
+    msg.repeatedString = new String[] { "a", "bc", "def" };
+    msg.repeatedNestedMessage = new TestAllTypesNano.NestedMessage[4];
+    for (int i = 0; i < msg.repeatedNestedMessage.length; i++) {
+      msg.repeatedNestedMessage[i] = new TestAllTypesNano.NestedMessage();
+      msg.repeatedNestedMessage[i].bb = i;
+    }
+    msg.repeatedNestedEnum = new int[] { TestAllTypesNano.FOO, TestAllTypesNano.BAZ };
+    msg.repeatedPackedInt32 = new int[] { 100, 200, 300, 400 };
+    msg.setOneofString("oneof");
+    return msg;
+  }
+}
@@ -0,0 +1,126 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2013 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+package com.google.protobuf.nano;
+
+import com.google.protobuf.nano.Benchmarks.Operation;
+
+import java.io.IOException;
+
+/**
+ * Measures reading and writing fixed64 values with each ByteArrayAccessNano
+ * backend, and with CodedInputByteBufferNano and CodedOutputByteBufferNano
+ * using the selected one, which the system property
+ * {@code com.google.protobuf.nano.byteArrayAccess} can force to
+ * {@code unsafe} or {@code portable}. It is not run by the tests; after
+ * {@code mvn test-compile}, run
+ *
+ * <pre>
+ * java -cp target/classes:target/test-classes \
+ *     [-Dcom.google.protobuf.nano.byteArrayAccess=portable] \
+ *     com.google.protobuf.nano.FixedWidthBenchmark [seconds]
+ * </pre>
+ *
+ * where seconds is the minimum time spent on each measurement (default 1).
+ */
+public class FixedWidthBenchmark {
+
+  private static final int COUNT = 1000;
+
+  public static void main(String[] args) throws Exception {
+    double seconds = args.length > 0 ? Double.parseDouble(args[0]) : 1;
+    // One byte before each value, as a tag would be, so that most values
+    // are unaligned.
+    final byte[] data = new byte[COUNT * 9];
+    for (int i = 0; i < COUNT; i++) {
+      data[i * 9] = (byte) i;
+      ByteArrayAccessNano.portable().putLongLittleEndian(
+          data, i * 9 + 1, i * 0x0123456789abcdefL);
+    }
+
+    report(ByteArrayAccessNano.portable(), data, seconds);
+    if (ByteArrayAccessNano.unsafe() != null) {
+      report(ByteArrayAccessNano.unsafe(), data, seconds);
+    } else {
+      System.out.println("unsafe backend unavailable");
+    }
+
+    double read = Benchmarks.measure(new Operation() {
+      @Override void run() throws IOException {
+        CodedInputByteBufferNano input = CodedInputByteBufferNano.newInstance(data);
+        long sum = 0;
+        for (int i = 0; i < COUNT; i++) {
+          sum += input.readRawByte();
+          sum += input.readFixed64();
+        }
+        Benchmarks.sink += (int) sum;
+      }
+    }, seconds);
+    final byte[] output = new byte[data.length];
+    double write = Benchmarks.measure(new Operation() {
+      @Override void run() throws IOException {
+        CodedOutputByteBufferNano coded = CodedOutputByteBufferNano.newInstance(output);
+        for (int i = 0; i < COUNT; i++) {
+          coded.writeRawByte(i);
+          coded.writeFixed64NoTag(i);
+        }
+        Benchmarks.sink += output[output.length - 1];
+      }
+    }, seconds);
+    System.out.println(String.format(
+        "coded streams (%s)  read %7.2f ns/value  write %7.2f ns/value",
+        ByteArrayAccessNano.INSTANCE.name(), read / COUNT, write / COUNT));
+  }
+
+  private static void report(final ByteArrayAccessNano backend,
+      final byte[] data, double seconds) throws IOException {
+    double read = Benchmarks.measure(new Operation() {
+      @Override void run() {
+        long sum = 0;
+        for (int i = 0; i < COUNT; i++) {
+          sum += backend.getLongLittleEndian(data, i * 9 + 1);
+        }
+        Benchmarks.sink += (int) sum;
+      }
+    }, seconds);
+    final byte[] output = new byte[data.length];
+    double write = Benchmarks.measure(new Operation() {
+      @Override void run() {
+        for (int i = 0; i < COUNT; i++) {
+          backend.putLongLittleEndian(output, i * 9 + 1, i);
+        }
+        Benchmarks.sink += output[output.length - 1];
+      }
+    }, seconds);
+    System.out.println(String.format(
+        "%-9s     read %7.2f ns/value  write %7.2f ns/value",
+        backend.name(), read / COUNT, write / COUNT));
+  }
+}
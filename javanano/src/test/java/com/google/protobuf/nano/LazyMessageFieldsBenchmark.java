@@ -0,0 +1,141 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2013 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+package com.google.protobuf.nano;
+
+import com.google.protobuf.nano.Benchmarks.Operation;
+import com.google.protobuf.nano.UnittestRecursiveNano.RecursiveMessageNano;
+
+import java.io.IOException;
+
+/**
+ * Measures parsing a message whose top-level field is read while a large
+ * sub-message is not, with the code generated with lazy_message_fields=all
+ * against the eager code, then parsing and writing the message back, and
+ * parsing it and reading all of it, which lazy fields make slower. It is not
+ * run by the tests; after {@code mvn test-compile}, run
+ *
+ * <pre>
+ * java -cp target/classes:target/test-classes \
+ *     com.google.protobuf.nano.LazyMessageFieldsBenchmark [seconds]
+ * </pre>
+ *
+ * where seconds is the minimum time spent on each measurement (default 1).
+ */
+public class LazyMessageFieldsBenchmark {
+
+  public static void main(String[] args) throws Exception {
+    double seconds = args.length > 0 ? Double.parseDouble(args[0]) : 1;
+
+    // Small messages four to a level, six levels deep, under the root.
+    RecursiveMessageNano root = new RecursiveMessageNano();
+    root.id = 1;
+    root.optionalRecursiveMessageNano = newTree(6);
+    final byte[] data = MessageNano.toByteArray(root);
+
+    double eagerTop = Benchmarks.measure(new Operation() {
+      @Override void run() throws IOException {
+        Benchmarks.sink += RecursiveMessageNano.parseFrom(data).id;
+      }
+    }, seconds);
+    double lazyTop = Benchmarks.measure(new Operation() {
+      @Override void run() throws IOException {
+        Benchmarks.sink += RecursiveLazy.RecursiveMessageNano.parseFrom(data).id;
+      }
+    }, seconds);
+    report("read top", data.length, eagerTop, lazyTop);
+
+    double eagerCopy = Benchmarks.measure(new Operation() {
+      @Override void run() throws IOException {
+        Benchmarks.sink += MessageNano.toByteArray(
+            RecursiveMessageNano.parseFrom(data)).length;
+      }
+    }, seconds);
+    double lazyCopy = Benchmarks.measure(new Operation() {
+      @Override void run() throws IOException {
+        Benchmarks.sink += MessageNano.toByteArray(
+            RecursiveLazy.RecursiveMessageNano.parseFrom(data)).length;
+      }
+    }, seconds);
+    report("rewrite", data.length, eagerCopy, lazyCopy);
+
+    double eagerAll = Benchmarks.measure(new Operation() {
+      @Override void run() throws IOException {
+        Benchmarks.sink += sumIds(RecursiveMessageNano.parseFrom(data));
+      }
+    }, seconds);
+    double lazyAll = Benchmarks.measure(new Operation() {
+      @Override void run() throws IOException {
+        Benchmarks.sink += sumIds(RecursiveLazy.RecursiveMessageNano.parseFrom(data));
+      }
+    }, seconds);
+    report("read all", data.length, eagerAll, lazyAll);
+  }
+
+  private static RecursiveMessageNano newTree(int depth) {
+    RecursiveMessageNano node = new RecursiveMessageNano();
+    node.id = depth;
+    if (depth > 1) {
+      node.repeatedRecursiveMessageNano = new RecursiveMessageNano[4];
+      for (int i = 0; i < 4; i++) {
+        node.repeatedRecursiveMessageNano[i] = newTree(depth - 1);
+      }
+    }
+    return node;
+  }
+
+  private static int sumIds(RecursiveMessageNano node) {
+    int sum = node.id;
+    if (node.optionalRecursiveMessageNano != null) {
+      sum += sumIds(node.optionalRecursiveMessageNano);
+    }
+    for (RecursiveMessageNano child : node.repeatedRecursiveMessageNano) {
+      sum += sumIds(child);
+    }
+    return sum;
+  }
+
+  private static int sumIds(RecursiveLazy.RecursiveMessageNano node) {
+    int sum = node.id;
+    if (node.hasOptionalRecursiveMessageNano()) {
+      sum += sumIds(node.getOptionalRecursiveMessageNano());
+    }
+    for (RecursiveLazy.RecursiveMessageNano child : node.repeatedRecursiveMessageNano) {
+      sum += sumIds(child);
+    }
+    return sum;
+  }
+
+  private static void report(String name, int bytes, double eager, double lazy) {
+    System.out.println(String.format(
+        "%-9s %7d bytes  eager %9.2f us/op  lazy %9.2f us/op",
+        name, bytes, eager / 1e3, lazy / 1e3));
+  }
+}
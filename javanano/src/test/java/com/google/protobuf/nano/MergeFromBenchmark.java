@@ -0,0 +1,125 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2013 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+package com.google.protobuf.nano;
+
+import com.google.protobuf.nano.Benchmarks.Operation;
+import com.google.protobuf.nano.NanoOuterClass.TestAllTypesNano;
+
+import java.io.ByteArrayOutputStream;
+import java.io.IOException;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.Collections;
+import java.util.List;
+import java.util.Random;
+
+/**
+ * Measures the generated mergeFrom() of TestAllTypesNano on differently
+ * shaped inputs, with dense field dispatch and with the plain tag switch.
+ * It is not run by the tests; after {@code mvn test-compile}, run
+ *
+ * <pre>
+ * java -cp target/classes:target/test-classes \
+ *     com.google.protobuf.nano.MergeFromBenchmark [seconds]
+ * </pre>
+ *
+ * where seconds is the minimum time spent on each measurement (default 1).
+ */
+public class MergeFromBenchmark {
+
+  public static void main(String[] args) throws Exception {
+    double seconds = args.length > 0 ? Double.parseDouble(args[0]) : 1;
+
+    // Fields in order of their numbers, as serialized, hit the expected tag
+    // after each field; shuffled, each tag goes through the switch. That is
+    // on the dense field indexes by default, and on the sparse tags in
+    // NanoSwitchDispatch, generated with field_dispatch=switch.
+    byte[] inOrder = MessageNano.toByteArray(Benchmarks.newTestAllTypes());
+    byte[] shuffled = shuffleFields(inOrder, new Random(42));
+    report("in order", "dense", inOrder, false, seconds);
+    report("in order", "switch", inOrder, true, seconds);
+    report("shuffled", "dense", shuffled, false, seconds);
+    report("shuffled", "switch", shuffled, true, seconds);
+  }
+
+  private static void report(String input, String dispatch, final byte[] data,
+      boolean tagSwitch, double seconds) throws IOException {
+    Operation operation;
+    if (tagSwitch) {
+      operation = new Operation() {
+        @Override void run() throws IOException {
+          Benchmarks.sink += NanoSwitchDispatch.TestAllTypesNano
+              .parseFrom(data).optionalInt32;
+        }
+      };
+    } else {
+      operation = new Operation() {
+        @Override void run() throws IOException {
+          Benchmarks.sink += TestAllTypesNano.parseFrom(data).optionalInt32;
+        }
+      };
+    }
+    double nanos = Benchmarks.measure(operation, seconds);
+    System.out.println(String.format(
+        "%-10s %-8s %6d bytes %9.1f ns/op %7.1f MB/s",
+        input, dispatch, data.length, nanos, data.length * 1e3 / nanos));
+  }
+
+  /**
+   * Returns the serialized message with its fields in random order. The
+   * consecutive values of a repeated field stay together.
+   */
+  static byte[] shuffleFields(byte[] data, Random random) throws IOException {
+    CodedInputByteBufferNano input = CodedInputByteBufferNano.newInstance(data);
+    List<byte[]> fields = new ArrayList<byte[]>();
+    int start = 0;
+    int previousTag = 0;
+    while (true) {
+      int position = input.getPosition();
+      int tag = input.readTag();
+      if (tag != previousTag && position > start) {
+        fields.add(Arrays.copyOfRange(data, start, position));
+        start = position;
+      }
+      if (tag == 0) {
+        break;
+      }
+      input.skipField(tag);
+      previousTag = tag;
+    }
+    Collections.shuffle(fields, random);
+    ByteArrayOutputStream shuffled = new ByteArrayOutputStream(data.length);
+    for (byte[] field : fields) {
+      shuffled.write(field);
+    }
+    return shuffled.toByteArray();
+  }
+}
@@ -43,6 +43,7 @@ import com.google.protobuf.nano.UnittestRecursiveNano.RecursiveMessageNano;
 import com.google.protobuf.nano.NanoReferenceTypesCompat;
 import com.google.protobuf.nano.UnittestSimpleNano.SimpleMessageNano;
 import com.google.protobuf.nano.UnittestSingleNano.SingleMessageNano;
+import com.google.protobuf.nano.UnittestSplitMethodsNano.SplitTreeNano;
 import com.google.protobuf.nano.testext.nano.Extensions;
 import com.google.protobuf.nano.testext.nano.Extensions.AnotherMessage;
 import com.google.protobuf.nano.testext.nano.Extensions.MessageWithGroup;
@@ -50,6 +51,9 @@ import com.google.protobuf.nano.testimport.nano.UnittestImportNano;
 
 import junit.framework.TestCase;
 
+import java.io.DataInputStream;
+import java.io.IOException;
+import java.nio.ByteBuffer;
 import java.util.Arrays;
 import java.util.HashMap;
 import java.util.Map;
@@ -4093,6 +4097,43 @@ public class NanoTest extends TestCase {
     assertTrue(Arrays.equals(new boolean[] {false, true, false, true}, nonPacked.bools));
   }
 
+  public void testProto3RepeatedFieldsNotDeclaredPacked() throws Exception {
+    // As protobuf-java writes them: proto3 packs repeated scalars and enums
+    // by default.
+    byte[] javaSerialized = new byte[] {
+        0x0A, 3, 1, (byte) 0xAC, 2,
+        0x12, 8, 5, 0, 0, 0, 0, 0, 0, 0,
+        0x1A, 1, 1,
+        0x22, 1, 1,
+    };
+    UnittestProto3Nano.TestRepeatedProto3Nano msg =
+        UnittestProto3Nano.TestRepeatedProto3Nano.parseFrom(javaSerialized);
+    assertTrue(Arrays.equals(new int[] {1, 300}, msg.int32S));
+    assertTrue(Arrays.equals(new long[] {5}, msg.fixed64S));
+    assertTrue(Arrays.equals(
+        new int[] {UnittestProto3Nano.TestRepeatedProto3Nano.ONE}, msg.enums));
+    assertTrue(Arrays.equals(new int[] {-1}, msg.packedSint32S));
+
+    // Nano writes the fields not declared [packed = true] unpacked, each value
+    // with the tag of its own wire type.
+    byte[] nanoSerialized = new byte[] {
+        0x08, 1,
+        0x08, (byte) 0xAC, 2,
+        0x11, 5, 0, 0, 0, 0, 0, 0, 0,
+        0x18, 1,
+        0x22, 1, 1,
+    };
+    assertEquals(nanoSerialized.length, msg.getSerializedSize());
+    assertTrue(Arrays.equals(nanoSerialized, MessageNano.toByteArray(msg)));
+    UnittestProto3Reverse.TestRepeatedProto3Nano reverse =
+        UnittestProto3Reverse.TestRepeatedProto3Nano.parseFrom(javaSerialized);
+    assertTrue(Arrays.equals(nanoSerialized, MessageNano.toByteArrayReverse(reverse)));
+
+    // Which parses back to the same message, as it would in protobuf-java.
+    assertEquals(msg,
+        UnittestProto3Nano.TestRepeatedProto3Nano.parseFrom(nanoSerialized));
+  }
+
   public void testMapsSerializeAndParse() throws Exception {
     TestMap origin = new TestMap();
     setMapMessage(origin);
@@ -4412,6 +4453,1593 @@ public class NanoTest extends TestCase {
     assertNotNull(proto.repeatedString);
   }
 
+  public void testSplitMethodsRoundTrip() throws Exception {
+    TestAllTypesNano msg = new TestAllTypesNano();
+    msg.optionalInt32 = 123;
+    msg.optionalString = "abc";
+    msg.optionalNestedMessage = new TestAllTypesNano.NestedMessage();
+    msg.optionalNestedMessage.bb = 5;
+    msg.optionalNestedEnum = TestAllTypesNano.BAR;
+    msg.repeatedInt32 = new int[] { 1, 2, 3 };
+    msg.repeatedSint64 = new long[] { -4, 5 };
+    msg.repeatedString = new String[] { "x", "y" };
+    msg.repeatedNestedEnum = new int[] { TestAllTypesNano.FOO, TestAllTypesNano.BAZ };
+    msg.repeatedPackedInt32 = new int[] { 7, 8 };
+    msg.defaultInt32 = 99;
+    msg.defaultBytes = new byte[] { 1, 2 };
+    msg.setOneofString("oneof");
+    byte[] bytes = MessageNano.toByteArray(msg);
+
+    // The methods generated with max_method_size read and write the same
+    // bytes.
+    NanoSplitMethods.TestAllTypesNano split =
+        NanoSplitMethods.TestAllTypesNano.parseFrom(bytes);
+    assertEquals(123, split.optionalInt32);
+    assertEquals("abc", split.optionalString);
+    assertEquals(5, split.optionalNestedMessage.bb);
+    assertEquals(NanoSplitMethods.TestAllTypesNano.BAR, split.optionalNestedEnum);
+    assertTrue(Arrays.equals(new int[] { 1, 2, 3 }, split.repeatedInt32));
+    assertTrue(Arrays.equals(new long[] { -4, 5 }, split.repeatedSint64));
+    assertTrue(Arrays.equals(new String[] { "x", "y" }, split.repeatedString));
+    assertTrue(Arrays.equals(new int[] { 7, 8 }, split.repeatedPackedInt32));
+    assertEquals(99, split.defaultInt32);
+    assertEquals("oneof", split.getOneofString());
+    assertEquals(bytes.length, split.getSerializedSize());
+    assertTrue(Arrays.equals(bytes, MessageNano.toByteArray(split)));
+
+    // Unknown fields, including one whose tag is negative as an int, are
+    // skipped wherever they appear.
+    byte[] unknown = new byte[] {
+        (byte) 0xc0, 0x3e, 0x01,  // field 1000, varint 1
+        (byte) 0xf8, (byte) 0xff, (byte) 0xff, (byte) 0xff, 0x0f, 0x01,
+                                  // field 536870911, varint 1
+    };
+    byte[] withUnknown = new byte[bytes.length + 2 * unknown.length];
+    System.arraycopy(unknown, 0, withUnknown, 0, unknown.length);
+    System.arraycopy(bytes, 0, withUnknown, unknown.length, bytes.length);
+    System.arraycopy(unknown, 0, withUnknown, unknown.length + bytes.length,
+        unknown.length);
+    split = NanoSplitMethods.TestAllTypesNano.parseFrom(withUnknown);
+    assertTrue(Arrays.equals(bytes, MessageNano.toByteArray(split)));
+  }
+
+  public void testSplitMethodsMapRoundTrip() throws Exception {
+    TestMap origin = new TestMap();
+    setMapMessage(origin);
+    MapTestSplitMethods.TestMap split =
+        MapTestSplitMethods.TestMap.parseFrom(MessageNano.toByteArray(origin));
+    TestMap copy = TestMap.parseFrom(MessageNano.toByteArray(split));
+    assertMapMessageSet(copy);
+  }
+
+  public void testUsedFieldsManifest() throws Exception {
+    TestAllTypesNano msg = new TestAllTypesNano();
+    msg.optionalInt32 = 1;
+    msg.optionalInt64 = 2;
+    msg.optionalString = "used";
+    msg.optionalBytes = new byte[] { 3 };
+    msg.optionalNestedMessage = new TestAllTypesNano.NestedMessage();
+    msg.optionalNestedMessage.bb = 4;
+    msg.repeatedString = new String[] { "unused" };
+    msg.repeatedPackedInt32 = new int[] { 5, 6 };
+    msg.setOneofUint32(7);
+    byte[] bytes = MessageNano.toByteArray(msg);
+
+    NanoUsedFields.TestAllTypesNano used =
+        NanoUsedFields.TestAllTypesNano.parseFrom(bytes);
+    assertEquals(1, used.optionalInt32);
+    assertEquals("used", used.optionalString);
+    assertEquals(4, used.optionalNestedMessage.bb);
+    assertTrue(Arrays.equals(new int[] { 5, 6 }, used.repeatedPackedInt32));
+    assertEquals(7, used.getOneofUint32());
+
+    // Fields missing from the manifest have no members...
+    Class<?> usedClass = NanoUsedFields.TestAllTypesNano.class;
+    for (String field : new String[] {
+        "optionalInt64", "optionalBytes", "repeatedString", "defaultInt32" }) {
+      try {
+        usedClass.getField(field);
+        fail("Unused field " + field + " was generated");
+      } catch (NoSuchFieldException expected) {
+      }
+    }
+    try {
+      usedClass.getMethod("getOneofString");
+      fail("Unused oneof field oneofString was generated");
+    } catch (NoSuchMethodException expected) {
+    }
+
+    // ...but are kept as unknown fields and written back out.
+    assertEquals(msg, TestAllTypesNano.parseFrom(MessageNano.toByteArray(used)));
+  }
+
+  public void testMergeFromFieldsOutOfOrder() throws Exception {
+    // mergeFrom() expects the fields in order of their numbers; fields in
+    // any other order are parsed the same.
+    TestAllTypesNano first = new TestAllTypesNano();
+    first.optionalInt32 = 1;
+    first.repeatedInt32 = new int[] { 4 };
+    TestAllTypesNano second = new TestAllTypesNano();
+    second.optionalInt64 = 2;
+    second.optionalString = "3";
+    second.repeatedInt32 = new int[] { 5 };
+    second.repeatedPackedInt32 = new int[] { 6 };
+    byte[] firstBytes = MessageNano.toByteArray(first);
+    byte[] secondBytes = MessageNano.toByteArray(second);
+    byte[] reversed = new byte[firstBytes.length + secondBytes.length];
+    System.arraycopy(secondBytes, 0, reversed, 0, secondBytes.length);
+    System.arraycopy(firstBytes, 0, reversed, secondBytes.length, firstBytes.length);
+
+    TestAllTypesNano parsed = TestAllTypesNano.parseFrom(reversed);
+    assertEquals(1, parsed.optionalInt32);
+    assertEquals(2, parsed.optionalInt64);
+    assertEquals("3", parsed.optionalString);
+    assertTrue(Arrays.equals(new int[] { 5, 4 }, parsed.repeatedInt32));
+    assertTrue(Arrays.equals(new int[] { 6 }, parsed.repeatedPackedInt32));
+  }
+
+  public void testMergeFromDenseFieldDispatch() throws Exception {
+    // TestAllTypesNano switches on dense field indexes, NanoSwitchDispatch on
+    // tags. Both skip unknown field numbers, small and large, and known field
+    // numbers with the wrong wire type.
+    byte[] bytes = new byte[64];
+    CodedOutputByteBufferNano output = CodedOutputByteBufferNano.newInstance(bytes);
+    output.writeString(14, "abc");
+    output.writeInt32(17, 7);
+    output.writeInt32(5000, 8);
+    output.writeString(1, "not an int32");
+    output.writeInt32(2, 9);
+    output.writeInt32(31, 10);
+    output.writeInt32(31, 11);
+    output.writeInt32(1, 12);
+    bytes = Arrays.copyOf(bytes, output.position());
+
+    TestAllTypesNano parsed = TestAllTypesNano.parseFrom(bytes);
+    assertEquals("abc", parsed.optionalString);
+    assertEquals(9, parsed.optionalInt64);
+    assertTrue(Arrays.equals(new int[] { 10, 11 }, parsed.repeatedInt32));
+    assertEquals(12, parsed.optionalInt32);
+
+    NanoSwitchDispatch.TestAllTypesNano parsedBySwitch =
+        NanoSwitchDispatch.TestAllTypesNano.parseFrom(bytes);
+    assertTrue(Arrays.equals(MessageNano.toByteArray(parsedBySwitch),
+        MessageNano.toByteArray(parsed)));
+  }
+
+  public void testSinglePassRepeatedFields() throws Exception {
+    TestAllTypesNano msg = new TestAllTypesNano();
+    msg.repeatedInt32 = new int[40];
+    for (int i = 0; i < msg.repeatedInt32.length; i++) {
+      msg.repeatedInt32[i] = i * 1000;
+    }
+    msg.repeatedDouble = new double[] { 0.5, -2 };
+    msg.repeatedBool = new boolean[] { true, false, true };
+    msg.repeatedString = new String[] { "a", "", "bc" };
+    msg.repeatedBytes = new byte[][] { { 1 }, {} };
+    msg.repeatedGroup = new TestAllTypesNano.RepeatedGroup[20];
+    msg.repeatedNestedMessage = new TestAllTypesNano.NestedMessage[20];
+    for (int i = 0; i < 20; i++) {
+      msg.repeatedGroup[i] = new TestAllTypesNano.RepeatedGroup();
+      msg.repeatedGroup[i].a = i;
+      msg.repeatedNestedMessage[i] = new TestAllTypesNano.NestedMessage();
+      msg.repeatedNestedMessage[i].bb = -i;
+    }
+    msg.repeatedNestedEnum = new int[] { TestAllTypesNano.FOO, TestAllTypesNano.BAZ };
+    byte[] bytes = MessageNano.toByteArray(msg);
+
+    // NanoSinglePass parses the same fields, and appends to existing values.
+    NanoSinglePass.TestAllTypesNano singlePass =
+        NanoSinglePass.TestAllTypesNano.parseFrom(bytes);
+    assertTrue(Arrays.equals(bytes, MessageNano.toByteArray(singlePass)));
+    MessageNano.mergeFrom(singlePass, bytes);
+    MessageNano.mergeFrom(msg, bytes);
+    assertTrue(Arrays.equals(MessageNano.toByteArray(msg),
+        MessageNano.toByteArray(singlePass)));
+    assertEquals(80, singlePass.repeatedInt32.length);
+    assertEquals(39000, singlePass.repeatedInt32[79]);
+    assertEquals(-19, singlePass.repeatedNestedMessage[39].bb);
+
+    // Invalid enum values are dropped.
+    bytes = new byte[16];
+    CodedOutputByteBufferNano output = CodedOutputByteBufferNano.newInstance(bytes);
+    output.writeInt32(51, TestAllTypesNano.BAR);
+    output.writeInt32(51, 4);
+    output.writeInt32(51, TestAllTypesNano.FOO);
+    output.writeInt32(51, 5);
+    bytes = Arrays.copyOf(bytes, output.position());
+    singlePass = NanoSinglePass.TestAllTypesNano.parseFrom(bytes);
+    assertTrue(Arrays.equals(new int[] { TestAllTypesNano.BAR, TestAllTypesNano.FOO },
+        singlePass.repeatedNestedEnum));
+  }
+
+  public void testSinglePassNestedRepeatedMessages() throws Exception {
+    // The repeated fields of the nested messages are parsed while those of
+    // the outer ones are, so they cannot share scratch arrays.
+    RecursiveMessageNano root = new RecursiveMessageNano();
+    root.repeatedRecursiveMessageNano = new RecursiveMessageNano[3];
+    for (int i = 0; i < 3; i++) {
+      RecursiveMessageNano child = new RecursiveMessageNano();
+      child.id = i;
+      child.repeatedRecursiveMessageNano = new RecursiveMessageNano[i + 1];
+      for (int j = 0; j <= i; j++) {
+        child.repeatedRecursiveMessageNano[j] = new RecursiveMessageNano();
+        child.repeatedRecursiveMessageNano[j].id = 10 * i + j;
+      }
+      root.repeatedRecursiveMessageNano[i] = child;
+    }
+    byte[] bytes = MessageNano.toByteArray(root);
+
+    RecursiveSinglePass.RecursiveMessageNano parsed =
+        RecursiveSinglePass.RecursiveMessageNano.parseFrom(bytes);
+    assertEquals(3, parsed.repeatedRecursiveMessageNano.length);
+    assertEquals(3, parsed.repeatedRecursiveMessageNano[2].repeatedRecursiveMessageNano.length);
+    assertEquals(21, parsed.repeatedRecursiveMessageNano[2].repeatedRecursiveMessageNano[1].id);
+    assertTrue(Arrays.equals(bytes, MessageNano.toByteArray(parsed)));
+
+    // Both forms of packable fields are still accepted.
+    NanoRepeatedPackables.Packed packed = new NanoRepeatedPackables.Packed();
+    packed.int32S = new int[] { 1, 2, 3 };
+    packed.doubles = new double[] { 4, 5 };
+    packed.enums = new int[] { NanoRepeatedPackables.Enum.OPTION_TWO };
+    byte[] packedBytes = MessageNano.toByteArray(packed);
+    NanoRepeatedPackablesSinglePass.NonPacked nonPacked = MessageNano.mergeFrom(
+        new NanoRepeatedPackablesSinglePass.NonPacked(), packedBytes);
+    NanoRepeatedPackablesSinglePass.Packed repacked = MessageNano.mergeFrom(
+        new NanoRepeatedPackablesSinglePass.Packed(), MessageNano.toByteArray(nonPacked));
+    assertTrue(Arrays.equals(packedBytes, MessageNano.toByteArray(repacked)));
+  }
+
+  public void testInterleavedRepeatedFields() throws Exception {
+    // Runs of one value per repeated field, alternating between the fields,
+    // so that each run appends to arrays with spare capacity.
+    byte[] bytes = new byte[4096];
+    CodedOutputByteBufferNano output = CodedOutputByteBufferNano.newInstance(bytes);
+    TestAllTypesNano expected = new TestAllTypesNano();
+    expected.repeatedInt32 = new int[100];
+    expected.repeatedString = new String[100];
+    expected.repeatedNestedMessage = new TestAllTypesNano.NestedMessage[100];
+    expected.repeatedNestedEnum = new int[50];
+    expected.repeatedPackedInt32 = new int[200];
+    for (int i = 0; i < 100; i++) {
+      TestAllTypesNano.NestedMessage nested = new TestAllTypesNano.NestedMessage();
+      nested.bb = i;
+      output.writeInt32(31, i);
+      output.writeString(44, "s" + i);
+      output.writeMessage(48, nested);
+      // Every other enum value is invalid and dropped.
+      output.writeInt32(51, i % 2 == 0 ? TestAllTypesNano.BAR : 42);
+      output.writeTag(87, WireFormatNano.WIRETYPE_LENGTH_DELIMITED);
+      output.writeRawVarint32(
+          CodedOutputByteBufferNano.computeInt32SizeNoTag(i)
+          + CodedOutputByteBufferNano.computeInt32SizeNoTag(-i));
+      output.writeInt32NoTag(i);
+      output.writeInt32NoTag(-i);
+      expected.repeatedInt32[i] = i;
+      expected.repeatedString[i] = "s" + i;
+      expected.repeatedNestedMessage[i] = nested;
+      if (i % 2 == 0) {
+        expected.repeatedNestedEnum[i / 2] = TestAllTypesNano.BAR;
+      }
+      expected.repeatedPackedInt32[2 * i] = i;
+      expected.repeatedPackedInt32[2 * i + 1] = -i;
+    }
+    bytes = Arrays.copyOf(bytes, output.position());
+    byte[] expectedBytes = MessageNano.toByteArray(expected);
+
+    // The arrays are trimmed to the values parsed.
+    TestAllTypesNano parsed = TestAllTypesNano.parseFrom(bytes);
+    assertEquals(100, parsed.repeatedInt32.length);
+    assertEquals(100, parsed.repeatedString.length);
+    assertEquals(100, parsed.repeatedNestedMessage.length);
+    assertEquals(50, parsed.repeatedNestedEnum.length);
+    assertEquals(200, parsed.repeatedPackedInt32.length);
+    assertTrue(Arrays.equals(expectedBytes, MessageNano.toByteArray(parsed)));
+    assertTrue(Arrays.equals(expectedBytes, MessageNano.toByteArray(
+        NanoSwitchDispatch.TestAllTypesNano.parseFrom(bytes))));
+    assertTrue(Arrays.equals(expectedBytes, MessageNano.toByteArray(
+        NanoSplitMethods.TestAllTypesNano.parseFrom(bytes))));
+    assertTrue(Arrays.equals(expectedBytes, MessageNano.toByteArray(
+        NanoSinglePass.TestAllTypesNano.parseFrom(bytes))));
+    assertTrue(Arrays.equals(expectedBytes, MessageNano.toByteArray(
+        NanoTableDriven.TestAllTypesNano.parseFrom(bytes))));
+
+    // Values already in the message are kept in front.
+    NanoSplitMethods.TestAllTypesNano split = new NanoSplitMethods.TestAllTypesNano();
+    split.repeatedInt32 = new int[] { -1 };
+    MessageNano.mergeFrom(split, bytes);
+    assertEquals(101, split.repeatedInt32.length);
+    assertEquals(-1, split.repeatedInt32[0]);
+    assertEquals(99, split.repeatedInt32[100]);
+    NanoTableDriven.TestAllTypesNano table = new NanoTableDriven.TestAllTypesNano();
+    table.repeatedString = new String[] { "first" };
+    MessageNano.mergeFrom(table, bytes);
+    assertEquals(101, table.repeatedString.length);
+    assertEquals("first", table.repeatedString[0]);
+    assertEquals("s99", table.repeatedString[100]);
+    assertEquals(50, table.repeatedNestedEnum.length);
+  }
+
+  public void testMergeTrimsArraysWhenParsingFails() throws Exception {
+    // Runs of one value per repeated field, so that the arrays get spare
+    // capacity, then a string cut off inside its bytes.
+    byte[] bytes = new byte[256];
+    CodedOutputByteBufferNano output = CodedOutputByteBufferNano.newInstance(bytes);
+    TestAllTypesNano expected = new TestAllTypesNano();
+    expected.repeatedInt32 = new int[10];
+    expected.repeatedString = new String[10];
+    for (int i = 0; i < 10; i++) {
+      output.writeInt32(31, i);
+      output.writeString(44, "s" + i);
+      expected.repeatedInt32[i] = i;
+      expected.repeatedString[i] = "s" + i;
+    }
+    output.writeTag(44, WireFormatNano.WIRETYPE_LENGTH_DELIMITED);
+    output.writeRawVarint32(5);
+    output.writeRawBytes(new byte[] { 'a', 'b' });
+    bytes = Arrays.copyOf(bytes, output.position());
+    byte[] expectedBytes = MessageNano.toByteArray(expected);
+
+    // The arrays keep the values parsed before the failure, without spare
+    // slots of zeros or nulls.
+    TestAllTypesNano generated = new TestAllTypesNano();
+    try {
+      MessageNano.mergeFrom(generated, bytes);
+      fail();
+    } catch (InvalidProtocolBufferNanoException e) {
+    }
+    assertEquals(10, generated.repeatedInt32.length);
+    assertEquals(10, generated.repeatedString.length);
+    assertTrue(Arrays.equals(expectedBytes, MessageNano.toByteArray(generated)));
+
+    NanoTableDriven.TestAllTypesNano table = new NanoTableDriven.TestAllTypesNano();
+    try {
+      MessageNano.mergeFrom(table, bytes);
+      fail();
+    } catch (InvalidProtocolBufferNanoException e) {
+    }
+    assertEquals(10, table.repeatedInt32.length);
+    assertEquals(10, table.repeatedString.length);
+    assertTrue(Arrays.equals(expectedBytes, MessageNano.toByteArray(table)));
+
+    MessageNano[] others = {
+        new NanoSwitchDispatch.TestAllTypesNano(),
+        new NanoSplitMethods.TestAllTypesNano(),
+        new NanoSinglePass.TestAllTypesNano(),
+        new NanoArrayParser.TestAllTypesNano(),
+    };
+    for (MessageNano other : others) {
+      try {
+        MessageNano.mergeFrom(other, bytes);
+        fail();
+      } catch (InvalidProtocolBufferNanoException e) {
+      }
+      assertTrue(other.getClass().getName(),
+          Arrays.equals(expectedBytes, MessageNano.toByteArray(other)));
+    }
+  }
+
+  public void testSplitMethodsNestedRepeatedFields() throws Exception {
+    // Each level parses its children while its own repeated fields are
+    // partly merged, so the levels share the lengths kept by the input, and
+    // the deeper ones make it grow.
+    SplitTreeNano expected = new SplitTreeNano();
+    byte[] bytes = writeSplitTree(0, 3, expected);
+    SplitTreeNano parsed = SplitTreeNano.parseFrom(bytes);
+    assertSplitTreeCounts(expected, parsed);
+    assertTrue(Arrays.equals(MessageNano.toByteArray(expected),
+        MessageNano.toByteArray(parsed)));
+
+    // Merging again appends to every level, one after the other.
+    MessageNano.mergeFrom(parsed, bytes);
+    assertEquals(2 * expected.int32S.length, parsed.int32S.length);
+    assertEquals(2 * expected.children.length, parsed.children.length);
+    assertSplitTreeCounts(expected.children[1], parsed.children[1]);
+    assertSplitTreeCounts(expected.children[1],
+        parsed.children[expected.children.length + 1]);
+  }
+
+  /**
+   * Writes a level of a SplitTreeNano, with runs of one value per repeated
+   * field alternating with its children, and sets the same values in
+   * {@code expected}.
+   */
+  private static byte[] writeSplitTree(int depth, int count,
+      SplitTreeNano expected) throws IOException {
+    byte[] bytes = new byte[16384];
+    CodedOutputByteBufferNano output = CodedOutputByteBufferNano.newInstance(bytes);
+    expected.int32S = new int[count];
+    expected.strings = new String[count];
+    expected.sint64S = new long[count];
+    expected.children = new SplitTreeNano[depth < 2 ? count : 0];
+    for (int i = 0; i < count; i++) {
+      output.writeInt32(1, 100 * depth + i);
+      output.writeString(3, depth + "." + i);
+      if (depth < 2) {
+        expected.children[i] = new SplitTreeNano();
+        byte[] child = writeSplitTree(depth + 1, i + 1, expected.children[i]);
+        output.writeTag(9, WireFormatNano.WIRETYPE_LENGTH_DELIMITED);
+        output.writeRawVarint32(child.length);
+        output.writeRawBytes(child);
+      }
+      output.writeTag(7, WireFormatNano.WIRETYPE_LENGTH_DELIMITED);
+      output.writeRawVarint32(CodedOutputByteBufferNano.computeSInt64SizeNoTag(-i));
+      output.writeSInt64NoTag(-i);
+      expected.int32S[i] = 100 * depth + i;
+      expected.strings[i] = depth + "." + i;
+      expected.sint64S[i] = -i;
+    }
+    if (depth == 0) {
+      expected.firstChild = new SplitTreeNano();
+      byte[] child = writeSplitTree(1, count + 1, expected.firstChild);
+      output.writeTag(10, WireFormatNano.WIRETYPE_LENGTH_DELIMITED);
+      output.writeRawVarint32(child.length);
+      output.writeRawBytes(child);
+    }
+    return Arrays.copyOf(bytes, output.position());
+  }
+
+  private static void assertSplitTreeCounts(SplitTreeNano expected,
+      SplitTreeNano actual) {
+    assertTrue(Arrays.equals(expected.int32S, actual.int32S));
+    assertTrue(Arrays.equals(expected.strings, actual.strings));
+    assertTrue(Arrays.equals(expected.sint64S, actual.sint64S));
+    assertEquals(expected.children.length, actual.children.length);
+    for (int i = 0; i < expected.children.length; i++) {
+      assertSplitTreeCounts(expected.children[i], actual.children[i]);
+    }
+    if (expected.firstChild != null) {
+      assertSplitTreeCounts(expected.firstChild, actual.firstChild);
+    }
+  }
+
+  public void testCountVarints() throws Exception {
+    // Varints of one to ten bytes, so that they straddle the long words.
+    byte[] bytes = new byte[200];
+    CodedOutputByteBufferNano output = CodedOutputByteBufferNano.newInstance(bytes);
+    int[] ends = new int[30];
+    for (int i = 0; i < ends.length; i++) {
+      output.writeRawVarint64(i % 10 == 9 ? -1 : (1L << (7 * (i % 10))) - 1);
+      ends[i] = output.position();
+    }
+    for (int from = 0; from < 10; from++) {
+      for (int to = from; to < ends.length; to++) {
+        int start = from == 0 ? 0 : ends[from - 1];
+        CodedInputByteBufferNano input = CodedInputByteBufferNano.newInstance(bytes);
+        input.skipRawBytes(start);
+        assertEquals(to - from + 1, input.countVarints(ends[to] - start));
+        assertEquals(start, input.getPosition());
+      }
+    }
+    CodedInputByteBufferNano input = CodedInputByteBufferNano.newInstance(bytes, 0, 12);
+    assertEquals(0, input.countVarints(0));
+    try {
+      input.countVarints(13);
+      fail();
+    } catch (InvalidProtocolBufferNanoException expected) {
+    }
+
+    // A varint cut off at the end of a packed field, whose last byte would
+    // otherwise be read as the next tag.
+    bytes = new byte[] { (byte) 0xBA, 5, 2, 1, (byte) 0x80, 8, 5 };
+    input = CodedInputByteBufferNano.newInstance(bytes, 3, 2);
+    try {
+      input.countVarints(2);
+      fail();
+    } catch (InvalidProtocolBufferNanoException expected) {
+    }
+    try {
+      TestAllTypesNano.parseFrom(bytes);
+      fail();
+    } catch (InvalidProtocolBufferNanoException expected) {
+    }
+    try {
+      NanoArrayParser.TestAllTypesNano.parseFrom(bytes);
+      fail();
+    } catch (InvalidProtocolBufferNanoException expected) {
+    }
+    try {
+      NanoTableDriven.TestAllTypesNano.parseFrom(bytes);
+      fail();
+    } catch (InvalidProtocolBufferNanoException expected) {
+    }
+
+    // Packed bools in longer encodings than one byte, and invalid enum
+    // values, which take room in the count but are dropped.
+    bytes = new byte[32];
+    output = CodedOutputByteBufferNano.newInstance(bytes);
+    output.writeTag(13, WireFormatNano.WIRETYPE_LENGTH_DELIMITED);
+    output.writeRawVarint32(5);
+    output.writeRawVarint32(0x80);
+    output.writeRawVarint32(0);
+    output.writeRawVarint32(0x100);
+    output.writeTag(14, WireFormatNano.WIRETYPE_LENGTH_DELIMITED);
+    output.writeRawVarint32(4);
+    output.writeRawVarint32(NanoRepeatedPackables.Enum.OPTION_TWO);
+    output.writeRawVarint32(300);
+    output.writeRawVarint32(NanoRepeatedPackables.Enum.OPTION_ONE);
+    bytes = Arrays.copyOf(bytes, output.position());
+    NanoRepeatedPackables.Packed packed =
+        MessageNano.mergeFrom(new NanoRepeatedPackables.Packed(), bytes);
+    assertTrue(Arrays.equals(new boolean[] { true, false, true }, packed.bools));
+    assertTrue(Arrays.equals(new int[] {
+        NanoRepeatedPackables.Enum.OPTION_TWO, NanoRepeatedPackables.Enum.OPTION_ONE },
+        packed.enums));
+    NanoRepeatedPackablesTable.Packed table =
+        MessageNano.mergeFrom(new NanoRepeatedPackablesTable.Packed(), bytes);
+    assertTrue(Arrays.equals(packed.bools, table.bools));
+    assertTrue(Arrays.equals(packed.enums, table.enums));
+  }
+
+  public void testPackedVarintsCutOffInsideVarint() throws Exception {
+    // A packed int32 field whose payload ends on a byte with the most
+    // significant bit set, followed by optional_int32. Counting only the
+    // bytes ending a varint would size the field for one value and read the
+    // rest of the cut-off varint as the next tag.
+    byte[] bytes = new byte[32];
+    CodedOutputByteBufferNano output = CodedOutputByteBufferNano.newInstance(bytes);
+    output.writeTag(87, WireFormatNano.WIRETYPE_LENGTH_DELIMITED);
+    output.writeRawVarint32(3);
+    int payload = output.position();
+    output.writeRawBytes(new byte[] { 1, (byte) 0xAC, (byte) 0x82 });
+    output.writeInt32(1, 5);
+    bytes = Arrays.copyOf(bytes, output.position());
+
+    CodedInputByteBufferNano input = CodedInputByteBufferNano.newInstance(bytes);
+    input.skipRawBytes(payload);
+    try {
+      input.countVarints(3);
+      fail();
+    } catch (InvalidProtocolBufferNanoException expected) {
+    }
+
+    MessageNano[] messages = {
+        new TestAllTypesNano(),
+        new NanoSwitchDispatch.TestAllTypesNano(),
+        new NanoSplitMethods.TestAllTypesNano(),
+        new NanoSinglePass.TestAllTypesNano(),
+        new NanoArrayParser.TestAllTypesNano(),
+        new NanoTableDriven.TestAllTypesNano(),
+    };
+    for (MessageNano message : messages) {
+      try {
+        MessageNano.mergeFrom(message, bytes);
+        fail(message.getClass().getName());
+      } catch (InvalidProtocolBufferNanoException expected) {
+      }
+    }
+  }
+
+  public void testPackedFixedSizeLengthNotOnValueBoundary() throws Exception {
+    // repeated_packed_sfixed64 with nine bytes, and repeated_fixed32 (not
+    // declared packed) with six, each followed by optional_int32. The bytes
+    // of the partial value must not be read as the next tag.
+    byte[][] inputs = new byte[2][];
+    for (int k = 0; k < inputs.length; k++) {
+      byte[] bytes = new byte[32];
+      CodedOutputByteBufferNano output = CodedOutputByteBufferNano.newInstance(bytes);
+      int size = k == 0 ? 8 : 4;
+      output.writeTag(k == 0 ? 88 : 37, WireFormatNano.WIRETYPE_LENGTH_DELIMITED);
+      output.writeRawVarint32(size + size / 2);
+      output.writeRawBytes(new byte[size]);
+      // Half a value, which reads as optional_int32 = 5 if taken for a tag.
+      output.writeRawBytes(new byte[] { 8, 5 });
+      if (size == 8) {
+        output.writeRawBytes(new byte[] { 8, 5 });
+      }
+      output.writeInt32(1, 7);
+      inputs[k] = Arrays.copyOf(bytes, output.position());
+    }
+
+    for (byte[] bytes : inputs) {
+      // The same exception from the streaming and the array parsers, and
+      // from the other forms of mergeFrom.
+      MessageNano[] messages = {
+          new TestAllTypesNano(),
+          new NanoSwitchDispatch.TestAllTypesNano(),
+          new NanoSplitMethods.TestAllTypesNano(),
+          new NanoSinglePass.TestAllTypesNano(),
+          new NanoArrayParser.TestAllTypesNano(),
+          new NanoTableDriven.TestAllTypesNano(),
+      };
+      String expectedMessage = null;
+      for (MessageNano message : messages) {
+        try {
+          MessageNano.mergeFrom(message, bytes);
+          fail(message.getClass().getName());
+        } catch (InvalidProtocolBufferNanoException e) {
+          if (expectedMessage == null) {
+            expectedMessage = e.getMessage();
+          }
+          assertEquals(message.getClass().getName(), expectedMessage, e.getMessage());
+        }
+      }
+      try {
+        new NanoArrayParser.TestAllTypesNano().mergeFrom(
+            CodedInputByteBufferNano.newInstance(bytes));
+        fail();
+      } catch (InvalidProtocolBufferNanoException e) {
+        assertEquals(expectedMessage, e.getMessage());
+      }
+    }
+  }
+
+  public void testArrayParser() throws Exception {
+    TestAllTypesNano msg = new TestAllTypesNano();
+    msg.optionalInt32 = -1;
+    msg.optionalUint64 = -1;
+    msg.optionalSint64 = Long.MIN_VALUE;
+    msg.optionalFixed32 = 1 << 31;
+    msg.optionalSfixed64 = -5;
+    msg.optionalFloat = 1.5f;
+    msg.optionalDouble = -0.0;
+    msg.optionalBool = true;
+    msg.optionalString = "\u00e9t\u00e9";
+    msg.optionalBytes = new byte[] { 1, 2 };
+    msg.optionalGroup = new TestAllTypesNano.OptionalGroup();
+    msg.optionalGroup.a = 17;
+    msg.optionalNestedMessage = new TestAllTypesNano.NestedMessage();
+    msg.optionalNestedMessage.bb = 5;
+    // Generated without array_parser, so parsed by the fallback.
+    msg.optionalImportMessage = new UnittestImportNano.ImportMessageNano();
+    msg.optionalImportMessage.d = 20;
+    msg.optionalNestedEnum = TestAllTypesNano.BAZ;
+    msg.repeatedInt32 = new int[] { 1, -2, 300 };
+    msg.repeatedFixed64 = new long[] { 7, -8 };
+    msg.repeatedBool = new boolean[] { true, false };
+    msg.repeatedString = new String[] { "a", "" };
+    msg.repeatedBytes = new byte[][] { {}, { 3 } };
+    msg.repeatedGroup = new TestAllTypesNano.RepeatedGroup[] {
+        new TestAllTypesNano.RepeatedGroup(), new TestAllTypesNano.RepeatedGroup() };
+    msg.repeatedGroup[1].a = 47;
+    msg.repeatedNestedMessage = new TestAllTypesNano.NestedMessage[] {
+        new TestAllTypesNano.NestedMessage() };
+    msg.repeatedNestedEnum = new int[] { TestAllTypesNano.FOO, TestAllTypesNano.BAR };
+    msg.repeatedPackedInt32 = new int[] { 1, -1, 1 << 20 };
+    msg.repeatedPackedSfixed64 = new long[] { 3, 4 };
+    msg.repeatedPackedNestedEnum = new int[] { TestAllTypesNano.BAR };
+    msg.setOneofNestedMessage(new TestAllTypesNano.NestedMessage());
+    msg.getOneofNestedMessage().bb = 112;
+    byte[] bytes = MessageNano.toByteArray(msg);
+
+    NanoArrayParser.TestAllTypesNano parsed =
+        NanoArrayParser.TestAllTypesNano.parseFrom(bytes);
+    assertTrue(Arrays.equals(bytes, MessageNano.toByteArray(parsed)));
+    assertEquals("\u00e9t\u00e9", parsed.optionalString);
+    assertEquals(20, parsed.optionalImportMessage.d);
+    assertEquals(112, parsed.getOneofNestedMessage().bb);
+
+    // Merging appends to the repeated fields, in both forms of packables.
+    MessageNano.mergeFrom(parsed, bytes);
+    MessageNano.mergeFrom(msg, bytes);
+    assertTrue(Arrays.equals(MessageNano.toByteArray(msg), MessageNano.toByteArray(parsed)));
+    assertEquals(6, parsed.repeatedInt32.length);
+    assertEquals(4, parsed.repeatedGroup.length);
+    assertEquals(47, parsed.repeatedGroup[3].a);
+    NanoRepeatedPackables.Packed packed = new NanoRepeatedPackables.Packed();
+    packed.int32S = new int[] { 1, 2, 3 };
+    packed.doubles = new double[] { 4, 5 };
+    packed.enums = new int[] { NanoRepeatedPackables.Enum.OPTION_TWO };
+    byte[] packedBytes = MessageNano.toByteArray(packed);
+    NanoRepeatedPackablesArrayParser.NonPacked nonPacked = MessageNano.mergeFrom(
+        new NanoRepeatedPackablesArrayParser.NonPacked(), packedBytes);
+    NanoRepeatedPackablesArrayParser.Packed repacked = MessageNano.mergeFrom(
+        new NanoRepeatedPackablesArrayParser.Packed(), MessageNano.toByteArray(nonPacked));
+    assertTrue(Arrays.equals(packedBytes, MessageNano.toByteArray(repacked)));
+
+    // Every prefix parses or fails as with a CodedInputByteBufferNano.
+    for (int length = 0; length < bytes.length; length++) {
+      byte[] prefix = Arrays.copyOf(bytes, length);
+      byte[] expected;
+      try {
+        expected = MessageNano.toByteArray(TestAllTypesNano.parseFrom(prefix));
+      } catch (InvalidProtocolBufferNanoException e) {
+        expected = null;
+      }
+      byte[] actual;
+      try {
+        actual = MessageNano.toByteArray(NanoArrayParser.TestAllTypesNano.parseFrom(prefix));
+      } catch (InvalidProtocolBufferNanoException e) {
+        actual = null;
+      }
+      assertTrue("prefix of " + length, Arrays.equals(expected, actual));
+    }
+
+    // The values of a packed field fill its length exactly, without a partial
+    // one left over to be read as the next tag.
+    bytes = new byte[] { (byte) 0xC2, 5, 9, 1, 0, 0, 0, 0, 0, 0, 0, 0 };
+    try {
+      NanoArrayParser.TestAllTypesNano.parseFrom(bytes);
+      fail();
+    } catch (InvalidProtocolBufferNanoException expected) {
+    }
+
+    // Maps are left to the fallback.
+    TestMap map = new TestMap();
+    map.int32ToStringField = new HashMap<Integer, String>();
+    map.int32ToStringField.put(1, "one");
+    bytes = MessageNano.toByteArray(map);
+    assertTrue(Arrays.equals(bytes, MessageNano.toByteArray(
+        MessageNano.mergeFrom(new MapTestArrayParser.TestMap(), bytes))));
+  }
+
+  public void testArrayParserUnknownFields() throws Exception {
+    byte[] bytes = new byte[64];
+    CodedOutputByteBufferNano output = CodedOutputByteBufferNano.newInstance(bytes);
+    output.writeInt64(1000, -1);
+    output.writeFixed32(1001, 2);
+    output.writeFixed64(1002, 3);
+    output.writeString(1003, "unknown");
+    output.writeTag(1004, WireFormatNano.WIRETYPE_START_GROUP);
+    output.writeTag(1005, WireFormatNano.WIRETYPE_START_GROUP);
+    output.writeInt32(1, 5);
+    output.writeTag(1005, WireFormatNano.WIRETYPE_END_GROUP);
+    output.writeTag(1004, WireFormatNano.WIRETYPE_END_GROUP);
+    output.writeInt32(1, 7);
+    NanoArrayParser.TestAllTypesNano parsed = NanoArrayParser.TestAllTypesNano.parseFrom(
+        Arrays.copyOf(bytes, output.position()));
+    assertEquals(7, parsed.optionalInt32);
+
+    // An end group tag ending the message, or not matching the start group
+    // tag, is invalid.
+    output.writeTag(1006, WireFormatNano.WIRETYPE_END_GROUP);
+    try {
+      NanoArrayParser.TestAllTypesNano.parseFrom(Arrays.copyOf(bytes, output.position()));
+      fail();
+    } catch (InvalidProtocolBufferNanoException expected) {
+    }
+    output = CodedOutputByteBufferNano.newInstance(bytes);
+    output.writeTag(1004, WireFormatNano.WIRETYPE_START_GROUP);
+    output.writeTag(1005, WireFormatNano.WIRETYPE_END_GROUP);
+    try {
+      NanoArrayParser.TestAllTypesNano.parseFrom(Arrays.copyOf(bytes, output.position()));
+      fail();
+    } catch (InvalidProtocolBufferNanoException expected) {
+    }
+
+    // Messages nested deeper than the recursion limit are rejected.
+    for (int depth = 63; depth <= 65; depth++) {
+      RecursiveMessageNano root = new RecursiveMessageNano();
+      RecursiveMessageNano leaf = root;
+      for (int i = 0; i < depth; i++) {
+        leaf.optionalRecursiveMessageNano = new RecursiveMessageNano();
+        leaf = leaf.optionalRecursiveMessageNano;
+      }
+      bytes = MessageNano.toByteArray(root);
+      try {
+        RecursiveArrayParser.RecursiveMessageNano.parseFrom(bytes);
+        assertTrue(depth <= 64);
+      } catch (InvalidProtocolBufferNanoException e) {
+        assertEquals(65, depth);
+      }
+    }
+  }
+
+  public void testReverseSerializer() throws Exception {
+    TestAllTypesNano msg = new TestAllTypesNano();
+    msg.optionalInt32 = -1;
+    msg.optionalUint64 = -1;
+    msg.optionalSint64 = Long.MIN_VALUE;
+    msg.optionalFixed32 = 1 << 31;
+    msg.optionalSfixed64 = -5;
+    msg.optionalFloat = 1.5f;
+    msg.optionalDouble = -0.0;
+    msg.optionalBool = true;
+    msg.optionalString = "\u00e9t\u00e9 \ud83d\ude00";
+    msg.optionalBytes = new byte[] { 1, 2 };
+    msg.optionalGroup = new TestAllTypesNano.OptionalGroup();
+    msg.optionalGroup.a = 17;
+    msg.optionalNestedMessage = new TestAllTypesNano.NestedMessage();
+    msg.optionalNestedMessage.bb = 5;
+    // Generated without reverse_serializer, so written by the fallback.
+    msg.optionalImportMessage = new UnittestImportNano.ImportMessageNano();
+    msg.optionalImportMessage.d = 20;
+    msg.optionalNestedEnum = TestAllTypesNano.BAZ;
+    msg.repeatedInt32 = new int[] { 1, -2, 300 };
+    msg.repeatedFixed64 = new long[] { 7, -8 };
+    msg.repeatedBool = new boolean[] { true, false };
+    msg.repeatedString = new String[] { "a", "" };
+    msg.repeatedBytes = new byte[][] { {}, { 3 } };
+    msg.repeatedGroup = new TestAllTypesNano.RepeatedGroup[] {
+        new TestAllTypesNano.RepeatedGroup(), new TestAllTypesNano.RepeatedGroup() };
+    msg.repeatedGroup[1].a = 47;
+    msg.repeatedNestedMessage = new TestAllTypesNano.NestedMessage[] {
+        new TestAllTypesNano.NestedMessage(), new TestAllTypesNano.NestedMessage() };
+    msg.repeatedNestedMessage[0].bb = 1 << 30;
+    msg.repeatedNestedEnum = new int[] { TestAllTypesNano.FOO, TestAllTypesNano.BAR };
+    msg.repeatedPackedInt32 = new int[] { 1, -1, 1 << 20 };
+    msg.repeatedPackedSfixed64 = new long[] { 3, 4 };
+    msg.repeatedPackedNestedEnum = new int[] { TestAllTypesNano.BAR };
+    msg.setOneofNestedMessage(new TestAllTypesNano.NestedMessage());
+    msg.getOneofNestedMessage().bb = 112;
+    byte[] bytes = MessageNano.toByteArray(msg);
+
+    // The same bytes as writeTo(), whatever the capacity to start with.
+    NanoReverse.TestAllTypesNano reverse = NanoReverse.TestAllTypesNano.parseFrom(bytes);
+    assertTrue(Arrays.equals(bytes, MessageNano.toByteArrayReverse(reverse)));
+    ReverseCodedOutputNano output = new ReverseCodedOutputNano(0);
+    reverse.writeToReverse(output);
+    assertEquals(bytes.length, output.size());
+    assertTrue(Arrays.equals(bytes, output.toByteArray()));
+
+    // Writes go in front of what is already there.
+    output.reset();
+    NanoReverse.ForeignMessageNano foreign = new NanoReverse.ForeignMessageNano();
+    foreign.c = 3;
+    output.writeMessageNoTag(reverse);
+    output.writeTag(1, WireFormatNano.WIRETYPE_LENGTH_DELIMITED);
+    output.writeMessageNoTag(foreign);
+    output.writeTag(2, WireFormatNano.WIRETYPE_LENGTH_DELIMITED);
+    byte[] expected = new byte[bytes.length + 10];
+    CodedOutputByteBufferNano forward = CodedOutputByteBufferNano.newInstance(expected);
+    forward.writeMessage(2, foreign);
+    forward.writeMessage(1, reverse);
+    assertTrue(Arrays.equals(Arrays.copyOf(expected, forward.position()), output.toByteArray()));
+
+    // Both forms of packables, and deeply nested messages.
+    NanoRepeatedPackablesReverse.Packed packed = new NanoRepeatedPackablesReverse.Packed();
+    packed.int32S = new int[] { 1, 2, 300 };
+    packed.sint64S = new long[] { -1, Long.MAX_VALUE };
+    packed.doubles = new double[] { 4, 5 };
+    packed.enums = new int[] { NanoRepeatedPackables.Enum.OPTION_TWO };
+    bytes = MessageNano.toByteArray(packed);
+    assertTrue(Arrays.equals(bytes, MessageNano.toByteArrayReverse(packed)));
+    NanoRepeatedPackablesReverse.NonPacked nonPacked = MessageNano.mergeFrom(
+        new NanoRepeatedPackablesReverse.NonPacked(), bytes);
+    assertTrue(Arrays.equals(MessageNano.toByteArray(nonPacked),
+        MessageNano.toByteArrayReverse(nonPacked)));
+    RecursiveReverse.RecursiveMessageNano root = new RecursiveReverse.RecursiveMessageNano();
+    RecursiveReverse.RecursiveMessageNano leaf = root;
+    for (int i = 0; i < 50; i++) {
+      leaf.optionalRecursiveMessageNano = new RecursiveReverse.RecursiveMessageNano();
+      leaf = leaf.optionalRecursiveMessageNano;
+      leaf.id = i;
+    }
+    assertTrue(Arrays.equals(MessageNano.toByteArray(root), MessageNano.toByteArrayReverse(root)));
+
+    // Maps are left to the fallback.
+    MapTestReverse.TestMap map = new MapTestReverse.TestMap();
+    map.int32ToStringField = new HashMap<Integer, String>();
+    map.int32ToStringField.put(1, "one");
+    assertTrue(Arrays.equals(MessageNano.toByteArray(map), MessageNano.toByteArrayReverse(map)));
+  }
+
+  public void testMaxSerializedSizeUpperBound() throws Exception {
+    // Values at their largest: negative varints, chars taking three bytes.
+    NanoReverse.TestAllTypesNano msg = new NanoReverse.TestAllTypesNano();
+    assertTrue(msg.maxSerializedSizeUpperBound() >= msg.getSerializedSize());
+    assertTrue(Arrays.equals(MessageNano.toByteArray(msg), MessageNano.toByteArrayFast(msg)));
+    msg.optionalInt32 = -1;
+    msg.optionalInt64 = -1;
+    msg.optionalUint32 = -1;
+    msg.optionalSint64 = Long.MIN_VALUE;
+    msg.optionalDouble = -0.0;
+    msg.optionalBool = true;
+    msg.optionalString = "\u20ac\u20ac\u20ac";
+    msg.optionalBytes = new byte[] { 1, 2 };
+    msg.optionalNestedEnum = -1;
+    msg.optionalGroup = new NanoReverse.TestAllTypesNano.OptionalGroup();
+    msg.optionalGroup.a = -1;
+    msg.optionalNestedMessage = new NanoReverse.TestAllTypesNano.NestedMessage();
+    msg.optionalNestedMessage.bb = -1;
+    msg.repeatedInt32 = new int[] { -1, -2 };
+    msg.repeatedString = new String[] { "\u20ac", null, "\ud83d\ude00" };
+    msg.repeatedBytes = new byte[][] { { 3 } };
+    msg.repeatedNestedMessage = new NanoReverse.TestAllTypesNano.NestedMessage[] {
+        msg.optionalNestedMessage, null };
+    msg.repeatedNestedEnum = new int[] { -1 };
+    msg.repeatedPackedInt32 = new int[] { -1, -1 };
+    msg.repeatedPackedNestedEnum = new int[] { -1 };
+    msg.setOneofString("\u20ac");
+    byte[] bytes = MessageNano.toByteArray(msg);
+    assertTrue(msg.maxSerializedSizeUpperBound() >= bytes.length);
+    assertTrue(Arrays.equals(bytes, MessageNano.toByteArrayFast(msg)));
+
+    // Messages left to the fallback return their serialized size.
+    MapTestReverse.TestMap map = new MapTestReverse.TestMap();
+    map.int32ToStringField = new HashMap<Integer, String>();
+    map.int32ToStringField.put(1, "one");
+    bytes = MessageNano.toByteArray(map);
+    assertEquals(bytes.length, map.maxSerializedSizeUpperBound());
+    assertTrue(Arrays.equals(bytes, MessageNano.toByteArrayFast(map)));
+  }
+
+  public void testLazyMessageFields() throws Exception {
+    TestAllTypesNano msg = new TestAllTypesNano();
+    msg.optionalInt32 = 3;
+    msg.optionalNestedMessage = new TestAllTypesNano.NestedMessage();
+    msg.optionalNestedMessage.bb = 5;
+    msg.optionalForeignMessage = new NanoOuterClass.ForeignMessageNano();
+    byte[] bytes = MessageNano.toByteArray(msg);
+
+    // Unread fields are written back as they were.
+    NanoLazy.TestAllTypesNano lazy = NanoLazy.TestAllTypesNano.parseFrom(bytes);
+    assertEquals(3, lazy.optionalInt32);
+    assertTrue(lazy.hasOptionalNestedMessage());
+    assertTrue(lazy.hasOptionalForeignMessage());
+    assertFalse(lazy.hasOptionalImportMessage());
+    assertNull(lazy.getOptionalImportMessage());
+    assertTrue(Arrays.equals(bytes, MessageNano.toByteArray(lazy)));
+    assertEquals(5, lazy.getOptionalNestedMessage().bb);
+    assertSame(lazy.getOptionalNestedMessage(), lazy.getOptionalNestedMessage());
+    lazy.getOptionalNestedMessage().bb = 6;
+    assertEquals(6, TestAllTypesNano.parseFrom(MessageNano.toByteArray(lazy))
+        .optionalNestedMessage.bb);
+    assertEquals(lazy, NanoLazy.TestAllTypesNano.parseFrom(MessageNano.toByteArray(lazy)));
+    lazy.clearOptionalForeignMessage();
+    assertFalse(lazy.hasOptionalForeignMessage());
+    lazy.clear();
+    assertFalse(lazy.hasOptionalNestedMessage());
+
+    // A nested message with an unknown field, which parsing drops, and a
+    // second occurrence to merge.
+    byte[] nested = new byte[4];
+    CodedOutputByteBufferNano output = CodedOutputByteBufferNano.newInstance(nested);
+    output.writeInt32(1, 7);
+    output.writeInt32(15, 1);
+    byte[] data = new byte[20];
+    output = CodedOutputByteBufferNano.newInstance(data);
+    output.writeTag(18, WireFormatNano.WIRETYPE_LENGTH_DELIMITED);
+    output.writeRawVarint32(nested.length);
+    output.writeRawBytes(nested);
+    bytes = Arrays.copyOf(data, output.position());
+    lazy = NanoLazy.TestAllTypesNano.parseFrom(bytes);
+    assertTrue(Arrays.equals(bytes, MessageNano.toByteArray(lazy)));
+
+    // Once sized, the field is written in the form it was sized in, even if
+    // it is parsed in between, as another thread may do.
+    int size = lazy.getSerializedSize();
+    assertEquals(7, lazy.getOptionalNestedMessage().bb);
+    byte[] written = new byte[size];
+    lazy.writeTo(CodedOutputByteBufferNano.newInstance(written));
+    assertTrue(Arrays.equals(bytes, written));
+    // However many times it is written.
+    written = new byte[size];
+    lazy.writeTo(CodedOutputByteBufferNano.newInstance(written));
+    assertTrue(Arrays.equals(bytes, written));
+    assertEquals(bytes.length - 2, MessageNano.toByteArray(lazy).length);
+
+    output.writeMessage(18, msg.optionalNestedMessage);
+    lazy = NanoLazy.TestAllTypesNano.parseFrom(Arrays.copyOf(data, output.position()));
+    assertEquals(5, lazy.getOptionalNestedMessage().bb);
+
+    // Readers on several threads all get the same message.
+    final NanoLazy.TestAllTypesNano shared = NanoLazy.TestAllTypesNano.parseFrom(
+        MessageNano.toByteArray(msg));
+    final NanoLazy.TestAllTypesNano.NestedMessage[] seen =
+        new NanoLazy.TestAllTypesNano.NestedMessage[4];
+    Thread[] threads = new Thread[seen.length];
+    for (int i = 0; i < threads.length; i++) {
+      final int index = i;
+      threads[i] = new Thread() {
+        @Override public void run() {
+          seen[index] = shared.getOptionalNestedMessage();
+        }
+      };
+      threads[i].start();
+    }
+    for (int i = 0; i < threads.length; i++) {
+      threads[i].join();
+      assertSame(shared.getOptionalNestedMessage(), seen[i]);
+    }
+
+    // Malformed messages fail when read.
+    data = new byte[] { (byte) 146, 1, 2, 8, (byte) 0x80 };
+    lazy = NanoLazy.TestAllTypesNano.parseFrom(data);
+    assertTrue(Arrays.equals(data, MessageNano.toByteArray(lazy)));
+    try {
+      lazy.getOptionalNestedMessage();
+      fail();
+    } catch (IllegalStateException expected) {
+      assertTrue(expected.getCause() instanceof InvalidProtocolBufferNanoException);
+    }
+  }
+
+  public void testLazyMessageFieldsRoundTrip() throws Exception {
+    TestAllTypesNano msg = new TestAllTypesNano();
+    msg.optionalInt32 = 3;
+    msg.optionalNestedMessage = new TestAllTypesNano.NestedMessage();
+    msg.optionalNestedMessage.bb = 300;
+    msg.optionalForeignMessage = new NanoOuterClass.ForeignMessageNano();
+    msg.optionalForeignMessage.c = -1;
+    byte[] bytes = MessageNano.toByteArray(msg);
+    // The message in the middle of a larger array, so that the fields are
+    // slices at an offset.
+    byte[] padded = new byte[bytes.length + 10];
+    System.arraycopy(bytes, 0, padded, 5, bytes.length);
+
+    // Written back without being read, byte for byte.
+    NanoLazy.TestAllTypesNano lazy = MessageNano.mergeFrom(
+        new NanoLazy.TestAllTypesNano(), padded, 5, bytes.length);
+    assertEquals(bytes.length, lazy.getSerializedSize());
+    assertTrue(Arrays.equals(bytes, MessageNano.toByteArray(lazy)));
+
+    // Read and changed, then written with the change.
+    lazy.getOptionalNestedMessage().bb = 301;
+    msg.optionalNestedMessage.bb = 301;
+    byte[] changed = MessageNano.toByteArray(msg);
+    assertTrue(Arrays.equals(changed, MessageNano.toByteArray(lazy)));
+    assertEquals(-1, lazy.getOptionalForeignMessage().c);
+    assertTrue(Arrays.equals(changed, MessageNano.toByteArray(lazy)));
+
+    // A message read eagerly, by calling the getters, equals one whose fields
+    // are still unread, both ways round, with the same hash code.
+    NanoLazy.TestAllTypesNano eager = NanoLazy.TestAllTypesNano.parseFrom(bytes);
+    assertEquals(300, eager.getOptionalNestedMessage().bb);
+    assertEquals(-1, eager.getOptionalForeignMessage().c);
+    NanoLazy.TestAllTypesNano built = new NanoLazy.TestAllTypesNano();
+    built.optionalInt32 = 3;
+    built.setOptionalNestedMessage(new NanoLazy.TestAllTypesNano.NestedMessage());
+    built.getOptionalNestedMessage().bb = 300;
+    built.setOptionalForeignMessage(new NanoLazy.ForeignMessageNano());
+    built.getOptionalForeignMessage().c = -1;
+    assertTrue(Arrays.equals(bytes, MessageNano.toByteArray(built)));
+    assertEquals(eager, NanoLazy.TestAllTypesNano.parseFrom(bytes));
+    assertEquals(NanoLazy.TestAllTypesNano.parseFrom(bytes), eager);
+    assertEquals(built, NanoLazy.TestAllTypesNano.parseFrom(bytes));
+    assertEquals(NanoLazy.TestAllTypesNano.parseFrom(bytes), built);
+    assertEquals(built.hashCode(), NanoLazy.TestAllTypesNano.parseFrom(bytes).hashCode());
+    assertEquals(eager.hashCode(), built.hashCode());
+    assertFalse(lazy.equals(eager));
+    assertFalse(eager.equals(lazy));
+
+    // A clone of unread fields reads them on its own, from the same bytes.
+    NanoLazy.TestAllTypesNano unread = MessageNano.mergeFrom(
+        new NanoLazy.TestAllTypesNano(), padded, 5, bytes.length);
+    NanoLazy.TestAllTypesNano cloned = unread.clone();
+    assertTrue(Arrays.equals(bytes, MessageNano.toByteArray(cloned)));
+    cloned.getOptionalNestedMessage().bb = 301;
+    assertNotSame(cloned.getOptionalNestedMessage(), unread.getOptionalNestedMessage());
+    assertEquals(300, unread.getOptionalNestedMessage().bb);
+    assertTrue(Arrays.equals(changed, MessageNano.toByteArray(cloned)));
+    assertTrue(Arrays.equals(bytes, MessageNano.toByteArray(unread)));
+    assertEquals(lazy, cloned);
+
+    // A clone of read fields copies the messages read.
+    cloned = lazy.clone();
+    assertNotSame(lazy.getOptionalNestedMessage(), cloned.getOptionalNestedMessage());
+    assertEquals(lazy, cloned);
+    cloned.getOptionalNestedMessage().bb = 302;
+    assertEquals(301, lazy.getOptionalNestedMessage().bb);
+    assertTrue(Arrays.equals(changed, MessageNano.toByteArray(lazy)));
+    assertEquals(302, TestAllTypesNano.parseFrom(MessageNano.toByteArray(cloned))
+        .optionalNestedMessage.bb);
+  }
+
+  public void testArrayDecoderVarints() throws Exception {
+    // Each value is decoded both far from the limit and right before it,
+    // where every byte is checked.
+    long[] values = { 0, 1, 127, 128, 1 << 20, Integer.MAX_VALUE, -1, Long.MIN_VALUE,
+        1L << 35 | 5 };
+    ArrayDecoderNano decoder = new ArrayDecoderNano();
+    for (long value : values) {
+      byte[] bytes = new byte[20];
+      CodedOutputByteBufferNano output = CodedOutputByteBufferNano.newInstance(bytes);
+      output.writeRawVarint64(value);
+      int size = output.position();
+      for (int limit : new int[] { bytes.length, size }) {
+        assertEquals(size, decoder.readRawVarint64(bytes, 0, limit));
+        assertEquals(value, decoder.longValue);
+        assertEquals(size, decoder.readRawVarint32(bytes, 0, limit));
+        assertEquals((int) value, decoder.intValue);
+        if (size > 1) {
+          try {
+            decoder.readRawVarint64(bytes, 0, size - 1);
+            fail();
+          } catch (InvalidProtocolBufferNanoException expected) {
+          }
+        }
+      }
+    }
+
+    byte[] malformed = new byte[20];
+    Arrays.fill(malformed, (byte) 0x80);
+    for (int limit : new int[] { 11, 20 }) {
+      try {
+        decoder.readRawVarint32(malformed, 0, limit);
+        fail();
+      } catch (InvalidProtocolBufferNanoException expected) {
+      }
+      try {
+        decoder.readRawVarint64(malformed, 0, limit);
+        fail();
+      } catch (InvalidProtocolBufferNanoException expected) {
+      }
+    }
+  }
+
+  public void testCodedInputVarints() throws Exception {
+    // Varints of every length, and ten byte ones whose last byte holds more
+    // than the top bit, each decoded both by the fast path, far from the end
+    // of the buffer, and by the slow path, right before it.
+    byte[][] encodings = new byte[14][];
+    for (int i = 0; i < 10; i++) {
+      byte[] bytes = new byte[10];
+      CodedOutputByteBufferNano output = CodedOutputByteBufferNano.newInstance(bytes);
+      output.writeRawVarint64(i == 9 ? Long.MIN_VALUE | 3 : (1L << (7 * i)) | 1);
+      encodings[i] = Arrays.copyOf(bytes, output.position());
+    }
+    for (int i = 10; i < encodings.length; i++) {
+      encodings[i] = new byte[10];
+      Arrays.fill(encodings[i], (byte) 0xff);
+      encodings[i][9] = (byte) (i - 10);
+    }
+    for (byte[] encoding : encodings) {
+      CodedInputByteBufferNano slow = CodedInputByteBufferNano.newInstance(encoding);
+      long value = slow.readRawVarint64();
+      assertEquals(encoding.length, slow.getPosition());
+      slow = CodedInputByteBufferNano.newInstance(encoding);
+      assertEquals((int) value, slow.readRawVarint32());
+      assertEquals(encoding.length, slow.getPosition());
+
+      byte[] padded = Arrays.copyOf(encoding, encoding.length + 10);
+      CodedInputByteBufferNano fast = CodedInputByteBufferNano.newInstance(padded);
+      assertEquals(value, fast.readRawVarint64());
+      assertEquals(encoding.length, fast.getPosition());
+      fast = CodedInputByteBufferNano.newInstance(padded);
+      assertEquals((int) value, fast.readRawVarint32());
+      assertEquals(encoding.length, fast.getPosition());
+    }
+
+    // Truncated and malformed varints.
+    byte[] malformed = new byte[20];
+    Arrays.fill(malformed, (byte) 0x80);
+    for (int length : new int[] { 9, 11, 20 }) {
+      try {
+        CodedInputByteBufferNano.newInstance(malformed, 0, length).readRawVarint32();
+        fail();
+      } catch (InvalidProtocolBufferNanoException expected) {
+      }
+      try {
+        CodedInputByteBufferNano.newInstance(malformed, 0, length).readRawVarint64();
+        fail();
+      } catch (InvalidProtocolBufferNanoException expected) {
+      }
+    }
+  }
+
+  public void testByteArrayAccess() throws Exception {
+    ByteArrayAccessNano[] backends = ByteArrayAccessNano.unsafe() == null
+        ? new ByteArrayAccessNano[] { ByteArrayAccessNano.portable() }
+        : new ByteArrayAccessNano[] {
+            ByteArrayAccessNano.portable(), ByteArrayAccessNano.unsafe() };
+    byte[] expected = { 0x01, 0x23, 0x45, 0x67, (byte) 0x89, (byte) 0xab,
+        (byte) 0xcd, (byte) 0xef, 0x10 };
+    for (ByteArrayAccessNano backend : backends) {
+      // Values at odd indices too, which are unaligned for Unsafe.
+      assertEquals(0x67452301, backend.getIntLittleEndian(expected, 0));
+      assertEquals(0x89674523, backend.getIntLittleEndian(expected, 1));
+      assertEquals(0xefcdab8967452301L, backend.getLongLittleEndian(expected, 0));
+      assertEquals(0x10efcdab89674523L, backend.getLongLittleEndian(expected, 1));
+
+      byte[] bytes = new byte[9];
+      backend.putLongLittleEndian(bytes, 1, 0x10efcdab89674523L);
+      backend.putIntLittleEndian(bytes, 0, 0x67452301);
+      assertTrue(Arrays.equals(expected, bytes));
+
+      for (int index : new int[] { -1, 7, 9 }) {
+        try {
+          backend.getIntLittleEndian(expected, index);
+          fail();
+        } catch (ArrayIndexOutOfBoundsException expectedException) {
+        }
+        try {
+          backend.putLongLittleEndian(bytes, index - 4, 0);
+          fail();
+        } catch (ArrayIndexOutOfBoundsException expectedException) {
+        }
+      }
+    }
+
+    // The selected backend reads what CodedOutputByteBufferNano writes,
+    // through a wrapped array and a direct buffer, with an offset.
+    for (ByteBuffer buffer : new ByteBuffer[] {
+        ByteBuffer.wrap(new byte[20], 1, 19).slice(), ByteBuffer.allocateDirect(20) }) {
+      CodedOutputByteBufferNano output = CodedOutputByteBufferNano.newInstance(buffer);
+      output.writeRawByte(7);
+      output.writeFixed32NoTag(0x89674523);
+      output.writeDoubleNoTag(-1.5);
+      output.writeSFixed64NoTag(Long.MIN_VALUE + 1);
+      byte[] written = new byte[output.position()];
+      buffer.flip();
+      buffer.get(written);
+      CodedInputByteBufferNano input = CodedInputByteBufferNano.newInstance(written);
+      assertEquals(7, input.readRawByte());
+      assertEquals(0x89674523, input.readFixed32());
+      assertEquals(-1.5, input.readDouble());
+      assertEquals(Long.MIN_VALUE + 1, input.readSFixed64());
+      assertTrue(input.isAtEnd());
+    }
+    try {
+      CodedInputByteBufferNano.newInstance(expected, 0, 7).readRawLittleEndian64();
+      fail();
+    } catch (InvalidProtocolBufferNanoException expectedException) {
+    }
+  }
+
+  public void testCodedOutputArrayAndByteBuffer() throws Exception {
+    // Writing to a slice of an array directly and through a ByteBuffer
+    // produces the same bytes, positions and errors.
+    TestAllTypesNano msg = new TestAllTypesNano();
+    msg.optionalInt32 = 123;
+    msg.optionalInt64 = 1L << 40;
+    msg.optionalFixed32 = 77;
+    msg.optionalDouble = 3.25;
+    msg.optionalBool = true;
+    msg.optionalString = "\u00e9t\u00e9 \ud83d\ude00";
+    msg.optionalBytes = new byte[] { 1, 2, 3, 4 };
+    msg.optionalNestedMessage = new TestAllTypesNano.NestedMessage();
+    msg.optionalNestedMessage.bb = 5;
+    msg.repeatedInt64 = new long[] { 1L << 33, -1, 0 };
+    msg.repeatedPackedInt32 = new int[] { 100, 200, 300, 400 };
+    msg.repeatedString = new String[] { "", "a", "\u0981\u0981" };
+    msg.repeatedSfixed64 = new long[] { Long.MIN_VALUE, -1, 0 };
+    int size = msg.getSerializedSize();
+    byte[] expected = MessageNano.toByteArray(msg);
+
+    byte[] arrayBytes = new byte[size + 3];
+    byte[] bufferBytes = new byte[size + 3];
+    CodedOutputByteBufferNano array =
+        CodedOutputByteBufferNano.newInstance(arrayBytes, 2, size);
+    CodedOutputByteBufferNano buffer =
+        CodedOutputByteBufferNano.newInstance(ByteBuffer.wrap(bufferBytes, 2, size));
+    assertEquals(2, array.position());
+    assertEquals(2, buffer.position());
+    msg.writeTo(array);
+    msg.writeTo(buffer);
+    assertTrue(Arrays.equals(arrayBytes, bufferBytes));
+    assertTrue(Arrays.equals(expected, Arrays.copyOfRange(arrayBytes, 2, size + 2)));
+    assertEquals(size + 2, array.position());
+    assertEquals(0, array.spaceLeft());
+    array.checkNoSpaceLeft();
+
+    for (CodedOutputByteBufferNano output
+        : new CodedOutputByteBufferNano[] { array, buffer }) {
+      try {
+        output.writeRawByte(0);
+        fail();
+      } catch (CodedOutputByteBufferNano.OutOfSpaceException expectedException) {
+      }
+      // Like ByteBuffer.clear(), reset() makes the whole array writable.
+      output.reset();
+      assertEquals(0, output.position());
+      assertEquals(size + 3, output.spaceLeft());
+    }
+
+    // Running out of space part way through each kind of value.
+    for (int length = 0; length < size; length++) {
+      try {
+        msg.writeTo(CodedOutputByteBufferNano.newInstance(new byte[length]));
+        fail();
+      } catch (CodedOutputByteBufferNano.OutOfSpaceException expectedException) {
+      }
+    }
+    try {
+      CodedOutputByteBufferNano.newInstance(arrayBytes, 2, size + 2);
+      fail();
+    } catch (IndexOutOfBoundsException expectedException) {
+    }
+  }
+
+  public void testPreEncodedTags() throws Exception {
+    NanoOuterClass.TestLargeFieldNumbersNano msg =
+        new NanoOuterClass.TestLargeFieldNumbersNano();
+    msg.oneByteTag = 1;
+    msg.twoByteTag = -2;
+    msg.threeByteTag = "three";
+    msg.lastThreeByteTag = 1L << 60;
+    msg.fourByteTag = new int[] { 4, 400 };
+    msg.largeGroup = new NanoOuterClass.TestLargeFieldNumbersNano.LargeGroup();
+    msg.largeGroup.a = 5;
+    byte[] bytes = MessageNano.toByteArray(msg);
+
+    // The same fields written with the tags computed at run time.
+    byte[] expected = new byte[bytes.length];
+    CodedOutputByteBufferNano output = CodedOutputByteBufferNano.newInstance(expected);
+    output.writeInt32(15, 1);
+    output.writeInt32(2047, -2);
+    output.writeString(2048, "three");
+    output.writeFixed64(262143, 1L << 60);
+    output.writeTag(262144, WireFormatNano.WIRETYPE_LENGTH_DELIMITED);
+    output.writeRawVarint32(3);
+    output.writeInt32NoTag(4);
+    output.writeInt32NoTag(400);
+    output.writeGroup(300000, msg.largeGroup);
+    output.checkNoSpaceLeft();
+    assertTrue(Arrays.equals(expected, bytes));
+
+    NanoOuterClass.TestLargeFieldNumbersNano parsed =
+        NanoOuterClass.TestLargeFieldNumbersNano.parseFrom(bytes);
+    assertTrue(MessageNano.messageNanoEquals(msg, parsed));
+
+    // Running out of space within a tag.
+    for (int length : new int[] { 3, 14, 16 }) {
+      try {
+        msg.writeTo(CodedOutputByteBufferNano.newInstance(new byte[length]));
+        fail();
+      } catch (CodedOutputByteBufferNano.OutOfSpaceException expectedException) {
+      }
+    }
+  }
+
+  public void testPackedDataSizeCache() throws Exception {
+    TestAllTypesNano msg = new TestAllTypesNano();
+    msg.repeatedPackedInt32 = new int[] { 1, 300, -1 };
+    msg.repeatedPackedNestedEnum = new int[] { TestAllTypesNano.FOO, TestAllTypesNano.BAR };
+    TestAllTypesNano parsed = TestAllTypesNano.parseFrom(MessageNano.toByteArray(msg));
+    assertTrue(Arrays.equals(msg.repeatedPackedInt32, parsed.repeatedPackedInt32));
+    assertTrue(Arrays.equals(msg.repeatedPackedNestedEnum, parsed.repeatedPackedNestedEnum));
+
+    // toByteArray used the cached sizes, so writeTo after a change recomputes them.
+    msg.repeatedPackedInt32 = new int[] { 1 << 30, 2 };
+    msg.repeatedPackedNestedEnum = new int[] { TestAllTypesNano.BAZ };
+    byte[] buffer = new byte[64];
+    CodedOutputByteBufferNano output = CodedOutputByteBufferNano.newInstance(buffer);
+    msg.writeTo(output);
+    parsed = MessageNano.mergeFrom(new TestAllTypesNano(), buffer, 0, output.position());
+    assertTrue(Arrays.equals(msg.repeatedPackedInt32, parsed.repeatedPackedInt32));
+    assertTrue(Arrays.equals(msg.repeatedPackedNestedEnum, parsed.repeatedPackedNestedEnum));
+
+    // clear() drops the cached sizes.
+    msg.getSerializedSize();
+    msg.clear();
+    msg.repeatedPackedInt32 = new int[] { 300 };
+    output = CodedOutputByteBufferNano.newInstance(buffer);
+    msg.writeTo(output);
+    parsed = MessageNano.mergeFrom(new TestAllTypesNano(), buffer, 0, output.position());
+    assertTrue(Arrays.equals(msg.repeatedPackedInt32, parsed.repeatedPackedInt32));
+    assertEquals(0, parsed.repeatedPackedNestedEnum.length);
+
+    // mergeFrom() drops the cached sizes of the fields it appends to.
+    msg.getSerializedSize();
+    TestAllTypesNano more = new TestAllTypesNano();
+    more.repeatedPackedInt32 = new int[] { -1, 1 << 20 };
+    MessageNano.mergeFrom(msg, MessageNano.toByteArray(more));
+    output = CodedOutputByteBufferNano.newInstance(buffer);
+    msg.writeTo(output);
+    parsed = MessageNano.mergeFrom(new TestAllTypesNano(), buffer, 0, output.position());
+    assertTrue(Arrays.equals(new int[] { 300, -1, 1 << 20 }, parsed.repeatedPackedInt32));
+
+    // Packed extensions cache the size until the next setExtension.
+    Extensions.ExtendableMessage message = new Extensions.ExtendableMessage();
+    int[] int32s = { 1, 300, -1 };
+    message.setExtension(PackedExtensions.packedInt32, int32s);
+    Extensions.ExtendableMessage parsedMessage =
+        Extensions.ExtendableMessage.parseFrom(MessageNano.toByteArray(message));
+    assertTrue(Arrays.equals(int32s, parsedMessage.getExtension(PackedExtensions.packedInt32)));
+    message.getSerializedSize();
+    int32s = new int[] { 1 << 30 };
+    message.setExtension(PackedExtensions.packedInt32, int32s);
+    output = CodedOutputByteBufferNano.newInstance(buffer);
+    message.writeTo(output);
+    parsedMessage = MessageNano.mergeFrom(
+        new Extensions.ExtendableMessage(), buffer, 0, output.position());
+    assertTrue(Arrays.equals(int32s, parsedMessage.getExtension(PackedExtensions.packedInt32)));
+  }
+
+  public void testPackedDataSizeCacheAfterMerge() throws Exception {
+    TestAllTypesNano first = new TestAllTypesNano();
+    first.repeatedPackedInt32 = new int[] { 1, 300 };
+    first.repeatedPackedNestedEnum = new int[] { TestAllTypesNano.FOO };
+    byte[] firstBytes = MessageNano.toByteArray(first);
+    TestAllTypesNano more = new TestAllTypesNano();
+    more.repeatedPackedInt32 = new int[] { -1, 1 << 20 };
+    more.repeatedPackedNestedEnum = new int[] { TestAllTypesNano.BAR, TestAllTypesNano.BAZ };
+    byte[] moreBytes = MessageNano.toByteArray(more);
+
+    // The encoding protobuf-java writes for the merged values: each packed
+    // field once, with the length of all its values.
+    byte[] merged = new byte[64];
+    CodedOutputByteBufferNano output = CodedOutputByteBufferNano.newInstance(merged);
+    int[] int32s = { 1, 300, -1, 1 << 20 };
+    int[] enums = { TestAllTypesNano.FOO, TestAllTypesNano.BAR, TestAllTypesNano.BAZ };
+    output.writeTag(87, WireFormatNano.WIRETYPE_LENGTH_DELIMITED);
+    int dataSize = 0;
+    for (int value : int32s) {
+      dataSize += CodedOutputByteBufferNano.computeInt32SizeNoTag(value);
+    }
+    output.writeRawVarint32(dataSize);
+    for (int value : int32s) {
+      output.writeInt32NoTag(value);
+    }
+    output.writeTag(89, WireFormatNano.WIRETYPE_LENGTH_DELIMITED);
+    output.writeRawVarint32(enums.length);
+    for (int value : enums) {
+      output.writeInt32NoTag(value);
+    }
+    merged = Arrays.copyOf(merged, output.position());
+
+    MessageNano[] messages = {
+        new TestAllTypesNano(),
+        new NanoSwitchDispatch.TestAllTypesNano(),
+        new NanoSplitMethods.TestAllTypesNano(),
+        new NanoSinglePass.TestAllTypesNano(),
+        new NanoArrayParser.TestAllTypesNano(),
+    };
+    for (MessageNano message : messages) {
+      String name = message.getClass().getName();
+      MessageNano.mergeFrom(message, firstBytes);
+      // Sizing caches the data sizes of the packed fields for writeTo().
+      assertEquals(firstBytes.length, message.getSerializedSize());
+      assertTrue(name, Arrays.equals(firstBytes, writeWithCachedSizes(message)));
+
+      // Merged values make writeTo() size the fields again, whether through
+      // the streaming or the array parser.
+      MessageNano.mergeFrom(message, moreBytes);
+      byte[] bytes = writeWithCachedSizes(message);
+      assertTrue(name, Arrays.equals(merged, bytes));
+      assertTrue(name, Arrays.equals(int32s,
+          TestAllTypesNano.parseFrom(bytes).repeatedPackedInt32));
+      message.getSerializedSize();
+      message.mergeFrom(CodedInputByteBufferNano.newInstance(moreBytes));
+      TestAllTypesNano twice = TestAllTypesNano.parseFrom(merged);
+      MessageNano.mergeFrom(twice, moreBytes);
+      assertTrue(name, Arrays.equals(MessageNano.toByteArray(twice),
+          writeWithCachedSizes(message)));
+
+      // As does clear().
+      message.getSerializedSize();
+      message.clear();
+      MessageNano.mergeFrom(message, moreBytes);
+      assertTrue(name, Arrays.equals(moreBytes, writeWithCachedSizes(message)));
+    }
+  }
+
+  /**
+   * Writes {@code message} with writeTo() alone, which uses the sizes cached
+   * by the last getSerializedSize() where they are still valid.
+   */
+  private static byte[] writeWithCachedSizes(MessageNano message) throws IOException {
+    byte[] buffer = new byte[256];
+    CodedOutputByteBufferNano output = CodedOutputByteBufferNano.newInstance(buffer);
+    message.writeTo(output);
+    return Arrays.copyOf(buffer, output.position());
+  }
+
+  public void testTableDrivenRoundTrip() throws Exception {
+    TestAllTypesNano msg = new TestAllTypesNano();
+    msg.optionalInt32 = 123;
+    msg.optionalUint64 = -1;
+    msg.optionalSint32 = -5;
+    msg.optionalFixed64 = 1L << 40;
+    msg.optionalFloat = 1.5f;
+    msg.optionalDouble = -0.0;  // differs from the default in its bits
+    msg.optionalBool = true;
+    msg.optionalString = "abc";
+    msg.optionalBytes = new byte[] { 1, 2 };
+    msg.optionalGroup = new TestAllTypesNano.OptionalGroup();
+    msg.optionalGroup.a = 17;
+    msg.optionalNestedMessage = new TestAllTypesNano.NestedMessage();
+    msg.optionalNestedMessage.bb = 5;
+    msg.optionalNestedEnum = TestAllTypesNano.BAR;
+    msg.repeatedInt32 = new int[] { 1, -2, 3 };
+    msg.repeatedSint64 = new long[] { -4, 5 };
+    msg.repeatedDouble = new double[] { 0.5, 2 };
+    msg.repeatedBool = new boolean[] { true, false };
+    msg.repeatedString = new String[] { "x", "y" };
+    msg.repeatedBytes = new byte[][] { { 3 }, {} };
+    msg.repeatedGroup = new TestAllTypesNano.RepeatedGroup[] {
+        new TestAllTypesNano.RepeatedGroup(), new TestAllTypesNano.RepeatedGroup() };
+    msg.repeatedGroup[1].a = 47;
+    msg.repeatedNestedMessage = new TestAllTypesNano.NestedMessage[] {
+        new TestAllTypesNano.NestedMessage() };
+    msg.repeatedNestedMessage[0].bb = 8;
+    msg.repeatedNestedEnum = new int[] { TestAllTypesNano.FOO, TestAllTypesNano.BAZ };
+    msg.repeatedPackedInt32 = new int[] { 7, 8 };
+    msg.repeatedPackedSfixed64 = new long[] { -9 };
+    msg.repeatedPackedNestedEnum = new int[] { TestAllTypesNano.BAR };
+    msg.defaultInt32 = 99;
+    msg.defaultString = "";  // differs from the default "hello"
+    msg.setOneofNestedMessage(new TestAllTypesNano.NestedMessage());
+    msg.getOneofNestedMessage().bb = 6;
+    byte[] bytes = MessageNano.toByteArray(msg);
+
+    // The field tables read and write the same bytes as the unrolled code.
+    NanoTableDriven.TestAllTypesNano table =
+        NanoTableDriven.TestAllTypesNano.parseFrom(bytes);
+    assertEquals(123, table.optionalInt32);
+    assertEquals(-1, table.optionalUint64);
+    assertEquals(Double.doubleToLongBits(-0.0),
+        Double.doubleToLongBits(table.optionalDouble));
+    assertEquals("abc", table.optionalString);
+    assertTrue(Arrays.equals(new byte[] { 1, 2 }, table.optionalBytes));
+    assertEquals(17, table.optionalGroup.a);
+    assertEquals(5, table.optionalNestedMessage.bb);
+    assertEquals(NanoTableDriven.TestAllTypesNano.BAR, table.optionalNestedEnum);
+    assertTrue(Arrays.equals(new int[] { 1, -2, 3 }, table.repeatedInt32));
+    assertTrue(Arrays.equals(new String[] { "x", "y" }, table.repeatedString));
+    assertEquals(2, table.repeatedGroup.length);
+    assertEquals(47, table.repeatedGroup[1].a);
+    assertEquals(8, table.repeatedNestedMessage[0].bb);
+    assertTrue(Arrays.equals(new long[] { -9 }, table.repeatedPackedSfixed64));
+    assertEquals("", table.defaultString);
+    assertEquals(6, table.getOneofNestedMessage().bb);
+    assertEquals(bytes.length, table.getSerializedSize());
+    assertTrue(Arrays.equals(bytes, MessageNano.toByteArray(table)));
+
+    // Invalid enum values are dropped, except in oneofs.
+    TestAllTypesNano invalid = new TestAllTypesNano();
+    invalid.optionalNestedEnum = 42;
+    invalid.repeatedNestedEnum = new int[] { 42, TestAllTypesNano.BAZ };
+    invalid.repeatedPackedNestedEnum = new int[] { TestAllTypesNano.FOO, 42 };
+    invalid.setOneofEnum(42);
+    table = NanoTableDriven.TestAllTypesNano.parseFrom(
+        MessageNano.toByteArray(invalid));
+    assertEquals(NanoTableDriven.TestAllTypesNano.FOO, table.optionalNestedEnum);
+    assertTrue(Arrays.equals(new int[] { NanoTableDriven.TestAllTypesNano.BAZ },
+        table.repeatedNestedEnum));
+    assertTrue(Arrays.equals(new int[] { NanoTableDriven.TestAllTypesNano.FOO },
+        table.repeatedPackedNestedEnum));
+    assertEquals(42, table.getOneofEnum());
+
+    // Unknown fields are stored and written after the known ones.
+    byte[] unknown = new byte[] { (byte) 0xc0, 0x3e, 0x01 };  // field 1000, varint 1
+    byte[] withUnknown = new byte[bytes.length + unknown.length];
+    System.arraycopy(bytes, 0, withUnknown, 0, bytes.length);
+    System.arraycopy(unknown, 0, withUnknown, bytes.length, unknown.length);
+    table = NanoTableDriven.TestAllTypesNano.parseFrom(withUnknown);
+    assertTrue(Arrays.equals(withUnknown, MessageNano.toByteArray(table)));
+  }
+
+  public void testTableDrivenRepeatedPackables() throws Exception {
+    NanoRepeatedPackables.NonPacked nonPacked = new NanoRepeatedPackables.NonPacked();
+    nonPacked.int32S = new int[] {1000, 2, 3};
+    nonPacked.int64S = new long[] {4000, 5, 6};
+    nonPacked.uint32S = new int[] {7000, 8, 9};
+    nonPacked.uint64S = new long[] {10000, 11, 12};
+    nonPacked.sint32S = new int[] {13000, 14, 15};
+    nonPacked.sint64S = new long[] {16000, 17, 18};
+    nonPacked.fixed32S = new int[] {19, 20, 21};
+    nonPacked.fixed64S = new long[] {22, 23, 24};
+    nonPacked.sfixed32S = new int[] {25, 26, 27};
+    nonPacked.sfixed64S = new long[] {28, 29, 30};
+    nonPacked.floats = new float[] {31, 32, 33};
+    nonPacked.doubles = new double[] {34, 35, 36};
+    nonPacked.bools = new boolean[] {false, true};
+    nonPacked.enums = new int[] {
+      NanoRepeatedPackables.Enum.OPTION_ONE,
+      NanoRepeatedPackables.Enum.OPTION_TWO,
+    };
+    nonPacked.noise = 13579;
+    byte[] nonPackedSerialized = MessageNano.toByteArray(nonPacked);
+    byte[] packedSerialized = MessageNano.toByteArray(
+        MessageNano.mergeFrom(new NanoRepeatedPackables.Packed(), nonPackedSerialized));
+
+    // Both forms are accepted, and written like the unrolled code does.
+    NanoRepeatedPackablesTable.NonPacked tableNonPacked = MessageNano.mergeFrom(
+        new NanoRepeatedPackablesTable.NonPacked(), packedSerialized);
+    assertEquals(nonPackedSerialized.length, tableNonPacked.getSerializedSize());
+    assertTrue(Arrays.equals(nonPackedSerialized, MessageNano.toByteArray(tableNonPacked)));
+    NanoRepeatedPackablesTable.Packed tablePacked = MessageNano.mergeFrom(
+        new NanoRepeatedPackablesTable.Packed(), nonPackedSerialized);
+    assertEquals(packedSerialized.length, tablePacked.getSerializedSize());
+    assertTrue(Arrays.equals(packedSerialized, MessageNano.toByteArray(tablePacked)));
+  }
+
+  public void testSplitMethodsSize() throws Exception {
+    // pom.xml generates NanoSplitMethods with max_method_size=500; allow for
+    // the estimate being off by a factor of four.
+    int limit = 4 * 500;
+    Map<String, Integer> unsplit = getMethodCodeSizes(TestAllTypesNano.class);
+    assertTrue(unsplit.get("mergeFrom") > limit);
+
+    Map<String, Integer> split =
+        getMethodCodeSizes(NanoSplitMethods.TestAllTypesNano.class);
+    int helpers = 0;
+    for (Map.Entry<String, Integer> method : split.entrySet()) {
+      String name = method.getKey();
+      if (name.startsWith("mergeFrom") || name.startsWith("writeTo")
+          || name.startsWith("computeSerializedSize")) {
+        assertTrue(name + " has " + method.getValue() + " bytes of code",
+            method.getValue() <= limit);
+        if (name.contains("Field")) {
+          helpers++;
+        }
+      }
+    }
+    assertTrue(split.containsKey("mergeFrom"));
+    assertTrue(helpers > 3);
+  }
+
   private void assertRepeatedPackablesEqual(
       NanoRepeatedPackables.NonPacked nonPacked, NanoRepeatedPackables.Packed packed) {
     // Not using MessageNano.equals() -- that belongs to a separate test.
@@ -4461,6 +6089,86 @@ public class NanoTest extends TestCase {
     }
   }
 
+  /**
+   * Returns the bytecode size of the methods of the given class, read from its
+   * class file. Overloads are reported under their name with the largest size.
+   */
+  private static Map<String, Integer> getMethodCodeSizes(Class<?> clazz)
+      throws IOException {
+    String resource = clazz.getName().replace('.', '/') + ".class";
+    DataInputStream in = new DataInputStream(
+        clazz.getClassLoader().getResourceAsStream(resource));
+    try {
+      skip(in, 8);  // magic, minor and major version
+      int constantPoolCount = in.readUnsignedShort();
+      String[] utf8 = new String[constantPoolCount];
+      for (int i = 1; i < constantPoolCount; i++) {
+        int tag = in.readUnsignedByte();
+        switch (tag) {
+          case 1:  // Utf8
+            utf8[i] = in.readUTF();
+            break;
+          case 7: case 8: case 16: case 19: case 20:  // Class, String, ...
+            skip(in, 2);
+            break;
+          case 15:  // MethodHandle
+            skip(in, 3);
+            break;
+          case 3: case 4: case 9: case 10: case 11: case 12: case 17: case 18:
+            skip(in, 4);
+            break;
+          case 5: case 6:  // Long and Double take two entries
+            skip(in, 8);
+            i++;
+            break;
+          default:
+            fail("Unknown constant pool tag " + tag + " in " + resource);
+        }
+      }
+      skip(in, 6);  // access flags, this class, super class
+      skip(in, 2 * in.readUnsignedShort());  // interfaces
+      int fieldCount = in.readUnsignedShort();
+      for (int i = 0; i < fieldCount; i++) {
+        skip(in, 6);  // access flags, name, descriptor
+        int attributeCount = in.readUnsignedShort();
+        for (int j = 0; j < attributeCount; j++) {
+          skip(in, 2);
+          skip(in, in.readInt());
+        }
+      }
+      Map<String, Integer> sizes = new HashMap<String, Integer>();
+      int methodCount = in.readUnsignedShort();
+      for (int i = 0; i < methodCount; i++) {
+        skip(in, 2);  // access flags
+        String name = utf8[in.readUnsignedShort()];
+        skip(in, 2);  // descriptor
+        int attributeCount = in.readUnsignedShort();
+        for (int j = 0; j < attributeCount; j++) {
+          String attributeName = utf8[in.readUnsignedShort()];
+          int length = in.readInt();
+          if (!attributeName.equals("Code")) {
+            skip(in, length);
+            continue;
+          }
+          skip(in, 4);  // max stack, max locals
+          int codeLength = in.readInt();
+          skip(in, length - 8);
+          Integer previous = sizes.get(name);
+          if (previous == null || previous < codeLength) {
+            sizes.put(name, codeLength);
+          }
+        }
+      }
+      return sizes;
+    } finally {
+      in.close();
+    }
+  }
+
+  private static void skip(DataInputStream in, int length) throws IOException {
+    in.readFully(new byte[length]);
+  }
+
   private static String hexDump(byte[] bytes) {
     StringBuilder sb = new StringBuilder();
     for (byte b : bytes) {
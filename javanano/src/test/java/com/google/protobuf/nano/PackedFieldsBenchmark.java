@@ -0,0 +1,113 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2013 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+package com.google.protobuf.nano;
+
+import com.google.protobuf.nano.Benchmarks.Operation;
+
+import java.io.IOException;
+import java.util.Random;
+
+/**
+ * Measures counting the values of packed varint fields with
+ * CodedInputByteBufferNano.countVarints() against decoding them, which the
+ * generated code did before, and parsing whole packed fields. It is not
+ * run by the tests; after {@code mvn test-compile}, run
+ *
+ * <pre>
+ * java -cp target/classes:target/test-classes \
+ *     com.google.protobuf.nano.PackedFieldsBenchmark [seconds]
+ * </pre>
+ *
+ * where seconds is the minimum time spent on each measurement (default 1).
+ */
+public class PackedFieldsBenchmark {
+
+  private static final int COUNT = 1000;
+
+  public static void main(String[] args) throws Exception {
+    double seconds = args.length > 0 ? Double.parseDouble(args[0]) : 1;
+    Random random = new Random(1);
+
+    NanoRepeatedPackables.Packed small = new NanoRepeatedPackables.Packed();
+    small.int32S = new int[COUNT];
+    small.bools = new boolean[COUNT];
+    NanoRepeatedPackables.Packed large = new NanoRepeatedPackables.Packed();
+    large.int64S = new long[COUNT];
+    large.sint64S = new long[COUNT];
+    for (int i = 0; i < COUNT; i++) {
+      small.int32S[i] = random.nextInt(100);
+      small.bools[i] = random.nextBoolean();
+      large.int64S[i] = random.nextLong() >>> random.nextInt(64);
+      large.sint64S[i] = random.nextLong() >> random.nextInt(64);
+    }
+    report("small", MessageNano.toByteArray(small), seconds);
+    report("large", MessageNano.toByteArray(large), seconds);
+  }
+
+  private static void report(String name, final byte[] data, double seconds)
+      throws IOException {
+    double counted = Benchmarks.measure(new Operation() {
+      @Override void run() throws IOException {
+        CodedInputByteBufferNano input = CodedInputByteBufferNano.newInstance(data);
+        while (input.readTag() != 0) {
+          int length = input.readRawVarint32();
+          Benchmarks.sink += input.countVarints(length);
+          input.skipRawBytes(length);
+        }
+      }
+    }, seconds);
+    double decoded = Benchmarks.measure(new Operation() {
+      @Override void run() throws IOException {
+        CodedInputByteBufferNano input = CodedInputByteBufferNano.newInstance(data);
+        while (input.readTag() != 0) {
+          int limit = input.pushLimit(input.readRawVarint32());
+          int count = 0;
+          while (input.getBytesUntilLimit() > 0) {
+            input.readRawVarint64();
+            count++;
+          }
+          Benchmarks.sink += count;
+          input.popLimit(limit);
+        }
+      }
+    }, seconds);
+    double parsed = Benchmarks.measure(new Operation() {
+      @Override void run() throws IOException {
+        Benchmarks.sink += MessageNano.mergeFrom(
+            new NanoRepeatedPackables.Packed(), data).noise;
+      }
+    }, seconds);
+    System.out.println(String.format(
+        "%-6s %6d bytes  count %8.2f us/op  decode to count %8.2f us/op"
+        + "  parse %8.2f us/op",
+        name, data.length, counted / 1e3, decoded / 1e3, parsed / 1e3));
+  }
+}
@@ -0,0 +1,100 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2013 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+package com.google.protobuf.nano;
+
+import com.google.protobuf.nano.Benchmarks.Operation;
+import com.google.protobuf.nano.NanoOuterClass.TestAllTypesNano;
+
+import java.io.IOException;
+
+/**
+ * Measures parsing payloads made mostly of unpacked repeated fields, with
+ * the default generated code, which counts the values of each field before
+ * parsing them, and with that of NanoSinglePass, generated with
+ * single_pass_repeated_fields=true. It is not run by the tests; after
+ * {@code mvn test-compile}, run
+ *
+ * <pre>
+ * java -cp target/classes:target/test-classes \
+ *     com.google.protobuf.nano.RepeatedFieldsBenchmark [seconds]
+ * </pre>
+ *
+ * where seconds is the minimum time spent on each measurement (default 1).
+ */
+public class RepeatedFieldsBenchmark {
+
+  public static void main(String[] args) throws Exception {
+    double seconds = args.length > 0 ? Double.parseDouble(args[0]) : 1;
+
+    TestAllTypesNano messages = new TestAllTypesNano();
+    messages.repeatedNestedMessage = new TestAllTypesNano.NestedMessage[1000];
+    for (int i = 0; i < messages.repeatedNestedMessage.length; i++) {
+      messages.repeatedNestedMessage[i] = new TestAllTypesNano.NestedMessage();
+      messages.repeatedNestedMessage[i].bb = i;
+    }
+    report("messages", MessageNano.toByteArray(messages), seconds);
+
+    TestAllTypesNano groups = new TestAllTypesNano();
+    groups.repeatedGroup = new TestAllTypesNano.RepeatedGroup[1000];
+    for (int i = 0; i < groups.repeatedGroup.length; i++) {
+      groups.repeatedGroup[i] = new TestAllTypesNano.RepeatedGroup();
+      groups.repeatedGroup[i].a = i;
+    }
+    report("groups", MessageNano.toByteArray(groups), seconds);
+
+    TestAllTypesNano scalars = new TestAllTypesNano();
+    scalars.repeatedInt64 = new long[1000];
+    scalars.repeatedString = new String[1000];
+    for (int i = 0; i < 1000; i++) {
+      scalars.repeatedInt64[i] = (long) i << 20;
+      scalars.repeatedString[i] = "value " + i;
+    }
+    report("scalars", MessageNano.toByteArray(scalars), seconds);
+  }
+
+  private static void report(String name, final byte[] data, double seconds)
+      throws IOException {
+    double twoPass = Benchmarks.measure(new Operation() {
+      @Override void run() throws IOException {
+        Benchmarks.sink += TestAllTypesNano.parseFrom(data).optionalInt32;
+      }
+    }, seconds);
+    double singlePass = Benchmarks.measure(new Operation() {
+      @Override void run() throws IOException {
+        Benchmarks.sink +=
+            NanoSinglePass.TestAllTypesNano.parseFrom(data).optionalInt32;
+      }
+    }, seconds);
+    System.out.println(String.format(
+        "%-10s %7d bytes  two-pass %9.1f us/op  single-pass %9.1f us/op",
+        name, data.length, twoPass / 1e3, singlePass / 1e3));
+  }
+}
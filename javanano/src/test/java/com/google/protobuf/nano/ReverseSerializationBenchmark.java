@@ -0,0 +1,119 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2013 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+package com.google.protobuf.nano;
+
+import com.google.protobuf.nano.Benchmarks.Operation;
+import com.google.protobuf.nano.RecursiveReverse.RecursiveMessageNano;
+
+import java.io.IOException;
+
+/**
+ * Measures serializing messages generated with reverse_serializer in two
+ * passes, computing the sizes and then writing, as MessageNano.toByteArray()
+ * does, against a single pass writing back to front, as
+ * MessageNano.toByteArrayReverse() does, the same into an output allocated at
+ * maxSerializedSizeUpperBound(), as MessageNano.toByteArrayFast() does, and
+ * the same into a ReverseCodedOutputNano reused across runs. It is not run by
+ * the tests; after {@code mvn test-compile}, run
+ *
+ * <pre>
+ * java -cp target/classes:target/test-classes \
+ *     com.google.protobuf.nano.ReverseSerializationBenchmark [seconds]
+ * </pre>
+ *
+ * where seconds is the minimum time spent on each measurement (default 1).
+ */
+public class ReverseSerializationBenchmark {
+
+  public static void main(String[] args) throws Exception {
+    double seconds = args.length > 0 ? Double.parseDouble(args[0]) : 1;
+
+    report("typical", NanoReverse.TestAllTypesNano.parseFrom(
+        MessageNano.toByteArray(Benchmarks.newTestAllTypes())), seconds);
+
+    // Small messages four to a level, six levels deep.
+    report("tree", newTree(6), seconds);
+
+    RecursiveMessageNano chain = new RecursiveMessageNano();
+    RecursiveMessageNano leaf = chain;
+    for (int i = 0; i < 60; i++) {
+      leaf.optionalRecursiveMessageNano = new RecursiveMessageNano();
+      leaf = leaf.optionalRecursiveMessageNano;
+      leaf.id = i;
+    }
+    report("chain", chain, seconds);
+  }
+
+  private static RecursiveMessageNano newTree(int depth) {
+    RecursiveMessageNano node = new RecursiveMessageNano();
+    node.id = depth;
+    if (depth > 1) {
+      node.repeatedRecursiveMessageNano = new RecursiveMessageNano[4];
+      for (int i = 0; i < 4; i++) {
+        node.repeatedRecursiveMessageNano[i] = newTree(depth - 1);
+      }
+    }
+    return node;
+  }
+
+  private static void report(String name, final MessageNano msg, double seconds)
+      throws IOException {
+    double twoPass = Benchmarks.measure(new Operation() {
+      @Override void run() {
+        Benchmarks.sink += MessageNano.toByteArray(msg).length;
+      }
+    }, seconds);
+    double reverse = Benchmarks.measure(new Operation() {
+      @Override void run() {
+        Benchmarks.sink += MessageNano.toByteArrayReverse(msg).length;
+      }
+    }, seconds);
+    double fast = Benchmarks.measure(new Operation() {
+      @Override void run() {
+        Benchmarks.sink += MessageNano.toByteArrayFast(msg).length;
+      }
+    }, seconds);
+    final ReverseCodedOutputNano output = new ReverseCodedOutputNano();
+    double reused = Benchmarks.measure(new Operation() {
+      @Override void run() throws IOException {
+        output.reset();
+        msg.writeToReverse(output);
+        Benchmarks.sink += output.size();
+      }
+    }, seconds);
+    System.out.println(String.format(
+        "%-8s %7d bytes (bound %7d)  two-pass %9.2f us/op  reverse %9.2f us/op"
+            + "  upper bound %9.2f us/op  reused output %9.2f us/op",
+        name, MessageNano.toByteArray(msg).length, msg.maxSerializedSizeUpperBound(),
+        twoPass / 1e3, reverse / 1e3, fast / 1e3, reused / 1e3));
+  }
+}
@@ -0,0 +1,98 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2013 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+package com.google.protobuf.nano;
+
+import com.google.protobuf.nano.Benchmarks.Operation;
+import com.google.protobuf.nano.NanoOuterClass.TestAllTypesNano;
+
+import java.io.IOException;
+import java.nio.ByteBuffer;
+
+/**
+ * Measures serializing messages with a CodedOutputByteBufferNano writing
+ * directly to a byte array, as MessageNano.toByteArray() does, against one
+ * writing through a heap ByteBuffer wrapping the same array, as all of them
+ * did before. It is not run by the tests; after {@code mvn test-compile}, run
+ *
+ * <pre>
+ * java -cp target/classes:target/test-classes \
+ *     com.google.protobuf.nano.SerializationBenchmark [seconds]
+ * </pre>
+ *
+ * where seconds is the minimum time spent on each measurement (default 1).
+ */
+public class SerializationBenchmark {
+
+  public static void main(String[] args) throws Exception {
+    double seconds = args.length > 0 ? Double.parseDouble(args[0]) : 1;
+
+    report("typical", Benchmarks.newTestAllTypes(), seconds);
+
+    TestAllTypesNano varints = new TestAllTypesNano();
+    varints.repeatedInt32 = new int[1000];
+    varints.repeatedInt64 = new long[1000];
+    for (int i = 0; i < 1000; i++) {
+      varints.repeatedInt32[i] = i * i;
+      varints.repeatedInt64[i] = -i;
+    }
+    report("varints", varints, seconds);
+
+    TestAllTypesNano strings = new TestAllTypesNano();
+    strings.repeatedString = new String[100];
+    for (int i = 0; i < 100; i++) {
+      strings.repeatedString[i] = i % 2 == 0 ? "string number " + i : "\u00e9t\u00e9 " + i;
+    }
+    report("strings", strings, seconds);
+  }
+
+  private static void report(String name, final TestAllTypesNano msg,
+      double seconds) throws IOException {
+    final byte[] data = new byte[msg.getSerializedSize()];
+    double array = Benchmarks.measure(new Operation() {
+      @Override void run() throws IOException {
+        CodedOutputByteBufferNano output = CodedOutputByteBufferNano.newInstance(data);
+        msg.writeTo(output);
+        Benchmarks.sink += output.position();
+      }
+    }, seconds);
+    double byteBuffer = Benchmarks.measure(new Operation() {
+      @Override void run() throws IOException {
+        CodedOutputByteBufferNano output =
+            CodedOutputByteBufferNano.newInstance(ByteBuffer.wrap(data));
+        msg.writeTo(output);
+        Benchmarks.sink += output.position();
+      }
+    }, seconds);
+    System.out.println(String.format(
+        "%-8s %7d bytes  array %9.2f us/op  byte buffer %9.2f us/op",
+        name, data.length, array / 1e3, byteBuffer / 1e3));
+  }
+}
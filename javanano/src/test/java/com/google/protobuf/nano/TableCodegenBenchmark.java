@@ -0,0 +1,128 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2013 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+package com.google.protobuf.nano;
+
+import com.google.protobuf.nano.Benchmarks.Operation;
+import com.google.protobuf.nano.NanoOuterClass.TestAllTypesNano;
+
+import java.io.IOException;
+import java.io.InputStream;
+
+/**
+ * Compares the class file size and the parsing and serialization throughput
+ * of TestAllTypesNano generated with codegen_style=table (NanoTableDriven)
+ * against the default unrolled code. It is not run by the tests; after
+ * {@code mvn test-compile}, run
+ *
+ * <pre>
+ * java -cp target/classes:target/test-classes \
+ *     com.google.protobuf.nano.TableCodegenBenchmark [seconds]
+ * </pre>
+ *
+ * where seconds is the minimum time spent on each measurement (default 1).
+ */
+public class TableCodegenBenchmark {
+
+  public static void main(String[] args) throws Exception {
+    double seconds = args.length > 0 ? Double.parseDouble(args[0]) : 1;
+
+    final TestAllTypesNano unrolled = Benchmarks.newTestAllTypes();
+    final byte[] data = MessageNano.toByteArray(unrolled);
+    final NanoTableDriven.TestAllTypesNano table =
+        NanoTableDriven.TestAllTypesNano.parseFrom(data);
+
+    System.out.println("class files (bytes): unrolled "
+        + classSize(TestAllTypesNano.class) + ", table "
+        + classSize(NanoTableDriven.TestAllTypesNano.class) + " + "
+        + classSize(MessageTableNano.class) + " shared by all messages");
+    System.out.println("message: " + data.length + " bytes");
+
+    report("parse", seconds, data.length, new Operation() {
+      @Override void run() throws IOException {
+        Benchmarks.sink += TestAllTypesNano.parseFrom(data).optionalInt32;
+      }
+    }, new Operation() {
+      @Override void run() throws IOException {
+        Benchmarks.sink += NanoTableDriven.TestAllTypesNano.parseFrom(data).optionalInt32;
+      }
+    });
+    report("serialize", seconds, data.length, new Operation() {
+      @Override void run() throws IOException {
+        Benchmarks.sink += MessageNano.toByteArray(unrolled).length;
+      }
+    }, new Operation() {
+      @Override void run() throws IOException {
+        Benchmarks.sink += MessageNano.toByteArray(table).length;
+      }
+    });
+  }
+
+  private static void report(String name, double seconds, int bytes,
+      Operation unrolled, Operation table) throws IOException {
+    double unrolledNanos = Benchmarks.measure(unrolled, seconds);
+    double tableNanos = Benchmarks.measure(table, seconds);
+    System.out.println(String.format(
+        "%-10s unrolled %9.1f ns/op %7.1f MB/s   table %9.1f ns/op %7.1f MB/s",
+        name, unrolledNanos, bytes * 1e3 / unrolledNanos,
+        tableNanos, bytes * 1e3 / tableNanos));
+  }
+
+  /**
+   * Returns the size of the class file of c, its anonymous classes, such as
+   * the field accessors of table-driven messages, and its nested classes.
+   */
+  private static long classSize(Class<?> c) throws IOException {
+    String path = "/" + c.getName().replace('.', '/');
+    long size = resourceSize(c, path + ".class");
+    for (int i = 1; c.getResource(path + "$" + i + ".class") != null; i++) {
+      size += resourceSize(c, path + "$" + i + ".class");
+    }
+    for (Class<?> nested : c.getDeclaredClasses()) {
+      size += classSize(nested);
+    }
+    return size;
+  }
+
+  private static long resourceSize(Class<?> c, String name) throws IOException {
+    InputStream in = c.getResourceAsStream(name);
+    long size = 0;
+    try {
+      byte[] buffer = new byte[4096];
+      int n;
+      while ((n = in.read(buffer)) > 0) {
+        size += n;
+      }
+    } finally {
+      in.close();
+    }
+    return size;
+  }
+}
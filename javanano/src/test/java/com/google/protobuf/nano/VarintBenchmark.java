@@ -0,0 +1,155 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2013 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+package com.google.protobuf.nano;
+
+import com.google.protobuf.nano.Benchmarks.Operation;
+
+import java.io.IOException;
+import java.util.Random;
+
+/**
+ * Measures decoding varints with CodedInputByteBufferNano.readRawVarint32()
+ * and readRawVarint64(), which decode those at least ten bytes from the end
+ * of the buffer without checking it for each byte, against decoding them
+ * byte by byte with readRawByte(), as they did before. It is not run by the
+ * tests; after {@code mvn test-compile}, run
+ *
+ * <pre>
+ * java -cp target/classes:target/test-classes \
+ *     com.google.protobuf.nano.VarintBenchmark [seconds]
+ * </pre>
+ *
+ * where seconds is the minimum time spent on each measurement (default 1).
+ */
+public class VarintBenchmark {
+
+  private static final int COUNT = 1000;
+
+  public static void main(String[] args) throws Exception {
+    double seconds = args.length > 0 ? Double.parseDouble(args[0]) : 1;
+    Random random = new Random(1);
+
+    // Tags, lengths and small counts.
+    long[] small = new long[COUNT];
+    // Mostly small values, some ids and timestamps, and a few negative
+    // int32 values, which take ten bytes.
+    long[] mixed = new long[COUNT];
+    // Hashes and other values spread over all 64 bits.
+    long[] large = new long[COUNT];
+    for (int i = 0; i < COUNT; i++) {
+      small[i] = random.nextInt(128);
+      int kind = random.nextInt(100);
+      if (kind < 60) {
+        mixed[i] = random.nextInt(128);
+      } else if (kind < 85) {
+        mixed[i] = random.nextInt(1 << 14);
+      } else if (kind < 95) {
+        mixed[i] = random.nextInt() >>> 1;
+      } else if (kind < 98) {
+        mixed[i] = System.currentTimeMillis() - random.nextInt(1 << 30);
+      } else {
+        mixed[i] = -1 - random.nextInt(1000);
+      }
+      large[i] = random.nextLong();
+    }
+    report("small", small, seconds);
+    report("mixed", mixed, seconds);
+    report("large", large, seconds);
+  }
+
+  private static void report(String name, long[] values, double seconds)
+      throws IOException {
+    final byte[] data = encode(values);
+    double int32 = Benchmarks.measure(new Operation() {
+      @Override void run() throws IOException {
+        CodedInputByteBufferNano input = CodedInputByteBufferNano.newInstance(data);
+        int sum = 0;
+        for (int i = 0; i < COUNT; i++) {
+          sum += input.readRawVarint32();
+        }
+        Benchmarks.sink += sum;
+      }
+    }, seconds);
+    double int64 = Benchmarks.measure(new Operation() {
+      @Override void run() throws IOException {
+        CodedInputByteBufferNano input = CodedInputByteBufferNano.newInstance(data);
+        long sum = 0;
+        for (int i = 0; i < COUNT; i++) {
+          sum += input.readRawVarint64();
+        }
+        Benchmarks.sink += (int) sum;
+      }
+    }, seconds);
+    double bytes = Benchmarks.measure(new Operation() {
+      @Override void run() throws IOException {
+        CodedInputByteBufferNano input = CodedInputByteBufferNano.newInstance(data);
+        long sum = 0;
+        for (int i = 0; i < COUNT; i++) {
+          sum += readRawVarint64ByBytes(input);
+        }
+        Benchmarks.sink += (int) sum;
+      }
+    }, seconds);
+    System.out.println(String.format(
+        "%-6s %6d bytes  varint32 %7.1f ns/value  varint64 %7.1f ns/value"
+        + "  by bytes %7.1f ns/value",
+        name, data.length, int32 / COUNT, int64 / COUNT, bytes / COUNT));
+  }
+
+  private static byte[] encode(long[] values) throws IOException {
+    int size = 0;
+    for (long value : values) {
+      size += CodedOutputByteBufferNano.computeRawVarint64Size(value);
+    }
+    byte[] data = new byte[size];
+    CodedOutputByteBufferNano output = CodedOutputByteBufferNano.newInstance(data);
+    for (long value : values) {
+      output.writeRawVarint64(value);
+    }
+    return data;
+  }
+
+  // The decoding loop of readRawVarint64() before its fast path.
+  private static long readRawVarint64ByBytes(CodedInputByteBufferNano input)
+      throws IOException {
+    int shift = 0;
+    long result = 0;
+    while (shift < 64) {
+      final byte b = input.readRawByte();
+      result |= (long) (b & 0x7F) << shift;
+      if ((b & 0x80) == 0) {
+        return result;
+      }
+      shift += 7;
+    }
+    throw new IOException("Malformed varint");
+  }
+}
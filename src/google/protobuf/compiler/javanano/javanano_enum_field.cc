@@ -52,32 +52,41 @@ namespace {
 // TODO(kenton):  Factor out a "SetCommonFieldVariables()" to get rid of
 //   repeat code between this and the other field types.
 void SetEnumVariables(const Params& params,
-    const FieldDescriptor* descriptor, map<string, string>* variables) {
-  (*variables)["name"] =
+    const FieldDescriptor* descriptor, TemplateVariables* variables) {
+  (*variables)[JAVANANO_VAR("name")] =
     RenameJavaKeywords(UnderscoresToCamelCase(descriptor));
-  (*variables)["capitalized_name"] =
+  (*variables)[JAVANANO_VAR("capitalized_name")] =
     RenameJavaKeywords(UnderscoresToCapitalizedCamelCase(descriptor));
-  (*variables)["number"] = SimpleItoa(descriptor->number());
+  (*variables)[JAVANANO_VAR("number")] = SimpleItoa(descriptor->number());
   if (params.use_reference_types_for_primitives()
       && !params.reftypes_primitive_enums()
       && !descriptor->is_repeated()) {
-    (*variables)["type"] = "java.lang.Integer";
-    (*variables)["default"] = "null";
+    (*variables)[JAVANANO_VAR("type")] = "java.lang.Integer";
+    (*variables)[JAVANANO_VAR("default")] = "null";
   } else {
-    (*variables)["type"] = "int";
-    (*variables)["default"] = DefaultValue(params, descriptor);
+    (*variables)[JAVANANO_VAR("type")] = "int";
+    (*variables)[JAVANANO_VAR("default")] = DefaultValue(params, descriptor);
   }
-  (*variables)["repeated_default"] =
+  (*variables)[JAVANANO_VAR("repeated_default")] =
       "com.google.protobuf.nano.WireFormatNano.EMPTY_INT_ARRAY";
-  (*variables)["tag"] = SimpleItoa(internal::WireFormat::MakeTag(descriptor));
-  (*variables)["tag_size"] = SimpleItoa(
+  (*variables)[JAVANANO_VAR("tag")] =
+      SimpleItoa(internal::WireFormat::MakeTag(descriptor));
+  (*variables)[JAVANANO_VAR("write_tag")] =
+      WriteTagCall(DeclaredTag(descriptor));
+  (*variables)[JAVANANO_VAR("tag_size")] = SimpleItoa(
       internal::WireFormat::TagSize(descriptor->number(), descriptor->type()));
-  (*variables)["non_packed_tag"] = SimpleItoa(
+  (*variables)[JAVANANO_VAR("max_value_size")] =
+      SimpleItoa(MaxValueSize(FieldDescriptor::TYPE_ENUM));
+  (*variables)[JAVANANO_VAR("max_tagged_size")] = SimpleItoa(
+      internal::WireFormat::TagSize(descriptor->number(), descriptor->type())
+      + MaxValueSize(FieldDescriptor::TYPE_ENUM));
+  (*variables)[JAVANANO_VAR("non_packed_tag")] = SimpleItoa(
       internal::WireFormatLite::MakeTag(descriptor->number(),
           internal::WireFormat::WireTypeForFieldType(descriptor->type())));
-  (*variables)["message_name"] = descriptor->containing_type()->name();
+  (*variables)[JAVANANO_VAR("message_name")] =
+      descriptor->containing_type()->name();
   const EnumDescriptor* enum_type = descriptor->enum_type();
-  (*variables)["message_type_intdef"] = "@"
+  (*variables)[JAVANANO_VAR("message_type_intdef")] = "@"
       + ToJavaName(params, enum_type->name(), true,
           enum_type->containing_type(), enum_type->file());
 }
@@ -121,37 +130,37 @@ EnumFieldGenerator::~EnumFieldGenerator() {}
 void EnumFieldGenerator::
 GenerateMembers(io::Printer* printer, bool /* unused lazy_init */) const {
   if (params_.generate_intdefs()) {
-    printer->Print(variables_, "$message_type_intdef$\n");
+    JAVANANO_PRINT(printer, variables_, "$message_type_intdef$\n");
   }
-  printer->Print(variables_, "public $type$ $name$;\n");
+  JAVANANO_PRINT(printer, variables_, "public $type$ $name$;\n");
 
   if (params_.generate_has()) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "public boolean has$capitalized_name$;\n");
   }
 }
 
 void EnumFieldGenerator::
 GenerateClearCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "$name$ = $default$;\n");
 
   if (params_.generate_has()) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "has$capitalized_name$ = false;\n");
   }
 }
 
 void EnumFieldGenerator::
 GenerateMergingCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "int value = input.readInt32();\n"
     "switch (value) {\n");
   PrintCaseLabels(printer, canonical_values_);
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "    this.$name$ = value;\n");
   if (params_.generate_has()) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "    has$capitalized_name$ = true;\n");
   }
   printer->Print(
@@ -162,41 +171,88 @@ GenerateMergingCode(io::Printer* printer) const {
   // fields, because there is no way to get the value out.
 }
 
+void EnumFieldGenerator::
+GenerateArrayMergingCode(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
+    "position = decoder.readInt32(buffer, position, limit);\n"
+    "int value = decoder.intValue;\n"
+    "switch (value) {\n");
+  PrintCaseLabels(printer, canonical_values_);
+  JAVANANO_PRINT(printer, variables_,
+    "    this.$name$ = value;\n");
+  if (params_.generate_has()) {
+    JAVANANO_PRINT(printer, variables_,
+      "    has$capitalized_name$ = true;\n");
+  }
+  printer->Print(
+    "    break;\n"
+    "}\n");
+}
+
 void EnumFieldGenerator::
 GenerateSerializationCode(io::Printer* printer) const {
   if (descriptor_->is_required() && !params_.generate_has()) {
     // Always serialize a required field if we don't have the 'has' signal.
-    printer->Print(variables_,
-      "output.writeInt32($number$, this.$name$);\n");
+    JAVANANO_PRINT(printer, variables_,
+      "output.$write_tag$;\n"
+      "output.writeInt32NoTag(this.$name$);\n");
   } else {
     if (params_.generate_has()) {
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "if (this.$name$ != $default$ || has$capitalized_name$) {\n");
     } else {
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "if (this.$name$ != $default$) {\n");
     }
-    printer->Print(variables_,
-      "  output.writeInt32($number$, this.$name$);\n"
+    JAVANANO_PRINT(printer, variables_,
+      "  output.$write_tag$;\n"
+      "  output.writeInt32NoTag(this.$name$);\n"
       "}\n");
   }
 }
 
+void EnumFieldGenerator::
+GenerateReverseSerializationCode(io::Printer* printer) const {
+  if (descriptor_->is_required() && !params_.generate_has()) {
+    JAVANANO_PRINT(printer, variables_,
+      "output.writeInt32NoTag(this.$name$);\n"
+      "output.$write_tag$;\n");
+  } else {
+    if (params_.generate_has()) {
+      JAVANANO_PRINT(printer, variables_,
+        "if (this.$name$ != $default$ || has$capitalized_name$) {\n");
+    } else {
+      JAVANANO_PRINT(printer, variables_,
+        "if (this.$name$ != $default$) {\n");
+    }
+    JAVANANO_PRINT(printer, variables_,
+      "  output.writeInt32NoTag(this.$name$);\n"
+      "  output.$write_tag$;\n"
+      "}\n");
+  }
+}
+
+int EnumFieldGenerator::SerializedSizeUpperBoundConstant() const {
+  return internal::WireFormat::TagSize(descriptor_->number(),
+                                       descriptor_->type())
+      + MaxValueSize(FieldDescriptor::TYPE_ENUM);
+}
+
 void EnumFieldGenerator::
 GenerateSerializedSizeCode(io::Printer* printer) const {
   if (descriptor_->is_required() && !params_.generate_has()) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "size += com.google.protobuf.nano.CodedOutputByteBufferNano\n"
       "  .computeInt32Size($number$, this.$name$);\n");
   } else {
     if (params_.generate_has()) {
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "if (this.$name$ != $default$ || has$capitalized_name$) {\n");
     } else {
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "if (this.$name$ != $default$) {\n");
     }
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "  size += com.google.protobuf.nano.CodedOutputByteBufferNano\n"
       "    .computeInt32Size($number$, this.$name$);\n"
       "}\n");
@@ -206,7 +262,7 @@ GenerateSerializedSizeCode(io::Printer* printer) const {
 void EnumFieldGenerator::GenerateEqualsCode(io::Printer* printer) const {
   if (params_.use_reference_types_for_primitives()
         && !params_.reftypes_primitive_enums()) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "if (this.$name$ == null) {\n"
       "  if (other.$name$ != null) {\n"
       "    return false;\n"
@@ -219,10 +275,10 @@ void EnumFieldGenerator::GenerateEqualsCode(io::Printer* printer) const {
     // then if the field value equals the default value in both messages,
     // but one's 'has' field is set and the other's is not, the serialized
     // forms are different and we should return false.
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "if (this.$name$ != other.$name$");
     if (params_.generate_has()) {
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "\n"
         "    || (this.$name$ == $default$\n"
         "        && this.has$capitalized_name$ != other.has$capitalized_name$)");
@@ -238,10 +294,10 @@ void EnumFieldGenerator::GenerateHashCodeCode(io::Printer* printer) const {
     "result = 31 * result + ");
   if (params_.use_reference_types_for_primitives()
         && !params_.reftypes_primitive_enums()) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "(this.$name$ == null ? 0 : this.$name$)");
   } else {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "this.$name$");
   }
   printer->Print(";\n");
@@ -262,21 +318,21 @@ AccessorEnumFieldGenerator::~AccessorEnumFieldGenerator() {}
 
 void AccessorEnumFieldGenerator::
 GenerateMembers(io::Printer* printer, bool /* unused lazy_init */) const {
-  printer->Print(variables_, "private int $name$_;\n");
+  JAVANANO_PRINT(printer, variables_, "private int $name$_;\n");
   if (params_.generate_intdefs()) {
-    printer->Print(variables_, "$message_type_intdef$\n");
+    JAVANANO_PRINT(printer, variables_, "$message_type_intdef$\n");
   }
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "public int get$capitalized_name$() {\n"
     "  return $name$_;\n"
     "}\n"
     "public $message_name$ set$capitalized_name$(");
   if (params_.generate_intdefs()) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "\n"
       "    $message_type_intdef$ ");
   }
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "int value) {\n"
     "  $name$_ = value;\n"
     "  $set_has$;\n"
@@ -294,17 +350,17 @@ GenerateMembers(io::Printer* printer, bool /* unused lazy_init */) const {
 
 void AccessorEnumFieldGenerator::
 GenerateClearCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "$name$_ = $default$;\n");
 }
 
 void AccessorEnumFieldGenerator::
 GenerateMergingCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "int value = input.readInt32();\n"
     "switch (value) {\n");
   PrintCaseLabels(printer, canonical_values_);
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "    $name$_ = value;\n"
     "    $set_has$;\n"
     "    break;\n"
@@ -314,17 +370,47 @@ GenerateMergingCode(io::Printer* printer) const {
   // fields, because there is no way to get the value out.
 }
 
+void AccessorEnumFieldGenerator::
+GenerateArrayMergingCode(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
+    "position = decoder.readInt32(buffer, position, limit);\n"
+    "int value = decoder.intValue;\n"
+    "switch (value) {\n");
+  PrintCaseLabels(printer, canonical_values_);
+  JAVANANO_PRINT(printer, variables_,
+    "    $name$_ = value;\n"
+    "    $set_has$;\n"
+    "    break;\n"
+    "}\n");
+}
+
 void AccessorEnumFieldGenerator::
 GenerateSerializationCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if ($get_has$) {\n"
-    "  output.writeInt32($number$, $name$_);\n"
+    "  output.$write_tag$;\n"
+    "  output.writeInt32NoTag($name$_);\n"
     "}\n");
 }
 
+void AccessorEnumFieldGenerator::
+GenerateReverseSerializationCode(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
+    "if ($get_has$) {\n"
+    "  output.writeInt32NoTag($name$_);\n"
+    "  output.$write_tag$;\n"
+    "}\n");
+}
+
+int AccessorEnumFieldGenerator::SerializedSizeUpperBoundConstant() const {
+  return internal::WireFormat::TagSize(descriptor_->number(),
+                                       descriptor_->type())
+      + MaxValueSize(FieldDescriptor::TYPE_ENUM);
+}
+
 void AccessorEnumFieldGenerator::
 GenerateSerializedSizeCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if ($get_has$) {\n"
     "  size += com.google.protobuf.nano.CodedOutputByteBufferNano\n"
     "    .computeInt32Size($number$, $name$_);\n"
@@ -333,7 +419,7 @@ GenerateSerializedSizeCode(io::Printer* printer) const {
 
 void AccessorEnumFieldGenerator::
 GenerateEqualsCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if ($different_has$\n"
     "    || $name$_ != other.$name$_) {\n"
     "  return false;\n"
@@ -342,7 +428,7 @@ GenerateEqualsCode(io::Printer* printer) const {
 
 void AccessorEnumFieldGenerator::
 GenerateHashCodeCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "result = 31 * result + $name$_;\n");
 }
 
@@ -352,32 +438,53 @@ RepeatedEnumFieldGenerator::
 RepeatedEnumFieldGenerator(const FieldDescriptor* descriptor, const Params& params)
   : FieldGenerator(params), descriptor_(descriptor) {
   SetEnumVariables(params, descriptor, &variables_);
+  SetRepeatedFieldGrowthVariables(descriptor, "int", &variables_);
+  variables_[JAVANANO_VAR("cached_data_size")] =
+      PackedDataSizeCacheName(descriptor);
   LoadEnumValues(params, descriptor->enum_type(), &canonical_values_);
 }
 
 RepeatedEnumFieldGenerator::~RepeatedEnumFieldGenerator() {}
 
+bool RepeatedEnumFieldGenerator::CachesDataSize() const {
+  // The table-driven runtime needs no cache.
+  return descriptor_->options().packed() && !params_.table_driven_codegen();
+}
+
 void RepeatedEnumFieldGenerator::
 GenerateMembers(io::Printer* printer, bool /* unused lazy_init */) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "public $type$[] $name$;\n");
+  if (CachesDataSize()) {
+    JAVANANO_PRINT(printer, variables_,
+      "private int $cached_data_size$ = -1;\n");
+  }
 }
 
 void RepeatedEnumFieldGenerator::
 GenerateClearCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "$name$ = $repeated_default$;\n");
+  if (CachesDataSize()) {
+    JAVANANO_PRINT(printer, variables_,
+      "$cached_data_size$ = -1;\n");
+  }
 }
 
 void RepeatedEnumFieldGenerator::
 GenerateMergingCode(io::Printer* printer) const {
+  if (params_.single_pass_repeated_fields()) {
+    GenerateSinglePassMergingCode(printer);
+    return;
+  }
+
   // First, figure out the maximum length of the array, then parse,
   // and finally copy the valid values to the field.
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "int length = com.google.protobuf.nano.WireFormatNano\n"
     "    .getRepeatedFieldArrayLength(input, $non_packed_tag$);\n"
     "int[] validValues = new int[length];\n"
-    "int validCount = 0;\n"
+    "int arrayLength = 0;\n"
     "for (int i = 0; i < length; i++) {\n"
     "  if (i != 0) { // tag for first value already consumed.\n"
     "    input.readTag();\n"
@@ -387,51 +494,72 @@ GenerateMergingCode(io::Printer* printer) const {
   printer->Indent();
   PrintCaseLabels(printer, canonical_values_);
   printer->Outdent();
-  printer->Print(variables_,
-    "      validValues[validCount++] = value;\n"
+  JAVANANO_PRINT(printer, variables_,
+    "      validValues[arrayLength++] = value;\n"
     "      break;\n"
     "  }\n"
     "}\n"
-    "if (validCount != 0) {\n"
-    "  int i = this.$name$ == null ? 0 : this.$name$.length;\n"
-    "  if (i == 0 && validCount == validValues.length) {\n"
-    "    this.$name$ = validValues;\n"
-    "  } else {\n"
-    "    int[] newArray = new int[i + validCount];\n"
-    "    if (i != 0) {\n"
-    "      java.lang.System.arraycopy(this.$name$, 0, newArray, 0, i);\n"
-    "    }\n"
-    "    java.lang.System.arraycopy(validValues, 0, newArray, i, validCount);\n"
-    "    this.$name$ = newArray;\n"
-    "  }\n"
+    "if (arrayLength == length && $merge_length$ == 0\n"
+    "    && (this.$name$ == null || this.$name$.length == 0)) {\n"
+    "  this.$name$ = validValues;\n"
+    "  $merge_length$ = arrayLength;\n"
+    "} else if (arrayLength != 0) {\n");
+  printer->Indent();
+  GenerateRepeatedFieldGrowCode(variables_, printer);
+  printer->Outdent();
+  JAVANANO_PRINT(printer, variables_,
+    "  java.lang.System.arraycopy(validValues, 0, newArray, i, arrayLength);\n"
+    "  this.$name$ = newArray;\n"
+    "  $merge_length$ = i + arrayLength;\n"
     "}\n");
 }
 
 void RepeatedEnumFieldGenerator::
-GenerateMergingCodeFromPacked(io::Printer* printer) const {
-  printer->Print(variables_,
-    "int bytes = input.readRawVarint32();\n"
-    "int limit = input.pushLimit(bytes);\n"
-    "// First pass to compute array length.\n"
+GenerateSinglePassMergingCode(io::Printer* printer) const {
+  // Parse the valid values into a scratch array of the input as long as
+  // their tag follows, then copy them to the field.
+  JAVANANO_PRINT(printer, variables_,
+    "int[] values = input.takeIntScratch();\n"
     "int arrayLength = 0;\n"
-    "int startPos = input.getPosition();\n"
-    "while (input.getBytesUntilLimit() > 0) {\n"
-    "  switch (input.readInt32()) {\n");
+    "do {\n"
+    "  int value = input.readInt32();\n"
+    "  switch (value) {\n");
   printer->Indent();
   PrintCaseLabels(printer, canonical_values_);
   printer->Outdent();
-  printer->Print(variables_,
-    "      arrayLength++;\n"
+  JAVANANO_PRINT(printer, variables_,
+    "      if (arrayLength == values.length) {\n"
+    "        values = java.util.Arrays.copyOf(values, arrayLength * 2);\n"
+    "      }\n"
+    "      values[arrayLength++] = value;\n"
     "      break;\n"
     "  }\n"
+    "} while (input.readTagIfEquals($non_packed_tag$));\n"
+    "if (arrayLength != 0) {\n");
+  printer->Indent();
+  GenerateRepeatedFieldGrowCode(variables_, printer);
+  printer->Outdent();
+  JAVANANO_PRINT(printer, variables_,
+    "  java.lang.System.arraycopy(values, 0, newArray, i, arrayLength);\n"
+    "  this.$name$ = newArray;\n"
+    "  $merge_length$ = i + arrayLength;\n"
     "}\n"
-    "if (arrayLength != 0) {\n"
-    "  input.rewindToPosition(startPos);\n"
-    "  int i = this.$name$ == null ? 0 : this.$name$.length;\n"
-    "  int[] newArray = new int[i + arrayLength];\n"
-    "  if (i != 0) {\n"
-    "    java.lang.System.arraycopy(this.$name$, 0, newArray, 0, i);\n"
-    "  }\n"
+    "input.releaseIntScratch(values);\n");
+}
+
+void RepeatedEnumFieldGenerator::
+GenerateMergingCodeFromPacked(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
+    "int bytes = input.readRawVarint32();\n"
+    "int limit = input.pushLimit(bytes);\n"
+    "// The number of values, counting the invalid ones which are dropped.\n"
+    "int arrayLength = input.countVarints(bytes);\n"
+    "if (arrayLength != 0) {\n");
+  printer->Indent();
+  GenerateRepeatedFieldGrowCode(variables_, printer);
+  printer->Outdent();
+  JAVANANO_PRINT(printer, variables_,
+    "  int start = i;\n"
     "  while (input.getBytesUntilLimit() > 0) {\n"
     "    int value = input.readInt32();\n"
     "    switch (value) {\n");
@@ -440,21 +568,105 @@ GenerateMergingCodeFromPacked(io::Printer* printer) const {
   PrintCaseLabels(printer, canonical_values_);
   printer->Outdent();
   printer->Outdent();
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "        newArray[i++] = value;\n"
     "        break;\n"
     "    }\n"
     "  }\n"
-    "  this.$name$ = newArray;\n"
+    "  if (i != start) {\n"
+    "    this.$name$ = newArray;\n"
+    "    $merge_length$ = i;\n"
+    "  }\n"
     "}\n"
     "input.popLimit(limit);\n");
 }
 
+void RepeatedEnumFieldGenerator::
+GenerateArrayMergingCode(io::Printer* printer) const {
+  // Valid values are appended one at a time; the growth of the array
+  // amortizes the copies.
+  JAVANANO_PRINT(printer, variables_,
+    "position = decoder.readInt32(buffer, position, limit);\n"
+    "int value = decoder.intValue;\n"
+    "switch (value) {\n");
+  PrintCaseLabels(printer, canonical_values_);
+  printer->Indent();
+  printer->Indent();
+  printer->Print(
+    "int arrayLength = 1;\n");
+  GenerateRepeatedFieldGrowCode(variables_, printer);
+  JAVANANO_PRINT(printer, variables_,
+    "newArray[i] = value;\n"
+    "this.$name$ = newArray;\n"
+    "$merge_length$ = i + 1;\n"
+    "break;\n");
+  printer->Outdent();
+  printer->Outdent();
+  printer->Print(
+    "}\n");
+}
+
+void RepeatedEnumFieldGenerator::
+GenerateArrayMergingCodeFromPacked(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
+    "position = decoder.readLength(buffer, position, limit);\n"
+    "int packedLimit = position + decoder.intValue;\n"
+    "// The number of values, counting the invalid ones which are dropped.\n"
+    "int arrayLength = decoder.countVarints(buffer, position, packedLimit);\n"
+    "if (arrayLength != 0) {\n");
+  printer->Indent();
+  GenerateRepeatedFieldGrowCode(variables_, printer);
+  printer->Outdent();
+  JAVANANO_PRINT(printer, variables_,
+    "  int start = i;\n"
+    "  while (position < packedLimit) {\n"
+    "    position = decoder.readInt32(buffer, position, packedLimit);\n"
+    "    int value = decoder.intValue;\n"
+    "    switch (value) {\n");
+  printer->Indent();
+  printer->Indent();
+  PrintCaseLabels(printer, canonical_values_);
+  printer->Outdent();
+  printer->Outdent();
+  JAVANANO_PRINT(printer, variables_,
+    "        newArray[i++] = value;\n"
+    "        break;\n"
+    "    }\n"
+    "  }\n"
+    "  if (i != start) {\n"
+    "    this.$name$ = newArray;\n"
+    "    $merge_length$ = i;\n"
+    "  }\n"
+    "}\n");
+}
+
+string RepeatedEnumFieldGenerator::MergeLengthVariable() const {
+  return RepeatedFieldMergeLengthName(descriptor_);
+}
+
+void RepeatedEnumFieldGenerator::
+GenerateMergeTrimCode(io::Printer* printer) const {
+  GenerateRepeatedFieldTrimCode(variables_, printer);
+}
+
+void RepeatedEnumFieldGenerator::
+GenerateMergeStartCode(io::Printer* printer) const {
+  if (CachesDataSize()) {
+    JAVANANO_PRINT(printer, variables_,
+      "$cached_data_size$ = -1;\n");
+  }
+}
+
 void RepeatedEnumFieldGenerator::
 GenerateRepeatedDataSizeCode(io::Printer* printer) const {
   // Creates a variable dataSize and puts the serialized size in there.
-  printer->Print(variables_,
-    "int dataSize = 0;\n"
+  printer->Print("int dataSize = 0;\n");
+  GenerateDataSizeSumCode(printer);
+}
+
+void RepeatedEnumFieldGenerator::
+GenerateDataSizeSumCode(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
     "for (int i = 0; i < this.$name$.length; i++) {\n"
     "  int element = this.$name$[i];\n"
     "  dataSize += com.google.protobuf.nano.CodedOutputByteBufferNano\n"
@@ -464,47 +676,117 @@ GenerateRepeatedDataSizeCode(io::Printer* printer) const {
 
 void RepeatedEnumFieldGenerator::
 GenerateSerializationCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if (this.$name$ != null && this.$name$.length > 0) {\n");
   printer->Indent();
 
   if (descriptor_->options().packed()) {
-    GenerateRepeatedDataSizeCode(printer);
-    printer->Print(variables_,
-      "output.writeRawVarint32($tag$);\n"
+    if (CachesDataSize()) {
+      // Use the size from computeSerializedSize() once.
+      JAVANANO_PRINT(printer, variables_,
+        "int dataSize = $cached_data_size$;\n"
+        "if (dataSize >= 0) {\n"
+        "  $cached_data_size$ = -1;\n"
+        "} else {\n"
+        "  dataSize = 0;\n");
+      printer->Indent();
+      GenerateDataSizeSumCode(printer);
+      printer->Outdent();
+      printer->Print("}\n");
+    } else {
+      GenerateRepeatedDataSizeCode(printer);
+    }
+    JAVANANO_PRINT(printer, variables_,
+      "output.$write_tag$;\n"
       "output.writeRawVarint32(dataSize);\n"
       "for (int i = 0; i < this.$name$.length; i++) {\n"
       "  output.writeRawVarint32(this.$name$[i]);\n"
       "}\n");
   } else {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "for (int i = 0; i < this.$name$.length; i++) {\n"
-      "  output.writeInt32($number$, this.$name$[i]);\n"
+      "  output.$write_tag$;\n"
+      "  output.writeInt32NoTag(this.$name$[i]);\n"
+      "}\n");
+  }
+
+  printer->Outdent();
+  JAVANANO_PRINT(printer, variables_,
+    "}\n");
+}
+
+void RepeatedEnumFieldGenerator::
+GenerateReverseSerializationCode(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
+    "if (this.$name$ != null && this.$name$.length > 0) {\n");
+  printer->Indent();
+
+  if (descriptor_->options().packed()) {
+    JAVANANO_PRINT(printer, variables_,
+      "int sizeBefore = output.size();\n"
+      "for (int i = this.$name$.length - 1; i >= 0; i--) {\n"
+      "  output.writeRawVarint32(this.$name$[i]);\n"
+      "}\n"
+      "output.writeRawVarint32(output.size() - sizeBefore);\n"
+      "output.$write_tag$;\n");
+  } else {
+    JAVANANO_PRINT(printer, variables_,
+      "for (int i = this.$name$.length - 1; i >= 0; i--) {\n"
+      "  output.writeInt32NoTag(this.$name$[i]);\n"
+      "  output.$write_tag$;\n"
       "}\n");
   }
 
   printer->Outdent();
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "}\n");
 }
 
+int RepeatedEnumFieldGenerator::SerializedSizeUpperBoundConstant() const {
+  if (descriptor_->options().packed()) {
+    return internal::WireFormat::TagSize(descriptor_->number(),
+                                         descriptor_->type())
+        + kMaxLengthPrefixSize;
+  }
+  return 0;
+}
+
+void RepeatedEnumFieldGenerator::
+GenerateSerializedSizeUpperBoundCode(io::Printer* printer) const {
+  if (descriptor_->options().packed()) {
+    JAVANANO_PRINT(printer, variables_,
+      "if (this.$name$ != null) {\n"
+      "  size += $max_value_size$ * this.$name$.length;\n"
+      "}\n");
+  } else {
+    JAVANANO_PRINT(printer, variables_,
+      "if (this.$name$ != null) {\n"
+      "  size += $max_tagged_size$ * this.$name$.length;\n"
+      "}\n");
+  }
+}
+
 void RepeatedEnumFieldGenerator::
 GenerateSerializedSizeCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if (this.$name$ != null && this.$name$.length > 0) {\n");
   printer->Indent();
 
   GenerateRepeatedDataSizeCode(printer);
+  if (CachesDataSize()) {
+    JAVANANO_PRINT(printer, variables_,
+      "$cached_data_size$ = dataSize;\n");
+  }
 
   printer->Print(
     "size += dataSize;\n");
   if (descriptor_->options().packed()) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "size += $tag_size$;\n"
       "size += com.google.protobuf.nano.CodedOutputByteBufferNano\n"
       "    .computeRawVarint32Size(dataSize);\n");
   } else {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "size += $tag_size$ * this.$name$.length;\n");
   }
 
@@ -516,7 +798,7 @@ GenerateSerializedSizeCode(io::Printer* printer) const {
 
 void RepeatedEnumFieldGenerator::
 GenerateFixClonedCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if (this.$name$ != null && this.$name$.length > 0) {\n"
     "  cloned.$name$ = this.$name$.clone();\n"
     "}\n");
@@ -524,7 +806,7 @@ GenerateFixClonedCode(io::Printer* printer) const {
 
 void RepeatedEnumFieldGenerator::
 GenerateEqualsCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if (!com.google.protobuf.nano.InternalNano.equals(\n"
     "    this.$name$, other.$name$)) {\n"
     "  return false;\n"
@@ -533,7 +815,7 @@ GenerateEqualsCode(io::Printer* printer) const {
 
 void RepeatedEnumFieldGenerator::
 GenerateHashCodeCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "result = 31 * result\n"
     "    + com.google.protobuf.nano.InternalNano.hashCode(this.$name$);\n");
 }
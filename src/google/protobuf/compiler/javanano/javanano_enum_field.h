@@ -52,6 +52,7 @@ class EnumFieldGenerator : public FieldGenerator {
   ~EnumFieldGenerator();
 
   // implements FieldGenerator ---------------------------------------
+  const char* ClassName() const { return "EnumFieldGenerator"; }
   void GenerateMembers(io::Printer* printer, bool lazy_init) const;
   void GenerateClearCode(io::Printer* printer) const;
   void GenerateMergingCode(io::Printer* printer) const;
@@ -59,10 +60,15 @@ class EnumFieldGenerator : public FieldGenerator {
   void GenerateSerializedSizeCode(io::Printer* printer) const;
   void GenerateEqualsCode(io::Printer* printer) const;
   void GenerateHashCodeCode(io::Printer* printer) const;
+  bool SupportsArrayParsing() const { return true; }
+  void GenerateArrayMergingCode(io::Printer* printer) const;
+  bool SupportsReverseSerialization() const { return true; }
+  void GenerateReverseSerializationCode(io::Printer* printer) const;
+  int SerializedSizeUpperBoundConstant() const;
 
  private:
   const FieldDescriptor* descriptor_;
-  map<string, string> variables_;
+  TemplateVariables variables_;
   vector<string> canonical_values_;
 
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(EnumFieldGenerator);
@@ -75,6 +81,7 @@ class AccessorEnumFieldGenerator : public FieldGenerator {
   ~AccessorEnumFieldGenerator();
 
   // implements FieldGenerator ---------------------------------------
+  const char* ClassName() const { return "AccessorEnumFieldGenerator"; }
   void GenerateMembers(io::Printer* printer, bool lazy_init) const;
   void GenerateClearCode(io::Printer* printer) const;
   void GenerateMergingCode(io::Printer* printer) const;
@@ -82,10 +89,15 @@ class AccessorEnumFieldGenerator : public FieldGenerator {
   void GenerateSerializedSizeCode(io::Printer* printer) const;
   void GenerateEqualsCode(io::Printer* printer) const;
   void GenerateHashCodeCode(io::Printer* printer) const;
+  bool SupportsArrayParsing() const { return true; }
+  void GenerateArrayMergingCode(io::Printer* printer) const;
+  bool SupportsReverseSerialization() const { return true; }
+  void GenerateReverseSerializationCode(io::Printer* printer) const;
+  int SerializedSizeUpperBoundConstant() const;
 
  private:
   const FieldDescriptor* descriptor_;
-  map<string, string> variables_;
+  TemplateVariables variables_;
   vector<string> canonical_values_;
 
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(AccessorEnumFieldGenerator);
@@ -98,6 +110,7 @@ class RepeatedEnumFieldGenerator : public FieldGenerator {
   ~RepeatedEnumFieldGenerator();
 
   // implements FieldGenerator ---------------------------------------
+  const char* ClassName() const { return "RepeatedEnumFieldGenerator"; }
   void GenerateMembers(io::Printer* printer, bool lazy_init) const;
   void GenerateClearCode(io::Printer* printer) const;
   void GenerateMergingCode(io::Printer* printer) const;
@@ -107,12 +120,26 @@ class RepeatedEnumFieldGenerator : public FieldGenerator {
   void GenerateEqualsCode(io::Printer* printer) const;
   void GenerateHashCodeCode(io::Printer* printer) const;
   void GenerateFixClonedCode(io::Printer* printer) const;
+  string MergeLengthVariable() const;
+  void GenerateMergeTrimCode(io::Printer* printer) const;
+  void GenerateMergeStartCode(io::Printer* printer) const;
+  bool SupportsArrayParsing() const { return true; }
+  void GenerateArrayMergingCode(io::Printer* printer) const;
+  void GenerateArrayMergingCodeFromPacked(io::Printer* printer) const;
+  bool SupportsReverseSerialization() const { return true; }
+  void GenerateReverseSerializationCode(io::Printer* printer) const;
+  int SerializedSizeUpperBoundConstant() const;
+  void GenerateSerializedSizeUpperBoundCode(io::Printer* printer) const;
 
  private:
+  // Whether the data size is kept for writeTo() in a private field.
+  bool CachesDataSize() const;
   void GenerateRepeatedDataSizeCode(io::Printer* printer) const;
+  void GenerateDataSizeSumCode(io::Printer* printer) const;
+  void GenerateSinglePassMergingCode(io::Printer* printer) const;
 
   const FieldDescriptor* descriptor_;
-  map<string, string> variables_;
+  TemplateVariables variables_;
   vector<string> canonical_values_;
 
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(RepeatedEnumFieldGenerator);
@@ -72,16 +72,21 @@ void FieldGenerator::GenerateMergingCodeFromPacked(io::Printer* printer) const {
 
 // =============================================
 
+std::atomic<int> FieldGeneratorMap::construction_count_(0);
+
 FieldGeneratorMap::FieldGeneratorMap(
     const Descriptor* descriptor, const Params &params)
   : descriptor_(descriptor),
     field_generators_(
       new std::unique_ptr<FieldGenerator>[descriptor->field_count()]) {
+  construction_count_++;
 
   int next_has_bit_index = 0;
   bool saved_defaults_needed = false;
   // Construct all the FieldGenerators.
   for (int i = 0; i < descriptor->field_count(); i++) {
+    // Unused fields get neither a generator nor a has bit.
+    if (!IsFieldUsed(params, descriptor->field(i))) continue;
     FieldGenerator* field_generator = MakeGenerator(
         descriptor->field(i), params, &next_has_bit_index);
     saved_defaults_needed = saved_defaults_needed
@@ -133,7 +138,11 @@ FieldGenerator* FieldGeneratorMap::MakeGenerator(const FieldDescriptor* field,
   } else {
     switch (java_type) {
       case JAVATYPE_MESSAGE:
-        return new MessageFieldGenerator(field, params);
+        if (IsLazyMessageField(params, field)) {
+          return new LazyMessageFieldGenerator(field, params);
+        } else {
+          return new MessageFieldGenerator(field, params);
+        }
       case JAVATYPE_ENUM:
         return new EnumFieldGenerator(field, params);
       default:
@@ -147,32 +156,86 @@ FieldGeneratorMap::~FieldGeneratorMap() {}
 const FieldGenerator& FieldGeneratorMap::get(
     const FieldDescriptor* field) const {
   GOOGLE_CHECK_EQ(field->containing_type(), descriptor_);
+  // Unused fields have no generator; callers skip them (see IsFieldUsed()).
+  GOOGLE_CHECK(field_generators_[field->index()] != NULL)
+      << "No generator for unused field " << field->full_name();
   return *field_generators_[field->index()];
 }
 
 void SetCommonOneofVariables(const FieldDescriptor* descriptor,
-                             map<string, string>* variables) {
-  (*variables)["oneof_name"] =
+                             TemplateVariables* variables) {
+  (*variables)[JAVANANO_VAR("oneof_name")] =
       UnderscoresToCamelCase(descriptor->containing_oneof());
-  (*variables)["oneof_capitalized_name"] =
+  (*variables)[JAVANANO_VAR("oneof_capitalized_name")] =
       UnderscoresToCapitalizedCamelCase(descriptor->containing_oneof());
-  (*variables)["oneof_index"] =
+  (*variables)[JAVANANO_VAR("oneof_index")] =
       SimpleItoa(descriptor->containing_oneof()->index());
-  (*variables)["set_oneof_case"] =
-      "this." + (*variables)["oneof_name"] +
+  (*variables)[JAVANANO_VAR("set_oneof_case")] =
+      "this." + (*variables)[JAVANANO_VAR("oneof_name")] +
       "Case_ = " + SimpleItoa(descriptor->number());
-  (*variables)["clear_oneof_case"] =
-      "this." + (*variables)["oneof_name"] + "Case_ = 0";
-  (*variables)["has_oneof_case"] =
-      "this." + (*variables)["oneof_name"] + "Case_ == " +
+  (*variables)[JAVANANO_VAR("clear_oneof_case")] =
+      "this." + (*variables)[JAVANANO_VAR("oneof_name")] + "Case_ = 0";
+  (*variables)[JAVANANO_VAR("has_oneof_case")] =
+      "this." + (*variables)[JAVANANO_VAR("oneof_name")] + "Case_ == " +
       SimpleItoa(descriptor->number());
 }
 
+void SetRepeatedFieldGrowthVariables(const FieldDescriptor* descriptor,
+                                     const string& element_type,
+                                     TemplateVariables* variables) {
+  // For arrays of arrays, such as byte[][], the dimensions of the elements
+  // go after that of the new array.
+  string::size_type dims = element_type.find('[');
+  if (dims == string::npos) {
+    dims = element_type.size();
+  }
+  (*variables)[JAVANANO_VAR("merge_length")] =
+      RepeatedFieldMergeLengthName(descriptor);
+  (*variables)[JAVANANO_VAR("array_type")] = element_type + "[]";
+  (*variables)[JAVANANO_VAR("new_array_start")] =
+      "new " + element_type.substr(0, dims) + "[";
+  (*variables)[JAVANANO_VAR("new_array_end")] = "]" + element_type.substr(dims);
+}
+
+string RepeatedFieldMergeLengthName(const FieldDescriptor* descriptor) {
+  return RenameJavaKeywords(UnderscoresToCamelCase(descriptor)) + "Length_";
+}
+
+string PackedDataSizeCacheName(const FieldDescriptor* descriptor) {
+  return RenameJavaKeywords(UnderscoresToCamelCase(descriptor)) + "DataSize_";
+}
+
+void GenerateRepeatedFieldGrowCode(const TemplateVariables& variables,
+                                   io::Printer* printer) {
+  // The first append of a mergeFrom() allocates just enough, as most fields
+  // come in a single run; further ones, of values interleaved with other
+  // fields, at least double the capacity.
+  JAVANANO_PRINT(printer, variables,
+    "int i = $merge_length$ != 0 ? $merge_length$\n"
+    "    : this.$name$ == null ? 0 : this.$name$.length;\n"
+    "$array_type$ newArray = this.$name$;\n"
+    "if (newArray == null || newArray.length - i < arrayLength) {\n"
+    "  newArray = $new_array_start$$merge_length$ == 0 ? i + arrayLength\n"
+    "      : java.lang.Math.max(i + arrayLength, 2 * i)$new_array_end$;\n"
+    "  if (i != 0) {\n"
+    "    java.lang.System.arraycopy(this.$name$, 0, newArray, 0, i);\n"
+    "  }\n"
+    "}\n");
+}
+
+void GenerateRepeatedFieldTrimCode(const TemplateVariables& variables,
+                                   io::Printer* printer) {
+  JAVANANO_PRINT(printer, variables,
+    "if ($merge_length$ != 0 && $merge_length$ != this.$name$.length) {\n"
+    "  this.$name$ = java.util.Arrays.copyOf(this.$name$, $merge_length$);\n"
+    "}\n");
+}
+
 void GenerateOneofFieldEquals(const FieldDescriptor* descriptor,
-                              const map<string, string>& variables,
+                              const TemplateVariables& variables,
                               io::Printer* printer) {
   if (GetJavaType(descriptor) == JAVATYPE_BYTES) {
-    printer->Print(variables,
+    JAVANANO_PRINT(printer, variables,
       "if (this.has$capitalized_name$()) {\n"
       "  if (!java.util.Arrays.equals((byte[]) this.$oneof_name$_,\n"
       "                               (byte[]) other.$oneof_name$_)) {\n"
@@ -180,7 +243,7 @@ void GenerateOneofFieldEquals(const FieldDescriptor* descriptor,
       "  }\n"
       "}\n");
   } else {
-    printer->Print(variables,
+    JAVANANO_PRINT(printer, variables,
       "if (this.has$capitalized_name$()) {\n"
       "  if (!this.$oneof_name$_.equals(other.$oneof_name$_)) {\n"
       "    return false;\n"
@@ -190,14 +253,14 @@ void GenerateOneofFieldEquals(const FieldDescriptor* descriptor,
 }
 
 void GenerateOneofFieldHashCode(const FieldDescriptor* descriptor,
-                                const map<string, string>& variables,
+                                const TemplateVariables& variables,
                                 io::Printer* printer) {
   if (GetJavaType(descriptor) == JAVATYPE_BYTES) {
-    printer->Print(variables,
+    JAVANANO_PRINT(printer, variables,
       "result = 31 * result + ($has_oneof_case$\n"
       "   ? java.util.Arrays.hashCode((byte[]) this.$oneof_name$_) : 0);\n");
   } else {
-    printer->Print(variables,
+    JAVANANO_PRINT(printer, variables,
       "result = 31 * result +\n"
       "  ($has_oneof_case$ ? this.$oneof_name$_.hashCode() : 0);\n");
   }
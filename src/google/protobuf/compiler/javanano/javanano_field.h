@@ -35,11 +35,13 @@
 #ifndef GOOGLE_PROTOBUF_COMPILER_JAVANANO_FIELD_H__
 #define GOOGLE_PROTOBUF_COMPILER_JAVANANO_FIELD_H__
 
+#include <atomic>
 #include <map>
 #include <string>
 #include <google/protobuf/stubs/common.h>
 #include <google/protobuf/descriptor.h>
 #include <google/protobuf/compiler/javanano/javanano_params.h>
+#include <google/protobuf/compiler/javanano/javanano_template.h>
 
 namespace google {
 namespace protobuf {
@@ -57,6 +59,9 @@ class FieldGenerator {
   FieldGenerator(const Params& params) : params_(params) {}
   virtual ~FieldGenerator();
 
+  // Name of the concrete generator class, for generation_stats_file.
+  virtual const char* ClassName() const = 0;
+
   virtual bool SavedDefaultNeeded() const;
   virtual void GenerateInitSavedDefaultCode(io::Printer* printer) const;
 
@@ -85,6 +90,40 @@ class FieldGenerator {
   virtual void GenerateHashCodeCode(io::Printer* printer) const = 0;
   virtual void GenerateFixClonedCode(io::Printer* printer) const {}
 
+  // Repeated fields append to their arrays with amortized growth within one
+  // mergeFrom(), keeping the number of values in use in a local variable of
+  // mergeFrom() declared as 0 (for "none appended yet"), and the array is
+  // trimmed to that length by GenerateMergeTrimCode before returning. Other
+  // fields return an empty name and print nothing.
+  virtual string MergeLengthVariable() const { return ""; }
+  virtual void GenerateMergeTrimCode(io::Printer* printer) const {}
+  // Prints code run at the start of every mergeFrom() of the message, which
+  // may change the values of any field: fields keeping state derived from
+  // their values between computeSerializedSize() and writeTo() drop it.
+  virtual void GenerateMergeStartCode(io::Printer* printer) const {}
+
+  // For the array_parser option: whether the field can be parsed by the
+  // mergeFrom() reading a byte array, and the code doing so, which reads the
+  // value at position (the tag already read) from buffer with the
+  // ArrayDecoderNano decoder, not past limit, and advances position past it.
+  virtual bool SupportsArrayParsing() const { return false; }
+  virtual void GenerateArrayMergingCode(io::Printer* printer) const {}
+  virtual void GenerateArrayMergingCodeFromPacked(io::Printer* printer) const {}
+
+  // For the reverse_serializer option: whether the field can be written by
+  // writeToReverse(), and the code doing so, which writes the field in front
+  // of what is in the ReverseCodedOutputNano output: the values of repeated
+  // fields last to first, each value before its tag.
+  virtual bool SupportsReverseSerialization() const { return false; }
+  virtual void GenerateReverseSerializationCode(io::Printer* printer) const {}
+  // Also for the reverse_serializer option, the parts of an upper bound of
+  // the serialized size of the field for maxSerializedSizeUpperBound(): the
+  // bytes known when generating code, and code adding the bytes depending
+  // on the values, such as those of strings, to size.
+  virtual int SerializedSizeUpperBoundConstant() const { return 0; }
+  virtual void GenerateSerializedSizeUpperBoundCode(
+      io::Printer* printer) const {}
+
  protected:
   const Params& params_;
  private:
@@ -101,7 +140,13 @@ class FieldGeneratorMap {
   int total_bits() const { return total_bits_; }
   bool saved_defaults_needed() const { return saved_defaults_needed_; }
 
+  // Number of FieldGeneratorMaps constructed so far in this process.  Each
+  // message should get exactly one per generator run; tests check this.
+  static int construction_count() { return construction_count_; }
+
  private:
+  static std::atomic<int> construction_count_;
+
   const Descriptor* descriptor_;
   std::unique_ptr<std::unique_ptr<FieldGenerator>[]> field_generators_;
   int total_bits_;
@@ -114,12 +159,32 @@ class FieldGeneratorMap {
 };
 
 void SetCommonOneofVariables(const FieldDescriptor* descriptor,
-                             map<string, string>* variables);
+                             TemplateVariables* variables);
+// Sets the variables of a repeated field with elements of the given Java
+// type used by GenerateRepeatedFieldGrowCode and GenerateRepeatedFieldTrimCode.
+void SetRepeatedFieldGrowthVariables(const FieldDescriptor* descriptor,
+                                     const string& element_type,
+                                     TemplateVariables* variables);
+string RepeatedFieldMergeLengthName(const FieldDescriptor* descriptor);
+// Name of the private field in which computeSerializedSize() keeps the data
+// size of a packed repeated field of varints for the next writeTo(), which
+// resets it to -1, as clear() and mergeFrom() do.
+string PackedDataSizeCacheName(const FieldDescriptor* descriptor);
+// Prints code making room for arrayLength more values in the array of the
+// repeated field: declares i, the number of values in use, and newArray, the
+// array itself or a copy of its first i values with enough capacity. The
+// caller stores the values from index i on, assigns newArray to the field
+// and the new number of values to the merge length variable.
+void GenerateRepeatedFieldGrowCode(const TemplateVariables& variables,
+                                   io::Printer* printer);
+void GenerateRepeatedFieldTrimCode(const TemplateVariables& variables,
+                                   io::Printer* printer);
+
 void GenerateOneofFieldEquals(const FieldDescriptor* descriptor,
-                              const map<string, string>& variables,
+                              const TemplateVariables& variables,
                               io::Printer* printer);
 void GenerateOneofFieldHashCode(const FieldDescriptor* descriptor,
-                                const map<string, string>& variables,
+                                const TemplateVariables& variables,
                                 io::Printer* printer);
 
 }  // namespace javanano
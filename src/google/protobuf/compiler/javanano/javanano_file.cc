@@ -32,6 +32,7 @@
 //  Based on original Protocol Buffers design by
 //  Sanjay Ghemawat, Jeff Dean, and others.
 
+#include <chrono>
 #include <iostream>
 
 #include <google/protobuf/compiler/javanano/javanano_file.h>
@@ -83,21 +84,114 @@ bool UsesExtensions(const Message& message) {
   return false;
 }
 
+// The overloads below check the same thing as UsesExtensions() on the
+// FileDescriptorProto of a file, but walk the descriptors directly: only
+// options messages can carry extensions (custom options) or unknown fields,
+// so there is no need to copy the whole file into a proto first.
+
+bool UsesExtensions(const FieldDescriptor* field) {
+  return UsesExtensions(field->options());
+}
+
+bool UsesExtensions(const EnumDescriptor* enum_type) {
+  if (UsesExtensions(enum_type->options())) return true;
+  for (int i = 0; i < enum_type->value_count(); i++) {
+    if (UsesExtensions(enum_type->value(i)->options())) return true;
+  }
+  return false;
+}
+
+bool UsesExtensions(const Descriptor* descriptor) {
+  if (UsesExtensions(descriptor->options())) return true;
+  for (int i = 0; i < descriptor->field_count(); i++) {
+    if (UsesExtensions(descriptor->field(i))) return true;
+  }
+  for (int i = 0; i < descriptor->extension_count(); i++) {
+    if (UsesExtensions(descriptor->extension(i))) return true;
+  }
+  for (int i = 0; i < descriptor->oneof_decl_count(); i++) {
+    if (UsesExtensions(descriptor->oneof_decl(i)->options())) return true;
+  }
+  for (int i = 0; i < descriptor->extension_range_count(); i++) {
+    if (UsesExtensions(*descriptor->extension_range(i)->options_)) {
+      return true;
+    }
+  }
+  for (int i = 0; i < descriptor->enum_type_count(); i++) {
+    if (UsesExtensions(descriptor->enum_type(i))) return true;
+  }
+  for (int i = 0; i < descriptor->nested_type_count(); i++) {
+    if (UsesExtensions(descriptor->nested_type(i))) return true;
+  }
+  return false;
+}
+
+bool UsesExtensions(const FileDescriptor* file) {
+  if (UsesExtensions(file->options())) return true;
+  for (int i = 0; i < file->message_type_count(); i++) {
+    if (UsesExtensions(file->message_type(i))) return true;
+  }
+  for (int i = 0; i < file->enum_type_count(); i++) {
+    if (UsesExtensions(file->enum_type(i))) return true;
+  }
+  for (int i = 0; i < file->extension_count(); i++) {
+    if (UsesExtensions(file->extension(i))) return true;
+  }
+  for (int i = 0; i < file->service_count(); i++) {
+    const ServiceDescriptor* service = file->service(i);
+    if (UsesExtensions(service->options())) return true;
+    for (int j = 0; j < service->method_count(); j++) {
+      if (UsesExtensions(service->method(j)->options())) return true;
+    }
+  }
+  return false;
+}
+
 }  // namespace
 
 FileGenerator::FileGenerator(const FileDescriptor* file, const Params& params)
   : file_(file),
     params_(params),
     java_package_(FileJavaPackage(params, file)),
-    classname_(FileClassName(params, file)) {}
+    classname_(FileClassName(params, file)),
+    message_seconds_(NULL) {
+  for (int i = 0; i < file_->extension_count(); i++) {
+    extension_generators_.emplace_back(
+        new ExtensionGenerator(file_->extension(i), params_));
+  }
+  for (int i = 0; i < file_->enum_type_count(); i++) {
+    enum_generators_.emplace_back(
+        new EnumGenerator(file_->enum_type(i), params_));
+  }
+  for (int i = 0; i < file_->message_type_count(); i++) {
+    message_generators_.emplace_back(
+        new MessageGenerator(file_->message_type(i), params_));
+  }
+}
 
 FileGenerator::~FileGenerator() {}
 
+void FileGenerator::CountFieldGenerators(map<string, int>* counts) const {
+  for (int i = 0; i < message_generators_.size(); i++) {
+    message_generators_[i]->CountFieldGenerators(counts);
+  }
+}
+
+void FileGenerator::GenerateMessage(int index, io::Printer* printer) {
+  if (message_seconds_ == NULL) {
+    message_generators_[index]->Generate(printer);
+    return;
+  }
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  message_generators_[index]->Generate(printer);
+  (*message_seconds_)[index] = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
 bool FileGenerator::Validate(string* error) {
   // Check for extensions
-  FileDescriptorProto file_proto;
-  file_->CopyTo(&file_proto);
-  if (UsesExtensions(file_proto) && !params_.store_unknown_fields()) {
+  if (UsesExtensions(file_) && !params_.store_unknown_fields()) {
     error->assign(file_->name());
     error->append(
         ": Java NANO_RUNTIME only supports extensions when the "
@@ -184,26 +278,25 @@ void FileGenerator::Generate(io::Printer* printer) {
   // -----------------------------------------------------------------
 
   // Extensions.
-  for (int i = 0; i < file_->extension_count(); i++) {
-    ExtensionGenerator(file_->extension(i), params_).Generate(printer);
+  for (int i = 0; i < extension_generators_.size(); i++) {
+    extension_generators_[i]->Generate(printer);
   }
 
   // Enums.
-  for (int i = 0; i < file_->enum_type_count(); i++) {
-    EnumGenerator(file_->enum_type(i), params_).Generate(printer);
+  for (int i = 0; i < enum_generators_.size(); i++) {
+    enum_generators_[i]->Generate(printer);
   }
 
   // Messages.
   if (!params_.java_multiple_files(file_->name())) {
-    for (int i = 0; i < file_->message_type_count(); i++) {
-      MessageGenerator(file_->message_type(i), params_).Generate(printer);
+    for (int i = 0; i < message_generators_.size(); i++) {
+      GenerateMessage(i, printer);
     }
   }
 
   // Static variables.
-  for (int i = 0; i < file_->message_type_count(); i++) {
-    // TODO(kenton):  Reuse MessageGenerator objects?
-    MessageGenerator(file_->message_type(i), params_).GenerateStaticVariables(printer);
+  for (int i = 0; i < message_generators_.size(); i++) {
+    message_generators_[i]->GenerateStaticVariables(printer);
   }
 
   printer->Outdent();
@@ -211,47 +304,50 @@ void FileGenerator::Generate(io::Printer* printer) {
     "}\n");
 }
 
-template<typename GeneratorClass, typename DescriptorClass>
-static void GenerateSibling(const string& package_dir,
-                            const string& java_package,
-                            const DescriptorClass* descriptor,
-                            GeneratorContext* output_directory,
-                            vector<string>* file_list,
-                            const Params& params) {
-  string filename = package_dir + descriptor->name() + ".java";
-  file_list->push_back(filename);
-
-  std::unique_ptr<io::ZeroCopyOutputStream> output(
-    output_directory->Open(filename));
-  io::Printer printer(output.get(), '$');
-
-  printer.Print(
+static void GenerateSiblingHeader(const string& java_package,
+                                  io::Printer* printer) {
+  printer->Print(
     "// Generated by the protocol buffer compiler.  DO NOT EDIT!\n");
   if (!java_package.empty()) {
-    printer.Print(
+    printer->Print(
       "\n"
       "package $package$;\n",
       "package", java_package);
   }
-
-  GeneratorClass(descriptor, params).Generate(&printer);
 }
 
-void FileGenerator::GenerateSiblings(const string& package_dir,
-                                     GeneratorContext* output_directory,
-                                     vector<string>* file_list) {
+void FileGenerator::ListJavaFiles(const string& package_dir,
+                                  vector<GeneratedJavaFile>* java_files) {
+  if (IsOuterClassNeeded(params_, file_)) {
+    GeneratedJavaFile java_file;
+    java_file.filename = package_dir + classname_ + ".java";
+    java_file.render = [this](io::Printer* printer) { Generate(printer); };
+    java_files->push_back(java_file);
+  }
+
   if (params_.java_multiple_files(file_->name())) {
     for (int i = 0; i < file_->message_type_count(); i++) {
-      GenerateSibling<MessageGenerator>(package_dir, java_package_,
-                                        file_->message_type(i),
-                                        output_directory, file_list, params_);
+      GeneratedJavaFile java_file;
+      java_file.filename =
+          package_dir + file_->message_type(i)->name() + ".java";
+      java_file.render = [this, i](io::Printer* printer) {
+        GenerateSiblingHeader(java_package_, printer);
+        GenerateMessage(i, printer);
+      };
+      java_files->push_back(java_file);
     }
 
     if (params_.java_enum_style()) {
       for (int i = 0; i < file_->enum_type_count(); i++) {
-        GenerateSibling<EnumGenerator>(package_dir, java_package_,
-                                       file_->enum_type(i),
-                                       output_directory, file_list, params_);
+        GeneratedJavaFile java_file;
+        java_file.filename =
+            package_dir + file_->enum_type(i)->name() + ".java";
+        EnumGenerator* generator = enum_generators_[i].get();
+        java_file.render = [this, generator](io::Printer* printer) {
+          GenerateSiblingHeader(java_package_, printer);
+          generator->Generate(printer);
+        };
+        java_files->push_back(java_file);
       }
     }
   }
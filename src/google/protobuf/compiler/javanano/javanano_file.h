@@ -35,6 +35,8 @@
 #ifndef GOOGLE_PROTOBUF_COMPILER_JAVANANO_FILE_H__
 #define GOOGLE_PROTOBUF_COMPILER_JAVANANO_FILE_H__
 
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 #include <google/protobuf/stubs/common.h>
@@ -55,6 +57,23 @@ namespace protobuf {
 namespace compiler {
 namespace javanano {
 
+class EnumGenerator;           // javanano_enum.h
+class ExtensionGenerator;      // javanano_extension.h
+class MessageGenerator;        // javanano_message.h
+
+// A .java file produced by a FileGenerator.  The render callback only reads
+// descriptors and params, so the callbacks of any number of these may run
+// concurrently; the rendered contents are then written out in list order.
+struct GeneratedJavaFile {
+  GeneratedJavaFile() : render_seconds(0) {}
+
+  string filename;
+  std::function<void(io::Printer*)> render;
+  string contents;
+  // Time spent in render, for generation_stats_file.
+  double render_seconds;
+};
+
 class FileGenerator {
  public:
   explicit FileGenerator(const FileDescriptor* file, const Params& params);
@@ -67,22 +86,43 @@ class FileGenerator {
 
   void Generate(io::Printer* printer);
 
-  // If we aren't putting everything into one file, this will write all the
-  // files other than the outer file (i.e. one for each message, enum, and
-  // service type).
-  void GenerateSiblings(const string& package_dir,
-                        GeneratorContext* output_directory,
-                        vector<string>* file_list);
+  // Appends every file this generator produces to java_files: the outer
+  // class if one is needed, then, if we aren't putting everything into one
+  // file, one sibling file for each message and enum type.  The generator
+  // must outlive the render callbacks.
+  void ListJavaFiles(const string& package_dir,
+                     vector<GeneratedJavaFile>* java_files);
+
+  // Adds the number of fields handled by each FieldGenerator class in this
+  // file to counts.
+  void CountFieldGenerators(map<string, int>* counts) const;
+
+  // If set, the seconds spent generating file->message_type(i) are stored in
+  // (*message_seconds)[i].  Each top-level message is generated by exactly
+  // one render callback, so concurrent callbacks never share an element.
+  void set_message_seconds(vector<double>* message_seconds) {
+    message_seconds_ = message_seconds;
+  }
 
   const string& java_package() { return java_package_; }
   const string& classname()    { return classname_;    }
 
  private:
+  void GenerateMessage(int index, io::Printer* printer);
+
   const FileDescriptor* file_;
   const Params& params_;
   string java_package_;
   string classname_;
 
+  // Built once for the whole file and shared by the outer class and the
+  // sibling files.
+  vector<std::unique_ptr<ExtensionGenerator> > extension_generators_;
+  vector<std::unique_ptr<EnumGenerator> > enum_generators_;
+  vector<std::unique_ptr<MessageGenerator> > message_generators_;
+
+  vector<double>* message_seconds_;
+
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(FileGenerator);
 };
 
@@ -0,0 +1,339 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// http://code.google.com/p/protobuf/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+
+#include <google/protobuf/compiler/javanano/javanano_generation_stats.h>
+#include <google/protobuf/stubs/strutil.h>
+
+namespace google {
+namespace protobuf {
+namespace compiler {
+namespace javanano {
+
+namespace {
+
+// Only this many of the largest method bodies are reported.
+const int kMaxReportedMethods = 20;
+
+bool IsIdentifierChar(char c) {
+  return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z')
+      || ('0' <= c && c <= '9') || c == '_' || c == '$';
+}
+
+// Returns the words of a declaration header, dropping leading annotations
+// like "@Override" or "@SuppressWarnings(...)" but keeping "@interface".
+vector<string> DeclarationWords(const string& header) {
+  string text = header;
+  for (;;) {
+    string::size_type start = text.find_first_not_of(' ');
+    if (start == string::npos || text[start] != '@'
+        || text.compare(start, 10, "@interface") == 0) {
+      break;
+    }
+    string::size_type end = start + 1;
+    while (end < text.size() && (IsIdentifierChar(text[end])
+                                 || text[end] == '.')) {
+      end++;
+    }
+    while (end < text.size() && text[end] == ' ') end++;
+    if (end < text.size() && text[end] == '(') {
+      int depth = 0;
+      for (; end < text.size(); end++) {
+        if (text[end] == '(') depth++;
+        if (text[end] == ')' && --depth == 0) break;
+      }
+      end++;
+    }
+    text.erase(0, end);
+  }
+  vector<string> words;
+  SplitStringUsing(text, " ", &words);
+  return words;
+}
+
+bool IsControlKeyword(const string& word) {
+  static const char* const kKeywords[] = {
+    "if", "else", "for", "while", "do", "switch", "case", "default", "try",
+    "catch", "finally", "synchronized", "return", "new",
+  };
+  for (int i = 0; i < GOOGLE_ARRAYSIZE(kKeywords); i++) {
+    if (word == kKeywords[i]) return true;
+  }
+  return false;
+}
+
+void AppendJsonString(const string& value, string* json) {
+  json->push_back('"');
+  for (int i = 0; i < value.size(); i++) {
+    char c = value[i];
+    if (c == '"' || c == '\\') {
+      json->push_back('\\');
+      json->push_back(c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      static const char kHexDigits[] = "0123456789abcdef";
+      json->append("\\u00");
+      json->push_back(kHexDigits[(c >> 4) & 0xf]);
+      json->push_back(kHexDigits[c & 0xf]);
+    } else {
+      json->push_back(c);
+    }
+  }
+  json->push_back('"');
+}
+
+void AppendFieldGenerators(const map<string, int>& counts, string* json) {
+  json->append("{");
+  for (map<string, int>::const_iterator it = counts.begin();
+       it != counts.end(); ++it) {
+    if (it != counts.begin()) json->append(", ");
+    AppendJsonString(it->first, json);
+    json->append(": " + SimpleItoa(it->second));
+  }
+  json->append("}");
+}
+
+}  // namespace
+
+GenerationStats::GenerationStats() {}
+GenerationStats::~GenerationStats() {}
+
+void GenerationStats::AddProtoFile(const string& name) {
+  proto_files_.push_back(ProtoFile());
+  proto_files_.back().name = name;
+  proto_files_.back().seconds = 0;
+}
+
+void GenerationStats::AddSeconds(double seconds) {
+  proto_files_.back().seconds += seconds;
+}
+
+void GenerationStats::AddMessage(const string& full_name, double seconds) {
+  proto_files_.back().messages.push_back(std::make_pair(full_name, seconds));
+}
+
+void GenerationStats::AddFieldGenerators(const map<string, int>& counts) {
+  map<string, int>& field_generators = proto_files_.back().field_generators;
+  for (map<string, int>::const_iterator it = counts.begin();
+       it != counts.end(); ++it) {
+    field_generators[it->first] += it->second;
+  }
+}
+
+void GenerationStats::AddJavaFile(const string& filename,
+                                  const string& contents) {
+  JavaFile java_file;
+  java_file.name = filename;
+  java_file.bytes = contents.size();
+  java_file.up_to_date = false;
+  proto_files_.back().java_files.push_back(java_file);
+  ScanMethods(filename, contents);
+}
+
+void GenerationStats::AddUpToDateJavaFile(const string& filename) {
+  JavaFile java_file;
+  java_file.name = filename;
+  java_file.bytes = 0;
+  java_file.up_to_date = true;
+  proto_files_.back().java_files.push_back(java_file);
+}
+
+// Matches braces to find the method bodies.  This is not a Java parser; it
+// only has to understand the code this generator emits, and skips comments
+// and literals so that braces inside them are not counted.
+void GenerationStats::ScanMethods(const string& filename,
+                                  const string& contents) {
+  struct Block {
+    string class_name;  // Set if this is the body of a type.
+    string method_name;  // Set if this is the body of a method.
+    size_t start;
+  };
+  vector<Block> blocks;
+  // The declaration or statement preceding the next brace, with all
+  // whitespace turned into single spaces.
+  string header;
+  size_t header_start = string::npos;
+
+  for (size_t i = 0; i < contents.size(); i++) {
+    char c = contents[i];
+    char next = i + 1 < contents.size() ? contents[i + 1] : '\0';
+    if (c == '/' && next == '/') {
+      i = contents.find('\n', i);
+      if (i == string::npos) break;
+    } else if (c == '/' && next == '*') {
+      i = contents.find("*/", i + 2);
+      if (i == string::npos) break;
+      i++;
+    } else if (c == '"' || c == '\'') {
+      if (header_start == string::npos) header_start = i;
+      for (i++; i < contents.size() && contents[i] != c; i++) {
+        if (contents[i] == '\\') i++;
+      }
+      header.push_back(c);
+      header.push_back(c);
+    } else if (c == '{') {
+      Block block;
+      block.start = header_start == string::npos ? i : header_start;
+      vector<string> words = DeclarationWords(header);
+      for (int j = 0; j + 1 < words.size(); j++) {
+        if (words[j] == "class" || words[j] == "interface"
+            || words[j] == "@interface" || words[j] == "enum") {
+          block.class_name = words[j + 1];
+          break;
+        }
+      }
+      string::size_type paren = header.find('(');
+      if (block.class_name.empty() && !words.empty()
+          && !IsControlKeyword(words[0]) && paren != string::npos
+          && header.find('=') == string::npos) {
+        string::size_type end = header.find_last_not_of(' ', paren - 1);
+        string::size_type start = end;
+        while (start > 0 && IsIdentifierChar(header[start - 1])) start--;
+        block.method_name = header.substr(start, end + 1 - start);
+      }
+      blocks.push_back(block);
+      header.clear();
+      header_start = string::npos;
+    } else if (c == '}' || c == ';') {
+      if (c == '}' && !blocks.empty()) {
+        const Block& block = blocks.back();
+        if (!block.method_name.empty()) {
+          Method method;
+          method.java_file = filename;
+          for (int j = 0; j < blocks.size(); j++) {
+            if (blocks[j].class_name.empty()) continue;
+            method.name += blocks[j].class_name + ".";
+          }
+          method.name += block.method_name;
+          method.bytes = i + 1 - block.start;
+          method.lines = 1 + std::count(contents.begin() + block.start,
+                                        contents.begin() + i, '\n');
+          methods_.push_back(method);
+        }
+        blocks.pop_back();
+      }
+      header.clear();
+      header_start = string::npos;
+    } else if (c == ' ' || c == '\n' || c == '\t' || c == '\r') {
+      if (!header.empty() && header[header.size() - 1] != ' ') {
+        header.push_back(' ');
+      }
+    } else {
+      if (header_start == string::npos) header_start = i;
+      header.push_back(c);
+    }
+  }
+}
+
+string GenerationStats::ToJson() const {
+  string json = "{\n  \"proto_files\": [";
+  double total_seconds = 0;
+  size_t total_bytes = 0;
+  map<string, int> total_field_generators;
+  for (int i = 0; i < proto_files_.size(); i++) {
+    const ProtoFile& proto_file = proto_files_[i];
+    size_t java_bytes = 0;
+    for (int j = 0; j < proto_file.java_files.size(); j++) {
+      java_bytes += proto_file.java_files[j].bytes;
+    }
+    total_seconds += proto_file.seconds;
+    total_bytes += java_bytes;
+    for (map<string, int>::const_iterator it =
+             proto_file.field_generators.begin();
+         it != proto_file.field_generators.end(); ++it) {
+      total_field_generators[it->first] += it->second;
+    }
+
+    json.append(i == 0 ? "{\n" : ", {\n");
+    json.append("    \"name\": ");
+    AppendJsonString(proto_file.name, &json);
+    json.append(",\n    \"seconds\": " + SimpleDtoa(proto_file.seconds));
+    json.append(",\n    \"java_bytes\": " + SimpleItoa(java_bytes));
+    json.append(",\n    \"messages\": [");
+    for (int j = 0; j < proto_file.messages.size(); j++) {
+      json.append(j == 0 ? "\n      {\"name\": " : ",\n      {\"name\": ");
+      AppendJsonString(proto_file.messages[j].first, &json);
+      json.append(", \"seconds\": "
+                  + SimpleDtoa(proto_file.messages[j].second) + "}");
+    }
+    json.append(proto_file.messages.empty() ? "]" : "\n    ]");
+    json.append(",\n    \"field_generators\": ");
+    AppendFieldGenerators(proto_file.field_generators, &json);
+    json.append(",\n    \"java_files\": [");
+    for (int j = 0; j < proto_file.java_files.size(); j++) {
+      const JavaFile& java_file = proto_file.java_files[j];
+      json.append(j == 0 ? "\n      {\"name\": " : ",\n      {\"name\": ");
+      AppendJsonString(java_file.name, &json);
+      if (java_file.up_to_date) {
+        json.append(", \"up_to_date\": true}");
+      } else {
+        json.append(", \"bytes\": " + SimpleItoa(java_file.bytes) + "}");
+      }
+    }
+    json.append(proto_file.java_files.empty() ? "]" : "\n    ]");
+    json.append("\n  }");
+  }
+  json.append("],\n");
+
+  json.append("  \"seconds\": " + SimpleDtoa(total_seconds) + ",\n");
+  json.append("  \"java_bytes\": " + SimpleItoa(total_bytes) + ",\n");
+  json.append("  \"field_generators\": ");
+  AppendFieldGenerators(total_field_generators, &json);
+  json.append(",\n");
+
+  // Largest first; ties are broken by position so the report is stable.
+  vector<const Method*> methods;
+  for (int i = 0; i < methods_.size(); i++) {
+    methods.push_back(&methods_[i]);
+  }
+  std::stable_sort(methods.begin(), methods.end(),
+                   [](const Method* a, const Method* b) {
+                     return a->bytes > b->bytes;
+                   });
+  if (methods.size() > kMaxReportedMethods) {
+    methods.resize(kMaxReportedMethods);
+  }
+  json.append("  \"largest_methods\": [");
+  for (int i = 0; i < methods.size(); i++) {
+    json.append(i == 0 ? "\n    {\"java_file\": " : ",\n    {\"java_file\": ");
+    AppendJsonString(methods[i]->java_file, &json);
+    json.append(", \"method\": ");
+    AppendJsonString(methods[i]->name, &json);
+    json.append(", \"bytes\": " + SimpleItoa(methods[i]->bytes));
+    json.append(", \"lines\": " + SimpleItoa(methods[i]->lines) + "}");
+  }
+  json.append(methods.empty() ? "]\n}\n" : "\n  ]\n}\n");
+  return json;
+}
+
+}  // namespace javanano
+}  // namespace compiler
+}  // namespace protobuf
+}  // namespace google
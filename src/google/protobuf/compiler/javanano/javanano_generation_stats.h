@@ -0,0 +1,121 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// http://code.google.com/p/protobuf/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Report of where the time and the generated code of a generator run go,
+// written by the generation_stats_file generator option.
+
+#ifndef GOOGLE_PROTOBUF_COMPILER_JAVANANO_GENERATION_STATS_H__
+#define GOOGLE_PROTOBUF_COMPILER_JAVANANO_GENERATION_STATS_H__
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <google/protobuf/stubs/common.h>
+#include <google/protobuf/compiler/javanano/javanano_params.h>
+
+namespace google {
+namespace protobuf {
+namespace compiler {
+namespace javanano {
+
+// Collects per-file statistics and renders them as a JSON document:
+//
+//   {
+//     "proto_files": [{
+//       "name": "foo.proto",
+//       "seconds": ...,            // setup plus rendering of all its outputs
+//       "java_bytes": ...,
+//       "messages": [{"name": "pkg.Foo", "seconds": ...}, ...],
+//       "field_generators": {"PrimitiveFieldGenerator": 3, ...},
+//       "java_files": [{"name": "pkg/Foo.java", "bytes": ...}, ...]
+//     }, ...],
+//     "seconds": ..., "java_bytes": ..., "field_generators": {...},
+//     "largest_methods": [{"java_file": "pkg/Foo.java",
+//                          "method": "Foo.Bar.mergeFrom",
+//                          "bytes": ..., "lines": ...}, ...]
+//   }
+//
+// Message times are those of the top-level messages, each including its
+// nested types.  Files skipped by incremental_cache_dir are listed with
+// "up_to_date": true instead of a size, and their messages report no time.
+class GenerationStats {
+ public:
+  GenerationStats();
+  ~GenerationStats();
+
+  // Starts the entry of a .proto file; the calls below add to the entry of
+  // the most recently added file.
+  void AddProtoFile(const string& name);
+  void AddSeconds(double seconds);
+  void AddMessage(const string& full_name, double seconds);
+  void AddFieldGenerators(const map<string, int>& counts);
+
+  // Records a rendered .java file and scans it for method bodies.
+  void AddJavaFile(const string& filename, const string& contents);
+  // Records a .java file which was not rendered because it is up to date.
+  void AddUpToDateJavaFile(const string& filename);
+
+  string ToJson() const;
+
+ private:
+  struct JavaFile {
+    string name;
+    size_t bytes;
+    bool up_to_date;
+  };
+  struct ProtoFile {
+    string name;
+    double seconds;
+    vector<std::pair<string, double> > messages;
+    map<string, int> field_generators;
+    vector<JavaFile> java_files;
+  };
+  struct Method {
+    string java_file;
+    string name;
+    size_t bytes;
+    int lines;
+  };
+
+  void ScanMethods(const string& filename, const string& contents);
+
+  vector<ProtoFile> proto_files_;
+  vector<Method> methods_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(GenerationStats);
+};
+
+}  // namespace javanano
+}  // namespace compiler
+}  // namespace protobuf
+
+}  // namespace google
+#endif  // GOOGLE_PROTOBUF_COMPILER_JAVANANO_GENERATION_STATS_H__
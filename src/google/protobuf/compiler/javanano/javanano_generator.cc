@@ -32,12 +32,20 @@
 //  Based on original Protocol Buffers design by
 //  Sanjay Ghemawat, Jeff Dean, and others.
 
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <thread>
+
 #include <google/protobuf/compiler/javanano/javanano_params.h>
 #include <google/protobuf/compiler/javanano/javanano_generator.h>
 #include <google/protobuf/compiler/javanano/javanano_file.h>
+#include <google/protobuf/compiler/javanano/javanano_generation_stats.h>
 #include <google/protobuf/compiler/javanano/javanano_helpers.h>
+#include <google/protobuf/compiler/javanano/javanano_output_cache.h>
 #include <google/protobuf/io/printer.h>
 #include <google/protobuf/io/zero_copy_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 #include <google/protobuf/descriptor.pb.h>
 #include <google/protobuf/stubs/strutil.h>
 
@@ -59,11 +67,17 @@ string TrimString(const string& s) {
 
 } // namespace
 
-void UpdateParamsRecursively(Params& params,
+void CollectDeclaredOptions(DeclaredJavaOptions* options,
     const FileDescriptor* file) {
+  // Diamond-shaped imports reach the same file along many paths; only the
+  // first visit needs to do anything.
+  if (!options->MarkVisited(file->name())) {
+    return;
+  }
+
   // Add any parameters for this file
   if (file->options().has_java_outer_classname()) {
-    params.set_java_outer_classname(
+    options->set_java_outer_classname(
       file->name(), file->options().java_outer_classname());
   }
   if (file->options().has_java_package()) {
@@ -72,49 +86,115 @@ void UpdateParamsRecursively(Params& params,
       result += ".";
     }
     result += "nano";
-    params.set_java_package(
+    options->set_java_package(
       file->name(), result);
   }
   if (file->options().has_java_multiple_files()) {
-    params.set_java_multiple_files(
+    options->set_java_multiple_files(
       file->name(), file->options().java_multiple_files());
   }
 
   // Loop through all dependent files recursively
   // adding dep
   for (int i = 0; i < file->dependency_count(); i++) {
-    UpdateParamsRecursively(params, file->dependency(i));
+    CollectDeclaredOptions(options, file->dependency(i));
   }
 }
 
-JavaNanoGenerator::JavaNanoGenerator() {}
-JavaNanoGenerator::~JavaNanoGenerator() {}
-
-bool JavaNanoGenerator::Generate(const FileDescriptor* file,
-                             const string& parameter,
-                             GeneratorContext* output_directory,
-                             string* error) const {
-  vector<std::pair<string, string> > options;
+namespace {
 
-  ParseGeneratorParameter(parameter, &options);
-
-  // -----------------------------------------------------------------
-  // parse generator options
+// Options controlling the generator run itself rather than the generated
+// code.
+struct RunOptions {
+  RunOptions() : num_threads(1) {}
 
   // Name a file where we will write a list of generated file names, one
   // per line.
   string output_list_file;
-  Params params(file->name());
+  // Number of threads used to render the output files.  0 means one per
+  // hardware thread; the default of 1 renders everything serially.
+  int num_threads;
+  // If set, files whose inputs are unchanged since they were last generated
+  // into incremental_output_dir are neither rendered nor written.
+  string incremental_cache_dir;
+  string incremental_output_dir;
+  // Name a file where we will write a JSON report of the time spent and the
+  // code generated per file; see GenerationStats.
+  string generation_stats_file;
+};
+
+bool IsRunOption(const string& option_name) {
+  return option_name == "output_list_file"
+      || option_name == "num_threads"
+      || option_name == "incremental_cache_dir"
+      || option_name == "incremental_output_dir"
+      || option_name == "generation_stats_file";
+}
 
-  // Update per file params
-  UpdateParamsRecursively(params, file);
+// Per-file state for one generation run.  Everything a render callback
+// touches lives here, so it must stay alive until all files are written.
+struct FileGenerationState {
+  std::unique_ptr<Params> params;
+  std::unique_ptr<FileGenerator> generator;
+  vector<GeneratedJavaFile> java_files;
+  // With incremental_cache_dir: the cache key of this file's outputs, and
+  // which of java_files can be skipped.
+  string cache_key;
+  vector<bool> up_to_date;
+  // With generation_stats_file: the time spent before rendering, and the
+  // render time of each top-level message.
+  double setup_seconds;
+  vector<double> message_seconds;
+};
 
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+// Reads the full names of the used fields and messages from the given
+// used_fields_manifest, one per line.  Blank lines and lines starting with
+// '#' are ignored.
+bool ReadUsedFieldsManifest(const string& path, set<string>* used_fields,
+                            string* error) {
+  std::ifstream input(path.c_str());
+  if (!input) {
+    *error = "Cannot read used_fields_manifest '" + path + "'";
+    return false;
+  }
+  string line;
+  while (std::getline(input, line)) {
+    line = TrimString(line);
+    if (line.empty() || line[0] == '#') continue;
+    used_fields->insert(line);
+  }
+  return true;
+}
+
+bool ParseParams(const FileDescriptor* file,
+                 const vector<std::pair<string, string> >& options,
+                 Params* params,
+                 RunOptions* run_options,
+                 string* error) {
   // Replace any existing options with ones from command line
   for (int i = 0; i < options.size(); i++) {
     string option_name = TrimString(options[i].first);
     string option_value = TrimString(options[i].second);
     if (option_name == "output_list_file") {
-      output_list_file = option_value;
+      run_options->output_list_file = option_value;
+    } else if (option_name == "incremental_cache_dir") {
+      run_options->incremental_cache_dir = option_value;
+    } else if (option_name == "incremental_output_dir") {
+      run_options->incremental_output_dir = option_value;
+    } else if (option_name == "generation_stats_file") {
+      run_options->generation_stats_file = option_value;
+    } else if (option_name == "num_threads") {
+      int* num_threads = &run_options->num_threads;
+      if (!safe_strto32(option_value, num_threads) || *num_threads < 0) {
+        *error = "Bad num_threads, expecting a non-negative integer found '"
+          + option_value + "'";
+        return false;
+      }
     } else if (option_name == "java_package") {
         vector<string> parts;
         SplitStringUsing(option_value, "|", &parts);
@@ -123,7 +203,7 @@ bool JavaNanoGenerator::Generate(const FileDescriptor* file,
             + option_value + "'";
           return false;
         }
-        params.set_java_package(parts[0], parts[1]);
+        params->set_java_package(parts[0], parts[1]);
     } else if (option_name == "java_outer_classname") {
         vector<string> parts;
         SplitStringUsing(option_value, "|", &parts);
@@ -133,36 +213,79 @@ bool JavaNanoGenerator::Generate(const FileDescriptor* file,
                    + option_value + "'";
           return false;
         }
-        params.set_java_outer_classname(parts[0], parts[1]);
+        params->set_java_outer_classname(parts[0], parts[1]);
     } else if (option_name == "store_unknown_fields") {
-      params.set_store_unknown_fields(option_value == "true");
+      params->set_store_unknown_fields(option_value == "true");
     } else if (option_name == "java_multiple_files") {
-      params.set_override_java_multiple_files(option_value == "true");
+      params->set_override_java_multiple_files(option_value == "true");
     } else if (option_name == "java_nano_generate_has") {
-      params.set_generate_has(option_value == "true");
+      params->set_generate_has(option_value == "true");
     } else if (option_name == "enum_style") {
-      params.set_java_enum_style(option_value == "java");
+      params->set_java_enum_style(option_value == "java");
     } else if (option_name == "optional_field_style") {
-      params.set_optional_field_accessors(option_value == "accessors");
-      params.set_use_reference_types_for_primitives(option_value == "reftypes"
+      params->set_optional_field_accessors(option_value == "accessors");
+      params->set_use_reference_types_for_primitives(option_value == "reftypes"
           || option_value == "reftypes_compat_mode");
-      params.set_reftypes_primitive_enums(
+      params->set_reftypes_primitive_enums(
           option_value == "reftypes_compat_mode");
       if (option_value == "reftypes_compat_mode") {
-        params.set_generate_clear(false);
+        params->set_generate_clear(false);
       }
     } else if (option_name == "generate_equals") {
-      params.set_generate_equals(option_value == "true");
+      params->set_generate_equals(option_value == "true");
     } else if (option_name == "ignore_services") {
-      params.set_ignore_services(option_value == "true");
+      params->set_ignore_services(option_value == "true");
     } else if (option_name == "parcelable_messages") {
-      params.set_parcelable_messages(option_value == "true");
+      params->set_parcelable_messages(option_value == "true");
     } else if (option_name == "generate_clone") {
-      params.set_generate_clone(option_value == "true");
+      params->set_generate_clone(option_value == "true");
     } else if (option_name == "generate_intdefs") {
-      params.set_generate_intdefs(option_value == "true");
+      params->set_generate_intdefs(option_value == "true");
     } else if (option_name == "generate_clear") {
-      params.set_generate_clear(option_value == "true");
+      params->set_generate_clear(option_value == "true");
+    } else if (option_name == "used_fields_manifest") {
+      // Read once per run by GenerateFiles().
+    } else if (option_name == "max_method_size") {
+      int max_method_size;
+      if (!safe_strto32(option_value, &max_method_size)
+          || max_method_size < 0) {
+        *error = "Bad max_method_size, expecting a non-negative integer "
+          "found '" + option_value + "'";
+        return false;
+      }
+      params->set_max_method_size(max_method_size);
+    } else if (option_name == "codegen_style") {
+      if (option_value != "unrolled" && option_value != "table") {
+        *error = "Bad codegen_style, expecting 'unrolled' or 'table' "
+          "found '" + option_value + "'";
+        return false;
+      }
+      params->set_table_driven_codegen(option_value == "table");
+    } else if (option_name == "field_dispatch") {
+      if (option_value != "auto" && option_value != "switch") {
+        *error = "Bad field_dispatch, expecting 'auto' or 'switch' "
+          "found '" + option_value + "'";
+        return false;
+      }
+      params->set_dense_field_dispatch(option_value == "auto");
+    } else if (option_name == "single_pass_repeated_fields") {
+      params->set_single_pass_repeated_fields(option_value == "true");
+    } else if (option_name == "array_parser") {
+      params->set_array_parser(option_value == "true");
+    } else if (option_name == "reverse_serializer") {
+      params->set_reverse_serializer(option_value == "true");
+    } else if (option_name == "lazy_message_fields") {
+      if (option_value == "none") {
+        params->set_lazy_message_fields(JAVANANO_LAZY_NONE);
+      } else if (option_value == "marked") {
+        params->set_lazy_message_fields(JAVANANO_LAZY_MARKED);
+      } else if (option_value == "all") {
+        params->set_lazy_message_fields(JAVANANO_LAZY_ALL);
+      } else {
+        *error = "Bad lazy_message_fields, expecting 'none', 'marked' or "
+          "'all' found '" + option_value + "'";
+        return false;
+      }
     } else {
       *error = "Ignore unknown javanano generator option: " + option_name;
     }
@@ -172,52 +295,291 @@ bool JavaNanoGenerator::Generate(const FileDescriptor* file,
   // Note: the enum-like optional_field_style generator param ensures
   // that we can never have illegal combinations of field styles
   // (e.g. reftypes and accessors can't be on at the same time).
-  if (params.generate_has()
-      && (params.optional_field_accessors()
-          || params.use_reference_types_for_primitives())) {
+  if (params->generate_has()
+      && (params->optional_field_accessors()
+          || params->use_reference_types_for_primitives())) {
     error->assign("java_nano_generate_has=true cannot be used in conjunction"
         " with optional_field_style=accessors or optional_field_style=reftypes");
     return false;
   }
 
+  return true;
+}
+
+void RenderJavaFile(GeneratedJavaFile* java_file) {
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  {
+    io::StringOutputStream output(&java_file->contents);
+    io::Printer printer(&output, '$');
+    java_file->render(&printer);
+  }
+  java_file->render_seconds = SecondsSince(start);
+}
+
+// Renders all files on up to num_threads workers.  Each worker claims the
+// next unrendered file from a shared counter, so one huge message doesn't
+// hold up the rest of the queue.  Every file renders into its own buffer,
+// hence the output does not depend on scheduling.
+void RenderJavaFiles(const vector<GeneratedJavaFile*>& java_files,
+                     int num_threads) {
+  if (num_threads > java_files.size()) {
+    num_threads = java_files.size();
+  }
+  if (num_threads <= 1) {
+    for (int i = 0; i < java_files.size(); i++) {
+      RenderJavaFile(java_files[i]);
+    }
+    return;
+  }
+
+  std::atomic<size_t> next_file(0);
+  auto worker = [&java_files, &next_file]() {
+    for (size_t i = next_file++; i < java_files.size(); i = next_file++) {
+      RenderJavaFile(java_files[i]);
+    }
+  };
+  vector<std::thread> workers;
+  for (int i = 1; i < num_threads; i++) {
+    workers.push_back(std::thread(worker));
+  }
+  worker();
+  for (int i = 0; i < workers.size(); i++) {
+    workers[i].join();
+  }
+}
+
+}  // namespace
+
+JavaNanoGenerator::JavaNanoGenerator() {}
+JavaNanoGenerator::~JavaNanoGenerator() {}
+
+bool JavaNanoGenerator::Generate(const FileDescriptor* file,
+                             const string& parameter,
+                             GeneratorContext* output_directory,
+                             string* error) const {
+  std::vector<const FileDescriptor*> files(1, file);
+  return GenerateFiles(files, parameter, output_directory, false, error);
+}
+
+bool JavaNanoGenerator::GenerateAll(
+    const std::vector<const FileDescriptor*>& files,
+    const string& parameter,
+    GeneratorContext* generator_context,
+    string* error) const {
+  return GenerateFiles(files, parameter, generator_context, true, error);
+}
+
+bool JavaNanoGenerator::GenerateFiles(
+    const std::vector<const FileDescriptor*>& files,
+    const string& parameter,
+    GeneratorContext* output_directory,
+    bool prefix_errors,
+    string* error) const {
+  vector<std::pair<string, string> > options;
+
+  ParseGeneratorParameter(parameter, &options);
+
+  RunOptions run_options;
+
+  // -----------------------------------------------------------------
+  // parse generator options and validate every file before rendering any.
+
+  // The options declared in all files and their dependencies are collected
+  // once and shared by the params of every file.
+  std::shared_ptr<DeclaredJavaOptions> declared_options(
+      new DeclaredJavaOptions());
+  for (int i = 0; i < files.size(); i++) {
+    CollectDeclaredOptions(declared_options.get(), files[i]);
+  }
+
+  // So is the used_fields_manifest, if any.
+  std::shared_ptr<set<string> > used_fields;
+  for (int i = 0; i < options.size(); i++) {
+    if (TrimString(options[i].first) != "used_fields_manifest") continue;
+    used_fields.reset(new set<string>());
+    if (!ReadUsedFieldsManifest(TrimString(options[i].second),
+                                used_fields.get(), error)) {
+      return false;
+    }
+  }
+
+  vector<FileGenerationState> states(files.size());
+  for (int i = 0; i < files.size(); i++) {
+    const FileDescriptor* file = files[i];
+    FileGenerationState& state = states[i];
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    state.params.reset(new Params(file->name()));
+    state.params->set_declared_options(declared_options);
+    state.params->set_used_fields(used_fields);
+    if (!ParseParams(file, options, state.params.get(), &run_options,
+                     error)) {
+      if (prefix_errors) *error = file->name() + ": " + *error;
+      return false;
+    }
+
+    state.generator.reset(new FileGenerator(file, *state.params));
+    if (!state.generator->Validate(error)) {
+      if (prefix_errors) *error = file->name() + ": " + *error;
+      return false;
+    }
+
+    string package_dir =
+      StringReplace(state.generator->java_package(), ".", "/", true);
+    if (!package_dir.empty()) package_dir += "/";
+
+    state.generator->ListJavaFiles(package_dir, &state.java_files);
+    state.setup_seconds = SecondsSince(start);
+  }
+
+  bool collect_stats = !run_options.generation_stats_file.empty();
+  if (collect_stats) {
+    for (int i = 0; i < states.size(); i++) {
+      states[i].message_seconds.resize(files[i]->message_type_count(), 0);
+      states[i].generator->set_message_seconds(&states[i].message_seconds);
+    }
+  }
+
   // -----------------------------------------------------------------
+  // find the files which are unchanged since the last run, if requested.
 
-  FileGenerator file_generator(file, params);
-  if (!file_generator.Validate(error)) {
-    return false;
+  std::unique_ptr<OutputCache> output_cache;
+  if (!run_options.incremental_cache_dir.empty()) {
+    if (run_options.incremental_output_dir.empty()) {
+      *error = "incremental_cache_dir requires incremental_output_dir, the "
+               "directory given to --javanano_out";
+      return false;
+    }
+    // Everything that affects the generated code is either in the options
+    // or in the descriptors, so those make up the cache key.
+    string generator_options;
+    for (int i = 0; i < options.size(); i++) {
+      string option_name = TrimString(options[i].first);
+      if (IsRunOption(option_name)
+          || option_name == "used_fields_manifest") {
+        continue;
+      }
+      generator_options += option_name + "="
+          + TrimString(options[i].second) + "\n";
+    }
+    // The manifest counts with its contents rather than its path.
+    if (used_fields != NULL) {
+      for (set<string>::const_iterator it = used_fields->begin();
+           it != used_fields->end(); ++it) {
+        generator_options += "used_field=" + *it + "\n";
+      }
+    }
+    output_cache.reset(new OutputCache(run_options.incremental_cache_dir,
+                                       run_options.incremental_output_dir,
+                                       generator_options));
+  }
+  for (int i = 0; i < states.size(); i++) {
+    FileGenerationState& state = states[i];
+    state.up_to_date.resize(state.java_files.size(), false);
+    if (output_cache == NULL) continue;
+    state.cache_key = output_cache->ComputeKey(files[i]);
+    for (int j = 0; j < state.java_files.size(); j++) {
+      state.up_to_date[j] = output_cache->IsUpToDate(
+          state.java_files[j].filename, state.cache_key);
+    }
   }
 
-  string package_dir =
-    StringReplace(file_generator.java_package(), ".", "/", true);
-  if (!package_dir.empty()) package_dir += "/";
+  // -----------------------------------------------------------------
+  // render all files of all protos, possibly in parallel.
 
-  vector<string> all_files;
+  int num_threads = run_options.num_threads;
+  if (num_threads == 0) {
+    num_threads = std::thread::hardware_concurrency();
+  }
+  vector<GeneratedJavaFile*> all_java_files;
+  for (int i = 0; i < states.size(); i++) {
+    for (int j = 0; j < states[i].java_files.size(); j++) {
+      if (states[i].up_to_date[j]) continue;
+      all_java_files.push_back(&states[i].java_files[j]);
+    }
+  }
+  RenderJavaFiles(all_java_files, num_threads);
 
-  if (IsOuterClassNeeded(params, file)) {
-    string java_filename = package_dir;
-    java_filename += file_generator.classname();
-    java_filename += ".java";
-    all_files.push_back(java_filename);
+  // -----------------------------------------------------------------
+  // write everything out in deterministic order.
 
-    // Generate main java file.
-    std::unique_ptr<io::ZeroCopyOutputStream> output(
-      output_directory->Open(java_filename));
-    io::Printer printer(output.get(), '$');
-    file_generator.Generate(&printer);
+  for (int i = 0; i < states.size(); i++) {
+    const FileGenerationState& state = states[i];
+    for (int j = 0; j < state.java_files.size(); j++) {
+      // Files skipped by the incremental cache are left untouched on disk.
+      if (state.up_to_date[j]) continue;
+      const GeneratedJavaFile& java_file = state.java_files[j];
+      {
+        std::unique_ptr<io::ZeroCopyOutputStream> output(
+          output_directory->Open(java_file.filename));
+        io::Printer printer(output.get(), '$');
+        printer.WriteRaw(java_file.contents.data(),
+                         java_file.contents.size());
+      }
+    }
+
+    // Generate output list if requested.  It always lists all files,
+    // including those skipped by the incremental cache.
+    if (!run_options.output_list_file.empty()) {
+      // Generate output list.  This is just a simple text file placed in a
+      // deterministic location which lists the .java files being generated.
+      std::unique_ptr<io::ZeroCopyOutputStream> srclist_raw_output(
+        output_directory->Open(run_options.output_list_file));
+      io::Printer srclist_printer(srclist_raw_output.get(), '$');
+      for (int j = 0; j < state.java_files.size(); j++) {
+        srclist_printer.Print("$filename$\n",
+                              "filename", state.java_files[j].filename);
+      }
+    }
   }
 
-  // Generate sibling files.
-  file_generator.GenerateSiblings(package_dir, output_directory, &all_files);
+  // Generate the statistics report if requested.
+  if (collect_stats) {
+    GenerationStats stats;
+    for (int i = 0; i < states.size(); i++) {
+      const FileGenerationState& state = states[i];
+      stats.AddProtoFile(files[i]->name());
+      stats.AddSeconds(state.setup_seconds);
+      for (int j = 0; j < state.message_seconds.size(); j++) {
+        stats.AddMessage(files[i]->message_type(j)->full_name(),
+                         state.message_seconds[j]);
+      }
+      map<string, int> field_generators;
+      state.generator->CountFieldGenerators(&field_generators);
+      stats.AddFieldGenerators(field_generators);
+      for (int j = 0; j < state.java_files.size(); j++) {
+        const GeneratedJavaFile& java_file = state.java_files[j];
+        if (state.up_to_date[j]) {
+          stats.AddUpToDateJavaFile(java_file.filename);
+        } else {
+          stats.AddSeconds(java_file.render_seconds);
+          stats.AddJavaFile(java_file.filename, java_file.contents);
+        }
+      }
+    }
+
+    std::unique_ptr<io::ZeroCopyOutputStream> stats_output(
+      output_directory->Open(run_options.generation_stats_file));
+    io::Printer stats_printer(stats_output.get(), '$');
+    string json = stats.ToJson();
+    stats_printer.WriteRaw(json.data(), json.size());
+  }
 
-  // Generate output list if requested.
-  if (!output_list_file.empty()) {
-    // Generate output list.  This is just a simple text file placed in a
-    // deterministic location which lists the .java files being generated.
-    std::unique_ptr<io::ZeroCopyOutputStream> srclist_raw_output(
-      output_directory->Open(output_list_file));
-    io::Printer srclist_printer(srclist_raw_output.get(), '$');
-    for (int i = 0; i < all_files.size(); i++) {
-      srclist_printer.Print("$filename$\n", "filename", all_files[i]);
+  // Record the files in the incremental cache only now that all of them
+  // have been generated; protoc writes none of them out on failure.
+  if (output_cache != NULL) {
+    for (int i = 0; i < states.size(); i++) {
+      const FileGenerationState& state = states[i];
+      for (int j = 0; j < state.java_files.size(); j++) {
+        if (state.up_to_date[j]) continue;
+        const GeneratedJavaFile& java_file = state.java_files[j];
+        if (!output_cache->Update(java_file.filename, state.cache_key,
+                                  java_file.contents, error)) {
+          return false;
+        }
+      }
     }
   }
 
@@ -38,6 +38,7 @@
 #define GOOGLE_PROTOBUF_COMPILER_JAVANANO_NANO_GENERATOR_H__
 
 #include <string>
+#include <vector>
 #include <google/protobuf/compiler/code_generator.h>
 
 namespace google {
@@ -59,8 +60,22 @@ class LIBPROTOC_EXPORT JavaNanoGenerator : public CodeGenerator {
                 const string& parameter,
                 GeneratorContext* output_directory,
                 string* error) const;
+  bool GenerateAll(const std::vector<const FileDescriptor*>& files,
+                   const string& parameter,
+                   GeneratorContext* generator_context,
+                   string* error) const;
+  bool HasGenerateAll() const { return true; }
 
  private:
+  // Shared by Generate() and GenerateAll().  Validates every file first, then
+  // renders all output files (on num_threads workers if requested) and writes
+  // them to output_directory in the same order as serial generation would.
+  bool GenerateFiles(const std::vector<const FileDescriptor*>& files,
+                     const string& parameter,
+                     GeneratorContext* output_directory,
+                     bool prefix_errors,
+                     string* error) const;
+
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(JavaNanoGenerator);
 };
 
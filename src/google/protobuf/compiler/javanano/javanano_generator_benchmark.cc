@@ -0,0 +1,380 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// http://code.google.com/p/protobuf/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmark for the javanano generator itself.  Builds synthetic schemas
+// in-process, runs JavaNanoGenerator over them with an in-memory
+// GeneratorContext and reports the time per field and the amount of code
+// emitted, as well as the time of FileGenerator::Validate next to the
+// FileDescriptorProto copy it used to make.  Run it before and after
+// generator changes:
+//
+//   bazel run -c opt //:javanano_generator_benchmark [-- <min_seconds>]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <google/protobuf/compiler/code_generator.h>
+#include <google/protobuf/compiler/javanano/javanano_file.h>
+#include <google/protobuf/compiler/javanano/javanano_generator.h>
+#include <google/protobuf/compiler/javanano/javanano_params.h>
+#include <google/protobuf/compiler/javanano/javanano_test_util.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/message.h>
+#include <google/protobuf/stubs/strutil.h>
+
+namespace google {
+namespace protobuf {
+namespace compiler {
+namespace javanano {
+namespace {
+
+const FieldDescriptorProto::Type kScalarTypes[] = {
+  FieldDescriptorProto::TYPE_INT32,
+  FieldDescriptorProto::TYPE_INT64,
+  FieldDescriptorProto::TYPE_UINT32,
+  FieldDescriptorProto::TYPE_SINT64,
+  FieldDescriptorProto::TYPE_FIXED32,
+  FieldDescriptorProto::TYPE_SFIXED64,
+  FieldDescriptorProto::TYPE_FLOAT,
+  FieldDescriptorProto::TYPE_DOUBLE,
+  FieldDescriptorProto::TYPE_BOOL,
+  FieldDescriptorProto::TYPE_STRING,
+  FieldDescriptorProto::TYPE_BYTES,
+};
+const int kScalarTypeCount = sizeof(kScalarTypes) / sizeof(kScalarTypes[0]);
+
+FileDescriptorProto NewFile(const string& name,
+                            const string& outer_classname) {
+  FileDescriptorProto file;
+  file.set_name(name + ".proto");
+  file.set_package("benchmark." + name);
+  file.mutable_options()->set_java_package("com.example.benchmark");
+  file.mutable_options()->set_java_outer_classname(outer_classname);
+  return file;
+}
+
+// One message with 2000 optional and repeated scalar fields.
+FileDescriptorProto WideMessage() {
+  FileDescriptorProto file = NewFile("wide", "WideProto");
+  DescriptorProto* message = file.add_message_type();
+  message->set_name("Wide");
+  for (int i = 1; i <= 2000; i++) {
+    AddField(message, "field_" + SimpleItoa(i), i,
+             kScalarTypes[i % kScalarTypeCount],
+             i % 4 == 0 ? FieldDescriptorProto::LABEL_REPEATED
+                        : FieldDescriptorProto::LABEL_OPTIONAL);
+  }
+  return file;
+}
+
+// Messages nested 30 levels deep (descriptor.cc allows at most 32), each
+// with a few fields and a reference to the next level.
+FileDescriptorProto DeepNesting() {
+  FileDescriptorProto file = NewFile("deep", "DeepProto");
+  DescriptorProto* message = file.add_message_type();
+  message->set_name("Level0");
+  string type_name = ".benchmark.deep.Level0";
+  for (int level = 0; level < 30; level++) {
+    for (int i = 1; i <= 8; i++) {
+      AddField(message, "field_" + SimpleItoa(i), i,
+               kScalarTypes[(level + i) % kScalarTypeCount],
+               FieldDescriptorProto::LABEL_OPTIONAL);
+    }
+    DescriptorProto* nested = message->add_nested_type();
+    nested->set_name("Level" + SimpleItoa(level + 1));
+    type_name += "." + nested->name();
+    AddField(message, "next", 9, FieldDescriptorProto::TYPE_MESSAGE,
+             FieldDescriptorProto::LABEL_OPTIONAL)->set_type_name(type_name);
+    message = nested;
+  }
+  return file;
+}
+
+// 200 oneofs with 5 members each.
+FileDescriptorProto ManyOneofs() {
+  FileDescriptorProto file = NewFile("oneofs", "OneofsProto");
+  DescriptorProto* message = file.add_message_type();
+  message->set_name("Oneofs");
+  DescriptorProto* payload = file.add_message_type();
+  payload->set_name("Payload");
+  AddField(payload, "value", 1, FieldDescriptorProto::TYPE_INT32,
+           FieldDescriptorProto::LABEL_OPTIONAL);
+  int number = 1;
+  for (int i = 0; i < 200; i++) {
+    message->add_oneof_decl()->set_name("choice_" + SimpleItoa(i));
+    for (int j = 0; j < 5; j++) {
+      FieldDescriptorProto* field =
+          AddField(message, "choice_" + SimpleItoa(i) + "_" + SimpleItoa(j),
+                   number++, j == 4 ? FieldDescriptorProto::TYPE_MESSAGE
+                                    : kScalarTypes[(i + j) % kScalarTypeCount],
+                   FieldDescriptorProto::LABEL_OPTIONAL);
+      field->set_oneof_index(i);
+      if (j == 4) field->set_type_name(".benchmark.oneofs.Payload");
+    }
+  }
+  return file;
+}
+
+// An enum with 10000 values, used by a singular and a packed repeated field.
+FileDescriptorProto HugeEnum() {
+  FileDescriptorProto file = NewFile("huge_enum", "HugeEnumProto");
+  EnumDescriptorProto* enum_type = file.add_enum_type();
+  enum_type->set_name("Huge");
+  for (int i = 0; i < 10000; i++) {
+    EnumValueDescriptorProto* value = enum_type->add_value();
+    value->set_name("HUGE_VALUE_" + SimpleItoa(i));
+    value->set_number(i);
+  }
+  DescriptorProto* message = file.add_message_type();
+  message->set_name("UsesHuge");
+  AddField(message, "single", 1, FieldDescriptorProto::TYPE_ENUM,
+           FieldDescriptorProto::LABEL_OPTIONAL)
+      ->set_type_name(".benchmark.huge_enum.Huge");
+  FieldDescriptorProto* repeated =
+      AddField(message, "packed", 2, FieldDescriptorProto::TYPE_ENUM,
+               FieldDescriptorProto::LABEL_REPEATED);
+  repeated->set_type_name(".benchmark.huge_enum.Huge");
+  repeated->mutable_options()->set_packed(true);
+  return file;
+}
+
+// 500 map fields and 500 extensions of an extendable message.
+FileDescriptorProto MapsAndExtensions() {
+  FileDescriptorProto file = NewFile("maps", "MapsProto");
+  DescriptorProto* message = file.add_message_type();
+  message->set_name("Maps");
+  message->add_extension_range()->set_start(1000);
+  message->mutable_extension_range(0)->set_end(2000);
+  for (int i = 1; i <= 500; i++) {
+    string entry_name = "Field" + SimpleItoa(i) + "Entry";
+    DescriptorProto* entry = message->add_nested_type();
+    entry->set_name(entry_name);
+    entry->mutable_options()->set_map_entry(true);
+    AddField(entry, "key", 1, i % 2 == 0 ? FieldDescriptorProto::TYPE_STRING
+                                         : FieldDescriptorProto::TYPE_INT32,
+             FieldDescriptorProto::LABEL_OPTIONAL);
+    AddField(entry, "value", 2, kScalarTypes[i % kScalarTypeCount],
+             FieldDescriptorProto::LABEL_OPTIONAL);
+    AddField(message, "field_" + SimpleItoa(i), i,
+             FieldDescriptorProto::TYPE_MESSAGE,
+             FieldDescriptorProto::LABEL_REPEATED)
+        ->set_type_name(".benchmark.maps.Maps." + entry_name);
+  }
+  for (int i = 0; i < 500; i++) {
+    FieldDescriptorProto* extension = file.add_extension();
+    extension->set_name("ext_" + SimpleItoa(i));
+    extension->set_number(1000 + i);
+    extension->set_type(kScalarTypes[i % kScalarTypeCount]);
+    extension->set_label(i % 2 == 0 ? FieldDescriptorProto::LABEL_OPTIONAL
+                                    : FieldDescriptorProto::LABEL_REPEATED);
+    extension->set_extendee(".benchmark.maps.Maps");
+  }
+  return file;
+}
+
+// 5000 small messages, as in generated-API files.  The scan in
+// FileGenerator::Validate has to visit every one of them.
+FileDescriptorProto ManyMessages() {
+  FileDescriptorProto file = NewFile("messages", "MessagesProto");
+  for (int i = 0; i < 5000; i++) {
+    DescriptorProto* message = file.add_message_type();
+    message->set_name("Message" + SimpleItoa(i));
+    for (int j = 1; j <= 4; j++) {
+      AddField(message, "field_" + SimpleItoa(j), j,
+               kScalarTypes[(i + j) % kScalarTypeCount],
+               FieldDescriptorProto::LABEL_OPTIONAL);
+    }
+  }
+  return file;
+}
+
+// Counts fields, extensions and enum values: everything the generator emits
+// a member or constant for.
+int CountFields(const EnumDescriptor* enum_type) {
+  return enum_type->value_count();
+}
+
+int CountFields(const Descriptor* descriptor) {
+  int count = descriptor->field_count() + descriptor->extension_count();
+  for (int i = 0; i < descriptor->enum_type_count(); i++) {
+    count += CountFields(descriptor->enum_type(i));
+  }
+  for (int i = 0; i < descriptor->nested_type_count(); i++) {
+    count += CountFields(descriptor->nested_type(i));
+  }
+  return count;
+}
+
+int CountFields(const FileDescriptor* file) {
+  int count = file->extension_count();
+  for (int i = 0; i < file->enum_type_count(); i++) {
+    count += CountFields(file->enum_type(i));
+  }
+  for (int i = 0; i < file->message_type_count(); i++) {
+    count += CountFields(file->message_type(i));
+  }
+  return count;
+}
+
+// The check FileGenerator::Validate used to make: copy the file into a
+// FileDescriptorProto and search it with reflection.  Kept here to compare
+// the descriptor scan against.
+bool ProtoUsesExtensions(const Message& message) {
+  const Reflection* reflection = message.GetReflection();
+  if (reflection->GetUnknownFields(message).field_count() > 0) return true;
+
+  vector<const FieldDescriptor*> fields;
+  reflection->ListFields(message, &fields);
+  for (int i = 0; i < fields.size(); i++) {
+    if (fields[i]->is_extension()) return true;
+    if (fields[i]->cpp_type() != FieldDescriptor::CPPTYPE_MESSAGE) continue;
+    if (fields[i]->is_repeated()) {
+      int size = reflection->FieldSize(message, fields[i]);
+      for (int j = 0; j < size; j++) {
+        if (ProtoUsesExtensions(
+                reflection->GetRepeatedMessage(message, fields[i], j))) {
+          return true;
+        }
+      }
+    } else if (ProtoUsesExtensions(
+                   reflection->GetMessage(message, fields[i]))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool CopyUsesExtensions(const FileDescriptor* file) {
+  FileDescriptorProto file_proto;
+  file->CopyTo(&file_proto);
+  return ProtoUsesExtensions(file_proto);
+}
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+// Runs the generator on file_proto until at least min_seconds have passed,
+// then prints one line of results.
+bool RunBenchmark(const string& name, const FileDescriptorProto& file_proto,
+                  const string& parameter, double min_seconds) {
+  DescriptorPool pool;
+  const FileDescriptor* file = pool.BuildFile(file_proto);
+  if (file == NULL) {
+    fprintf(stderr, "%s: failed to build the synthetic schema\n",
+            name.c_str());
+    return false;
+  }
+  int fields = CountFields(file);
+
+  // FileGenerator::Validate on its own, as it walks the whole file, and the
+  // FileDescriptorProto copy it used to make for the same check.
+  Params params(file->name());
+  params.set_store_unknown_fields(true);
+  params.set_java_outer_classname(file->name(),
+                                  file->options().java_outer_classname());
+  FileGenerator file_generator(file, params);
+  int validate_iterations = 0;
+  string error;
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  do {
+    file_generator.Validate(&error);
+    validate_iterations++;
+  } while (SecondsSince(start) < min_seconds / 10);
+  double validate_seconds = SecondsSince(start) / validate_iterations;
+
+  int copy_iterations = 0;
+  start = std::chrono::steady_clock::now();
+  do {
+    CopyUsesExtensions(file);
+    copy_iterations++;
+  } while (SecondsSince(start) < min_seconds / 10);
+  double copy_seconds = SecondsSince(start) / copy_iterations;
+
+  JavaNanoGenerator generator;
+  int iterations = 0;
+  int files = 0;
+  int64 bytes = 0;
+  start = std::chrono::steady_clock::now();
+  do {
+    MemoryGeneratorContext context;
+    if (!generator.Generate(file, parameter, &context, &error)) {
+      fprintf(stderr, "%s: %s\n", name.c_str(), error.c_str());
+      return false;
+    }
+    files = context.file_count();
+    bytes = context.total_bytes();
+    iterations++;
+  } while (SecondsSince(start) < min_seconds);
+  double seconds = SecondsSince(start) / iterations;
+
+  printf("%-12s %6d fields %10.1f ns/field %10.1f us validate"
+         " (%10.1f us copy) %4d files %10lld bytes %8.2f ms/run (%d runs)\n",
+         name.c_str(), fields, seconds * 1e9 / fields, validate_seconds * 1e6,
+         copy_seconds * 1e6, files, static_cast<long long>(bytes),
+         seconds * 1e3, iterations);
+  return true;
+}
+
+}  // namespace
+}  // namespace javanano
+}  // namespace compiler
+}  // namespace protobuf
+}  // namespace google
+
+int main(int argc, char* argv[]) {
+  using google::protobuf::compiler::javanano::RunBenchmark;
+  namespace javanano = google::protobuf::compiler::javanano;
+
+  double min_seconds = argc > 1 ? atof(argv[1]) : 1.0;
+
+  bool ok = true;
+  ok &= RunBenchmark("wide", javanano::WideMessage(), "", min_seconds);
+  ok &= RunBenchmark("wide_access", javanano::WideMessage(),
+                     "optional_field_style=accessors", min_seconds);
+  ok &= RunBenchmark("wide_table", javanano::WideMessage(),
+                     "codegen_style=table", min_seconds);
+  ok &= RunBenchmark("deep", javanano::DeepNesting(), "", min_seconds);
+  ok &= RunBenchmark("oneofs", javanano::ManyOneofs(), "", min_seconds);
+  ok &= RunBenchmark("huge_enum", javanano::HugeEnum(), "", min_seconds);
+  ok &= RunBenchmark("messages", javanano::ManyMessages(), "", min_seconds);
+  ok &= RunBenchmark("maps_exts", javanano::MapsAndExtensions(),
+                     "store_unknown_fields=true", min_seconds);
+  ok &= RunBenchmark("multi_files", javanano::DeepNesting(),
+                     "java_multiple_files=true", min_seconds);
+  return ok ? 0 : 1;
+}
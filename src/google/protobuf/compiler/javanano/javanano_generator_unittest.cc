@@ -0,0 +1,258 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// http://code.google.com/p/protobuf/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Checks of the generator which need more than the Java tests can see:
+// how much work it does, rather than what it emits.  There is no C++ test
+// framework in this tree, so each test is a function returning whether it
+// passed, and main() runs them all:
+//
+//   bazel test //:javanano_generator_unittest
+
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <google/protobuf/compiler/code_generator.h>
+#include <google/protobuf/compiler/javanano/javanano_field.h>
+#include <google/protobuf/compiler/javanano/javanano_generator.h>
+#include <google/protobuf/compiler/javanano/javanano_test_util.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/stubs/strutil.h>
+
+namespace google {
+namespace protobuf {
+namespace compiler {
+namespace javanano {
+namespace {
+
+#define EXPECT_EQ(expected, actual)                                        \
+  do {                                                                     \
+    if ((expected) != (actual)) {                                          \
+      fprintf(stderr, "%s:%d: expected %s == %s, got %d vs %d\n",          \
+              __FILE__, __LINE__, #expected, #actual,                      \
+              static_cast<int>(expected), static_cast<int>(actual));       \
+      return false;                                                        \
+    }                                                                      \
+  } while (0)
+
+#define EXPECT_TRUE(condition)                                             \
+  do {                                                                     \
+    if (!(condition)) {                                                    \
+      fprintf(stderr, "%s:%d: expected %s\n", __FILE__, __LINE__,          \
+              #condition);                                                 \
+      return false;                                                        \
+    }                                                                      \
+  } while (0)
+
+// Ten levels of nested messages, each also holding an enum and an extension
+// of the outermost message.
+FileDescriptorProto NestedFile(int* message_count) {
+  FileDescriptorProto file;
+  file.set_name("nested.proto");
+  file.set_package("test.nested");
+  file.mutable_options()->set_java_package("com.example.nested");
+  file.mutable_options()->set_java_outer_classname("NestedProto");
+  DescriptorProto* message = file.add_message_type();
+  message->set_name("Level0");
+  message->add_extension_range()->set_start(100);
+  message->mutable_extension_range(0)->set_end(200);
+  *message_count = 1;
+  string type_name = ".test.nested.Level0";
+  for (int level = 0; level < 10; level++) {
+    AddField(message, "value", 1, FieldDescriptorProto::TYPE_INT32);
+    AddField(message, "name", 2, FieldDescriptorProto::TYPE_STRING);
+
+    EnumDescriptorProto* enum_type = message->add_enum_type();
+    enum_type->set_name("Kind");
+    enum_type->add_value()->set_name("KIND_" + SimpleItoa(level));
+    enum_type->mutable_value(0)->set_number(0);
+
+    FieldDescriptorProto* extension = message->add_extension();
+    extension->set_name("ext_" + SimpleItoa(level));
+    extension->set_number(100 + level);
+    extension->set_type(FieldDescriptorProto::TYPE_INT32);
+    extension->set_label(FieldDescriptorProto::LABEL_OPTIONAL);
+    extension->set_extendee(".test.nested.Level0");
+
+    DescriptorProto* nested = message->add_nested_type();
+    nested->set_name("Level" + SimpleItoa(level + 1));
+    type_name += "." + nested->name();
+    AddField(message, "next", 3, FieldDescriptorProto::TYPE_MESSAGE)
+        ->set_type_name(type_name);
+    message = nested;
+    ++*message_count;
+  }
+  return file;
+}
+
+// Every message gets its field generators built once per run, however
+// many passes (class body, static variables, static initializers, sibling
+// files) walk it.
+bool TestFieldGeneratorsBuiltOncePerMessage() {
+  int message_count;
+  DescriptorPool pool;
+  const FileDescriptor* file = pool.BuildFile(NestedFile(&message_count));
+  EXPECT_TRUE(file != NULL);
+
+  // Extensions need store_unknown_fields.
+  const char* parameters[] = {
+    "store_unknown_fields=true",
+    "store_unknown_fields=true,generate_equals=true,generate_clone=true",
+    "store_unknown_fields=true,java_multiple_files=true,"
+        "optional_field_style=accessors",
+    "store_unknown_fields=true,codegen_style=table",
+  };
+  JavaNanoGenerator generator;
+  for (int i = 0; i < sizeof(parameters) / sizeof(parameters[0]); i++) {
+    MemoryGeneratorContext context;
+    string error;
+    int before = FieldGeneratorMap::construction_count();
+    EXPECT_TRUE(generator.Generate(file, parameters[i], &context, &error));
+    EXPECT_EQ(message_count, FieldGeneratorMap::construction_count() - before);
+  }
+  return true;
+}
+
+// A layered import DAG of layers * kFilesPerLayer files.  Each file imports
+// three files of the layer below, so every file is reachable from the top
+// along exponentially many paths, declares its own java_package and
+// java_outer_classname, and has a message referring to one from an import.
+const int kFilesPerLayer = 200;
+
+string DagFileName(int layer, int index) {
+  return "dag/layer" + SimpleItoa(layer) + "_" + SimpleItoa(index) + ".proto";
+}
+
+FileDescriptorProto DagFile(int layers, int layer, int index) {
+  FileDescriptorProto file;
+  file.set_name(DagFileName(layer, index));
+  file.set_package("test.dag.l" + SimpleItoa(layer));
+  file.mutable_options()->set_java_package(
+      "com.example.dag.l" + SimpleItoa(layer));
+  file.mutable_options()->set_java_outer_classname(
+      "File" + SimpleItoa(index));
+  DescriptorProto* message = file.add_message_type();
+  message->set_name("Node" + SimpleItoa(index));
+  AddField(message, "id", 1, FieldDescriptorProto::TYPE_INT64);
+  if (layer + 1 < layers) {
+    for (int i = 0; i < 3; i++) {
+      file.add_dependency(
+          DagFileName(layer + 1, (index + i * 67) % kFilesPerLayer));
+    }
+    AddField(message, "child", 2, FieldDescriptorProto::TYPE_MESSAGE)
+        ->set_type_name(".test.dag.l" + SimpleItoa(layer + 1) + ".Node"
+                        + SimpleItoa(index));
+  }
+  return file;
+}
+
+// Generates the top layer of a DAG with the given number of layers into
+// context, and sets *seconds to the best time of three runs.
+bool GenerateDag(int layers, MemoryGeneratorContext* context,
+                 double* seconds) {
+  DescriptorPool pool;
+  vector<const FileDescriptor*> top_files;
+  for (int layer = layers - 1; layer >= 0; layer--) {
+    for (int index = 0; index < kFilesPerLayer; index++) {
+      const FileDescriptor* file =
+          pool.BuildFile(DagFile(layers, layer, index));
+      EXPECT_TRUE(file != NULL);
+      if (layer == 0) top_files.push_back(file);
+    }
+  }
+
+  JavaNanoGenerator generator;
+  for (int run = 0; run < 3; run++) {
+    string error;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    EXPECT_TRUE(generator.GenerateAll(top_files, "", context, &error));
+    double run_seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    if (run == 0 || run_seconds < *seconds) *seconds = run_seconds;
+  }
+  return true;
+}
+
+// Generating the top layer of the DAG visits each file once to collect its
+// declared options, so ten times the layers should take about ten times as
+// long.  Walking every import path instead grows exponentially with the
+// number of layers.  Only the ratio of the two times is checked, with ample
+// room for noise, so that a slow machine doesn't fail the test.
+bool TestImportDagScalesLinearly() {
+  const int kSmallLayers = 5;
+  const int kLargeLayers = 50;
+
+  MemoryGeneratorContext small_context;
+  double small_seconds;
+  EXPECT_TRUE(GenerateDag(kSmallLayers, &small_context, &small_seconds));
+  MemoryGeneratorContext large_context;
+  double large_seconds;
+  EXPECT_TRUE(GenerateDag(kLargeLayers, &large_context, &large_seconds));
+  printf("Generated %d files importing %d in %.4fs, importing %d in %.4fs\n",
+         kFilesPerLayer, kSmallLayers * kFilesPerLayer, small_seconds,
+         kLargeLayers * kFilesPerLayer, large_seconds);
+  EXPECT_TRUE(large_seconds < 30 * small_seconds);
+
+  EXPECT_EQ(kFilesPerLayer, large_context.file_count());
+  // The type of the child field comes from the options of an import.
+  EXPECT_TRUE(large_context.contents("com/example/dag/l0/nano/File7.java").find(
+      "com.example.dag.l1.nano.File7.Node7 child;") != string::npos);
+  return true;
+}
+
+}  // namespace
+}  // namespace javanano
+}  // namespace compiler
+}  // namespace protobuf
+}  // namespace google
+
+int main(int argc, char* argv[]) {
+  namespace javanano = google::protobuf::compiler::javanano;
+
+  struct {
+    const char* name;
+    bool (*run)();
+  } tests[] = {
+    {"FieldGeneratorsBuiltOncePerMessage",
+     javanano::TestFieldGeneratorsBuiltOncePerMessage},
+    {"ImportDagScalesLinearly", javanano::TestImportDagScalesLinearly},
+  };
+
+  int failures = 0;
+  for (int i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+    bool passed = tests[i].run();
+    printf("[%s] %s\n", passed ? "  OK  " : "FAILED", tests[i].name);
+    if (!passed) failures++;
+  }
+  return failures == 0 ? 0 : 1;
+}
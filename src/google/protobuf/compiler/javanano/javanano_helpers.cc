@@ -32,12 +32,14 @@
 //  Based on original Protocol Buffers design by
 //  Sanjay Ghemawat, Jeff Dean, and others.
 
+#include <string.h>
 #include <limits>
 #include <vector>
 
 #include <google/protobuf/compiler/javanano/javanano_helpers.h>
 #include <google/protobuf/compiler/javanano/javanano_params.h>
 #include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/wire_format.h>
 #include <google/protobuf/stubs/hash.h>
 #include <google/protobuf/stubs/strutil.h>
 #include <google/protobuf/stubs/substitute.h>
@@ -481,6 +483,60 @@ string DefaultValue(const Params& params, const FieldDescriptor* field) {
   return "";
 }
 
+bool IsPackedField(const FieldDescriptor* field) {
+  return field->is_packable() && field->options().packed();
+}
+
+uint32 DeclaredTag(const FieldDescriptor* field) {
+  return internal::WireFormatLite::MakeTag(field->number(),
+      IsPackedField(field)
+          ? internal::WireFormatLite::WIRETYPE_LENGTH_DELIMITED
+          : internal::WireFormat::WireTypeForFieldType(field->type()));
+}
+
+string WriteTagCall(uint32 tag) {
+  if (tag >= (1 << 21)) {
+    // writeRawVarint32 takes the tag as an int, unsigned.
+    return "writeRawVarint32(" + SimpleItoa(static_cast<int32>(tag)) + ")";
+  }
+  string call = "writeTagBytes(";
+  while (tag >= 0x80) {
+    call += SimpleItoa((tag & 0x7F) | 0x80) + ", ";
+    tag >>= 7;
+  }
+  return call + SimpleItoa(tag) + ")";
+}
+
+int MaxValueSize(FieldDescriptor::Type type) {
+  switch (type) {
+    case FieldDescriptor::TYPE_INT32   : return 10;
+    case FieldDescriptor::TYPE_INT64   : return 10;
+    case FieldDescriptor::TYPE_UINT32  : return 5;
+    case FieldDescriptor::TYPE_UINT64  : return 10;
+    case FieldDescriptor::TYPE_SINT32  : return 5;
+    case FieldDescriptor::TYPE_SINT64  : return 10;
+    case FieldDescriptor::TYPE_FIXED32 : return 4;
+    case FieldDescriptor::TYPE_FIXED64 : return 8;
+    case FieldDescriptor::TYPE_SFIXED32: return 4;
+    case FieldDescriptor::TYPE_SFIXED64: return 8;
+    case FieldDescriptor::TYPE_FLOAT   : return 4;
+    case FieldDescriptor::TYPE_DOUBLE  : return 8;
+
+    case FieldDescriptor::TYPE_BOOL    : return 1;
+    case FieldDescriptor::TYPE_ENUM    : return 10;
+
+    case FieldDescriptor::TYPE_STRING  : return -1;
+    case FieldDescriptor::TYPE_BYTES   : return -1;
+    case FieldDescriptor::TYPE_GROUP   : return -1;
+    case FieldDescriptor::TYPE_MESSAGE : return -1;
+
+    // No default because we want the compiler to complain if any new
+    // types are added.
+  }
+  GOOGLE_LOG(FATAL) << "Can't get here.";
+  return -1;
+}
+
 
 static const char* kBitMasks[] = {
   "0x00000001",
@@ -569,7 +625,7 @@ string GenerateDifferentBit(int bit_index) {
 }
 
 void SetBitOperationVariables(const string name,
-    int bitIndex, map<string, string>* variables) {
+    int bitIndex, TemplateVariables* variables) {
   (*variables)["get_" + name] = GenerateGetBit(bitIndex);
   (*variables)["set_" + name] = GenerateSetBit(bitIndex);
   (*variables)["clear_" + name] = GenerateClearBit(bitIndex);
@@ -587,6 +643,72 @@ bool HasMapField(const Descriptor* descriptor) {
   return false;
 }
 
+bool IsFieldUsed(const Params& params, const FieldDescriptor* field) {
+  const set<string>* used_fields = params.used_fields();
+  return used_fields == NULL
+      || used_fields->count(field->full_name()) > 0
+      || used_fields->count(field->containing_type()->full_name()) > 0;
+}
+
+bool IsLazyMessageField(const Params& params, const FieldDescriptor* field) {
+  if (field->type() != FieldDescriptor::TYPE_MESSAGE || field->is_repeated()
+      || field->containing_oneof() != NULL) {
+    return false;
+  }
+  switch (params.lazy_message_fields()) {
+    case JAVANANO_LAZY_NONE  : return false;
+    case JAVANANO_LAZY_MARKED: return field->options().lazy();
+    case JAVANANO_LAZY_ALL   : return true;
+  }
+  GOOGLE_LOG(FATAL) << "Can't get here.";
+  return false;
+}
+
+int EstimateBytecodeSize(const string& java_code) {
+  int size = 0;
+  for (int i = 0; i < java_code.size();) {
+    char c = java_code[i];
+    if (c == '/' && i + 1 < java_code.size() && java_code[i + 1] == '/') {
+      while (i < java_code.size() && java_code[i] != '\n') i++;
+    } else if (c == '/' && i + 1 < java_code.size()
+               && java_code[i + 1] == '*') {
+      string::size_type end = java_code.find("*/", i + 2);
+      i = end == string::npos ? java_code.size() : end + 2;
+    } else if (c == '"' || c == '\'') {
+      // A literal is loaded by a single ldc or bipush.
+      for (i++; i < java_code.size() && java_code[i] != c; i++) {
+        if (java_code[i] == '\\') i++;
+      }
+      i++;
+      size += 2;
+    } else if (ascii_isalnum(c) || c == '_' || c == '$') {
+      // A qualified name like "this.foo_" or "output.writeInt32" is one
+      // operand, or one call if followed by an argument list.
+      while (i < java_code.size() && (ascii_isalnum(java_code[i])
+             || java_code[i] == '_' || java_code[i] == '$'
+             || java_code[i] == '.')) {
+        i++;
+      }
+      int next = i;
+      while (next < java_code.size() && ascii_isspace(java_code[next])) {
+        next++;
+      }
+      size += next < java_code.size() && java_code[next] == '(' ? 4 : 2;
+    } else if (strchr("+-*/%=<>!&|^~?:[", c) != NULL) {
+      while (i < java_code.size() && c != '['
+             && strchr("+-*/%=<>!&|^~?:", java_code[i]) != NULL) {
+        i++;
+      }
+      if (c == '[') i++;
+      size += 2;
+    } else {
+      // Whitespace and punctuation.
+      i++;
+    }
+  }
+  return size;
+}
+
 }  // namespace javanano
 }  // namespace compiler
 }  // namespace protobuf
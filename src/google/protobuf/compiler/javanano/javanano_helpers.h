@@ -37,6 +37,7 @@
 
 #include <string>
 #include <google/protobuf/compiler/javanano/javanano_params.h>
+#include <google/protobuf/compiler/javanano/javanano_template.h>
 #include <google/protobuf/descriptor.pb.h>
 #include <google/protobuf/descriptor.h>
 #include <google/protobuf/io/printer.h>
@@ -146,6 +147,29 @@ string EmptyArrayName(const Params& params, const FieldDescriptor* field);
 
 string DefaultValue(const Params& params, const FieldDescriptor* field);
 
+// Whether the field is serialized in packed form. Nano writes repeated
+// fields packed only where they are declared [packed = true], including in
+// proto3 files, where packing is otherwise the default.
+bool IsPackedField(const FieldDescriptor* field);
+
+// The tag the field is serialized with: for packed fields the tag of the
+// whole length-delimited run, otherwise the tag written before each value.
+uint32 DeclaredTag(const FieldDescriptor* field);
+
+// Returns the call on a CodedOutputByteBufferNano writing the given tag.
+// Tags of up to three bytes are encoded as a varint here, for example
+// "writeTagBytes(162, 1)" for tag 162; longer ones are written with
+// writeRawVarint32.
+string WriteTagCall(uint32 tag);
+
+// The most bytes a value of the given type takes serialized, without its
+// tag, or -1 for strings, bytes, groups and messages, whose sizes depend on
+// their contents. Negative int32 and enum values take ten bytes, being
+// sign-extended. Length-delimited values take up to kMaxLengthPrefixSize
+// bytes for their length.
+int MaxValueSize(FieldDescriptor::Type type);
+const int kMaxLengthPrefixSize = 5;
+
 
 // Methods for shared bitfields.
 
@@ -181,7 +205,7 @@ string GenerateDifferentBit(int bit_index);
 // the given name of the bit, to the appropriate Java expressions for the given
 // bit index.
 void SetBitOperationVariables(const string name,
-    int bitIndex, map<string, string>* variables);
+    int bitIndex, TemplateVariables* variables);
 
 inline bool IsMapEntry(const Descriptor* descriptor) {
   // TODO(liujisi): Add an option to turn on maps for proto2 syntax as well.
@@ -191,6 +215,22 @@ inline bool IsMapEntry(const Descriptor* descriptor) {
 
 bool HasMapField(const Descriptor* descriptor);
 
+// Returns false if a used_fields_manifest was given which lists neither the
+// field nor its message.  No code is generated for such a field, so it is
+// parsed as an unknown field.
+bool IsFieldUsed(const Params& params, const FieldDescriptor* field);
+
+// Returns true if the field is a singular message field outside of oneofs
+// which the lazy_message_fields option makes parse only when first read.
+// Groups, having no length, are always parsed eagerly.
+bool IsLazyMessageField(const Params& params, const FieldDescriptor* field);
+
+// Returns a rough estimate of the number of bytes of bytecode javac emits for
+// the given generated Java statements.  Every operand and operator is taken
+// to cost two bytes and every method call four, which matches javac's output
+// for typical generated code to within a few percent.
+int EstimateBytecodeSize(const string& java_code);
+
 }  // namespace javanano
 }  // namespace compiler
 }  // namespace protobuf
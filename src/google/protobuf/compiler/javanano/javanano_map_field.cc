@@ -84,27 +84,31 @@ const FieldDescriptor* ValueField(const FieldDescriptor* descriptor) {
 }
 
 void SetMapVariables(const Params& params,
-    const FieldDescriptor* descriptor, map<string, string>* variables) {
+    const FieldDescriptor* descriptor, TemplateVariables* variables) {
   const FieldDescriptor* key = KeyField(descriptor);
   const FieldDescriptor* value = ValueField(descriptor);
-  (*variables)["name"] =
+  (*variables)[JAVANANO_VAR("name")] =
     RenameJavaKeywords(UnderscoresToCamelCase(descriptor));
-  (*variables)["number"] = SimpleItoa(descriptor->number());
-  (*variables)["key_type"] = TypeName(params, key, false);
-  (*variables)["boxed_key_type"] = TypeName(params,key, true);
-  (*variables)["key_desc_type"] =
+  (*variables)[JAVANANO_VAR("number")] = SimpleItoa(descriptor->number());
+  (*variables)[JAVANANO_VAR("key_type")] = TypeName(params, key, false);
+  (*variables)[JAVANANO_VAR("boxed_key_type")] = TypeName(params,key, true);
+  (*variables)[JAVANANO_VAR("key_desc_type")] =
       "TYPE_" + ToUpper(FieldDescriptor::TypeName(key->type()));
-  (*variables)["key_tag"] = SimpleItoa(internal::WireFormat::MakeTag(key));
-  (*variables)["value_type"] = TypeName(params, value, false);
-  (*variables)["boxed_value_type"] = TypeName(params, value, true);
-  (*variables)["value_desc_type"] =
+  (*variables)[JAVANANO_VAR("key_tag")] =
+      SimpleItoa(internal::WireFormat::MakeTag(key));
+  (*variables)[JAVANANO_VAR("value_type")] = TypeName(params, value, false);
+  (*variables)[JAVANANO_VAR("boxed_value_type")] =
+      TypeName(params, value, true);
+  (*variables)[JAVANANO_VAR("value_desc_type")] =
       "TYPE_" + ToUpper(FieldDescriptor::TypeName(value->type()));
-  (*variables)["value_tag"] = SimpleItoa(internal::WireFormat::MakeTag(value));
-  (*variables)["type_parameters"] =
-      (*variables)["boxed_key_type"] + ", " + (*variables)["boxed_value_type"];
-  (*variables)["value_default"] =
+  (*variables)[JAVANANO_VAR("value_tag")] =
+      SimpleItoa(internal::WireFormat::MakeTag(value));
+  (*variables)[JAVANANO_VAR("type_parameters")] =
+      (*variables)[JAVANANO_VAR("boxed_key_type")] + ", " +
+      (*variables)[JAVANANO_VAR("boxed_value_type")];
+  (*variables)[JAVANANO_VAR("value_default")] =
       value->type() == FieldDescriptor::TYPE_MESSAGE
-          ? "new " + (*variables)["value_type"] + "()"
+          ? "new " + (*variables)[JAVANANO_VAR("value_type")] + "()"
           : "null";
 }
 }  // namespace
@@ -120,19 +124,19 @@ MapFieldGenerator::~MapFieldGenerator() {}
 
 void MapFieldGenerator::
 GenerateMembers(io::Printer* printer, bool /* unused lazy_init */) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "public java.util.Map<$type_parameters$> $name$;\n");
 }
 
 void MapFieldGenerator::
 GenerateClearCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "$name$ = null;\n");
 }
 
 void MapFieldGenerator::
 GenerateMergingCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "this.$name$ = com.google.protobuf.nano.InternalNano.mergeMapEntry(\n"
     "  input, this.$name$, mapFactory,\n"
     "  com.google.protobuf.nano.InternalNano.$key_desc_type$,\n"
@@ -144,7 +148,7 @@ GenerateMergingCode(io::Printer* printer) const {
 
 void MapFieldGenerator::
 GenerateSerializationCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if (this.$name$ != null) {\n"
     "  com.google.protobuf.nano.InternalNano.serializeMapField(\n"
     "    output, this.$name$, $number$,\n"
@@ -155,7 +159,7 @@ GenerateSerializationCode(io::Printer* printer) const {
 
 void MapFieldGenerator::
 GenerateSerializedSizeCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if (this.$name$ != null) {\n"
     "  size += com.google.protobuf.nano.InternalNano.computeMapFieldSize(\n"
     "    this.$name$, $number$,\n"
@@ -166,7 +170,7 @@ GenerateSerializedSizeCode(io::Printer* printer) const {
 
 void MapFieldGenerator::
 GenerateEqualsCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if (!com.google.protobuf.nano.InternalNano.equals(\n"
     "  this.$name$, other.$name$)) {\n"
     "  return false;\n"
@@ -175,7 +179,7 @@ GenerateEqualsCode(io::Printer* printer) const {
 
 void MapFieldGenerator::
 GenerateHashCodeCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "result = 31 * result +\n"
     "    com.google.protobuf.nano.InternalNano.hashCode(this.$name$);\n");
 }
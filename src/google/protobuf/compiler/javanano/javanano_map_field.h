@@ -48,6 +48,7 @@ class MapFieldGenerator : public FieldGenerator {
   ~MapFieldGenerator();
 
   // implements FieldGenerator ---------------------------------------
+  const char* ClassName() const { return "MapFieldGenerator"; }
   void GenerateMembers(io::Printer* printer, bool lazy_init) const;
   void GenerateClearCode(io::Printer* printer) const;
   void GenerateMergingCode(io::Printer* printer) const;
@@ -58,7 +59,7 @@ class MapFieldGenerator : public FieldGenerator {
 
  private:
   const FieldDescriptor* descriptor_;
-  map<string, string> variables_;
+  TemplateVariables variables_;
 
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(MapFieldGenerator);
 };
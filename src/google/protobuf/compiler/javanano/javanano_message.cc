@@ -41,6 +41,7 @@
 #include <google/protobuf/stubs/strutil.h>
 #include <google/protobuf/io/printer.h>
 #include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 #include <google/protobuf/wire_format.h>
 #include <google/protobuf/descriptor.pb.h>
 
@@ -61,17 +62,79 @@ struct FieldOrderingByNumber {
   }
 };
 
-// Sort the fields of the given Descriptor by number into a new[]'d array
-// and return it.
-const FieldDescriptor** SortFieldsByNumber(const Descriptor* descriptor) {
-  const FieldDescriptor** fields =
-    new const FieldDescriptor*[descriptor->field_count()];
-  for (int i = 0; i < descriptor->field_count(); i++) {
-    fields[i] = descriptor->field(i);
+// Flags of the field kinds in a field table, as in MessageTableNano.
+const int kKindRequired = 0x20;
+const int kKindRepeated = 0x40;
+const int kKindPacked = 0x80;
+const int kKindOneof = 0x100;
+
+// The tag of the field in its other form, if it is packable.
+uint32 AlternateTag(const FieldDescriptor* field) {
+  return WireFormatLite::MakeTag(field->number(), IsPackedField(field)
+      ? WireFormat::WireTypeForFieldType(field->type())
+      : WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+}
+
+// The suffix of the MessageTableNano.FieldAccessor methods reading and
+// writing the Java field of the given field: oneof values and arrays are
+// objects, like strings, bytes and messages.
+string TableAccessorType(const FieldDescriptor* field) {
+  if (field->is_repeated() || field->containing_oneof() != NULL) {
+    return "Object";
   }
-  std::sort(fields, fields + descriptor->field_count(),
+  switch (GetJavaType(field)) {
+    case JAVATYPE_INT:
+    case JAVATYPE_ENUM:
+      return "Int";
+    case JAVATYPE_LONG:
+      return "Long";
+    case JAVATYPE_FLOAT:
+      return "Float";
+    case JAVATYPE_DOUBLE:
+      return "Double";
+    case JAVATYPE_BOOLEAN:
+      return "Boolean";
+    default:
+      return "Object";
+  }
+}
+
+// The Java field holding the value of the given field.
+string TableFieldJavaName(const FieldDescriptor* field) {
+  if (field->containing_oneof() != NULL) {
+    return UnderscoresToCamelCase(field->containing_oneof()) + "_";
+  }
+  return RenameJavaKeywords(UnderscoresToCamelCase(field));
+}
+
+bool IsMessageOrGroup(const FieldDescriptor* field) {
+  return field->type() == FieldDescriptor::TYPE_MESSAGE
+      || field->type() == FieldDescriptor::TYPE_GROUP;
+}
+
+// Limits of dense field dispatch: the indexes are stored in a byte array
+// with an entry for each field number up to the largest. With fewer fields,
+// the lookupswitch javac generates for the tags is cheap enough.
+const int kMinDenseDispatchFields = 16;
+const int kMaxDenseDispatchFields = 255;
+const int kMaxDenseDispatchFieldNumber = 4095;
+
+// How the parsing loop of mergeFrom() is left when the input ends: the
+// loop is labeled "parse" if repeated fields need trimming after it.
+const char kReturnFromMerge[] = "return this;";
+const char kBreakFromMerge[] = "break parse;";
+
+string MergeLoopLabel(bool trims_after_loop) {
+  return trims_after_loop ? "parse: " : "";
+}
+
+// Returns a copy of the given fields sorted by number.
+vector<const FieldDescriptor*> SortFieldsByNumber(
+    const vector<const FieldDescriptor*>& fields) {
+  vector<const FieldDescriptor*> sorted_fields(fields);
+  std::sort(sorted_fields.begin(), sorted_fields.end(),
        FieldOrderingByNumber());
-  return fields;
+  return sorted_fields;
 }
 
 }  // namespace
@@ -82,28 +145,58 @@ MessageGenerator::MessageGenerator(const Descriptor* descriptor, const Params& p
   : params_(params),
     descriptor_(descriptor),
     field_generators_(descriptor, params) {
+  for (int i = 0; i < descriptor_->field_count(); i++) {
+    const FieldDescriptor* field = descriptor_->field(i);
+    if (!IsFieldUsed(params_, field)) continue;
+    fields_.push_back(field);
+  }
+  for (int i = 0; i < descriptor_->oneof_decl_count(); i++) {
+    const OneofDescriptor* oneof = descriptor_->oneof_decl(i);
+    for (int j = 0; j < oneof->field_count(); j++) {
+      if (IsFieldUsed(params_, oneof->field(j))) {
+        oneofs_.push_back(oneof);
+        break;
+      }
+    }
+  }
+  for (int i = 0; i < descriptor_->extension_count(); i++) {
+    extension_generators_.emplace_back(
+        new ExtensionGenerator(descriptor_->extension(i), params_));
+  }
+  for (int i = 0; i < descriptor_->enum_type_count(); i++) {
+    enum_generators_.emplace_back(
+        new EnumGenerator(descriptor_->enum_type(i), params_));
+  }
+  for (int i = 0; i < descriptor_->nested_type_count(); i++) {
+    if (IsMapEntry(descriptor_->nested_type(i))) continue;
+    nested_generators_.emplace_back(
+        new MessageGenerator(descriptor_->nested_type(i), params_));
+  }
 }
 
 MessageGenerator::~MessageGenerator() {}
 
+void MessageGenerator::CountFieldGenerators(map<string, int>* counts) const {
+  for (int i = 0; i < fields_.size(); i++) {
+    (*counts)[field_generators_.get(fields_[i]).ClassName()]++;
+  }
+  for (int i = 0; i < nested_generators_.size(); i++) {
+    nested_generators_[i]->CountFieldGenerators(counts);
+  }
+}
+
 void MessageGenerator::GenerateStaticVariables(io::Printer* printer) {
   // Generate static members for all nested types.
-  for (int i = 0; i < descriptor_->nested_type_count(); i++) {
-    // TODO(kenton):  Reuse MessageGenerator objects?
-    if (IsMapEntry(descriptor_->nested_type(i))) continue;
-    MessageGenerator(descriptor_->nested_type(i), params_)
-      .GenerateStaticVariables(printer);
+  for (int i = 0; i < nested_generators_.size(); i++) {
+    nested_generators_[i]->GenerateStaticVariables(printer);
   }
 }
 
 void MessageGenerator::GenerateStaticVariableInitializers(
     io::Printer* printer) {
   // Generate static member initializers for all nested types.
-  for (int i = 0; i < descriptor_->nested_type_count(); i++) {
-   // TODO(kenton):  Reuse MessageGenerator objects?
-    if (IsMapEntry(descriptor_->nested_type(i))) continue;
-    MessageGenerator(descriptor_->nested_type(i), params_)
-      .GenerateStaticVariableInitializers(printer);
+  for (int i = 0; i < nested_generators_.size(); i++) {
+    nested_generators_[i]->GenerateStaticVariableInitializers(printer);
   }
 }
 
@@ -168,24 +261,23 @@ void MessageGenerator::Generate(io::Printer* printer) {
   }
 
   // Nested types and extensions
-  for (int i = 0; i < descriptor_->extension_count(); i++) {
-    ExtensionGenerator(descriptor_->extension(i), params_).Generate(printer);
+  for (int i = 0; i < extension_generators_.size(); i++) {
+    extension_generators_[i]->Generate(printer);
   }
 
-  for (int i = 0; i < descriptor_->enum_type_count(); i++) {
-    EnumGenerator(descriptor_->enum_type(i), params_).Generate(printer);
+  for (int i = 0; i < enum_generators_.size(); i++) {
+    enum_generators_[i]->Generate(printer);
   }
 
-  for (int i = 0; i < descriptor_->nested_type_count(); i++) {
-    if (IsMapEntry(descriptor_->nested_type(i))) continue;
-    MessageGenerator(descriptor_->nested_type(i), params_).Generate(printer);
+  for (int i = 0; i < nested_generators_.size(); i++) {
+    nested_generators_[i]->Generate(printer);
   }
 
   // oneof
   map<string, string> vars;
   vars["message_name"] = descriptor_->name();
-  for (int i = 0; i < descriptor_->oneof_decl_count(); i++) {
-    const OneofDescriptor* oneof_desc = descriptor_->oneof_decl(i);
+  for (int i = 0; i < oneofs_.size(); i++) {
+    const OneofDescriptor* oneof_desc = oneofs_[i];
     vars["oneof_name"] = UnderscoresToCamelCase(oneof_desc);
     vars["oneof_capitalized_name"] =
         UnderscoresToCapitalizedCamelCase(oneof_desc);
@@ -193,6 +285,7 @@ void MessageGenerator::Generate(io::Printer* printer) {
     // Oneof Constants
     for (int j = 0; j < oneof_desc->field_count(); j++) {
       const FieldDescriptor* field = oneof_desc->field(j);
+      if (!IsFieldUsed(params_, field)) continue;
       vars["number"] = SimpleItoa(field->number());
       vars["cap_field_name"] = ToUpper(field->name());
       printer->Print(vars,
@@ -262,10 +355,10 @@ void MessageGenerator::Generate(io::Printer* printer) {
   }
 
   // Fields and maybe their default values
-  for (int i = 0; i < descriptor_->field_count(); i++) {
+  for (int i = 0; i < fields_.size(); i++) {
     printer->Print("\n");
-    PrintFieldComment(printer, descriptor_->field(i));
-    field_generators_.get(descriptor_->field(i)).GenerateMembers(
+    PrintFieldComment(printer, fields_[i]);
+    field_generators_.get(fields_[i]).GenerateMembers(
         printer, lazy_init);
   }
 
@@ -286,8 +379,8 @@ void MessageGenerator::Generate(io::Printer* printer) {
     printer->Indent();
     printer->Indent();
     printer->Indent();
-    for (int i = 0; i < descriptor_->field_count(); i++) {
-      field_generators_.get(descriptor_->field(i))
+    for (int i = 0; i < fields_.size(); i++) {
+      field_generators_.get(fields_[i])
           .GenerateInitSavedDefaultCode(printer);
     }
     printer->Outdent();
@@ -331,8 +424,12 @@ void MessageGenerator::Generate(io::Printer* printer) {
     GenerateHashCode(printer);
   }
 
-  GenerateMessageSerializationMethods(printer);
-  GenerateMergeFromMethods(printer);
+  if (UsesFieldTable()) {
+    GenerateFieldTable(printer);
+  } else {
+    GenerateMessageSerializationMethods(printer);
+    GenerateMergeFromMethods(printer);
+  }
   GenerateParseFromMethods(printer);
 
   printer->Outdent();
@@ -341,16 +438,407 @@ void MessageGenerator::Generate(io::Printer* printer) {
 
 // ===================================================================
 
+vector<MessageGenerator::FieldRange> MessageGenerator::SplitFieldsBySize(
+    const vector<const FieldDescriptor*>& sorted_fields,
+    const std::function<void(const FieldDescriptor*, io::Printer*)>&
+        generate_field) {
+  vector<FieldRange> ranges;
+  FieldRange range = { 0, 0 };
+  int range_size = 0;
+  for (int i = 0; i < sorted_fields.size(); i++) {
+    int field_size = 0;
+    if (params_.max_method_size() > 0) {
+      string code;
+      {
+        io::StringOutputStream output(&code);
+        io::Printer printer(&output, '$');
+        generate_field(sorted_fields[i], &printer);
+      }
+      field_size = EstimateBytecodeSize(code);
+    }
+    // A field too large to share a method gets one of its own.
+    if (range.end > range.begin
+        && range_size + field_size > params_.max_method_size()) {
+      ranges.push_back(range);
+      range.begin = i;
+      range_size = 0;
+    }
+    range.end = i + 1;
+    range_size += field_size;
+  }
+  ranges.push_back(range);
+  return ranges;
+}
+
+string MessageGenerator::RangeMethodSuffix(
+    const vector<const FieldDescriptor*>& sorted_fields,
+    const FieldRange& range) {
+  if (range.end - range.begin == 1) {
+    return "Field" + SimpleItoa(sorted_fields[range.begin]->number());
+  }
+  return "Fields" + SimpleItoa(sorted_fields[range.begin]->number()) + "To"
+      + SimpleItoa(sorted_fields[range.end - 1]->number());
+}
+
+bool MessageGenerator::UsesFieldTable() const {
+  // MessageTableNano only knows plain public fields and oneofs; messages
+  // with maps, has flags, accessors or lazy message fields keep the
+  // unrolled code.
+  if (!params_.table_driven_codegen() || fields_.empty()
+      || params_.generate_has() || params_.optional_field_accessors()
+      || params_.use_reference_types_for_primitives()) {
+    return false;
+  }
+  for (int i = 0; i < fields_.size(); i++) {
+    if ((fields_[i]->type() == FieldDescriptor::TYPE_MESSAGE
+         && IsMapEntry(fields_[i]->message_type()))
+        || IsLazyMessageField(params_, fields_[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void MessageGenerator::GenerateFieldTable(io::Printer* printer) {
+  vector<const FieldDescriptor*> sorted_fields = SortFieldsByNumber(fields_);
+
+  printer->Print(
+    "\n"
+    "private static volatile com.google.protobuf.nano.MessageTableNano\n"
+    "    _fieldTable;\n"
+    "\n"
+    "private static com.google.protobuf.nano.MessageTableNano fieldTable() {\n"
+    "  if (_fieldTable == null) {\n"
+    "    synchronized (\n"
+    "        com.google.protobuf.nano.InternalNano.LAZY_INIT_LOCK) {\n"
+    "      if (_fieldTable == null) {\n"
+    "        _fieldTable = new com.google.protobuf.nano.MessageTableNano(\n"
+    "            new $classname$(),\n"
+    "            new int[] {\n"
+    "              // number, wire type, kind, slot\n",
+    "classname", descriptor_->name());
+
+  // Slots are indexes into fields_, the declaration order.
+  for (int i = 0; i < sorted_fields.size(); i++) {
+    const FieldDescriptor* field = sorted_fields[i];
+    int kind = field->type();
+    if (field->is_required()) {
+      kind |= kKindRequired;
+    }
+    if (field->is_repeated()) {
+      kind |= kKindRepeated;
+    }
+    if (IsPackedField(field)) {
+      kind |= kKindPacked;
+    }
+    if (field->containing_oneof() != NULL) {
+      kind |= kKindOneof;
+    }
+    int slot = std::find(fields_.begin(), fields_.end(), field)
+        - fields_.begin();
+    map<string, string> vars;
+    vars["number"] = SimpleItoa(field->number());
+    vars["wire_type"] = SimpleItoa(
+        WireFormat::WireTypeForFieldType(field->type()));
+    vars["kind"] = SimpleItoa(kind);
+    vars["slot"] = SimpleItoa(slot);
+    printer->Print(vars,
+      "              $number$, $wire_type$, $kind$, $slot$,\n");
+  }
+
+  printer->Print(
+    "            },\n");
+  bool has_enum_field = false;
+  for (int i = 0; i < fields_.size(); i++) {
+    if (fields_[i]->type() == FieldDescriptor::TYPE_ENUM
+        && fields_[i]->containing_oneof() == NULL) {
+      has_enum_field = true;
+    }
+  }
+
+  // Invalid enum values from the wire are dropped, as by the unrolled code,
+  // except for oneof members.
+  if (has_enum_field) {
+    printer->Print(
+      "            new int[][] {\n");
+    for (int i = 0; i < fields_.size(); i++) {
+      if (fields_[i]->type() != FieldDescriptor::TYPE_ENUM
+          || fields_[i]->containing_oneof() != NULL) {
+        printer->Print("              null,\n");
+        continue;
+      }
+      const EnumDescriptor* enum_type = fields_[i]->enum_type();
+      set<int> numbers;
+      for (int j = 0; j < enum_type->value_count(); j++) {
+        numbers.insert(enum_type->value(j)->number());
+      }
+      string values;
+      for (set<int>::const_iterator it = numbers.begin();
+           it != numbers.end(); ++it) {
+        if (!values.empty()) {
+          values += ", ";
+        }
+        values += SimpleItoa(*it);
+      }
+      printer->Print(
+        "              { $values$ },\n",
+        "values", values);
+    }
+    printer->Print(
+      "            },\n");
+  } else {
+    printer->Print(
+      "            null,\n");
+  }
+
+  GenerateFieldTableAccessor(printer);
+
+  printer->Print(
+    "      }\n"
+    "    }\n"
+    "  }\n"
+    "  return _fieldTable;\n"
+    "}\n"
+    "\n"
+    "@Override\n"
+    "public void writeTo(com.google.protobuf.nano.CodedOutputByteBufferNano output)\n"
+    "    throws java.io.IOException {\n"
+    "  fieldTable().writeTo(this, output);\n"
+    "  super.writeTo(output);\n"
+    "}\n"
+    "\n"
+    "@Override\n"
+    "protected int computeSerializedSize() {\n"
+    "  return super.computeSerializedSize()\n"
+    "      + fieldTable().computeSerializedSize(this);\n"
+    "}\n"
+    "\n"
+    "@Override\n"
+    "public $classname$ mergeFrom(\n"
+    "        com.google.protobuf.nano.CodedInputByteBufferNano input)\n"
+    "    throws java.io.IOException {\n"
+    "  fieldTable().mergeFrom(this, input);\n"
+    "  return this;\n"
+    "}\n",
+    "classname", descriptor_->name());
+}
+
+void MessageGenerator::GenerateFieldTableAccessor(io::Printer* printer) {
+  printer->Print(
+    "            new com.google.protobuf.nano.MessageTableNano.FieldAccessor() {\n");
+
+  // Whether a method was printed, to separate the next one.
+  bool has_method = false;
+  static const char* const kAccessorTypes[][2] = {
+    { "Int", "int" },
+    { "Long", "long" },
+    { "Float", "float" },
+    { "Double", "double" },
+    { "Boolean", "boolean" },
+    { "Object", "java.lang.Object" },
+  };
+  for (int t = 0; t < GOOGLE_ARRAYSIZE(kAccessorTypes); t++) {
+    map<string, string> vars;
+    vars["classname"] = descriptor_->name();
+    vars["accessor"] = kAccessorTypes[t][0];
+    vars["type"] = kAccessorTypes[t][1];
+    bool has_field = false;
+    for (int i = 0; i < fields_.size(); i++) {
+      if (TableAccessorType(fields_[i]) == vars["accessor"]) {
+        has_field = true;
+      }
+    }
+    if (!has_field) {
+      continue;
+    }
+
+    if (has_method) {
+      printer->Print("\n");
+    }
+    has_method = true;
+    printer->Print(vars,
+      "              @Override\n"
+      "              public $type$ get$accessor$(\n"
+      "                  com.google.protobuf.nano.MessageNano message, int slot) {\n"
+      "                switch (slot) {\n");
+    for (int i = 0; i < fields_.size(); i++) {
+      if (TableAccessorType(fields_[i]) != vars["accessor"]) {
+        continue;
+      }
+      vars["slot"] = SimpleItoa(i);
+      vars["name"] = TableFieldJavaName(fields_[i]);
+      printer->Print(vars,
+        "                  case $slot$: return (($classname$) message).$name$;\n");
+    }
+    printer->Print(vars,
+      "                  default: return super.get$accessor$(message, slot);\n"
+      "                }\n"
+      "              }\n"
+      "\n"
+      "              @Override\n"
+      "              public void set$accessor$(\n"
+      "                  com.google.protobuf.nano.MessageNano message, int slot,\n"
+      "                  $type$ value) {\n"
+      "                switch (slot) {\n");
+    for (int i = 0; i < fields_.size(); i++) {
+      const FieldDescriptor* field = fields_[i];
+      if (TableAccessorType(field) != vars["accessor"]) {
+        continue;
+      }
+      vars["slot"] = SimpleItoa(i);
+      vars["name"] = TableFieldJavaName(field);
+      // Oneof values are held as java.lang.Object; other objects are cast to
+      // the type of their field.
+      vars["cast"] = "";
+      if (vars["accessor"] == "Object" && field->containing_oneof() == NULL) {
+        string value_type = IsMessageOrGroup(field)
+            ? ClassName(params_, field->message_type())
+            : PrimitiveTypeName(GetJavaType(field));
+        if (field->is_repeated()) {
+          value_type += "[]";
+        }
+        vars["cast"] = "(" + value_type + ") ";
+      }
+      printer->Print(vars,
+        "                  case $slot$: (($classname$) message).$name$ = $cast$value; return;\n");
+    }
+    printer->Print(vars,
+      "                  default: super.set$accessor$(message, slot, value);\n"
+      "                }\n"
+      "              }\n");
+  }
+
+  bool has_oneof_field = false;
+  bool has_message_field = false;
+  bool has_repeated_message_field = false;
+  for (int i = 0; i < fields_.size(); i++) {
+    if (fields_[i]->containing_oneof() != NULL) {
+      has_oneof_field = true;
+    }
+    if (IsMessageOrGroup(fields_[i])) {
+      has_message_field = true;
+      if (fields_[i]->is_repeated()) {
+        has_repeated_message_field = true;
+      }
+    }
+  }
+
+  if (has_oneof_field) {
+    if (has_method) {
+      printer->Print("\n");
+    }
+    has_method = true;
+    printer->Print(
+      "              @Override\n"
+      "              public int getOneofCase(\n"
+      "                  com.google.protobuf.nano.MessageNano message, int slot) {\n"
+      "                switch (slot) {\n");
+    for (int i = 0; i < fields_.size(); i++) {
+      if (fields_[i]->containing_oneof() == NULL) {
+        continue;
+      }
+      printer->Print(
+        "                  case $slot$: return (($classname$) message).$oneof$Case_;\n",
+        "slot", SimpleItoa(i),
+        "classname", descriptor_->name(),
+        "oneof", UnderscoresToCamelCase(fields_[i]->containing_oneof()));
+    }
+    printer->Print(
+      "                  default: return super.getOneofCase(message, slot);\n"
+      "                }\n"
+      "              }\n"
+      "\n"
+      "              @Override\n"
+      "              public void setOneofCase(\n"
+      "                  com.google.protobuf.nano.MessageNano message, int slot,\n"
+      "                  int number) {\n"
+      "                switch (slot) {\n");
+    for (int i = 0; i < fields_.size(); i++) {
+      if (fields_[i]->containing_oneof() == NULL) {
+        continue;
+      }
+      printer->Print(
+        "                  case $slot$: (($classname$) message).$oneof$Case_ = number; return;\n",
+        "slot", SimpleItoa(i),
+        "classname", descriptor_->name(),
+        "oneof", UnderscoresToCamelCase(fields_[i]->containing_oneof()));
+    }
+    printer->Print(
+      "                  default: super.setOneofCase(message, slot, number);\n"
+      "                }\n"
+      "              }\n");
+  }
+
+  if (has_message_field) {
+    if (has_method) {
+      printer->Print("\n");
+    }
+    has_method = true;
+    printer->Print(
+      "              @Override\n"
+      "              public com.google.protobuf.nano.MessageNano newMessage(int slot) {\n"
+      "                switch (slot) {\n");
+    for (int i = 0; i < fields_.size(); i++) {
+      if (!IsMessageOrGroup(fields_[i])) {
+        continue;
+      }
+      printer->Print(
+        "                  case $slot$: return new $type$();\n",
+        "slot", SimpleItoa(i),
+        "type", ClassName(params_, fields_[i]->message_type()));
+    }
+    printer->Print(
+      "                  default: return super.newMessage(slot);\n"
+      "                }\n"
+      "              }\n");
+  }
+
+  if (has_repeated_message_field) {
+    if (has_method) {
+      printer->Print("\n");
+    }
+    has_method = true;
+    printer->Print(
+      "              @Override\n"
+      "              public com.google.protobuf.nano.MessageNano[] newMessageArray(\n"
+      "                  int slot, int length) {\n"
+      "                switch (slot) {\n");
+    for (int i = 0; i < fields_.size(); i++) {
+      if (!IsMessageOrGroup(fields_[i]) || !fields_[i]->is_repeated()) {
+        continue;
+      }
+      printer->Print(
+        "                  case $slot$: return new $type$[length];\n",
+        "slot", SimpleItoa(i),
+        "type", ClassName(params_, fields_[i]->message_type()));
+    }
+    printer->Print(
+      "                  default: return super.newMessageArray(slot, length);\n"
+      "                }\n"
+      "              }\n");
+  }
+
+  printer->Print(
+    "            });\n");
+}
+
 void MessageGenerator::
 GenerateMessageSerializationMethods(io::Printer* printer) {
   // Rely on the parent implementations of writeTo() and getSerializedSize()
   // if there are no fields to serialize in this message.
-  if (descriptor_->field_count() == 0) {
+  if (fields_.empty()) {
     return;
   }
 
-  std::unique_ptr<const FieldDescriptor*[]> sorted_fields(
-    SortFieldsByNumber(descriptor_));
+  vector<const FieldDescriptor*> sorted_fields = SortFieldsByNumber(fields_);
+
+  // Methods above HotSpot's HugeMethodLimit are never compiled, so with
+  // max_method_size the fields are written by helper methods, each handling
+  // a range of field numbers.
+  vector<FieldRange> ranges = SplitFieldsBySize(sorted_fields,
+      [this](const FieldDescriptor* field, io::Printer* printer) {
+        GenerateSerializeOneField(printer, field);
+      });
 
   printer->Print(
     "\n"
@@ -359,9 +847,17 @@ GenerateMessageSerializationMethods(io::Printer* printer) {
     "    throws java.io.IOException {\n");
   printer->Indent();
 
-  // Output the fields in sorted order
-  for (int i = 0; i < descriptor_->field_count(); i++) {
-    GenerateSerializeOneField(printer, sorted_fields[i]);
+  if (ranges.size() == 1) {
+    // Output the fields in sorted order
+    for (int i = 0; i < fields_.size(); i++) {
+      GenerateSerializeOneField(printer, sorted_fields[i]);
+    }
+  } else {
+    for (int i = 0; i < ranges.size(); i++) {
+      printer->Print(
+        "writeTo$suffix$(output);\n",
+        "suffix", RangeMethodSuffix(sorted_fields, ranges[i]));
+    }
   }
 
   // The parent implementation will write any unknown fields if necessary.
@@ -371,6 +867,30 @@ GenerateMessageSerializationMethods(io::Printer* printer) {
   printer->Outdent();
   printer->Print("}\n");
 
+  if (ranges.size() > 1) {
+    for (int i = 0; i < ranges.size(); i++) {
+      printer->Print(
+        "\n"
+        "private void writeTo$suffix$(\n"
+        "        com.google.protobuf.nano.CodedOutputByteBufferNano output)\n"
+        "    throws java.io.IOException {\n",
+        "suffix", RangeMethodSuffix(sorted_fields, ranges[i]));
+      printer->Indent();
+      for (int j = ranges[i].begin; j < ranges[i].end; j++) {
+        GenerateSerializeOneField(printer, sorted_fields[j]);
+      }
+      printer->Outdent();
+      printer->Print("}\n");
+    }
+  } else if (UsesReverseSerializer()) {
+    GenerateReverseSerializationMethod(printer, sorted_fields);
+  }
+
+  ranges = SplitFieldsBySize(sorted_fields,
+      [this](const FieldDescriptor* field, io::Printer* printer) {
+        field_generators_.get(field).GenerateSerializedSizeCode(printer);
+      });
+
   // The parent implementation will get the serialized size for unknown
   // fields if necessary.
   printer->Print(
@@ -380,19 +900,172 @@ GenerateMessageSerializationMethods(io::Printer* printer) {
     "  int size = super.computeSerializedSize();\n");
   printer->Indent();
 
-  for (int i = 0; i < descriptor_->field_count(); i++) {
-    field_generators_.get(sorted_fields[i]).GenerateSerializedSizeCode(printer);
+  if (ranges.size() == 1) {
+    for (int i = 0; i < fields_.size(); i++) {
+      field_generators_.get(sorted_fields[i]).GenerateSerializedSizeCode(printer);
+    }
+  } else {
+    for (int i = 0; i < ranges.size(); i++) {
+      printer->Print(
+        "size += computeSerializedSize$suffix$();\n",
+        "suffix", RangeMethodSuffix(sorted_fields, ranges[i]));
+    }
   }
 
   printer->Outdent();
   printer->Print(
     "  return size;\n"
     "}\n");
+
+  if (ranges.size() > 1) {
+    for (int i = 0; i < ranges.size(); i++) {
+      printer->Print(
+        "\n"
+        "private int computeSerializedSize$suffix$() {\n"
+        "  int size = 0;\n",
+        "suffix", RangeMethodSuffix(sorted_fields, ranges[i]));
+      printer->Indent();
+      for (int j = ranges[i].begin; j < ranges[i].end; j++) {
+        field_generators_.get(sorted_fields[j])
+            .GenerateSerializedSizeCode(printer);
+      }
+      printer->Outdent();
+      printer->Print(
+        "  return size;\n"
+        "}\n");
+    }
+  }
+}
+
+bool MessageGenerator::UsesReverseSerializer() const {
+  // Unknown fields and extensions are only written by writeTo(). Messages
+  // whose writeTo() is split by max_method_size keep the writeToReverse()
+  // of MessageNano too, see GenerateMessageSerializationMethods().
+  if (!params_.reverse_serializer() || params_.store_unknown_fields()
+      || fields_.empty() || UsesFieldTable()) {
+    return false;
+  }
+  for (int i = 0; i < fields_.size(); i++) {
+    if (!field_generators_.get(fields_[i]).SupportsReverseSerialization()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void MessageGenerator::GenerateReverseSerializationMethod(
+    io::Printer* printer, const vector<const FieldDescriptor*>& sorted_fields) {
+  // Each field goes in front of the ones written before it, so they are
+  // written from the highest number down, and the bytes come out in the
+  // order of writeTo().
+  printer->Print(
+    "\n"
+    "@Override\n"
+    "public void writeToReverse(\n"
+    "        com.google.protobuf.nano.ReverseCodedOutputNano output)\n"
+    "    throws java.io.IOException {\n");
+  printer->Indent();
+  for (int i = sorted_fields.size() - 1; i >= 0; i--) {
+    field_generators_.get(sorted_fields[i])
+        .GenerateReverseSerializationCode(printer);
+  }
+  printer->Outdent();
+  printer->Print("}\n");
+
+  // The bound takes every field as set: the sizes known here are summed
+  // into one constant, and only strings, bytes, repeated fields and
+  // messages add to it at run time.
+  int constant_size = 0;
+  for (int i = 0; i < fields_.size(); i++) {
+    constant_size += field_generators_.get(fields_[i])
+        .SerializedSizeUpperBoundConstant();
+  }
+  printer->Print(
+    "\n"
+    "@Override\n"
+    "public int maxSerializedSizeUpperBound() {\n"
+    "  int size = $size$;\n",
+    "size", SimpleItoa(constant_size));
+  printer->Indent();
+  for (int i = 0; i < sorted_fields.size(); i++) {
+    field_generators_.get(sorted_fields[i])
+        .GenerateSerializedSizeUpperBoundCode(printer);
+  }
+  printer->Outdent();
+  printer->Print(
+    "  return size;\n"
+    "}\n");
+}
+
+bool MessageGenerator::UsesDenseFieldDispatch() const {
+  if (!params_.dense_field_dispatch()
+      || fields_.size() < kMinDenseDispatchFields
+      || fields_.size() > kMaxDenseDispatchFields) {
+    return false;
+  }
+  // The labels of the tag switch are 0 and the tags of both forms of
+  // packable fields. Like javac, compare the costs of a tableswitch over
+  // those and of a lookupswitch; only the latter is worth avoiding.
+  int64 labels = 1;
+  int64 max_tag = 0;
+  for (int i = 0; i < fields_.size(); i++) {
+    const FieldDescriptor* field = fields_[i];
+    if (field->number() > kMaxDenseDispatchFieldNumber) {
+      return false;
+    }
+    labels++;
+    max_tag = std::max<int64>(max_tag, DeclaredTag(field));
+    if (field->is_packable()) {
+      labels++;
+      max_tag = std::max<int64>(max_tag, AlternateTag(field));
+    }
+  }
+  int64 table_cost = 4 + (max_tag + 1) + 3 * 3;
+  int64 lookup_cost = 3 + 2 * labels + 3 * labels;
+  return table_cost > lookup_cost;
 }
 
 void MessageGenerator::GenerateMergeFromMethods(io::Printer* printer) {
-  std::unique_ptr<const FieldDescriptor*[]> sorted_fields(
-    SortFieldsByNumber(descriptor_));
+  vector<const FieldDescriptor*> sorted_fields = SortFieldsByNumber(fields_);
+
+  vector<FieldRange> ranges = SplitFieldsBySize(sorted_fields,
+      [this](const FieldDescriptor* field, io::Printer* printer) {
+        GenerateMergeFromCases(printer, field);
+      });
+
+  bool dense_dispatch = ranges.size() <= 1 && UsesDenseFieldDispatch();
+  if (dense_dispatch) {
+    printer->Print(
+      "\n"
+      "private static volatile byte[] _fieldIndexes;\n"
+      "\n"
+      "private static byte[] fieldIndexes() {\n"
+      "  if (_fieldIndexes == null) {\n"
+      "    synchronized (\n"
+      "        com.google.protobuf.nano.InternalNano.LAZY_INIT_LOCK) {\n"
+      "      if (_fieldIndexes == null) {\n"
+      "        _fieldIndexes = com.google.protobuf.nano.InternalNano.fieldIndexes(\n"
+      "            new int[] {\n");
+    for (int i = 0; i < sorted_fields.size(); i += 10) {
+      string numbers;
+      for (int j = i; j < sorted_fields.size() && j < i + 10; j++) {
+        numbers += SimpleItoa(sorted_fields[j]->number()) + ",";
+        if (j + 1 < sorted_fields.size() && j + 1 < i + 10) {
+          numbers += " ";
+        }
+      }
+      printer->Print(
+        "              $numbers$\n",
+        "numbers", numbers);
+    }
+    printer->Print(
+      "            });\n"
+      "      }\n"
+      "    }\n"
+      "  }\n"
+      "  return _fieldIndexes;\n"
+      "}\n");
+  }
 
   printer->Print(
     "\n"
@@ -402,73 +1075,447 @@ void MessageGenerator::GenerateMergeFromMethods(io::Printer* printer) {
     "    throws java.io.IOException {\n",
     "classname", descriptor_->name());
 
+  // Repeated fields track the lengths in use of their arrays in local
+  // variables (see FieldGenerator::MergeLengthVariable()), and are trimmed
+  // to them after the parsing loop, which is then left by "break parse".
+  vector<const FieldDescriptor*> grown_fields;
+  for (int i = 0; i < sorted_fields.size(); i++) {
+    if (!field_generators_.get(sorted_fields[i]).MergeLengthVariable()
+        .empty()) {
+      grown_fields.push_back(sorted_fields[i]);
+    }
+  }
+  bool trims_after_loop = !grown_fields.empty();
+  const char* exit = trims_after_loop ? kBreakFromMerge : kReturnFromMerge;
+
   printer->Indent();
+  for (int i = 0; i < sorted_fields.size(); i++) {
+    field_generators_.get(sorted_fields[i]).GenerateMergeStartCode(printer);
+  }
+  if (ranges.size() > 1) {
+    // Each helper parses the tags of its range of field numbers and returns
+    // false for any other tag, which is then handled as an unknown field.
+    // Tags are compared as signed ints, so huge field numbers end up in the
+    // first range, which doesn't know them either. The helpers keep the
+    // lengths of repeated fields on a stack of the input, from lengthsBase.
+    if (trims_after_loop) {
+      printer->Print(
+        "int lengthsBase = input.pushMergeLengths($count$);\n",
+        "count", SimpleItoa(grown_fields.size()));
+      GenerateMergeTryStart(printer, grown_fields);
+    }
+    printer->Print(
+      "$label$while (true) {\n"
+      "  int tag = input.readTag();\n"
+      "  if (tag == 0) {\n"     // zero signals EOF / limit reached
+      "    $exit$\n"
+      "  }\n"
+      "  boolean parsed;\n",
+      "label", MergeLoopLabel(trims_after_loop), "exit", exit);
+    printer->Indent();
+    for (int i = 0; i < ranges.size(); i++) {
+      map<string, string> vars;
+      vars["suffix"] = RangeMethodSuffix(sorted_fields, ranges[i]);
+      vars["lengths"] = trims_after_loop ? ", lengthsBase" : "";
+      if (i + 1 < ranges.size()) {
+        vars["else"] = i == 0 ? "" : "} else ";
+        // The lowest tag of the next range.
+        vars["limit"] = SimpleItoa(WireFormatLite::MakeTag(
+            sorted_fields[ranges[i + 1].begin]->number(),
+            WireFormatLite::WIRETYPE_VARINT));
+        printer->Print(vars,
+          "$else$if (tag < $limit$) {\n"
+          "  parsed = mergeFrom$suffix$(input, tag$lengths$);\n");
+      } else {
+        printer->Print(vars,
+          "} else {\n"
+          "  parsed = mergeFrom$suffix$(input, tag$lengths$);\n"
+          "}\n");
+      }
+    }
+    printer->Print(
+      "if (!parsed) {\n");
+    printer->Indent();
+    GenerateUnknownFieldMergingCode(printer, exit);
+    printer->Outdent();
+    printer->Outdent();
+    printer->Print(
+      "  }\n"     // if (!parsed)
+      "}\n");     // while (true)
+    if (trims_after_loop) {
+      GenerateMergeTrimCode(printer, grown_fields, true);
+    }
+    printer->Outdent();
+    printer->Print(
+      "}\n");
+
+    for (int i = 0; i < ranges.size(); i++) {
+      printer->Print(
+        "\n"
+        "private boolean mergeFrom$suffix$(\n"
+        "        com.google.protobuf.nano.CodedInputByteBufferNano input, int tag$lengths$)\n"
+        "    throws java.io.IOException {\n",
+        "suffix", RangeMethodSuffix(sorted_fields, ranges[i]),
+        "lengths", trims_after_loop ? ", int lengthsBase" : "");
+      printer->Indent();
+      // The lengths of the repeated fields of the range, stored back if
+      // a tag is parsed. Messages parsed in the meantime may have grown the
+      // stack, so it is fetched again.
+      vector<std::pair<string, int> > lengths;
+      for (int j = ranges[i].begin; j < ranges[i].end; j++) {
+        string length =
+            field_generators_.get(sorted_fields[j]).MergeLengthVariable();
+        if (!length.empty()) {
+          int index = std::find(grown_fields.begin(), grown_fields.end(),
+                                sorted_fields[j]) - grown_fields.begin();
+          if (lengths.empty()) {
+            printer->Print("int[] lengths = input.mergeLengths();\n");
+          }
+          lengths.push_back(std::make_pair(length, index));
+          printer->Print(
+            "int $length$ = lengths[lengthsBase + $index$];\n",
+            "length", length, "index", SimpleItoa(index));
+        }
+      }
+      bool has_map_field = false;
+      for (int j = ranges[i].begin; j < ranges[i].end; j++) {
+        const FieldDescriptor* field = sorted_fields[j];
+        if (field->type() == FieldDescriptor::TYPE_MESSAGE &&
+            IsMapEntry(field->message_type())) {
+          has_map_field = true;
+        }
+      }
+      if (has_map_field) {
+        printer->Print(
+          "com.google.protobuf.nano.MapFactories.MapFactory mapFactory =\n"
+          "  com.google.protobuf.nano.MapFactories.getMapFactory();\n");
+      }
+      printer->Print(
+        "switch (tag) {\n");
+      printer->Indent();
+      printer->Print(
+        "default:\n"
+        "  return false;\n");
+      for (int j = ranges[i].begin; j < ranges[i].end; j++) {
+        GenerateMergeFromCases(printer, sorted_fields[j]);
+      }
+      printer->Outdent();
+      printer->Print(
+        "}\n");       // switch (tag)
+      if (!lengths.empty()) {
+        printer->Print("lengths = input.mergeLengths();\n");
+      }
+      for (int j = 0; j < lengths.size(); j++) {
+        printer->Print(
+          "lengths[lengthsBase + $index$] = $length$;\n",
+          "length", lengths[j].first, "index", SimpleItoa(lengths[j].second));
+      }
+      printer->Outdent();
+      printer->Print(
+        "  return true;\n"
+        "}\n");
+    }
+    return;
+  }
+
   if (HasMapField(descriptor_)) {
     printer->Print(
       "com.google.protobuf.nano.MapFactories.MapFactory mapFactory =\n"
       "  com.google.protobuf.nano.MapFactories.getMapFactory();\n");
   }
 
+  for (int i = 0; i < grown_fields.size(); i++) {
+    printer->Print(
+      "int $length$ = 0;\n",
+      "length", field_generators_.get(grown_fields[i]).MergeLengthVariable());
+  }
+
+  GenerateMergeTryStart(printer, grown_fields);
+  if (dense_dispatch) {
+    GenerateDenseMergeFromBody(printer, sorted_fields, trims_after_loop);
+  } else {
+    GenerateSwitchMergeFromBody(printer, sorted_fields, trims_after_loop);
+  }
+  GenerateMergeTrimCode(printer, grown_fields, false);
+  printer->Outdent();
+  printer->Print(
+    "}\n");
+
+  if (UsesArrayParser()) {
+    GenerateArrayMergeFromMethod(printer, sorted_fields, grown_fields);
+  }
+}
+
+bool MessageGenerator::UsesArrayParser() const {
+  // Unknown fields and extensions are only stored by reading them from a
+  // CodedInputByteBufferNano, and the methods split by max_method_size keep
+  // to it too.
+  if (!params_.array_parser() || params_.store_unknown_fields()
+      || fields_.empty() || UsesFieldTable()) {
+    return false;
+  }
+  for (int i = 0; i < fields_.size(); i++) {
+    if (!field_generators_.get(fields_[i]).SupportsArrayParsing()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void MessageGenerator::GenerateArrayMergeFromMethod(
+    io::Printer* printer, const vector<const FieldDescriptor*>& sorted_fields,
+    const vector<const FieldDescriptor*>& grown_fields) {
+  // The position is kept in a local variable and passed to the decoder,
+  // which returns it advanced past what it read; values come back in its
+  // fields. Only the lengths of values are checked against the limit, and
+  // varints when they may run past it.
   printer->Print(
-    "while (true) {\n");
+    "\n"
+    "@Override\n"
+    "protected boolean hasArrayParser() {\n"
+    "  return true;\n"
+    "}\n"
+    "\n"
+    "@Override\n"
+    "public int mergeFrom(byte[] buffer, int position, int limit,\n"
+    "        com.google.protobuf.nano.ArrayDecoderNano decoder)\n"
+    "    throws java.io.IOException {\n");
+  printer->Indent();
+
+  for (int i = 0; i < sorted_fields.size(); i++) {
+    field_generators_.get(sorted_fields[i]).GenerateMergeStartCode(printer);
+  }
+  for (int i = 0; i < grown_fields.size(); i++) {
+    printer->Print(
+      "int $length$ = 0;\n",
+      "length", field_generators_.get(grown_fields[i]).MergeLengthVariable());
+  }
+  bool trims_after_loop = !grown_fields.empty();
+  const char* exit = trims_after_loop ? kBreakFromMerge : "return position;";
+
+  GenerateMergeTryStart(printer, grown_fields);
+  printer->Print(
+    "$label$while (position < limit) {\n"
+    "  position = decoder.readTag(buffer, position, limit);\n"
+    "  int tag = decoder.intValue;\n"
+    "  switch (tag) {\n",
+    "label", MergeLoopLabel(trims_after_loop));
+  printer->Indent();
   printer->Indent();
 
+  printer->Print(
+    "default: {\n"
+    "  position = decoder.skipField(buffer, position, limit, tag);\n"
+    "  if (decoder.lastTag != 0) {\n"
+    "    $exit$\n"   // it's an endgroup tag
+    "  }\n"
+    "  break;\n"
+    "}\n",
+    "exit", exit);
+  for (int i = 0; i < sorted_fields.size(); i++) {
+    const FieldDescriptor* field = sorted_fields[i];
+    GenerateArrayMergeFromCase(printer, field, IsPackedField(field));
+  }
+  for (int i = 0; i < sorted_fields.size(); i++) {
+    const FieldDescriptor* field = sorted_fields[i];
+    if (field->is_packable()) {
+      GenerateArrayMergeFromCase(printer, field, !IsPackedField(field));
+    }
+  }
+
+  printer->Outdent();
+  printer->Outdent();
+  printer->Print(
+    "  }\n"      // switch (tag)
+    "}\n");      // while (position < limit)
+  if (trims_after_loop) {
+    printer->Outdent();
+    printer->Print(
+      "} finally {\n");
+    printer->Indent();
+    for (int i = 0; i < grown_fields.size(); i++) {
+      field_generators_.get(grown_fields[i]).GenerateMergeTrimCode(printer);
+    }
+    printer->Outdent();
+    printer->Print(
+      "}\n");
+  }
+  printer->Print(
+    "return position;\n");
+  printer->Outdent();
+  printer->Print(
+    "}\n");
+}
+
+void MessageGenerator::GenerateArrayMergeFromCase(
+    io::Printer* printer, const FieldDescriptor* field, bool packed) {
+  uint32 tag = packed
+      ? WireFormatLite::MakeTag(field->number(),
+                                WireFormatLite::WIRETYPE_LENGTH_DELIMITED)
+      : WireFormatLite::MakeTag(field->number(),
+                                WireFormat::WireTypeForFieldType(field->type()));
+  printer->Print(
+    "case $tag$: {\n",
+    "tag", SimpleItoa(tag));
+  printer->Indent();
+  if (packed) {
+    field_generators_.get(field).GenerateArrayMergingCodeFromPacked(printer);
+  } else {
+    field_generators_.get(field).GenerateArrayMergingCode(printer);
+  }
+  printer->Outdent();
+  printer->Print(
+    "  break;\n"
+    "}\n");
+}
+
+void MessageGenerator::GenerateSwitchMergeFromBody(
+    io::Printer* printer, const vector<const FieldDescriptor*>& sorted_fields,
+    bool trims_after_loop) {
+  const char* exit = trims_after_loop ? kBreakFromMerge : kReturnFromMerge;
+  // Fields usually arrive in order of their numbers, so after parsing a
+  // field the next tag is compared against that of the next field and, if it
+  // matches, the next field's case is entered by falling through to it rather
+  // than through the switch. Any other tag is dispatched by the switch, via
+  // continue; break reads the next tag.
   printer->Print(
     "int tag = input.readTag();\n"
+    "$label$while (true) {\n",
+    "label", MergeLoopLabel(trims_after_loop));
+  printer->Indent();
+
+  printer->Print(
     "switch (tag) {\n");
   printer->Indent();
 
   printer->Print(
     "case 0:\n"          // zero signals EOF / limit reached
-    "  return this;\n"
-    "default: {\n");
+    "  $exit$\n"
+    "default: {\n",
+    "exit", exit);
 
   printer->Indent();
-  if (params_.store_unknown_fields()) {
-    printer->Print(
-        "if (!storeUnknownField(input, tag)) {\n"
-        "  return this;\n"
+  GenerateUnknownFieldMergingCode(printer, exit);
+  printer->Print("break;\n");
+  printer->Outdent();
+  printer->Print("}\n");
+
+  // The cases for the declared forms of the fields, in order, followed by
+  // those for packable fields in their other form: to make packed = true
+  // wire compatible, both forms are parsed regardless of
+  // field->options().packed().
+  for (int i = 0; i < fields_.size(); i++) {
+    const FieldDescriptor* field = sorted_fields[i];
+    GenerateMergeFromCase(printer, field, IsPackedField(field));
+    if (i + 1 < fields_.size()) {
+      printer->Print(
+        "  tag = input.readTag();\n"
+        "  if (tag != $next_tag$) {\n"
+        "    continue;\n"
+        "  }\n"
+        "}\n",
+        "next_tag", SimpleItoa(DeclaredTag(sorted_fields[i + 1])));
+    } else {
+      printer->Print(
+        "  break;\n"
         "}\n");
-  } else {
-    printer->Print(
-        "if (!com.google.protobuf.nano.WireFormatNano.parseUnknownField(input, tag)) {\n"
-        "  return this;\n"   // it's an endgroup tag
+    }
+  }
+  for (int i = 0; i < fields_.size(); i++) {
+    const FieldDescriptor* field = sorted_fields[i];
+    if (field->is_packable()) {
+      GenerateMergeFromCase(printer, field, !IsPackedField(field));
+      printer->Print(
+        "  break;\n"
         "}\n");
+    }
   }
+
+  printer->Outdent();
+  printer->Print(
+    "}\n"       // switch (tag)
+    "tag = input.readTag();\n");
+  printer->Outdent();
+  printer->Print(
+    "}\n");     // while (true)
+}
+
+void MessageGenerator::GenerateDenseMergeFromBody(
+    io::Printer* printer, const vector<const FieldDescriptor*>& sorted_fields,
+    bool trims_after_loop) {
+  const char* exit = trims_after_loop ? kBreakFromMerge : kReturnFromMerge;
+  // As with the tag switch, the next field's case is entered by falling
+  // through to it when its tag comes next. Otherwise the switch is on the
+  // index of the field number in fieldIndexes(), 0 for unknown numbers, so
+  // javac compiles it to a tableswitch; each case checks the wire type.
+  printer->Print(
+    "byte[] fieldIndexes = fieldIndexes();\n"
+    "int tag = input.readTag();\n"
+    "$label$while (true) {\n"
+    "  int number = tag >>> 3;\n"
+    "  switch (number < fieldIndexes.length\n"
+    "      ? fieldIndexes[number] & 0xff : 0) {\n",
+    "label", MergeLoopLabel(trims_after_loop));
+  printer->Indent();
+  printer->Indent();
+
+  printer->Print(
+    "case 0: {\n"
+    "  if (tag == 0) {\n"      // zero signals EOF / limit reached
+    "    $exit$\n"
+    "  }\n",
+    "exit", exit);
+  printer->Indent();
+  GenerateUnknownFieldMergingCode(printer, exit);
   printer->Print("break;\n");
   printer->Outdent();
   printer->Print("}\n");
 
-  for (int i = 0; i < descriptor_->field_count(); i++) {
+  for (int i = 0; i < sorted_fields.size(); i++) {
     const FieldDescriptor* field = sorted_fields[i];
-    uint32 tag = WireFormatLite::MakeTag(field->number(),
-      WireFormat::WireTypeForFieldType(field->type()));
-
+    const FieldGenerator& generator = field_generators_.get(field);
+    bool packed = IsPackedField(field);
     printer->Print(
-      "case $tag$: {\n",
-      "tag", SimpleItoa(tag));
+      "case $index$: {\n"
+      "  if (tag != $tag$) {\n",
+      "index", SimpleItoa(i + 1),
+      "tag", SimpleItoa(DeclaredTag(field)));
+    printer->Indent();
     printer->Indent();
-
-    field_generators_.get(field).GenerateMergingCode(printer);
-
-    printer->Outdent();
-    printer->Print(
-      "  break;\n"
-      "}\n");
-
     if (field->is_packable()) {
-      // To make packed = true wire compatible, we generate parsing code from a
-      // packed version of this field regardless of field->options().packed().
-      uint32 packed_tag = WireFormatLite::MakeTag(field->number(),
-        WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+      // Both forms are parsed, to make packed = true wire compatible.
       printer->Print(
-        "case $tag$: {\n",
-        "tag", SimpleItoa(packed_tag));
+        "if (tag == $tag$) {\n",
+        "tag", SimpleItoa(AlternateTag(field)));
       printer->Indent();
-
-      field_generators_.get(field).GenerateMergingCodeFromPacked(printer);
-
+      if (packed) {
+        generator.GenerateMergingCode(printer);
+      } else {
+        generator.GenerateMergingCodeFromPacked(printer);
+      }
+      printer->Print("break;\n");
       printer->Outdent();
+      printer->Print("}\n");
+    }
+    GenerateUnknownFieldMergingCode(printer, exit);
+    printer->Print("break;\n");
+    printer->Outdent();
+    printer->Print("}\n");
+    if (packed) {
+      generator.GenerateMergingCodeFromPacked(printer);
+    } else {
+      generator.GenerateMergingCode(printer);
+    }
+    printer->Outdent();
+    if (i + 1 < sorted_fields.size()) {
+      printer->Print(
+        "  tag = input.readTag();\n"
+        "  if (tag != $next_tag$) {\n"
+        "    continue;\n"
+        "  }\n"
+        "}\n",
+        "next_tag", SimpleItoa(DeclaredTag(sorted_fields[i + 1])));
+    } else {
       printer->Print(
         "  break;\n"
         "}\n");
@@ -476,12 +1523,110 @@ void MessageGenerator::GenerateMergeFromMethods(io::Printer* printer) {
   }
 
   printer->Outdent();
+  printer->Print(
+    "}\n"       // switch (index)
+    "tag = input.readTag();\n");
   printer->Outdent();
+  printer->Print(
+    "}\n");     // while (true)
+}
+
+void MessageGenerator::GenerateMergeTryStart(
+    io::Printer* printer, const vector<const FieldDescriptor*>& grown_fields) {
+  if (grown_fields.empty()) {
+    return;
+  }
+  printer->Print(
+    "try {\n");
+  printer->Indent();
+}
+
+void MessageGenerator::GenerateMergeTrimCode(
+    io::Printer* printer, const vector<const FieldDescriptor*>& grown_fields,
+    bool lengths_on_stack) {
+  if (grown_fields.empty()) {
+    return;
+  }
+  printer->Outdent();
+  printer->Print(
+    "} finally {\n");
+  printer->Indent();
+  if (lengths_on_stack) {
+    printer->Print(
+      "int[] lengths = input.mergeLengths();\n");
+    for (int i = 0; i < grown_fields.size(); i++) {
+      printer->Print(
+        "int $length$ = lengths[lengthsBase + $index$];\n",
+        "length",
+        field_generators_.get(grown_fields[i]).MergeLengthVariable(),
+        "index", SimpleItoa(i));
+    }
+  }
+  for (int i = 0; i < grown_fields.size(); i++) {
+    field_generators_.get(grown_fields[i]).GenerateMergeTrimCode(printer);
+  }
+  if (lengths_on_stack) {
+    printer->Print(
+      "input.popMergeLengths(lengthsBase);\n");
+  }
   printer->Outdent();
   printer->Print(
-    "    }\n"     // switch (tag)
-    "  }\n"       // while (true)
+    "}\n"
+    "return this;\n");
+}
+
+void MessageGenerator::GenerateUnknownFieldMergingCode(io::Printer* printer,
+                                                       const char* exit) {
+  if (params_.store_unknown_fields()) {
+    printer->Print(
+        "if (!storeUnknownField(input, tag)) {\n"
+        "  $exit$\n"
+        "}\n",
+        "exit", exit);
+  } else {
+    printer->Print(
+        "if (!com.google.protobuf.nano.WireFormatNano.parseUnknownField(input, tag)) {\n"
+        "  $exit$\n"   // it's an endgroup tag
+        "}\n",
+        "exit", exit);
+  }
+}
+
+void MessageGenerator::GenerateMergeFromCase(io::Printer* printer,
+                                             const FieldDescriptor* field,
+                                             bool packed) {
+  uint32 tag = packed
+      ? WireFormatLite::MakeTag(field->number(),
+                                WireFormatLite::WIRETYPE_LENGTH_DELIMITED)
+      : WireFormatLite::MakeTag(field->number(),
+                                WireFormat::WireTypeForFieldType(field->type()));
+  printer->Print(
+    "case $tag$: {\n",
+    "tag", SimpleItoa(tag));
+  printer->Indent();
+  if (packed) {
+    field_generators_.get(field).GenerateMergingCodeFromPacked(printer);
+  } else {
+    field_generators_.get(field).GenerateMergingCode(printer);
+  }
+  printer->Outdent();
+}
+
+void MessageGenerator::GenerateMergeFromCases(io::Printer* printer,
+                                              const FieldDescriptor* field) {
+  GenerateMergeFromCase(printer, field, false);
+  printer->Print(
+    "  break;\n"
     "}\n");
+
+  if (field->is_packable()) {
+    // To make packed = true wire compatible, we generate parsing code from a
+    // packed version of this field regardless of field->options().packed().
+    GenerateMergeFromCase(printer, field, true);
+    printer->Print(
+      "  break;\n"
+      "}\n");
+  }
 }
 
 void MessageGenerator::
@@ -537,17 +1682,17 @@ void MessageGenerator::GenerateFieldInitializers(io::Printer* printer) {
   }
 
   // Call clear for all of the fields.
-  for (int i = 0; i < descriptor_->field_count(); i++) {
-    const FieldDescriptor* field = descriptor_->field(i);
+  for (int i = 0; i < fields_.size(); i++) {
+    const FieldDescriptor* field = fields_[i];
     field_generators_.get(field).GenerateClearCode(printer);
   }
 
   // Clear oneofs.
-  for (int i = 0; i < descriptor_->oneof_decl_count(); i++) {
+  for (int i = 0; i < oneofs_.size(); i++) {
     printer->Print(
       "clear$oneof_capitalized_name$();\n",
       "oneof_capitalized_name", UnderscoresToCapitalizedCamelCase(
-          descriptor_->oneof_decl(i)));
+          oneofs_[i]));
   }
 
   // Clear unknown fields.
@@ -573,8 +1718,8 @@ void MessageGenerator::GenerateClone(io::Printer* printer) {
     "}\n",
     "classname", descriptor_->name());
 
-  for (int i = 0; i < descriptor_->field_count(); i++) {
-    field_generators_.get(descriptor_->field(i)).GenerateFixClonedCode(printer);
+  for (int i = 0; i < fields_.size(); i++) {
+    field_generators_.get(fields_[i]).GenerateFixClonedCode(printer);
   }
 
   printer->Outdent();
@@ -588,7 +1733,7 @@ void MessageGenerator::GenerateEquals(io::Printer* printer) {
   // Don't override if there are no fields. We could generate an
   // equals method that compares types, but often empty messages
   // are used as namespaces.
-  if (descriptor_->field_count() == 0 && !params_.store_unknown_fields()) {
+  if (fields_.empty() && !params_.store_unknown_fields()) {
     return;
   }
 
@@ -608,8 +1753,8 @@ void MessageGenerator::GenerateEquals(io::Printer* printer) {
     "classname", descriptor_->name());
 
   // Checking oneof case before checking each oneof field.
-  for (int i = 0; i < descriptor_->oneof_decl_count(); i++) {
-    const OneofDescriptor* oneof_desc = descriptor_->oneof_decl(i);
+  for (int i = 0; i < oneofs_.size(); i++) {
+    const OneofDescriptor* oneof_desc = oneofs_[i];
     printer->Print(
       "if (this.$oneof_name$Case_ != other.$oneof_name$Case_) {\n"
       "  return false;\n"
@@ -617,8 +1762,8 @@ void MessageGenerator::GenerateEquals(io::Printer* printer) {
       "oneof_name", UnderscoresToCamelCase(oneof_desc));
   }
 
-  for (int i = 0; i < descriptor_->field_count(); i++) {
-    const FieldDescriptor* field = descriptor_->field(i);
+  for (int i = 0; i < fields_.size(); i++) {
+    const FieldDescriptor* field = fields_[i];
     field_generators_.get(field).GenerateEqualsCode(printer);
   }
 
@@ -639,7 +1784,7 @@ void MessageGenerator::GenerateEquals(io::Printer* printer) {
 }
 
 void MessageGenerator::GenerateHashCode(io::Printer* printer) {
-  if (descriptor_->field_count() == 0 && !params_.store_unknown_fields()) {
+  if (fields_.empty() && !params_.store_unknown_fields()) {
     return;
   }
 
@@ -651,8 +1796,8 @@ void MessageGenerator::GenerateHashCode(io::Printer* printer) {
 
   printer->Print("int result = 17;\n");
   printer->Print("result = 31 * result + getClass().getName().hashCode();\n");
-  for (int i = 0; i < descriptor_->field_count(); i++) {
-    const FieldDescriptor* field = descriptor_->field(i);
+  for (int i = 0; i < fields_.size(); i++) {
+    const FieldDescriptor* field = fields_[i];
     field_generators_.get(field).GenerateHashCodeCode(printer);
   }
 
@@ -35,7 +35,10 @@
 #ifndef GOOGLE_PROTOBUF_COMPILER_JAVANANO_MESSAGE_H__
 #define GOOGLE_PROTOBUF_COMPILER_JAVANANO_MESSAGE_H__
 
+#include <functional>
+#include <memory>
 #include <string>
+#include <vector>
 #include <google/protobuf/compiler/javanano/javanano_helpers.h>
 #include <google/protobuf/compiler/javanano/javanano_field.h>
 #include <google/protobuf/compiler/javanano/javanano_params.h>
@@ -52,6 +55,11 @@ namespace protobuf {
 namespace compiler {
 namespace javanano {
 
+class EnumGenerator;           // javanano_enum.h
+class ExtensionGenerator;      // javanano_extension.h
+
+// Generators for nested types, extensions and fields are built once in the
+// constructor and reused by every Generate*() pass below.
 class MessageGenerator {
  public:
   explicit MessageGenerator(const Descriptor* descriptor, const Params& params);
@@ -69,9 +77,90 @@ class MessageGenerator {
   // Generate the class itself.
   void Generate(io::Printer* printer);
 
+  // Adds the number of fields handled by each FieldGenerator class, in this
+  // message and the messages nested in it, to counts.
+  void CountFieldGenerators(map<string, int>* counts) const;
+
  private:
+  // A run of fields [begin, end), as indexes into the fields sorted by
+  // number, whose code goes into one method.
+  struct FieldRange {
+    int begin;
+    int end;
+  };
+
+  // Splits the sorted fields into ranges so that the code printed by
+  // generate_field for each range is estimated to fit into
+  // params_.max_method_size() bytes of bytecode.  Returns a single range if
+  // the option is not set or everything fits into one method.
+  vector<FieldRange> SplitFieldsBySize(
+      const vector<const FieldDescriptor*>& sorted_fields,
+      const std::function<void(const FieldDescriptor*, io::Printer*)>&
+          generate_field);
+  // Returns the suffix of the name of the method handling the given range,
+  // e.g. "Fields1To100", or "Field7" for a single field.
+  static string RangeMethodSuffix(
+      const vector<const FieldDescriptor*>& sorted_fields,
+      const FieldRange& range);
+
+  // Whether the message gets a field table and methods delegating to
+  // MessageTableNano (codegen_style=table) instead of unrolled code.
+  bool UsesFieldTable() const;
+  void GenerateFieldTable(io::Printer* printer);
+  // Prints the MessageTableNano.FieldAccessor reading and writing the fields
+  // of the message by slot, their index in fields_.
+  void GenerateFieldTableAccessor(io::Printer* printer);
+
   void GenerateMessageSerializationMethods(io::Printer* printer);
+  // Whether the message gets a writeToReverse() writing its fields to a
+  // ReverseCodedOutputNano (reverse_serializer=true), which needs all of its
+  // fields to support it; others inherit the one of MessageNano. Such
+  // messages also get the maxSerializedSizeUpperBound() that
+  // MessageNano.toByteArrayFast() sizes its output with.
+  bool UsesReverseSerializer() const;
+  void GenerateReverseSerializationMethod(
+      io::Printer* printer, const vector<const FieldDescriptor*>& sorted_fields);
   void GenerateMergeFromMethods(io::Printer* printer);
+  // Whether mergeFrom() switches on dense field indexes rather than on tags,
+  // which javac would compile to a slower lookupswitch.
+  bool UsesDenseFieldDispatch() const;
+  // Prints the parsing loop of mergeFrom(), switching on tags or on dense
+  // field indexes, which returns when the input ends, or breaks out to the
+  // trimming of repeated fields if trims_after_loop.
+  void GenerateSwitchMergeFromBody(
+      io::Printer* printer, const vector<const FieldDescriptor*>& sorted_fields,
+      bool trims_after_loop);
+  void GenerateDenseMergeFromBody(
+      io::Printer* printer, const vector<const FieldDescriptor*>& sorted_fields,
+      bool trims_after_loop);
+  // Print the start of the try block around the parsing loop, and the
+  // finally block trimming the arrays of the given repeated fields to the
+  // lengths in use, followed by the return, if there are any: arrays are
+  // trimmed even when parsing fails. With lengths_on_stack, the lengths are
+  // read from the stack of the input, as the split methods keep them, and
+  // popped.
+  void GenerateMergeTryStart(
+      io::Printer* printer, const vector<const FieldDescriptor*>& grown_fields);
+  void GenerateMergeTrimCode(
+      io::Printer* printer, const vector<const FieldDescriptor*>& grown_fields,
+      bool lengths_on_stack);
+  // Whether the message gets a mergeFrom() parsing a byte array directly
+  // with an ArrayDecoderNano (array_parser=true), which needs all of its
+  // fields to support it; others inherit the one of MessageNano.
+  bool UsesArrayParser() const;
+  void GenerateArrayMergeFromMethod(
+      io::Printer* printer, const vector<const FieldDescriptor*>& sorted_fields,
+      const vector<const FieldDescriptor*>& grown_fields);
+  void GenerateArrayMergeFromCase(io::Printer* printer,
+                                  const FieldDescriptor* field, bool packed);
+  void GenerateMergeFromCases(io::Printer* printer,
+                              const FieldDescriptor* field);
+  // Prints the start of the case parsing the field in packed or unpacked
+  // form, up to and excluding what ends the case.
+  void GenerateMergeFromCase(io::Printer* printer,
+                             const FieldDescriptor* field, bool packed);
+  void GenerateUnknownFieldMergingCode(io::Printer* printer,
+                                       const char* exit);
   void GenerateParseFromMethods(io::Printer* printer);
   void GenerateSerializeOneField(io::Printer* printer,
                                  const FieldDescriptor* field);
@@ -84,7 +173,15 @@ class MessageGenerator {
 
   const Params& params_;
   const Descriptor* descriptor_;
+  // The fields and oneofs code is generated for, in declaration order; with
+  // used_fields_manifest, only those that are used.
+  vector<const FieldDescriptor*> fields_;
+  vector<const OneofDescriptor*> oneofs_;
   FieldGeneratorMap field_generators_;
+  vector<std::unique_ptr<ExtensionGenerator> > extension_generators_;
+  vector<std::unique_ptr<EnumGenerator> > enum_generators_;
+  // Excludes map entries, for which no classes are generated.
+  vector<std::unique_ptr<MessageGenerator> > nested_generators_;
 
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(MessageGenerator);
 };
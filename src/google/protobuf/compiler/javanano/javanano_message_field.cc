@@ -51,22 +51,43 @@ using internal::WireFormatLite;
 
 namespace {
 
+// The bytes a message or group field takes serialized with its tag, but for
+// the contents of the message: a group has its start and end tags, a message
+// its tag and length.
+int MaxTaggedSize(const FieldDescriptor* descriptor) {
+  int size = WireFormat::TagSize(descriptor->number(), descriptor->type());
+  if (descriptor->type() != FieldDescriptor::TYPE_GROUP) {
+    size += kMaxLengthPrefixSize;
+  }
+  return size;
+}
+
 // TODO(kenton):  Factor out a "SetCommonFieldVariables()" to get rid of
 //   repeat code between this and the other field types.
 void SetMessageVariables(const Params& params,
-    const FieldDescriptor* descriptor, map<string, string>* variables) {
-  (*variables)["name"] =
+    const FieldDescriptor* descriptor, TemplateVariables* variables) {
+  (*variables)[JAVANANO_VAR("name")] =
     RenameJavaKeywords(UnderscoresToCamelCase(descriptor));
-  (*variables)["capitalized_name"] =
+  (*variables)[JAVANANO_VAR("capitalized_name")] =
     RenameJavaKeywords(UnderscoresToCapitalizedCamelCase(descriptor));
-  (*variables)["number"] = SimpleItoa(descriptor->number());
-  (*variables)["type"] = ClassName(params, descriptor->message_type());
-  (*variables)["group_or_message"] =
+  (*variables)[JAVANANO_VAR("number")] = SimpleItoa(descriptor->number());
+  (*variables)[JAVANANO_VAR("type")] =
+      ClassName(params, descriptor->message_type());
+  (*variables)[JAVANANO_VAR("group_or_message")] =
     (descriptor->type() == FieldDescriptor::TYPE_GROUP) ?
     "Group" : "Message";
-  (*variables)["message_name"] = descriptor->containing_type()->name();
+  (*variables)[JAVANANO_VAR("message_name")] =
+      descriptor->containing_type()->name();
   //(*variables)["message_type"] = descriptor->message_type()->name();
-  (*variables)["tag"] = SimpleItoa(WireFormat::MakeTag(descriptor));
+  (*variables)[JAVANANO_VAR("tag")] =
+      SimpleItoa(WireFormat::MakeTag(descriptor));
+  (*variables)[JAVANANO_VAR("write_tag")] =
+      WriteTagCall(WireFormat::MakeTag(descriptor));
+  (*variables)[JAVANANO_VAR("write_end_tag")] =
+      WriteTagCall(WireFormatLite::MakeTag(
+      descriptor->number(), WireFormatLite::WIRETYPE_END_GROUP));
+  (*variables)[JAVANANO_VAR("max_tagged_size")] =
+      SimpleItoa(MaxTaggedSize(descriptor));
 }
 
 }  // namespace
@@ -83,43 +104,91 @@ MessageFieldGenerator::~MessageFieldGenerator() {}
 
 void MessageFieldGenerator::
 GenerateMembers(io::Printer* printer, bool /* unused lazy_init */) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "public $type$ $name$;\n");
 }
 
 void MessageFieldGenerator::
 GenerateClearCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "$name$ = null;\n");
 }
 
 void MessageFieldGenerator::
 GenerateMergingCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if (this.$name$ == null) {\n"
     "  this.$name$ = new $type$();\n"
     "}\n");
 
   if (descriptor_->type() == FieldDescriptor::TYPE_GROUP) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "input.readGroup(this.$name$, $number$);\n");
   } else {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "input.readMessage(this.$name$);\n");
   }
 }
 
+void MessageFieldGenerator::
+GenerateArrayMergingCode(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
+    "if (this.$name$ == null) {\n"
+    "  this.$name$ = new $type$();\n"
+    "}\n");
+
+  if (descriptor_->type() == FieldDescriptor::TYPE_GROUP) {
+    JAVANANO_PRINT(printer, variables_,
+      "position = decoder.readGroup(\n"
+      "    this.$name$, buffer, position, limit, $number$);\n");
+  } else {
+    JAVANANO_PRINT(printer, variables_,
+      "position = decoder.readMessage(this.$name$, buffer, position, limit);\n");
+  }
+}
+
 void MessageFieldGenerator::
 GenerateSerializationCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
+    "if (this.$name$ != null) {\n"
+    "  output.$write_tag$;\n"
+    "  output.write$group_or_message$NoTag(this.$name$);\n");
+  if (descriptor_->type() == FieldDescriptor::TYPE_GROUP) {
+    JAVANANO_PRINT(printer, variables_,
+      "  output.$write_end_tag$;\n");
+  }
+  printer->Print("}\n");
+}
+
+void MessageFieldGenerator::
+GenerateReverseSerializationCode(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
+    "if (this.$name$ != null) {\n");
+  if (descriptor_->type() == FieldDescriptor::TYPE_GROUP) {
+    JAVANANO_PRINT(printer, variables_,
+      "  output.$write_end_tag$;\n");
+  }
+  JAVANANO_PRINT(printer, variables_,
+    "  output.write$group_or_message$NoTag(this.$name$);\n"
+    "  output.$write_tag$;\n"
+    "}\n");
+}
+
+int MessageFieldGenerator::SerializedSizeUpperBoundConstant() const {
+  return MaxTaggedSize(descriptor_);
+}
+
+void MessageFieldGenerator::
+GenerateSerializedSizeUpperBoundCode(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
     "if (this.$name$ != null) {\n"
-    "  output.write$group_or_message$($number$, this.$name$);\n"
+    "  size += this.$name$.maxSerializedSizeUpperBound();\n"
     "}\n");
 }
 
 void MessageFieldGenerator::
 GenerateSerializedSizeCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if (this.$name$ != null) {\n"
     "  size += com.google.protobuf.nano.CodedOutputByteBufferNano\n"
     "    .compute$group_or_message$Size($number$, this.$name$);\n"
@@ -128,7 +197,7 @@ GenerateSerializedSizeCode(io::Printer* printer) const {
 
 void MessageFieldGenerator::
 GenerateFixClonedCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if (this.$name$ != null) {\n"
     "  cloned.$name$ = this.$name$.clone();\n"
     "}\n");
@@ -136,7 +205,7 @@ GenerateFixClonedCode(io::Printer* printer) const {
 
 void MessageFieldGenerator::
 GenerateEqualsCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if (this.$name$ == null) { \n"
     "  if (other.$name$ != null) {\n"
     "    return false;\n"
@@ -150,10 +219,162 @@ GenerateEqualsCode(io::Printer* printer) const {
 
 void MessageFieldGenerator::
 GenerateHashCodeCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "result = 31 * result +\n"
     "    (this.$name$ == null ? 0 : this.$name$.hashCode());\n");
 }
+
+// ===================================================================
+
+LazyMessageFieldGenerator::
+LazyMessageFieldGenerator(const FieldDescriptor* descriptor,
+                          const Params& params)
+  : FieldGenerator(params), descriptor_(descriptor) {
+  SetMessageVariables(params, descriptor, &variables_);
+  variables_[JAVANANO_VAR("tag_size")] = SimpleItoa(
+      WireFormat::TagSize(descriptor->number(), descriptor->type()));
+}
+
+LazyMessageFieldGenerator::~LazyMessageFieldGenerator() {}
+
+void LazyMessageFieldGenerator::
+GenerateMembers(io::Printer* printer, bool /* unused lazy_init */) const {
+  // The getter may be called from several threads: the first to see the
+  // message unparsed parses it under the lock of the message, then later
+  // ones only read the volatile field. The slice is kept after parsing, so
+  // that a reader seeing it can rely on the message being there, and so
+  // that serializing while another thread parses still writes one form.
+  JAVANANO_PRINT(printer, variables_,
+    "private byte[] $name$Buffer_;\n"
+    "private int $name$Offset_;\n"
+    "private int $name$Length_;\n"
+    "private boolean $name$SizedAsBytes_;\n"
+    "private volatile $type$ $name$_;\n"
+    "public $type$ get$capitalized_name$() {\n"
+    "  $type$ value = $name$_;\n"
+    "  if (value == null && $name$Buffer_ != null) {\n"
+    "    value = parse$capitalized_name$Lazily();\n"
+    "  }\n"
+    "  return value;\n"
+    "}\n"
+    "private synchronized $type$ parse$capitalized_name$Lazily() {\n"
+    "  if ($name$_ == null) {\n"
+    "    try {\n"
+    "      $name$_ = com.google.protobuf.nano.MessageNano.mergeFrom(\n"
+    "          new $type$(),\n"
+    "          $name$Buffer_, $name$Offset_, $name$Length_);\n"
+    "    } catch (com.google.protobuf.nano.InvalidProtocolBufferNanoException e) {\n"
+    "      throw new java.lang.IllegalStateException(\n"
+    "          \"Lazily parsing $name$ failed\", e);\n"
+    "    }\n"
+    "  }\n"
+    "  return $name$_;\n"
+    "}\n"
+    "public $message_name$ set$capitalized_name$($type$ value) {\n"
+    "  if (value == null) {\n"
+    "    throw new java.lang.NullPointerException();\n"
+    "  }\n"
+    "  $name$_ = value;\n"
+    "  $name$Buffer_ = null;\n"
+    "  return this;\n"
+    "}\n"
+    "public boolean has$capitalized_name$() {\n"
+    "  return $name$_ != null || $name$Buffer_ != null;\n"
+    "}\n"
+    "public $message_name$ clear$capitalized_name$() {\n"
+    "  $name$_ = null;\n"
+    "  $name$Buffer_ = null;\n"
+    "  return this;\n"
+    "}\n");
+}
+
+void LazyMessageFieldGenerator::
+GenerateClearCode(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
+    "$name$_ = null;\n"
+    "$name$Buffer_ = null;\n");
+}
+
+void LazyMessageFieldGenerator::
+GenerateMergingCode(io::Printer* printer) const {
+  // Repeated occurrences of the field are merged, which needs the message.
+  JAVANANO_PRINT(printer, variables_,
+    "if (this.$name$_ != null || this.$name$Buffer_ != null) {\n"
+    "  input.readMessage(get$capitalized_name$());\n"
+    "  this.$name$Buffer_ = null;\n"
+    "} else {\n"
+    "  int length = input.readRawVarint32();\n"
+    "  int offset = input.getBufferPosition();\n"
+    "  input.skipRawBytes(length);\n"
+    "  this.$name$Buffer_ = input.getBuffer();\n"
+    "  this.$name$Offset_ = offset;\n"
+    "  this.$name$Length_ = length;\n"
+    "}\n");
+}
+
+void LazyMessageFieldGenerator::
+GenerateSerializationCode(io::Printer* printer) const {
+  // Writes the form the last computeSerializedSize() counted, if it was
+  // called, however many times the message is written after it. Only
+  // computeSerializedSize() sets the flag.
+  JAVANANO_PRINT(printer, variables_,
+    "if (this.$name$Buffer_ != null\n"
+    "    && (this.$name$SizedAsBytes_ || this.$name$_ == null)) {\n"
+    "  output.$write_tag$;\n"
+    "  output.writeRawVarint32(this.$name$Length_);\n"
+    "  output.writeRawBytes(this.$name$Buffer_,\n"
+    "      this.$name$Offset_, this.$name$Length_);\n"
+    "} else if (this.$name$_ != null) {\n"
+    "  output.$write_tag$;\n"
+    "  output.writeMessageNoTag(this.$name$_);\n"
+    "}\n");
+}
+
+void LazyMessageFieldGenerator::
+GenerateSerializedSizeCode(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
+    "if (this.$name$_ != null) {\n"
+    "  this.$name$SizedAsBytes_ = false;\n"
+    "  size += com.google.protobuf.nano.CodedOutputByteBufferNano\n"
+    "    .computeMessageSize($number$, this.$name$_);\n"
+    "} else if (this.$name$Buffer_ != null) {\n"
+    "  this.$name$SizedAsBytes_ = true;\n"
+    "  size += $tag_size$\n"
+    "      + com.google.protobuf.nano.CodedOutputByteBufferNano\n"
+    "          .computeRawVarint32Size(this.$name$Length_)\n"
+    "      + this.$name$Length_;\n"
+    "}\n");
+}
+
+void LazyMessageFieldGenerator::
+GenerateFixClonedCode(io::Printer* printer) const {
+  // The slice is never written to, so the clone can share it.
+  JAVANANO_PRINT(printer, variables_,
+    "if (this.$name$_ != null) {\n"
+    "  cloned.$name$_ = this.$name$_.clone();\n"
+    "}\n");
+}
+
+void LazyMessageFieldGenerator::
+GenerateEqualsCode(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
+    "if (this.get$capitalized_name$() == null) {\n"
+    "  if (other.get$capitalized_name$() != null) {\n"
+    "    return false;\n"
+    "  }\n"
+    "} else {\n"
+    "  if (!this.get$capitalized_name$().equals(other.get$capitalized_name$())) {\n"
+    "    return false;\n"
+    "  }\n"
+    "}\n");
+}
+
+void LazyMessageFieldGenerator::
+GenerateHashCodeCode(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
+    "result = 31 * result + (this.get$capitalized_name$() == null\n"
+    "    ? 0 : this.get$capitalized_name$().hashCode());\n");
+}
 // ===================================================================
 
 MessageOneofFieldGenerator::MessageOneofFieldGenerator(
@@ -161,13 +382,17 @@ MessageOneofFieldGenerator::MessageOneofFieldGenerator(
     : FieldGenerator(params), descriptor_(descriptor) {
     SetMessageVariables(params, descriptor, &variables_);
     SetCommonOneofVariables(descriptor, &variables_);
+    // Oneof groups are written as messages.
+    variables_[JAVANANO_VAR("write_tag")] =
+        WriteTagCall(WireFormatLite::MakeTag(
+        descriptor->number(), WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
 }
 
 MessageOneofFieldGenerator::~MessageOneofFieldGenerator() {}
 
 void MessageOneofFieldGenerator::
 GenerateMembers(io::Printer* printer, bool /* unused lazy_init */) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "public boolean has$capitalized_name$() {\n"
     "  return $has_oneof_case$;\n"
     "}\n"
@@ -192,7 +417,7 @@ GenerateClearCode(io::Printer* printer) const {
 
 void MessageOneofFieldGenerator::
 GenerateMergingCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if (!($has_oneof_case$)) {\n"
     "  this.$oneof_name$_ = new $type$();\n"
     "}\n"
@@ -201,18 +426,54 @@ GenerateMergingCode(io::Printer* printer) const {
     "$set_oneof_case$;\n");
 }
 
+void MessageOneofFieldGenerator::
+GenerateArrayMergingCode(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
+    "if (!($has_oneof_case$)) {\n"
+    "  this.$oneof_name$_ = new $type$();\n"
+    "}\n"
+    "position = decoder.readMessage(\n"
+    "    (com.google.protobuf.nano.MessageNano) this.$oneof_name$_,\n"
+    "    buffer, position, limit);\n"
+    "$set_oneof_case$;\n");
+}
+
 void MessageOneofFieldGenerator::
 GenerateSerializationCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if ($has_oneof_case$) {\n"
-    "  output.writeMessage($number$,\n"
+    "  output.$write_tag$;\n"
+    "  output.writeMessageNoTag(\n"
     "      (com.google.protobuf.nano.MessageNano) this.$oneof_name$_);\n"
     "}\n");
 }
 
+void MessageOneofFieldGenerator::
+GenerateReverseSerializationCode(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
+    "if ($has_oneof_case$) {\n"
+    "  output.writeMessageNoTag(\n"
+    "      (com.google.protobuf.nano.MessageNano) this.$oneof_name$_);\n"
+    "  output.$write_tag$;\n"
+    "}\n");
+}
+
+int MessageOneofFieldGenerator::SerializedSizeUpperBoundConstant() const {
+  return MaxTaggedSize(descriptor_);
+}
+
+void MessageOneofFieldGenerator::
+GenerateSerializedSizeUpperBoundCode(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
+    "if ($has_oneof_case$) {\n"
+    "  size += ((com.google.protobuf.nano.MessageNano) this.$oneof_name$_)\n"
+    "      .maxSerializedSizeUpperBound();\n"
+    "}\n");
+}
+
 void MessageOneofFieldGenerator::
 GenerateSerializedSizeCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if ($has_oneof_case$) {\n"
     "  size += com.google.protobuf.nano.CodedOutputByteBufferNano\n"
     "    .computeMessageSize($number$,\n"
@@ -222,7 +483,7 @@ GenerateSerializedSizeCode(io::Printer* printer) const {
 
 void MessageOneofFieldGenerator::
 GenerateFixClonedCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if (this.$oneof_name$ != null) {\n"
     "  cloned.$oneof_name$ = this.$oneof_name$.clone();\n"
     "}\n");
@@ -244,71 +505,177 @@ RepeatedMessageFieldGenerator::RepeatedMessageFieldGenerator(
     const FieldDescriptor* descriptor, const Params& params)
     : FieldGenerator(params), descriptor_(descriptor) {
   SetMessageVariables(params, descriptor, &variables_);
+  SetRepeatedFieldGrowthVariables(
+      descriptor, variables_[JAVANANO_VAR("type")], &variables_);
 }
 
 RepeatedMessageFieldGenerator::~RepeatedMessageFieldGenerator() {}
 
 void RepeatedMessageFieldGenerator::
 GenerateMembers(io::Printer* printer, bool /* unused lazy_init */) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "public $type$[] $name$;\n");
 }
 
 void RepeatedMessageFieldGenerator::
 GenerateClearCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "$name$ = $type$.emptyArray();\n");
 }
 
 void RepeatedMessageFieldGenerator::
 GenerateMergingCode(io::Printer* printer) const {
+  if (params_.single_pass_repeated_fields()) {
+    GenerateSinglePassMergingCode(printer);
+    return;
+  }
+
   // First, figure out the length of the array, then parse.
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "int arrayLength = com.google.protobuf.nano.WireFormatNano\n"
-    "    .getRepeatedFieldArrayLength(input, $tag$);\n"
-    "int i = this.$name$ == null ? 0 : this.$name$.length;\n"
-    "$type$[] newArray =\n"
-    "    new $type$[i + arrayLength];\n"
-    "if (i != 0) {\n"
-    "  java.lang.System.arraycopy(this.$name$, 0, newArray, 0, i);\n"
-    "}\n"
-    "for (; i < newArray.length - 1; i++) {\n"
+    "    .getRepeatedFieldArrayLength(input, $tag$);\n");
+  GenerateRepeatedFieldGrowCode(variables_, printer);
+  JAVANANO_PRINT(printer, variables_,
+    "int end = i + arrayLength;\n"
+    "for (; i < end - 1; i++) {\n"
     "  newArray[i] = new $type$();\n");
 
   if (descriptor_->type() == FieldDescriptor::TYPE_GROUP) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "  input.readGroup(newArray[i], $number$);\n");
   } else {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "  input.readMessage(newArray[i]);\n");
   }
 
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "  input.readTag();\n"
     "}\n"
     "// Last one without readTag.\n"
     "newArray[i] = new $type$();\n");
 
   if (descriptor_->type() == FieldDescriptor::TYPE_GROUP) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "input.readGroup(newArray[i], $number$);\n");
   } else {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "input.readMessage(newArray[i]);\n");
   }
 
-  printer->Print(variables_,
-    "this.$name$ = newArray;\n");
+  JAVANANO_PRINT(printer, variables_,
+    "this.$name$ = newArray;\n"
+    "$merge_length$ = end;\n");
+}
+
+void RepeatedMessageFieldGenerator::
+GenerateArrayMergingCode(io::Printer* printer) const {
+  // Messages are appended one at a time; the growth of the array amortizes
+  // the copies.
+  JAVANANO_PRINT(printer, variables_,
+    "$type$ value = new $type$();\n");
+  if (descriptor_->type() == FieldDescriptor::TYPE_GROUP) {
+    JAVANANO_PRINT(printer, variables_,
+      "position = decoder.readGroup(value, buffer, position, limit, $number$);\n");
+  } else {
+    JAVANANO_PRINT(printer, variables_,
+      "position = decoder.readMessage(value, buffer, position, limit);\n");
+  }
+  printer->Print(
+    "int arrayLength = 1;\n");
+  GenerateRepeatedFieldGrowCode(variables_, printer);
+  JAVANANO_PRINT(printer, variables_,
+    "newArray[i] = value;\n"
+    "this.$name$ = newArray;\n"
+    "$merge_length$ = i + 1;\n");
+}
+
+void RepeatedMessageFieldGenerator::
+GenerateSinglePassMergingCode(io::Printer* printer) const {
+  // Parse the messages into a scratch array of the input as long as their
+  // tag follows, then copy them to the field.
+  JAVANANO_PRINT(printer, variables_,
+    "java.lang.Object[] values = input.takeObjectScratch();\n"
+    "int arrayLength = 0;\n"
+    "do {\n"
+    "  if (arrayLength == values.length) {\n"
+    "    values = java.util.Arrays.copyOf(values, arrayLength * 2);\n"
+    "  }\n"
+    "  $type$ value = new $type$();\n");
+
+  if (descriptor_->type() == FieldDescriptor::TYPE_GROUP) {
+    JAVANANO_PRINT(printer, variables_,
+      "  input.readGroup(value, $number$);\n");
+  } else {
+    JAVANANO_PRINT(printer, variables_,
+      "  input.readMessage(value);\n");
+  }
+
+  JAVANANO_PRINT(printer, variables_,
+    "  values[arrayLength++] = value;\n"
+    "} while (input.readTagIfEquals($tag$));\n");
+  GenerateRepeatedFieldGrowCode(variables_, printer);
+  JAVANANO_PRINT(printer, variables_,
+    "java.lang.System.arraycopy(values, 0, newArray, i, arrayLength);\n"
+    "this.$name$ = newArray;\n"
+    "$merge_length$ = i + arrayLength;\n"
+    "input.releaseObjectScratch(values, arrayLength);\n");
+}
+
+string RepeatedMessageFieldGenerator::MergeLengthVariable() const {
+  return RepeatedFieldMergeLengthName(descriptor_);
+}
+
+void RepeatedMessageFieldGenerator::
+GenerateMergeTrimCode(io::Printer* printer) const {
+  GenerateRepeatedFieldTrimCode(variables_, printer);
 }
 
 void RepeatedMessageFieldGenerator::
 GenerateSerializationCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if (this.$name$ != null && this.$name$.length > 0) {\n"
     "  for (int i = 0; i < this.$name$.length; i++) {\n"
     "    $type$ element = this.$name$[i];\n"
     "    if (element != null) {\n"
-    "      output.write$group_or_message$($number$, element);\n"
+    "      output.$write_tag$;\n"
+    "      output.write$group_or_message$NoTag(element);\n");
+  if (descriptor_->type() == FieldDescriptor::TYPE_GROUP) {
+    JAVANANO_PRINT(printer, variables_,
+      "      output.$write_end_tag$;\n");
+  }
+  JAVANANO_PRINT(printer, variables_,
+    "    }\n"
+    "  }\n"
+    "}\n");
+}
+
+void RepeatedMessageFieldGenerator::
+GenerateReverseSerializationCode(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
+    "if (this.$name$ != null && this.$name$.length > 0) {\n"
+    "  for (int i = this.$name$.length - 1; i >= 0; i--) {\n"
+    "    $type$ element = this.$name$[i];\n"
+    "    if (element != null) {\n");
+  if (descriptor_->type() == FieldDescriptor::TYPE_GROUP) {
+    JAVANANO_PRINT(printer, variables_,
+      "      output.$write_end_tag$;\n");
+  }
+  JAVANANO_PRINT(printer, variables_,
+    "      output.write$group_or_message$NoTag(element);\n"
+    "      output.$write_tag$;\n"
+    "    }\n"
+    "  }\n"
+    "}\n");
+}
+
+void RepeatedMessageFieldGenerator::
+GenerateSerializedSizeUpperBoundCode(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
+    "if (this.$name$ != null) {\n"
+    "  for (int i = 0; i < this.$name$.length; i++) {\n"
+    "    $type$ element = this.$name$[i];\n"
+    "    if (element != null) {\n"
+    "      size += $max_tagged_size$ + element.maxSerializedSizeUpperBound();\n"
     "    }\n"
     "  }\n"
     "}\n");
@@ -316,7 +683,7 @@ GenerateSerializationCode(io::Printer* printer) const {
 
 void RepeatedMessageFieldGenerator::
 GenerateSerializedSizeCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if (this.$name$ != null && this.$name$.length > 0) {\n"
     "  for (int i = 0; i < this.$name$.length; i++) {\n"
     "    $type$ element = this.$name$[i];\n"
@@ -330,7 +697,7 @@ GenerateSerializedSizeCode(io::Printer* printer) const {
 
 void RepeatedMessageFieldGenerator::
 GenerateFixClonedCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if (this.$name$ != null && this.$name$.length > 0) {\n"
     "  cloned.$name$ = new $type$[this.$name$.length];\n"
     "  for (int i = 0; i < this.$name$.length; i++) {\n"
@@ -343,7 +710,7 @@ GenerateFixClonedCode(io::Printer* printer) const {
 
 void RepeatedMessageFieldGenerator::
 GenerateEqualsCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if (!com.google.protobuf.nano.InternalNano.equals(\n"
     "    this.$name$, other.$name$)) {\n"
     "  return false;\n"
@@ -352,7 +719,7 @@ GenerateEqualsCode(io::Printer* printer) const {
 
 void RepeatedMessageFieldGenerator::
 GenerateHashCodeCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "result = 31 * result\n"
     "    + com.google.protobuf.nano.InternalNano.hashCode(this.$name$);\n");
 }
@@ -51,6 +51,7 @@ class MessageFieldGenerator : public FieldGenerator {
   ~MessageFieldGenerator();
 
   // implements FieldGenerator ---------------------------------------
+  const char* ClassName() const { return "MessageFieldGenerator"; }
   void GenerateMembers(io::Printer* printer, bool lazy_init) const;
   void GenerateClearCode(io::Printer* printer) const;
   void GenerateMergingCode(io::Printer* printer) const;
@@ -59,14 +60,48 @@ class MessageFieldGenerator : public FieldGenerator {
   void GenerateEqualsCode(io::Printer* printer) const;
   void GenerateHashCodeCode(io::Printer* printer) const;
   void GenerateFixClonedCode(io::Printer* printer) const;
+  bool SupportsArrayParsing() const { return true; }
+  void GenerateArrayMergingCode(io::Printer* printer) const;
+  bool SupportsReverseSerialization() const { return true; }
+  void GenerateReverseSerializationCode(io::Printer* printer) const;
+  int SerializedSizeUpperBoundConstant() const;
+  void GenerateSerializedSizeUpperBoundCode(io::Printer* printer) const;
 
  private:
   const FieldDescriptor* descriptor_;
-  map<string, string> variables_;
+  TemplateVariables variables_;
 
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(MessageFieldGenerator);
 };
 
+// A message field under the lazy_message_fields option: private, with
+// accessors, keeping the slice of the parsed array holding its serialized
+// form until the getter first parses it, and writing the slice back as it
+// is while the field has not been parsed.
+class LazyMessageFieldGenerator : public FieldGenerator {
+ public:
+  explicit LazyMessageFieldGenerator(
+      const FieldDescriptor* descriptor, const Params& params);
+  ~LazyMessageFieldGenerator();
+
+  // implements FieldGenerator ---------------------------------------
+  const char* ClassName() const { return "LazyMessageFieldGenerator"; }
+  void GenerateMembers(io::Printer* printer, bool lazy_init) const;
+  void GenerateClearCode(io::Printer* printer) const;
+  void GenerateMergingCode(io::Printer* printer) const;
+  void GenerateSerializationCode(io::Printer* printer) const;
+  void GenerateSerializedSizeCode(io::Printer* printer) const;
+  void GenerateEqualsCode(io::Printer* printer) const;
+  void GenerateHashCodeCode(io::Printer* printer) const;
+  void GenerateFixClonedCode(io::Printer* printer) const;
+
+ private:
+  const FieldDescriptor* descriptor_;
+  TemplateVariables variables_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(LazyMessageFieldGenerator);
+};
+
 class MessageOneofFieldGenerator : public FieldGenerator {
  public:
   explicit MessageOneofFieldGenerator(const FieldDescriptor* descriptor,
@@ -74,6 +109,7 @@ class MessageOneofFieldGenerator : public FieldGenerator {
   ~MessageOneofFieldGenerator();
 
   // implements FieldGenerator ---------------------------------------
+  const char* ClassName() const { return "MessageOneofFieldGenerator"; }
   void GenerateMembers(io::Printer* printer, bool lazy_init) const;
   void GenerateClearCode(io::Printer* printer) const;
   void GenerateMergingCode(io::Printer* printer) const;
@@ -82,10 +118,16 @@ class MessageOneofFieldGenerator : public FieldGenerator {
   void GenerateEqualsCode(io::Printer* printer) const;
   void GenerateHashCodeCode(io::Printer* printer) const;
   void GenerateFixClonedCode(io::Printer* printer) const;
+  bool SupportsArrayParsing() const { return true; }
+  void GenerateArrayMergingCode(io::Printer* printer) const;
+  bool SupportsReverseSerialization() const { return true; }
+  void GenerateReverseSerializationCode(io::Printer* printer) const;
+  int SerializedSizeUpperBoundConstant() const;
+  void GenerateSerializedSizeUpperBoundCode(io::Printer* printer) const;
 
  private:
   const FieldDescriptor* descriptor_;
-  map<string, string> variables_;
+  TemplateVariables variables_;
 
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(MessageOneofFieldGenerator);
 };
@@ -97,6 +139,7 @@ class RepeatedMessageFieldGenerator : public FieldGenerator {
   ~RepeatedMessageFieldGenerator();
 
   // implements FieldGenerator ---------------------------------------
+  const char* ClassName() const { return "RepeatedMessageFieldGenerator"; }
   void GenerateMembers(io::Printer* printer, bool lazy_init) const;
   void GenerateClearCode(io::Printer* printer) const;
   void GenerateMergingCode(io::Printer* printer) const;
@@ -105,10 +148,19 @@ class RepeatedMessageFieldGenerator : public FieldGenerator {
   void GenerateEqualsCode(io::Printer* printer) const;
   void GenerateHashCodeCode(io::Printer* printer) const;
   void GenerateFixClonedCode(io::Printer* printer) const;
+  string MergeLengthVariable() const;
+  void GenerateMergeTrimCode(io::Printer* printer) const;
+  bool SupportsArrayParsing() const { return true; }
+  void GenerateArrayMergingCode(io::Printer* printer) const;
+  bool SupportsReverseSerialization() const { return true; }
+  void GenerateReverseSerializationCode(io::Printer* printer) const;
+  void GenerateSerializedSizeUpperBoundCode(io::Printer* printer) const;
 
  private:
+  void GenerateSinglePassMergingCode(io::Printer* printer) const;
+
   const FieldDescriptor* descriptor_;
-  map<string, string> variables_;
+  TemplateVariables variables_;
 
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(RepeatedMessageFieldGenerator);
 };
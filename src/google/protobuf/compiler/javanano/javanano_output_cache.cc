@@ -0,0 +1,215 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// http://code.google.com/p/protobuf/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+
+#include <google/protobuf/compiler/javanano/javanano_output_cache.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/stubs/strutil.h>
+
+namespace google {
+namespace protobuf {
+namespace compiler {
+namespace javanano {
+
+namespace {
+
+// Bump this whenever the format of the entries changes.
+const char kCacheFormat[] = "javanano-output-cache-2";
+
+// Identifies the generator in the cache keys, so that caches written by
+// another generator are ignored: the protobuf release, and for builds from
+// unreleased sources whatever the build defines JAVANANO_BUILD_ID to, such
+// as the commit hash.
+#ifndef JAVANANO_BUILD_ID
+#define JAVANANO_BUILD_ID ""
+#endif
+
+// A 128-bit fingerprint made of two independent 64-bit multiplicative hashes.
+// It is not cryptographic, but accidental collisions between the inputs of
+// one output file are vanishingly unlikely.  Every piece of input is prefixed
+// with its length so that different splits of the same bytes don't collide.
+class Fingerprint {
+ public:
+  Fingerprint() : a_(0xcbf29ce484222325ULL), b_(0x9e3779b97f4a7c15ULL) {}
+
+  void Add(const string& data) {
+    uint64 size = data.size();
+    for (int i = 0; i < 8; i++) {
+      AddByte(static_cast<uint8>(size >> (8 * i)));
+    }
+    for (int i = 0; i < data.size(); i++) {
+      AddByte(static_cast<uint8>(data[i]));
+    }
+  }
+
+  string ToString() const {
+    char buffer[33];
+    snprintf(buffer, sizeof(buffer), "%016llx%016llx",
+             static_cast<unsigned long long>(a_),
+             static_cast<unsigned long long>(b_));
+    return buffer;
+  }
+
+ private:
+  void AddByte(uint8 byte) {
+    a_ = (a_ ^ byte) * 0x100000001b3ULL;
+    b_ = (b_ ^ byte) * 0xff51afd7ed558ccdULL;
+    b_ ^= b_ >> 32;
+  }
+
+  uint64 a_;
+  uint64 b_;
+};
+
+string ContentsDigest(const string& contents) {
+  Fingerprint fingerprint;
+  fingerprint.Add(contents);
+  return fingerprint.ToString();
+}
+
+void CollectDependencies(const FileDescriptor* file,
+                         map<string, const FileDescriptor*>* files) {
+  if (!files->insert(std::make_pair(file->name(), file)).second) {
+    return;
+  }
+  for (int i = 0; i < file->dependency_count(); i++) {
+    CollectDependencies(file->dependency(i), files);
+  }
+}
+
+}  // namespace
+
+OutputCache::OutputCache(const string& directory,
+                         const string& output_directory,
+                         const string& generator_options)
+  : directory_(directory),
+    output_directory_(output_directory),
+    generator_options_(generator_options) {
+  if (!directory_.empty() && directory_[directory_.size() - 1] != '/') {
+    directory_ += "/";
+  }
+  if (!output_directory_.empty()
+      && output_directory_[output_directory_.size() - 1] != '/') {
+    output_directory_ += "/";
+  }
+}
+
+OutputCache::~OutputCache() {}
+
+const string& OutputCache::FileDigest(const FileDescriptor* file) {
+  string& digest = file_digests_[file];
+  if (digest.empty()) {
+    FileDescriptorProto file_proto;
+    file->CopyTo(&file_proto);
+    string serialized;
+    file_proto.SerializeToString(&serialized);
+
+    Fingerprint fingerprint;
+    fingerprint.Add(serialized);
+    digest = fingerprint.ToString();
+  }
+  return digest;
+}
+
+string OutputCache::ComputeKey(const FileDescriptor* file) {
+  // Sorted by name, so the key doesn't depend on the import order.
+  map<string, const FileDescriptor*> files;
+  CollectDependencies(file, &files);
+
+  Fingerprint fingerprint;
+  fingerprint.Add(kCacheFormat);
+  fingerprint.Add(SimpleItoa(GOOGLE_PROTOBUF_VERSION));
+  fingerprint.Add(JAVANANO_BUILD_ID);
+  fingerprint.Add(generator_options_);
+  fingerprint.Add(file->name());
+  for (map<string, const FileDescriptor*>::const_iterator it = files.begin();
+       it != files.end(); ++it) {
+    fingerprint.Add(it->first);
+    fingerprint.Add(FileDigest(it->second));
+  }
+  return fingerprint.ToString();
+}
+
+string OutputCache::EntryPath(const string& filename) const {
+  Fingerprint fingerprint;
+  fingerprint.Add(filename);
+  return directory_ + fingerprint.ToString();
+}
+
+bool OutputCache::IsUpToDate(const string& filename,
+                             const string& key) const {
+  std::ifstream entry(EntryPath(filename).c_str());
+  if (!entry) {
+    return false;
+  }
+  string cached_filename;
+  string cached_key;
+  string cached_contents;
+  std::getline(entry, cached_filename);
+  std::getline(entry, cached_key);
+  std::getline(entry, cached_contents);
+  if (cached_filename != filename || cached_key != key) {
+    return false;
+  }
+
+  // The file must still be in the output directory as it was generated:
+  // it may have been deleted or overwritten since, or never written at all
+  // if protoc failed after the entry was recorded.
+  std::ifstream output((output_directory_ + filename).c_str(),
+                       std::ios::in | std::ios::binary);
+  if (!output) {
+    return false;
+  }
+  std::ostringstream contents;
+  contents << output.rdbuf();
+  return ContentsDigest(contents.str()) == cached_contents;
+}
+
+bool OutputCache::Update(const string& filename, const string& key,
+                         const string& contents, string* error) {
+  string path = EntryPath(filename);
+  std::ofstream entry(path.c_str(), std::ios::out | std::ios::trunc);
+  entry << filename << "\n" << key << "\n" << ContentsDigest(contents) << "\n";
+  entry.close();
+  if (!entry) {
+    *error = "Unable to write incremental cache entry '" + path + "'";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace javanano
+}  // namespace compiler
+}  // namespace protobuf
+}  // namespace google
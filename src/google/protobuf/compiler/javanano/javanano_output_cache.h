@@ -0,0 +1,102 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// http://code.google.com/p/protobuf/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Content-addressed cache of generated output files, used by the
+// incremental_cache_dir generator option.
+
+#ifndef GOOGLE_PROTOBUF_COMPILER_JAVANANO_OUTPUT_CACHE_H__
+#define GOOGLE_PROTOBUF_COMPILER_JAVANANO_OUTPUT_CACHE_H__
+
+#include <map>
+#include <string>
+#include <google/protobuf/stubs/common.h>
+#include <google/protobuf/compiler/javanano/javanano_params.h>
+
+namespace google {
+namespace protobuf {
+  class FileDescriptor;        // descriptor.h
+}
+
+namespace protobuf {
+namespace compiler {
+namespace javanano {
+
+// Remembers, for every generated .java file, a fingerprint of everything the
+// file was generated from: the generator options and the FileDescriptorProtos
+// of the .proto file and all of its transitive dependencies.  When the
+// fingerprint is unchanged the file does not need to be rendered or written
+// again, so its timestamp and downstream build products stay untouched.
+//
+// Entries are stored as one small file per output file in the cache
+// directory, with a digest of the file's contents, which must still be found
+// in the output directory for the entry to count.  Each output directory
+// needs its own cache directory.
+class OutputCache {
+ public:
+  // output_directory is the directory protoc writes the generated files to.
+  // generator_options should contain all options which affect the generated
+  // code, in a canonical form.
+  OutputCache(const string& directory, const string& output_directory,
+              const string& generator_options);
+  ~OutputCache();
+
+  // Returns the key of the outputs generated from file.  The digests of the
+  // individual files are memoized, so the transitive walk is cheap for files
+  // sharing most of their dependencies.
+  string ComputeKey(const FileDescriptor* file);
+
+  // Returns true if filename was last generated with the given key and is
+  // still in the output directory as it was generated.
+  bool IsUpToDate(const string& filename, const string& key) const;
+
+  // Records that filename has been generated with the given key and
+  // contents.  Call it only once the file has been written out.  Returns
+  // false and fills in error if the entry could not be written.
+  bool Update(const string& filename, const string& key,
+              const string& contents, string* error);
+
+ private:
+  const string& FileDigest(const FileDescriptor* file);
+  string EntryPath(const string& filename) const;
+
+  string directory_;
+  string output_directory_;
+  string generator_options_;
+  map<const FileDescriptor*, string> file_digests_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(OutputCache);
+};
+
+}  // namespace javanano
+}  // namespace compiler
+}  // namespace protobuf
+
+}  // namespace google
+#endif  // GOOGLE_PROTOBUF_COMPILER_JAVANANO_OUTPUT_CACHE_H__
@@ -34,6 +34,7 @@
 #define PROTOBUF_COMPILER_JAVANANO_JAVANANO_PARAMS_H_
 
 #include <map>
+#include <memory>
 #include <set>
 #include <google/protobuf/stubs/strutil.h>
 
@@ -48,6 +49,60 @@ using std::vector;
 using std::set;
 
 enum eMultipleFiles { JAVANANO_MUL_UNSET, JAVANANO_MUL_FALSE, JAVANANO_MUL_TRUE };
+enum eLazyMessageFields {
+  JAVANANO_LAZY_NONE, JAVANANO_LAZY_MARKED, JAVANANO_LAZY_ALL
+};
+
+// The java_package, java_outer_classname and java_multiple_files options
+// declared in a set of .proto files and their transitive dependencies.  It is
+// filled once per generator run, visiting each file once, and then shared
+// read-only by the Params of all files being generated.
+class DeclaredJavaOptions {
+ public:
+  typedef map<string, string> NameMap;
+  typedef set<string> NameSet;
+ private:
+  NameSet visited_files_;
+  NameMap java_packages_;
+  NameMap java_outer_classnames_;
+  NameSet java_multiple_files_;
+
+ public:
+  // Returns false if file_name was already visited.
+  bool MarkVisited(const string& file_name) {
+    return visited_files_.insert(file_name).second;
+  }
+
+  void set_java_package(const string& file_name,
+      const string& java_package) {
+    java_packages_[file_name] = java_package;
+  }
+  const string* java_package(const string& file_name) const {
+    NameMap::const_iterator itr = java_packages_.find(file_name);
+    return itr == java_packages_.end() ? NULL : &itr->second;
+  }
+
+  void set_java_outer_classname(const string& file_name,
+      const string& java_outer_classname) {
+    java_outer_classnames_[file_name] = java_outer_classname;
+  }
+  const string* java_outer_classname(const string& file_name) const {
+    NameMap::const_iterator itr = java_outer_classnames_.find(file_name);
+    return itr == java_outer_classnames_.end() ? NULL : &itr->second;
+  }
+
+  void set_java_multiple_files(const string& file_name, bool value) {
+    if (value) {
+      java_multiple_files_.insert(file_name);
+    } else {
+      java_multiple_files_.erase(file_name);
+    }
+  }
+  bool java_multiple_files(const string& file_name) const {
+    return java_multiple_files_.find(file_name)
+            != java_multiple_files_.end();
+  }
+};
 
 // Parameters for used by the generators
 class Params {
@@ -59,9 +114,11 @@ class Params {
   string base_name_;
   eMultipleFiles override_java_multiple_files_;
   bool store_unknown_fields_;
+  // Options declared in the .proto files, shared between all Params of a run.
+  std::shared_ptr<const DeclaredJavaOptions> declared_options_;
+  // Command line overrides of the declared options.
   NameMap java_packages_;
   NameMap java_outer_classnames_;
-  NameSet java_multiple_files_;
   bool generate_has_;
   bool java_enum_style_;
   bool optional_field_accessors_;
@@ -73,6 +130,16 @@ class Params {
   bool generate_clear_;
   bool generate_clone_;
   bool generate_intdefs_;
+  int max_method_size_;
+  bool table_driven_codegen_;
+  bool dense_field_dispatch_;
+  bool single_pass_repeated_fields_;
+  bool array_parser_;
+  bool reverse_serializer_;
+  eLazyMessageFields lazy_message_fields_;
+  // Fields and messages listed in used_fields_manifest, shared between all
+  // Params of a run.  NULL if no manifest was given.
+  std::shared_ptr<const set<string> > used_fields_;
 
  public:
   Params(const string & base_name) :
@@ -90,16 +157,29 @@ class Params {
     reftypes_primitive_enums_(false),
     generate_clear_(true),
     generate_clone_(false),
-    generate_intdefs_(false) {
+    generate_intdefs_(false),
+    max_method_size_(0),
+    table_driven_codegen_(false),
+    dense_field_dispatch_(true),
+    single_pass_repeated_fields_(false),
+    array_parser_(false),
+    reverse_serializer_(false),
+    lazy_message_fields_(JAVANANO_LAZY_NONE) {
   }
 
   const string& base_name() const {
     return base_name_;
   }
 
+  void set_declared_options(
+      const std::shared_ptr<const DeclaredJavaOptions>& declared_options) {
+    declared_options_ = declared_options;
+  }
+
   bool has_java_package(const string& file_name) const {
-    return java_packages_.find(file_name)
-                        != java_packages_.end();
+    return java_packages_.find(file_name) != java_packages_.end()
+        || (declared_options_ != NULL
+            && declared_options_->java_package(file_name) != NULL);
   }
   void set_java_package(const string& file_name,
       const string& java_package) {
@@ -109,19 +189,19 @@ class Params {
     NameMap::const_iterator itr;
 
     itr = java_packages_.find(file_name);
-    if  (itr == java_packages_.end()) {
-      return empty_;
-    } else {
+    if  (itr != java_packages_.end()) {
       return itr->second;
     }
-  }
-  const NameMap& java_packages() {
-    return java_packages_;
+    const string* declared = declared_options_ != NULL
+        ? declared_options_->java_package(file_name) : NULL;
+    return declared != NULL ? *declared : empty_;
   }
 
   bool has_java_outer_classname(const string& file_name) const {
     return java_outer_classnames_.find(file_name)
-                        != java_outer_classnames_.end();
+                        != java_outer_classnames_.end()
+        || (declared_options_ != NULL
+            && declared_options_->java_outer_classname(file_name) != NULL);
   }
   void set_java_outer_classname(const string& file_name,
       const string& java_outer_classname) {
@@ -131,14 +211,12 @@ class Params {
     NameMap::const_iterator itr;
 
     itr = java_outer_classnames_.find(file_name);
-    if  (itr == java_outer_classnames_.end()) {
-      return empty_;
-    } else {
+    if  (itr != java_outer_classnames_.end()) {
       return itr->second;
     }
-  }
-  const NameMap& java_outer_classnames() {
-    return java_outer_classnames_;
+    const string* declared = declared_options_ != NULL
+        ? declared_options_->java_outer_classname(file_name) : NULL;
+    return declared != NULL ? *declared : empty_;
   }
 
   void set_override_java_multiple_files(bool java_multiple_files) {
@@ -152,13 +230,6 @@ class Params {
     override_java_multiple_files_ = JAVANANO_MUL_UNSET;
   }
 
-  void set_java_multiple_files(const string& file_name, bool value) {
-    if (value) {
-      java_multiple_files_.insert(file_name);
-    } else {
-      java_multiple_files_.erase(file_name);
-    }
-  }
   bool java_multiple_files(const string& file_name) const {
     switch (override_java_multiple_files_) {
       case JAVANANO_MUL_FALSE:
@@ -166,8 +237,8 @@ class Params {
       case JAVANANO_MUL_TRUE:
         return true;
       default:
-        return java_multiple_files_.find(file_name)
-                != java_multiple_files_.end();
+        return declared_options_ != NULL
+            && declared_options_->java_multiple_files(file_name);
     }
   }
 
@@ -254,6 +325,77 @@ class Params {
   bool generate_intdefs() const {
     return generate_intdefs_;
   }
+
+  // Estimated bytecode size above which the serialization and parsing
+  // methods are split up; 0 means never.
+  void set_max_method_size(int value) {
+    max_method_size_ = value;
+  }
+  int max_method_size() const {
+    return max_method_size_;
+  }
+
+  // Whether messages get a static field table interpreted by
+  // MessageTableNano instead of unrolled serialization and parsing code.
+  void set_table_driven_codegen(bool value) {
+    table_driven_codegen_ = value;
+  }
+  bool table_driven_codegen() const {
+    return table_driven_codegen_;
+  }
+
+  // Whether mergeFrom() may dispatch on dense field indexes instead of raw
+  // tags where that lets javac compile its switch to a tableswitch.
+  void set_dense_field_dispatch(bool value) {
+    dense_field_dispatch_ = value;
+  }
+  bool dense_field_dispatch() const {
+    return dense_field_dispatch_;
+  }
+
+  // Whether the values of unpacked repeated fields are parsed in a single
+  // pass into scratch arrays of the input, rather than counted first.
+  void set_single_pass_repeated_fields(bool value) {
+    single_pass_repeated_fields_ = value;
+  }
+  bool single_pass_repeated_fields() const {
+    return single_pass_repeated_fields_;
+  }
+
+  // Whether messages get a mergeFrom() parsing a byte array directly with
+  // an ArrayDecoderNano, besides the one taking a CodedInputByteBufferNano.
+  void set_array_parser(bool value) {
+    array_parser_ = value;
+  }
+  bool array_parser() const {
+    return array_parser_;
+  }
+
+  // Whether messages get a writeToReverse() writing their fields back to
+  // front into a ReverseCodedOutputNano, besides writeTo().
+  void set_reverse_serializer(bool value) {
+    reverse_serializer_ = value;
+  }
+  bool reverse_serializer() const {
+    return reverse_serializer_;
+  }
+
+  // Which singular message fields keep their serialized form until they
+  // are first read: none, those marked [lazy = true], or all of them.
+  void set_lazy_message_fields(eLazyMessageFields value) {
+    lazy_message_fields_ = value;
+  }
+  eLazyMessageFields lazy_message_fields() const {
+    return lazy_message_fields_;
+  }
+
+  void set_used_fields(
+      const std::shared_ptr<const set<string> >& used_fields) {
+    used_fields_ = used_fields;
+  }
+  const set<string>* used_fields() const {
+    return used_fields_.get();
+  }
 };
 
 }  // namespace javanano
@@ -123,6 +123,50 @@ const char* GetCapitalizedType(const FieldDescriptor* field) {
   return NULL;
 }
 
+// The kind of scratch array of CodedInputByteBufferNano that holds values of
+// the given type, as in its takeIntScratch() etc.
+const char* ScratchKind(JavaType type) {
+  switch (type) {
+    case JAVATYPE_INT    : return "Int"    ;
+    case JAVATYPE_LONG   : return "Long"   ;
+    case JAVATYPE_FLOAT  : return "Float"  ;
+    case JAVATYPE_DOUBLE : return "Double" ;
+    case JAVATYPE_BOOLEAN: return "Boolean";
+    case JAVATYPE_STRING : return "Object" ;
+    case JAVATYPE_BYTES  : return "Object" ;
+    case JAVATYPE_ENUM   : return "Int"    ;
+    case JAVATYPE_MESSAGE: return "Object" ;
+
+    // No default because we want the compiler to complain if any new
+    // JavaTypes are added.
+  }
+
+  GOOGLE_LOG(FATAL) << "Can't get here.";
+  return NULL;
+}
+
+// The field of ArrayDecoderNano into which its read methods decode values of
+// the given type.
+const char* ArrayDecoderValue(JavaType type) {
+  switch (type) {
+    case JAVATYPE_INT    : return "intValue"    ;
+    case JAVATYPE_LONG   : return "longValue"   ;
+    case JAVATYPE_FLOAT  : return "floatValue"  ;
+    case JAVATYPE_DOUBLE : return "doubleValue" ;
+    case JAVATYPE_BOOLEAN: return "booleanValue";
+    case JAVATYPE_STRING : return "stringValue" ;
+    case JAVATYPE_BYTES  : return "bytesValue"  ;
+    case JAVATYPE_ENUM   : return "intValue"    ;
+    case JAVATYPE_MESSAGE: return NULL          ;
+
+    // No default because we want the compiler to complain if any new
+    // JavaTypes are added.
+  }
+
+  GOOGLE_LOG(FATAL) << "Can't get here.";
+  return NULL;
+}
+
 // For encodings with fixed sizes, returns that size in bytes.  Otherwise
 // returns -1.
 int FixedSize(FieldDescriptor::Type type) {
@@ -155,6 +199,14 @@ int FixedSize(FieldDescriptor::Type type) {
   return -1;
 }
 
+// The most bytes a value of the field takes serialized with its tag, but
+// for the contents of strings and bytes.
+int MaxTaggedSize(const FieldDescriptor* descriptor) {
+  int max_value_size = MaxValueSize(descriptor->type());
+  return WireFormat::TagSize(descriptor->number(), descriptor->type())
+      + (max_value_size != -1 ? max_value_size : kMaxLengthPrefixSize);
+}
+
 bool AllAscii(const string& text) {
   for (int i = 0; i < text.size(); i++) {
     if ((text[i] & 0x80) != 0) {
@@ -165,18 +217,20 @@ bool AllAscii(const string& text) {
 }
 
 
-void SetPrimitiveVariables(const FieldDescriptor* descriptor, const Params params,
-                           map<string, string>* variables) {
-  (*variables)["name"] =
+void SetPrimitiveVariables(const FieldDescriptor* descriptor, const Params& params,
+                           TemplateVariables* variables) {
+  (*variables)[JAVANANO_VAR("name")] =
     RenameJavaKeywords(UnderscoresToCamelCase(descriptor));
-  (*variables)["capitalized_name"] =
+  (*variables)[JAVANANO_VAR("capitalized_name")] =
     RenameJavaKeywords(UnderscoresToCapitalizedCamelCase(descriptor));
-  (*variables)["number"] = SimpleItoa(descriptor->number());
+  (*variables)[JAVANANO_VAR("number")] = SimpleItoa(descriptor->number());
   if (params.use_reference_types_for_primitives()
       && !descriptor->is_repeated()) {
-    (*variables)["type"] = BoxedPrimitiveTypeName(GetJavaType(descriptor));
+    (*variables)[JAVANANO_VAR("type")] =
+        BoxedPrimitiveTypeName(GetJavaType(descriptor));
   } else {
-    (*variables)["type"] = PrimitiveTypeName(GetJavaType(descriptor));
+    (*variables)[JAVANANO_VAR("type")] =
+        PrimitiveTypeName(GetJavaType(descriptor));
   }
   // Deals with defaults. For C++-string types (string and bytes),
   // we might need to have the generated code do the unicode decoding
@@ -187,48 +241,72 @@ void SetPrimitiveVariables(const FieldDescriptor* descriptor, const Params param
       !descriptor->default_value_string().empty() &&
       !params.use_reference_types_for_primitives()) {
     if (descriptor->type() == FieldDescriptor::TYPE_BYTES) {
-      (*variables)["default"] = DefaultValue(params, descriptor);
-      (*variables)["default_constant"] = FieldDefaultConstantName(descriptor);
-      (*variables)["default_constant_value"] = strings::Substitute(
-          "com.google.protobuf.nano.InternalNano.bytesDefaultValue(\"$0\")",
-          CEscape(descriptor->default_value_string()));
-      (*variables)["default_copy_if_needed"] =
-          (*variables)["default"] + ".clone()";
+      (*variables)[JAVANANO_VAR("default")] = DefaultValue(params, descriptor);
+      (*variables)[JAVANANO_VAR("default_constant")] =
+          FieldDefaultConstantName(descriptor);
+      (*variables)[JAVANANO_VAR("default_constant_value")] =
+          strings::Substitute(
+              "com.google.protobuf.nano.InternalNano."
+              "bytesDefaultValue(\"$0\")",
+              CEscape(descriptor->default_value_string()));
+      (*variables)[JAVANANO_VAR("default_copy_if_needed")] =
+          (*variables)[JAVANANO_VAR("default")] + ".clone()";
     } else if (AllAscii(descriptor->default_value_string())) {
       // All chars are ASCII.  In this case directly referencing a
       // CEscape()'d string literal works fine.
-      (*variables)["default"] =
+      (*variables)[JAVANANO_VAR("default")] =
           "\"" + CEscape(descriptor->default_value_string()) + "\"";
-      (*variables)["default_copy_if_needed"] = (*variables)["default"];
+      (*variables)[JAVANANO_VAR("default_copy_if_needed")] =
+          (*variables)[JAVANANO_VAR("default")];
     } else {
       // Strings where some chars are non-ASCII. We need to save the
       // default value.
-      (*variables)["default"] = DefaultValue(params, descriptor);
-      (*variables)["default_constant"] = FieldDefaultConstantName(descriptor);
-      (*variables)["default_constant_value"] = strings::Substitute(
-          "com.google.protobuf.nano.InternalNano.stringDefaultValue(\"$0\")",
-          CEscape(descriptor->default_value_string()));
-      (*variables)["default_copy_if_needed"] = (*variables)["default"];
+      (*variables)[JAVANANO_VAR("default")] = DefaultValue(params, descriptor);
+      (*variables)[JAVANANO_VAR("default_constant")] =
+          FieldDefaultConstantName(descriptor);
+      (*variables)[JAVANANO_VAR("default_constant_value")] =
+          strings::Substitute(
+              "com.google.protobuf.nano.InternalNano."
+              "stringDefaultValue(\"$0\")",
+              CEscape(descriptor->default_value_string()));
+      (*variables)[JAVANANO_VAR("default_copy_if_needed")] =
+          (*variables)[JAVANANO_VAR("default")];
     }
   } else {
     // Non-string, non-bytes field. Defaults are literals.
-    (*variables)["default"] = DefaultValue(params, descriptor);
-    (*variables)["default_copy_if_needed"] = (*variables)["default"];
+    (*variables)[JAVANANO_VAR("default")] = DefaultValue(params, descriptor);
+    (*variables)[JAVANANO_VAR("default_copy_if_needed")] =
+        (*variables)[JAVANANO_VAR("default")];
   }
-  (*variables)["boxed_type"] = BoxedPrimitiveTypeName(GetJavaType(descriptor));
-  (*variables)["capitalized_type"] = GetCapitalizedType(descriptor);
-  (*variables)["tag"] = SimpleItoa(WireFormat::MakeTag(descriptor));
-  (*variables)["tag_size"] = SimpleItoa(
+  (*variables)[JAVANANO_VAR("boxed_type")] =
+      BoxedPrimitiveTypeName(GetJavaType(descriptor));
+  (*variables)[JAVANANO_VAR("capitalized_type")] =
+      GetCapitalizedType(descriptor);
+  (*variables)[JAVANANO_VAR("array_value")] =
+      string("decoder.") + ArrayDecoderValue(GetJavaType(descriptor));
+  (*variables)[JAVANANO_VAR("tag")] =
+      SimpleItoa(WireFormat::MakeTag(descriptor));
+  (*variables)[JAVANANO_VAR("write_tag")] =
+      WriteTagCall(DeclaredTag(descriptor));
+  (*variables)[JAVANANO_VAR("tag_size")] = SimpleItoa(
       WireFormat::TagSize(descriptor->number(), descriptor->type()));
-  (*variables)["non_packed_tag"] = SimpleItoa(
+  (*variables)[JAVANANO_VAR("non_packed_tag")] = SimpleItoa(
       internal::WireFormatLite::MakeTag(descriptor->number(),
           internal::WireFormat::WireTypeForFieldType(descriptor->type())));
   int fixed_size = FixedSize(descriptor->type());
   if (fixed_size != -1) {
-    (*variables)["fixed_size"] = SimpleItoa(fixed_size);
+    (*variables)[JAVANANO_VAR("fixed_size")] = SimpleItoa(fixed_size);
   }
-  (*variables)["message_name"] = descriptor->containing_type()->name();
-  (*variables)["empty_array_name"] = EmptyArrayName(params, descriptor);
+  int max_value_size = MaxValueSize(descriptor->type());
+  if (max_value_size != -1) {
+    (*variables)[JAVANANO_VAR("max_value_size")] = SimpleItoa(max_value_size);
+  }
+  (*variables)[JAVANANO_VAR("max_tagged_size")] =
+      SimpleItoa(MaxTaggedSize(descriptor));
+  (*variables)[JAVANANO_VAR("message_name")] =
+      descriptor->containing_type()->name();
+  (*variables)[JAVANANO_VAR("empty_array_name")] =
+      EmptyArrayName(params, descriptor);
 }
 }  // namespace
 
@@ -243,57 +321,69 @@ PrimitiveFieldGenerator(const FieldDescriptor* descriptor, const Params& params)
 PrimitiveFieldGenerator::~PrimitiveFieldGenerator() {}
 
 bool PrimitiveFieldGenerator::SavedDefaultNeeded() const {
-  return variables_.find("default_constant") != variables_.end();
+  return variables_.has(JAVANANO_VAR("default_constant"));
 }
 
 void PrimitiveFieldGenerator::GenerateInitSavedDefaultCode(io::Printer* printer) const {
-  if (variables_.find("default_constant") != variables_.end()) {
-    printer->Print(variables_,
+  if (variables_.has(JAVANANO_VAR("default_constant"))) {
+    JAVANANO_PRINT(printer, variables_,
       "$default_constant$ = $default_constant_value$;\n");
   }
 }
 
 void PrimitiveFieldGenerator::
 GenerateMembers(io::Printer* printer, bool lazy_init) const {
-  if (variables_.find("default_constant") != variables_.end()) {
+  if (variables_.has(JAVANANO_VAR("default_constant"))) {
     // Those primitive types that need a saved default.
     if (lazy_init) {
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "private static $type$ $default_constant$;\n");
     } else {
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "private static final $type$ $default_constant$ =\n"
         "    $default_constant_value$;\n");
     }
   }
 
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "public $type$ $name$;\n");
 
   if (params_.generate_has()) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "public boolean has$capitalized_name$;\n");
   }
 }
 
 void PrimitiveFieldGenerator::
 GenerateClearCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "$name$ = $default_copy_if_needed$;\n");
 
   if (params_.generate_has()) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "has$capitalized_name$ = false;\n");
   }
 }
 
 void PrimitiveFieldGenerator::
 GenerateMergingCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "this.$name$ = input.read$capitalized_type$();\n");
 
   if (params_.generate_has()) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
+      "has$capitalized_name$ = true;\n");
+  }
+}
+
+void PrimitiveFieldGenerator::
+GenerateArrayMergingCode(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
+    "position = decoder.read$capitalized_type$(buffer, position, limit);\n"
+    "this.$name$ = $array_value$;\n");
+
+  if (params_.generate_has()) {
+    JAVANANO_PRINT(printer, variables_,
       "has$capitalized_name$ = true;\n");
   }
 }
@@ -303,34 +393,34 @@ GenerateSerializationConditional(io::Printer* printer) const {
   if (params_.use_reference_types_for_primitives()) {
     // For reference type mode, serialize based on equality
     // to null.
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "if (this.$name$ != null) {\n");
     return;
   }
   if (params_.generate_has()) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "if (has$capitalized_name$ || ");
   } else {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "if (");
   }
   JavaType java_type = GetJavaType(descriptor_);
   if (IsArrayType(java_type)) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "!java.util.Arrays.equals(this.$name$, $default$)) {\n");
   } else if (IsReferenceType(java_type)) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "!this.$name$.equals($default$)) {\n");
   } else if (java_type == JAVATYPE_FLOAT) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "java.lang.Float.floatToIntBits(this.$name$)\n"
       "    != java.lang.Float.floatToIntBits($default$)) {\n");
   } else if (java_type == JAVATYPE_DOUBLE) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "java.lang.Double.doubleToLongBits(this.$name$)\n"
       "    != java.lang.Double.doubleToLongBits($default$)) {\n");
   } else {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "this.$name$ != $default$) {\n");
   }
 }
@@ -339,25 +429,67 @@ void PrimitiveFieldGenerator::
 GenerateSerializationCode(io::Printer* printer) const {
   if (descriptor_->is_required() && !params_.generate_has()) {
     // Always serialize a required field if we don't have the 'has' signal.
-    printer->Print(variables_,
-      "output.write$capitalized_type$($number$, this.$name$);\n");
+    JAVANANO_PRINT(printer, variables_,
+      "output.$write_tag$;\n"
+      "output.write$capitalized_type$NoTag(this.$name$);\n");
+  } else {
+    GenerateSerializationConditional(printer);
+    JAVANANO_PRINT(printer, variables_,
+      "  output.$write_tag$;\n"
+      "  output.write$capitalized_type$NoTag(this.$name$);\n"
+      "}\n");
+  }
+}
+
+void PrimitiveFieldGenerator::
+GenerateReverseSerializationCode(io::Printer* printer) const {
+  if (descriptor_->is_required() && !params_.generate_has()) {
+    JAVANANO_PRINT(printer, variables_,
+      "output.write$capitalized_type$NoTag(this.$name$);\n"
+      "output.$write_tag$;\n");
   } else {
     GenerateSerializationConditional(printer);
-    printer->Print(variables_,
-      "  output.write$capitalized_type$($number$, this.$name$);\n"
+    JAVANANO_PRINT(printer, variables_,
+      "  output.write$capitalized_type$NoTag(this.$name$);\n"
+      "  output.$write_tag$;\n"
       "}\n");
   }
 }
 
+int PrimitiveFieldGenerator::SerializedSizeUpperBoundConstant() const {
+  return MaxTaggedSize(descriptor_);
+}
+
+void PrimitiveFieldGenerator::
+GenerateSerializedSizeUpperBoundCode(io::Printer* printer) const {
+  // A char takes at most three bytes in UTF-8, a surrogate pair four.
+  switch (GetJavaType(descriptor_)) {
+    case JAVATYPE_STRING:
+      JAVANANO_PRINT(printer, variables_,
+        "if (this.$name$ != null) {\n"
+        "  size += 3 * this.$name$.length();\n"
+        "}\n");
+      break;
+    case JAVATYPE_BYTES:
+      JAVANANO_PRINT(printer, variables_,
+        "if (this.$name$ != null) {\n"
+        "  size += this.$name$.length;\n"
+        "}\n");
+      break;
+    default:
+      break;
+  }
+}
+
 void PrimitiveFieldGenerator::
 GenerateSerializedSizeCode(io::Printer* printer) const {
   if (descriptor_->is_required() && !params_.generate_has()) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "size += com.google.protobuf.nano.CodedOutputByteBufferNano\n"
       "    .compute$capitalized_type$Size($number$, this.$name$);\n");
   } else {
     GenerateSerializationConditional(printer);
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "  size += com.google.protobuf.nano.CodedOutputByteBufferNano\n"
       "      .compute$capitalized_type$Size($number$, this.$name$);\n"
       "}\n");
@@ -366,7 +498,7 @@ GenerateSerializedSizeCode(io::Printer* printer) const {
 
 void RepeatedPrimitiveFieldGenerator::
 GenerateFixClonedCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if (this.$name$ != null && this.$name$.length > 0) {\n"
     "  cloned.$name$ = this.$name$.clone();\n"
     "}\n");
@@ -380,10 +512,10 @@ GenerateEqualsCode(io::Printer* printer) const {
   // forms are different and we should return false.
   JavaType java_type = GetJavaType(descriptor_);
   if (java_type == JAVATYPE_BYTES) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "if (!java.util.Arrays.equals(this.$name$, other.$name$)");
     if (params_.generate_has()) {
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "\n"
         "    || (java.util.Arrays.equals(this.$name$, $default$)\n"
         "        && this.has$capitalized_name$ != other.has$capitalized_name$)");
@@ -393,14 +525,14 @@ GenerateEqualsCode(io::Printer* printer) const {
       "}\n");
   } else if (java_type == JAVATYPE_STRING
       || params_.use_reference_types_for_primitives()) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "if (this.$name$ == null) {\n"
       "  if (other.$name$ != null) {\n"
       "    return false;\n"
       "  }\n"
       "} else if (!this.$name$.equals(other.$name$)");
     if (params_.generate_has()) {
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "\n"
         "    || (this.$name$.equals($default$)\n"
         "        && this.has$capitalized_name$ != other.has$capitalized_name$)");
@@ -409,12 +541,12 @@ GenerateEqualsCode(io::Printer* printer) const {
       "  return false;\n"
       "}\n");
   } else if (java_type == JAVATYPE_FLOAT) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "{\n"
       "  int bits = java.lang.Float.floatToIntBits(this.$name$);\n"
       "  if (bits != java.lang.Float.floatToIntBits(other.$name$)");
     if (params_.generate_has()) {
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "\n"
         "      || (bits == java.lang.Float.floatToIntBits($default$)\n"
         "          && this.has$capitalized_name$ != other.has$capitalized_name$)");
@@ -424,12 +556,12 @@ GenerateEqualsCode(io::Printer* printer) const {
       "  }\n"
       "}\n");
   } else if (java_type == JAVATYPE_DOUBLE) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "{\n"
       "  long bits = java.lang.Double.doubleToLongBits(this.$name$);\n"
       "  if (bits != java.lang.Double.doubleToLongBits(other.$name$)");
     if (params_.generate_has()) {
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "\n"
         "      || (bits == java.lang.Double.doubleToLongBits($default$)\n"
         "          && this.has$capitalized_name$ != other.has$capitalized_name$)");
@@ -439,10 +571,10 @@ GenerateEqualsCode(io::Printer* printer) const {
       "  }\n"
       "}\n");
   } else {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "if (this.$name$ != other.$name$");
     if (params_.generate_has()) {
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "\n"
         "    || (this.$name$ == $default$\n"
         "        && this.has$capitalized_name$ != other.has$capitalized_name$)");
@@ -457,11 +589,11 @@ void PrimitiveFieldGenerator::
 GenerateHashCodeCode(io::Printer* printer) const {
   JavaType java_type = GetJavaType(descriptor_);
   if (java_type == JAVATYPE_BYTES) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "result = 31 * result + java.util.Arrays.hashCode(this.$name$);\n");
   } else if (java_type == JAVATYPE_STRING
       || params_.use_reference_types_for_primitives()) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "result = 31 * result\n"
       "    + (this.$name$ == null ? 0 : this.$name$.hashCode());\n");
   } else {
@@ -469,28 +601,28 @@ GenerateHashCodeCode(io::Printer* printer) const {
       // For all Java primitive types below, the hash codes match the
       // results of BoxedType.valueOf(primitiveValue).hashCode().
       case JAVATYPE_INT:
-        printer->Print(variables_,
+        JAVANANO_PRINT(printer, variables_,
           "result = 31 * result + this.$name$;\n");
         break;
       case JAVATYPE_LONG:
-        printer->Print(variables_,
+        JAVANANO_PRINT(printer, variables_,
           "result = 31 * result\n"
           "    + (int) (this.$name$ ^ (this.$name$ >>> 32));\n");
         break;
       case JAVATYPE_FLOAT:
-        printer->Print(variables_,
+        JAVANANO_PRINT(printer, variables_,
           "result = 31 * result\n"
           "    + java.lang.Float.floatToIntBits(this.$name$);\n");
         break;
       case JAVATYPE_DOUBLE:
-        printer->Print(variables_,
+        JAVANANO_PRINT(printer, variables_,
           "{\n"
           "  long v = java.lang.Double.doubleToLongBits(this.$name$);\n"
           "  result = 31 * result + (int) (v ^ (v >>> 32));\n"
           "}\n");
         break;
       case JAVATYPE_BOOLEAN:
-        printer->Print(variables_,
+        JAVANANO_PRINT(printer, variables_,
           "result = 31 * result + (this.$name$ ? 1231 : 1237);\n");
         break;
       default:
@@ -513,43 +645,43 @@ AccessorPrimitiveFieldGenerator(const FieldDescriptor* descriptor,
 AccessorPrimitiveFieldGenerator::~AccessorPrimitiveFieldGenerator() {}
 
 bool AccessorPrimitiveFieldGenerator::SavedDefaultNeeded() const {
-  return variables_.find("default_constant") != variables_.end();
+  return variables_.has(JAVANANO_VAR("default_constant"));
 }
 
 void AccessorPrimitiveFieldGenerator::
 GenerateInitSavedDefaultCode(io::Printer* printer) const {
-  if (variables_.find("default_constant") != variables_.end()) {
-    printer->Print(variables_,
+  if (variables_.has(JAVANANO_VAR("default_constant"))) {
+    JAVANANO_PRINT(printer, variables_,
       "$default_constant$ = $default_constant_value$;\n");
   }
 }
 
 void AccessorPrimitiveFieldGenerator::
 GenerateMembers(io::Printer* printer, bool lazy_init) const {
-  if (variables_.find("default_constant") != variables_.end()) {
+  if (variables_.has(JAVANANO_VAR("default_constant"))) {
     // Those primitive types that need a saved default.
     if (lazy_init) {
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "private static $type$ $default_constant$;\n");
     } else {
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "private static final $type$ $default_constant$ =\n"
         "    $default_constant_value$;\n");
     }
   }
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "private $type$ $name$_;\n"
     "public $type$ get$capitalized_name$() {\n"
     "  return $name$_;\n"
     "}\n"
     "public $message_name$ set$capitalized_name$($type$ value) {\n");
   if (IsReferenceType(GetJavaType(descriptor_))) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "  if (value == null) {\n"
       "    throw new java.lang.NullPointerException();\n"
       "  }\n");
   }
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "  $name$_ = value;\n"
     "  $set_has$;\n"
     "  return this;\n"
@@ -566,28 +698,67 @@ GenerateMembers(io::Printer* printer, bool lazy_init) const {
 
 void AccessorPrimitiveFieldGenerator::
 GenerateClearCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "$name$_ = $default_copy_if_needed$;\n");
 }
 
 void AccessorPrimitiveFieldGenerator::
 GenerateMergingCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "$name$_ = input.read$capitalized_type$();\n"
     "$set_has$;\n");
 }
 
+void AccessorPrimitiveFieldGenerator::
+GenerateArrayMergingCode(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
+    "position = decoder.read$capitalized_type$(buffer, position, limit);\n"
+    "$name$_ = $array_value$;\n"
+    "$set_has$;\n");
+}
+
 void AccessorPrimitiveFieldGenerator::
 GenerateSerializationCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if ($get_has$) {\n"
-    "  output.write$capitalized_type$($number$, $name$_);\n"
+    "  output.$write_tag$;\n"
+    "  output.write$capitalized_type$NoTag($name$_);\n"
     "}\n");
 }
 
+void AccessorPrimitiveFieldGenerator::
+GenerateReverseSerializationCode(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
+    "if ($get_has$) {\n"
+    "  output.write$capitalized_type$NoTag($name$_);\n"
+    "  output.$write_tag$;\n"
+    "}\n");
+}
+
+int AccessorPrimitiveFieldGenerator::SerializedSizeUpperBoundConstant() const {
+  return MaxTaggedSize(descriptor_);
+}
+
+void AccessorPrimitiveFieldGenerator::
+GenerateSerializedSizeUpperBoundCode(io::Printer* printer) const {
+  // The setters do not take null.
+  switch (GetJavaType(descriptor_)) {
+    case JAVATYPE_STRING:
+      JAVANANO_PRINT(printer, variables_,
+        "size += 3 * $name$_.length();\n");
+      break;
+    case JAVATYPE_BYTES:
+      JAVANANO_PRINT(printer, variables_,
+        "size += $name$_.length;\n");
+      break;
+    default:
+      break;
+  }
+}
+
 void AccessorPrimitiveFieldGenerator::
 GenerateSerializedSizeCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if ($get_has$) {\n"
     "  size += com.google.protobuf.nano.CodedOutputByteBufferNano\n"
     "      .compute$capitalized_type$Size($number$, $name$_);\n"
@@ -600,7 +771,7 @@ GenerateEqualsCode(io::Printer* printer) const {
     // For all Java primitive types below, the equality checks match the
     // results of BoxedType.valueOf(primitiveValue).equals(otherValue).
     case JAVATYPE_FLOAT:
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "if ($different_has$\n"
         "    || java.lang.Float.floatToIntBits($name$_)\n"
         "        != java.lang.Float.floatToIntBits(other.$name$_)) {\n"
@@ -608,7 +779,7 @@ GenerateEqualsCode(io::Printer* printer) const {
         "}\n");
       break;
     case JAVATYPE_DOUBLE:
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "if ($different_has$\n"
         "    || java.lang.Double.doubleToLongBits($name$_)\n"
         "        != java.lang.Double.doubleToLongBits(other.$name$_)) {\n"
@@ -618,7 +789,7 @@ GenerateEqualsCode(io::Printer* printer) const {
     case JAVATYPE_INT:
     case JAVATYPE_LONG:
     case JAVATYPE_BOOLEAN:
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "if ($different_has$\n"
         "    || $name$_ != other.$name$_) {\n"
         "  return false;\n"
@@ -626,7 +797,7 @@ GenerateEqualsCode(io::Printer* printer) const {
       break;
     case JAVATYPE_STRING:
       // Accessor style would guarantee $name$_ non-null
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "if ($different_has$\n"
         "    || !$name$_.equals(other.$name$_)) {\n"
         "  return false;\n"
@@ -634,7 +805,7 @@ GenerateEqualsCode(io::Printer* printer) const {
       break;
     case JAVATYPE_BYTES:
       // Accessor style would guarantee $name$_ non-null
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "if ($different_has$\n"
         "    || !java.util.Arrays.equals($name$_, other.$name$_)) {\n"
         "  return false;\n"
@@ -652,37 +823,37 @@ GenerateHashCodeCode(io::Printer* printer) const {
     // For all Java primitive types below, the hash codes match the
     // results of BoxedType.valueOf(primitiveValue).hashCode().
     case JAVATYPE_INT:
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "result = 31 * result + $name$_;\n");
       break;
     case JAVATYPE_LONG:
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "result = 31 * result + (int) ($name$_ ^ ($name$_ >>> 32));\n");
       break;
     case JAVATYPE_FLOAT:
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "result = 31 * result +\n"
         "    java.lang.Float.floatToIntBits($name$_);\n");
       break;
     case JAVATYPE_DOUBLE:
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "{\n"
         "  long v = java.lang.Double.doubleToLongBits($name$_);\n"
         "  result = 31 * result + (int) (v ^ (v >>> 32));\n"
         "}\n");
       break;
     case JAVATYPE_BOOLEAN:
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "result = 31 * result + ($name$_ ? 1231 : 1237);\n");
       break;
     case JAVATYPE_STRING:
       // Accessor style would guarantee $name$_ non-null
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "result = 31 * result + $name$_.hashCode();\n");
       break;
     case JAVATYPE_BYTES:
       // Accessor style would guarantee $name$_ non-null
-      printer->Print(variables_,
+      JAVANANO_PRINT(printer, variables_,
         "result = 31 * result + java.util.Arrays.hashCode($name$_);\n");
       break;
     default:
@@ -704,7 +875,7 @@ PrimitiveOneofFieldGenerator::~PrimitiveOneofFieldGenerator() {}
 
 void PrimitiveOneofFieldGenerator::GenerateMembers(
     io::Printer* printer, bool /*unused lazy_init*/) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "public boolean has$capitalized_name$() {\n"
     "  return $has_oneof_case$;\n"
     "}\n"
@@ -728,23 +899,64 @@ void PrimitiveOneofFieldGenerator::GenerateClearCode(
 
 void PrimitiveOneofFieldGenerator::GenerateMergingCode(
     io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "this.$oneof_name$_ = input.read$capitalized_type$();\n"
     "$set_oneof_case$;\n");
 }
 
+void PrimitiveOneofFieldGenerator::GenerateArrayMergingCode(
+    io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
+    "position = decoder.read$capitalized_type$(buffer, position, limit);\n"
+    "this.$oneof_name$_ = $array_value$;\n"
+    "$set_oneof_case$;\n");
+}
+
 void PrimitiveOneofFieldGenerator::GenerateSerializationCode(
     io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
+    "if ($has_oneof_case$) {\n"
+    "  output.$write_tag$;\n"
+    "  output.write$capitalized_type$NoTag(($boxed_type$) this.$oneof_name$_);\n"
+    "}\n");
+}
+
+void PrimitiveOneofFieldGenerator::GenerateReverseSerializationCode(
+    io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
     "if ($has_oneof_case$) {\n"
-    "  output.write$capitalized_type$(\n"
-    "      $number$, ($boxed_type$) this.$oneof_name$_);\n"
+    "  output.write$capitalized_type$NoTag(($boxed_type$) this.$oneof_name$_);\n"
+    "  output.$write_tag$;\n"
     "}\n");
 }
 
+int PrimitiveOneofFieldGenerator::SerializedSizeUpperBoundConstant() const {
+  return MaxTaggedSize(descriptor_);
+}
+
+void PrimitiveOneofFieldGenerator::GenerateSerializedSizeUpperBoundCode(
+    io::Printer* printer) const {
+  switch (GetJavaType(descriptor_)) {
+    case JAVATYPE_STRING:
+      JAVANANO_PRINT(printer, variables_,
+        "if ($has_oneof_case$) {\n"
+        "  size += 3 * (($boxed_type$) this.$oneof_name$_).length();\n"
+        "}\n");
+      break;
+    case JAVATYPE_BYTES:
+      JAVANANO_PRINT(printer, variables_,
+        "if ($has_oneof_case$) {\n"
+        "  size += (($boxed_type$) this.$oneof_name$_).length;\n"
+        "}\n");
+      break;
+    default:
+      break;
+  }
+}
+
 void PrimitiveOneofFieldGenerator::GenerateSerializedSizeCode(
     io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if ($has_oneof_case$) {\n"
     "  size += com.google.protobuf.nano.CodedOutputByteBufferNano\n"
     "      .compute$capitalized_type$Size(\n"
@@ -768,48 +980,95 @@ RepeatedPrimitiveFieldGenerator::RepeatedPrimitiveFieldGenerator(
     const FieldDescriptor* descriptor, const Params& params)
   : FieldGenerator(params), descriptor_(descriptor) {
   SetPrimitiveVariables(descriptor, params, &variables_);
+  JavaType java_type = GetJavaType(descriptor);
+  variables_[JAVANANO_VAR("scratch_kind")] = ScratchKind(java_type);
+  variables_[JAVANANO_VAR("scratch_type")] = IsReferenceType(java_type)
+      ? "java.lang.Object" : variables_[JAVANANO_VAR("type")];
+  SetRepeatedFieldGrowthVariables(descriptor,
+      java_type == JAVATYPE_BYTES ? "byte[]" : variables_[JAVANANO_VAR("type")],
+      &variables_);
+  variables_[JAVANANO_VAR("cached_data_size")] =
+      PackedDataSizeCacheName(descriptor);
 }
 
 RepeatedPrimitiveFieldGenerator::~RepeatedPrimitiveFieldGenerator() {}
 
+bool RepeatedPrimitiveFieldGenerator::CachesDataSize() const {
+  // Fixed size values and the table-driven runtime need no cache.
+  return descriptor_->is_packable() && descriptor_->options().packed()
+      && FixedSize(descriptor_->type()) == -1
+      && !params_.table_driven_codegen();
+}
+
 void RepeatedPrimitiveFieldGenerator::
 GenerateMembers(io::Printer* printer, bool /*unused init_defaults*/) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "public $type$[] $name$;\n");
+  if (CachesDataSize()) {
+    JAVANANO_PRINT(printer, variables_,
+      "private int $cached_data_size$ = -1;\n");
+  }
 }
 
 void RepeatedPrimitiveFieldGenerator::
 GenerateClearCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "$name$ = $default$;\n");
+  if (CachesDataSize()) {
+    JAVANANO_PRINT(printer, variables_,
+      "$cached_data_size$ = -1;\n");
+  }
 }
 
 void RepeatedPrimitiveFieldGenerator::
 GenerateMergingCode(io::Printer* printer) const {
+  if (params_.single_pass_repeated_fields()) {
+    GenerateSinglePassMergingCode(printer);
+    return;
+  }
+
   // First, figure out the length of the array, then parse.
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "int arrayLength = com.google.protobuf.nano.WireFormatNano\n"
-    "    .getRepeatedFieldArrayLength(input, $non_packed_tag$);\n"
-    "int i = this.$name$ == null ? 0 : this.$name$.length;\n");
-
-  if (GetJavaType(descriptor_) == JAVATYPE_BYTES) {
-    printer->Print(variables_,
-      "byte[][] newArray = new byte[i + arrayLength][];\n");
-  } else {
-    printer->Print(variables_,
-      "$type$[] newArray = new $type$[i + arrayLength];\n");
-  }
-  printer->Print(variables_,
-    "if (i != 0) {\n"
-    "  java.lang.System.arraycopy(this.$name$, 0, newArray, 0, i);\n"
-    "}\n"
-    "for (; i < newArray.length - 1; i++) {\n"
+    "    .getRepeatedFieldArrayLength(input, $non_packed_tag$);\n");
+  GenerateRepeatedFieldGrowCode(variables_, printer);
+  JAVANANO_PRINT(printer, variables_,
+    "int end = i + arrayLength;\n"
+    "for (; i < end - 1; i++) {\n"
     "  newArray[i] = input.read$capitalized_type$();\n"
     "  input.readTag();\n"
     "}\n"
     "// Last one without readTag.\n"
     "newArray[i] = input.read$capitalized_type$();\n"
-    "this.$name$ = newArray;\n");
+    "this.$name$ = newArray;\n"
+    "$merge_length$ = end;\n");
+}
+
+void RepeatedPrimitiveFieldGenerator::
+GenerateSinglePassMergingCode(io::Printer* printer) const {
+  // Parse the values into a scratch array of the input as long as their tag
+  // follows, then copy them to the field.
+  JAVANANO_PRINT(printer, variables_,
+    "$scratch_type$[] values = input.take$scratch_kind$Scratch();\n"
+    "int arrayLength = 0;\n"
+    "do {\n"
+    "  if (arrayLength == values.length) {\n"
+    "    values = java.util.Arrays.copyOf(values, arrayLength * 2);\n"
+    "  }\n"
+    "  values[arrayLength++] = input.read$capitalized_type$();\n"
+    "} while (input.readTagIfEquals($non_packed_tag$));\n");
+  GenerateRepeatedFieldGrowCode(variables_, printer);
+  JAVANANO_PRINT(printer, variables_,
+    "java.lang.System.arraycopy(values, 0, newArray, i, arrayLength);\n"
+    "this.$name$ = newArray;\n"
+    "$merge_length$ = i + arrayLength;\n");
+  if (IsReferenceType(GetJavaType(descriptor_))) {
+    JAVANANO_PRINT(printer, variables_,
+      "input.releaseObjectScratch(values, arrayLength);\n");
+  } else {
+    JAVANANO_PRINT(printer, variables_,
+      "input.release$scratch_kind$Scratch(values);\n");
+  }
 }
 
 void RepeatedPrimitiveFieldGenerator::
@@ -822,44 +1081,94 @@ GenerateMergingCodeFromPacked(io::Printer* printer) const {
   // can be calculated much more easily. However, FixedSize() returns 1 for
   // repeated bool fields, which are guaranteed to have the fixed size of
   // 1 byte per value only if we control the output. On the wire they can
-  // legally appear as variable-size integers, so we need to use the slow
-  // way for repeated bool fields.
+  // legally appear as variable-size integers, so repeated bool fields are
+  // counted like other varints, by the bytes ending a value.
   if (descriptor_->type() == FieldDescriptor::TYPE_BOOL
       || FixedSize(descriptor_->type()) == -1) {
-    printer->Print(variables_,
-      "// First pass to compute array length.\n"
-      "int arrayLength = 0;\n"
-      "int startPos = input.getPosition();\n"
-      "while (input.getBytesUntilLimit() > 0) {\n"
-      "  input.read$capitalized_type$();\n"
-      "  arrayLength++;\n"
-      "}\n"
-      "input.rewindToPosition(startPos);\n");
+    JAVANANO_PRINT(printer, variables_,
+      "int arrayLength = input.countVarints(length);\n");
   } else {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "int arrayLength = length / $fixed_size$;\n");
   }
 
-  printer->Print(variables_,
-    "int i = this.$name$ == null ? 0 : this.$name$.length;\n"
-    "$type$[] newArray = new $type$[i + arrayLength];\n"
-    "if (i != 0) {\n"
-    "  java.lang.System.arraycopy(this.$name$, 0, newArray, 0, i);\n"
-    "}\n"
-    "for (; i < newArray.length; i++) {\n"
+  GenerateRepeatedFieldGrowCode(variables_, printer);
+  JAVANANO_PRINT(printer, variables_,
+    "int end = i + arrayLength;\n"
+    "for (; i < end; i++) {\n"
     "  newArray[i] = input.read$capitalized_type$();\n"
     "}\n"
+    "input.checkPackedEnd();\n"
     "this.$name$ = newArray;\n"
+    "$merge_length$ = end;\n"
     "input.popLimit(limit);\n");
 }
 
+void RepeatedPrimitiveFieldGenerator::
+GenerateArrayMergingCode(io::Printer* printer) const {
+  // Values of unpacked fields are appended one at a time; the growth of the
+  // array amortizes the copies.
+  JAVANANO_PRINT(printer, variables_,
+    "position = decoder.read$capitalized_type$(buffer, position, limit);\n"
+    "int arrayLength = 1;\n");
+  GenerateRepeatedFieldGrowCode(variables_, printer);
+  JAVANANO_PRINT(printer, variables_,
+    "newArray[i] = $array_value$;\n"
+    "this.$name$ = newArray;\n"
+    "$merge_length$ = i + 1;\n");
+}
+
+void RepeatedPrimitiveFieldGenerator::
+GenerateArrayMergingCodeFromPacked(io::Printer* printer) const {
+  printer->Print(
+    "position = decoder.readLength(buffer, position, limit);\n"
+    "int packedLimit = position + decoder.intValue;\n");
+  // As in GenerateMergingCodeFromPacked, bools are counted like varints.
+  if (descriptor_->type() == FieldDescriptor::TYPE_BOOL
+      || FixedSize(descriptor_->type()) == -1) {
+    JAVANANO_PRINT(printer, variables_,
+      "int arrayLength = decoder.countVarints(buffer, position, packedLimit);\n");
+  } else {
+    JAVANANO_PRINT(printer, variables_,
+      "int arrayLength = decoder.intValue / $fixed_size$;\n");
+  }
+
+  GenerateRepeatedFieldGrowCode(variables_, printer);
+  JAVANANO_PRINT(printer, variables_,
+    "int end = i + arrayLength;\n"
+    "for (; i < end; i++) {\n"
+    "  position = decoder.read$capitalized_type$(buffer, position, packedLimit);\n"
+    "  newArray[i] = $array_value$;\n"
+    "}\n"
+    "decoder.checkPackedEnd(position, packedLimit);\n"
+    "this.$name$ = newArray;\n"
+    "$merge_length$ = end;\n");
+}
+
+string RepeatedPrimitiveFieldGenerator::MergeLengthVariable() const {
+  return RepeatedFieldMergeLengthName(descriptor_);
+}
+
+void RepeatedPrimitiveFieldGenerator::
+GenerateMergeTrimCode(io::Printer* printer) const {
+  GenerateRepeatedFieldTrimCode(variables_, printer);
+}
+
+void RepeatedPrimitiveFieldGenerator::
+GenerateMergeStartCode(io::Printer* printer) const {
+  if (CachesDataSize()) {
+    JAVANANO_PRINT(printer, variables_,
+      "$cached_data_size$ = -1;\n");
+  }
+}
+
 void RepeatedPrimitiveFieldGenerator::
 GenerateRepeatedDataSizeCode(io::Printer* printer) const {
   // Creates a variable dataSize and puts the serialized size in there.
   // If the element type is a Java reference type, also generates
   // dataCount which stores the number of non-null elements in the field.
   if (IsReferenceType(GetJavaType(descriptor_))) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "int dataCount = 0;\n"
       "int dataSize = 0;\n"
       "for (int i = 0; i < this.$name$.length; i++) {\n"
@@ -871,45 +1180,66 @@ GenerateRepeatedDataSizeCode(io::Printer* printer) const {
       "  }\n"
       "}\n");
   } else if (FixedSize(descriptor_->type()) == -1) {
-    printer->Print(variables_,
-      "int dataSize = 0;\n"
-      "for (int i = 0; i < this.$name$.length; i++) {\n"
-      "  $type$ element = this.$name$[i];\n"
-      "  dataSize += com.google.protobuf.nano.CodedOutputByteBufferNano\n"
-      "      .compute$capitalized_type$SizeNoTag(element);\n"
-      "}\n");
+    printer->Print("int dataSize = 0;\n");
+    GenerateDataSizeSumCode(printer);
   } else {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "int dataSize = $fixed_size$ * this.$name$.length;\n");
   }
 }
 
+void RepeatedPrimitiveFieldGenerator::
+GenerateDataSizeSumCode(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
+    "for (int i = 0; i < this.$name$.length; i++) {\n"
+    "  $type$ element = this.$name$[i];\n"
+    "  dataSize += com.google.protobuf.nano.CodedOutputByteBufferNano\n"
+    "      .compute$capitalized_type$SizeNoTag(element);\n"
+    "}\n");
+}
+
 void RepeatedPrimitiveFieldGenerator::
 GenerateSerializationCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if (this.$name$ != null && this.$name$.length > 0) {\n");
   printer->Indent();
 
   if (descriptor_->is_packable() && descriptor_->options().packed()) {
-    GenerateRepeatedDataSizeCode(printer);
-    printer->Print(variables_,
-      "output.writeRawVarint32($tag$);\n"
+    if (CachesDataSize()) {
+      // Use the size from computeSerializedSize() once.
+      JAVANANO_PRINT(printer, variables_,
+        "int dataSize = $cached_data_size$;\n"
+        "if (dataSize >= 0) {\n"
+        "  $cached_data_size$ = -1;\n"
+        "} else {\n"
+        "  dataSize = 0;\n");
+      printer->Indent();
+      GenerateDataSizeSumCode(printer);
+      printer->Outdent();
+      printer->Print("}\n");
+    } else {
+      GenerateRepeatedDataSizeCode(printer);
+    }
+    JAVANANO_PRINT(printer, variables_,
+      "output.$write_tag$;\n"
       "output.writeRawVarint32(dataSize);\n"
       "for (int i = 0; i < this.$name$.length; i++) {\n"
       "  output.write$capitalized_type$NoTag(this.$name$[i]);\n"
       "}\n");
   } else if (IsReferenceType(GetJavaType(descriptor_))) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "for (int i = 0; i < this.$name$.length; i++) {\n"
       "  $type$ element = this.$name$[i];\n"
       "  if (element != null) {\n"
-      "    output.write$capitalized_type$($number$, element);\n"
+      "    output.$write_tag$;\n"
+      "    output.write$capitalized_type$NoTag(element);\n"
       "  }\n"
       "}\n");
   } else {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "for (int i = 0; i < this.$name$.length; i++) {\n"
-      "  output.write$capitalized_type$($number$, this.$name$[i]);\n"
+      "  output.$write_tag$;\n"
+      "  output.write$capitalized_type$NoTag(this.$name$[i]);\n"
       "}\n");
   }
 
@@ -917,26 +1247,107 @@ GenerateSerializationCode(io::Printer* printer) const {
   printer->Print("}\n");
 }
 
+void RepeatedPrimitiveFieldGenerator::
+GenerateReverseSerializationCode(io::Printer* printer) const {
+  JAVANANO_PRINT(printer, variables_,
+    "if (this.$name$ != null && this.$name$.length > 0) {\n");
+  printer->Indent();
+
+  if (descriptor_->is_packable() && descriptor_->options().packed()) {
+    // The data size is what the values took once they are written.
+    JAVANANO_PRINT(printer, variables_,
+      "int sizeBefore = output.size();\n"
+      "for (int i = this.$name$.length - 1; i >= 0; i--) {\n"
+      "  output.write$capitalized_type$NoTag(this.$name$[i]);\n"
+      "}\n"
+      "output.writeRawVarint32(output.size() - sizeBefore);\n"
+      "output.$write_tag$;\n");
+  } else if (IsReferenceType(GetJavaType(descriptor_))) {
+    JAVANANO_PRINT(printer, variables_,
+      "for (int i = this.$name$.length - 1; i >= 0; i--) {\n"
+      "  $type$ element = this.$name$[i];\n"
+      "  if (element != null) {\n"
+      "    output.write$capitalized_type$NoTag(element);\n"
+      "    output.$write_tag$;\n"
+      "  }\n"
+      "}\n");
+  } else {
+    JAVANANO_PRINT(printer, variables_,
+      "for (int i = this.$name$.length - 1; i >= 0; i--) {\n"
+      "  output.write$capitalized_type$NoTag(this.$name$[i]);\n"
+      "  output.$write_tag$;\n"
+      "}\n");
+  }
+
+  printer->Outdent();
+  printer->Print("}\n");
+}
+
+int RepeatedPrimitiveFieldGenerator::SerializedSizeUpperBoundConstant() const {
+  if (descriptor_->is_packable() && descriptor_->options().packed()) {
+    return WireFormat::TagSize(descriptor_->number(), descriptor_->type())
+        + kMaxLengthPrefixSize;
+  }
+  return 0;
+}
+
+void RepeatedPrimitiveFieldGenerator::
+GenerateSerializedSizeUpperBoundCode(io::Printer* printer) const {
+  JavaType java_type = GetJavaType(descriptor_);
+  if (descriptor_->is_packable() && descriptor_->options().packed()) {
+    JAVANANO_PRINT(printer, variables_,
+      "if (this.$name$ != null) {\n"
+      "  size += $max_value_size$ * this.$name$.length;\n"
+      "}\n");
+  } else if (IsReferenceType(java_type)) {
+    JAVANANO_PRINT(printer, variables_,
+      "if (this.$name$ != null) {\n"
+      "  for (int i = 0; i < this.$name$.length; i++) {\n"
+      "    $type$ element = this.$name$[i];\n"
+      "    if (element != null) {\n");
+    if (java_type == JAVATYPE_STRING) {
+      JAVANANO_PRINT(printer, variables_,
+        "      size += $max_tagged_size$ + 3 * element.length();\n");
+    } else {
+      JAVANANO_PRINT(printer, variables_,
+        "      size += $max_tagged_size$ + element.length;\n");
+    }
+    JAVANANO_PRINT(printer, variables_,
+      "    }\n"
+      "  }\n"
+      "}\n");
+  } else {
+    JAVANANO_PRINT(printer, variables_,
+      "if (this.$name$ != null) {\n"
+      "  size += $max_tagged_size$ * this.$name$.length;\n"
+      "}\n");
+  }
+}
+
 void RepeatedPrimitiveFieldGenerator::
 GenerateSerializedSizeCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if (this.$name$ != null && this.$name$.length > 0) {\n");
   printer->Indent();
 
   GenerateRepeatedDataSizeCode(printer);
+  if (CachesDataSize()) {
+    JAVANANO_PRINT(printer, variables_,
+      "$cached_data_size$ = dataSize;\n");
+  }
 
   printer->Print(
     "size += dataSize;\n");
   if (descriptor_->is_packable() && descriptor_->options().packed()) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "size += $tag_size$;\n"
       "size += com.google.protobuf.nano.CodedOutputByteBufferNano\n"
       "    .computeRawVarint32Size(dataSize);\n");
   } else if (IsReferenceType(GetJavaType(descriptor_))) {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "size += $tag_size$ * dataCount;\n");
   } else {
-    printer->Print(variables_,
+    JAVANANO_PRINT(printer, variables_,
       "size += $tag_size$ * this.$name$.length;\n");
   }
 
@@ -948,7 +1359,7 @@ GenerateSerializedSizeCode(io::Printer* printer) const {
 
 void RepeatedPrimitiveFieldGenerator::
 GenerateEqualsCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "if (!com.google.protobuf.nano.InternalNano.equals(\n"
     "    this.$name$, other.$name$)) {\n"
     "  return false;\n"
@@ -957,7 +1368,7 @@ GenerateEqualsCode(io::Printer* printer) const {
 
 void RepeatedPrimitiveFieldGenerator::
 GenerateHashCodeCode(io::Printer* printer) const {
-  printer->Print(variables_,
+  JAVANANO_PRINT(printer, variables_,
     "result = 31 * result\n"
     "    + com.google.protobuf.nano.InternalNano.hashCode(this.$name$);\n");
 }
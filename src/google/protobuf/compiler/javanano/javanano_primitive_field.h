@@ -51,6 +51,7 @@ class PrimitiveFieldGenerator : public FieldGenerator {
   ~PrimitiveFieldGenerator();
 
   // implements FieldGenerator ---------------------------------------
+  const char* ClassName() const { return "PrimitiveFieldGenerator"; }
   bool SavedDefaultNeeded() const;
   void GenerateInitSavedDefaultCode(io::Printer* printer) const;
   void GenerateMembers(io::Printer* printer, bool lazy_init) const;
@@ -60,12 +61,18 @@ class PrimitiveFieldGenerator : public FieldGenerator {
   void GenerateSerializedSizeCode(io::Printer* printer) const;
   void GenerateEqualsCode(io::Printer* printer) const;
   void GenerateHashCodeCode(io::Printer* printer) const;
+  bool SupportsArrayParsing() const { return true; }
+  void GenerateArrayMergingCode(io::Printer* printer) const;
+  bool SupportsReverseSerialization() const { return true; }
+  void GenerateReverseSerializationCode(io::Printer* printer) const;
+  int SerializedSizeUpperBoundConstant() const;
+  void GenerateSerializedSizeUpperBoundCode(io::Printer* printer) const;
 
  private:
   void GenerateSerializationConditional(io::Printer* printer) const;
 
   const FieldDescriptor* descriptor_;
-  map<string, string> variables_;
+  TemplateVariables variables_;
 
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(PrimitiveFieldGenerator);
 };
@@ -77,6 +84,7 @@ class AccessorPrimitiveFieldGenerator : public FieldGenerator {
   ~AccessorPrimitiveFieldGenerator();
 
   // implements FieldGenerator ---------------------------------------
+  const char* ClassName() const { return "AccessorPrimitiveFieldGenerator"; }
   bool SavedDefaultNeeded() const;
   void GenerateInitSavedDefaultCode(io::Printer* printer) const;
   void GenerateMembers(io::Printer* printer, bool lazy_init) const;
@@ -86,10 +94,16 @@ class AccessorPrimitiveFieldGenerator : public FieldGenerator {
   void GenerateSerializedSizeCode(io::Printer* printer) const;
   void GenerateEqualsCode(io::Printer* printer) const;
   void GenerateHashCodeCode(io::Printer* printer) const;
+  bool SupportsArrayParsing() const { return true; }
+  void GenerateArrayMergingCode(io::Printer* printer) const;
+  bool SupportsReverseSerialization() const { return true; }
+  void GenerateReverseSerializationCode(io::Printer* printer) const;
+  int SerializedSizeUpperBoundConstant() const;
+  void GenerateSerializedSizeUpperBoundCode(io::Printer* printer) const;
 
  private:
   const FieldDescriptor* descriptor_;
-  map<string, string> variables_;
+  TemplateVariables variables_;
 
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(AccessorPrimitiveFieldGenerator);
 };
@@ -101,6 +115,7 @@ class PrimitiveOneofFieldGenerator : public FieldGenerator {
   ~PrimitiveOneofFieldGenerator();
 
   // implements FieldGenerator ---------------------------------------
+  const char* ClassName() const { return "PrimitiveOneofFieldGenerator"; }
   void GenerateMembers(io::Printer* printer, bool lazy_init) const;
   void GenerateClearCode(io::Printer* printer) const;
   void GenerateMergingCode(io::Printer* printer) const;
@@ -108,10 +123,16 @@ class PrimitiveOneofFieldGenerator : public FieldGenerator {
   void GenerateSerializedSizeCode(io::Printer* printer) const;
   void GenerateEqualsCode(io::Printer* printer) const;
   void GenerateHashCodeCode(io::Printer* printer) const;
+  bool SupportsArrayParsing() const { return true; }
+  void GenerateArrayMergingCode(io::Printer* printer) const;
+  bool SupportsReverseSerialization() const { return true; }
+  void GenerateReverseSerializationCode(io::Printer* printer) const;
+  int SerializedSizeUpperBoundConstant() const;
+  void GenerateSerializedSizeUpperBoundCode(io::Printer* printer) const;
 
  private:
   const FieldDescriptor* descriptor_;
-  map<string, string> variables_;
+  TemplateVariables variables_;
 
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(PrimitiveOneofFieldGenerator);
 };
@@ -123,6 +144,7 @@ class RepeatedPrimitiveFieldGenerator : public FieldGenerator {
   ~RepeatedPrimitiveFieldGenerator();
 
   // implements FieldGenerator ---------------------------------------
+  const char* ClassName() const { return "RepeatedPrimitiveFieldGenerator"; }
   void GenerateMembers(io::Printer* printer, bool lazy_init) const;
   void GenerateClearCode(io::Printer* printer) const;
   void GenerateMergingCode(io::Printer* printer) const;
@@ -132,12 +154,26 @@ class RepeatedPrimitiveFieldGenerator : public FieldGenerator {
   void GenerateEqualsCode(io::Printer* printer) const;
   void GenerateHashCodeCode(io::Printer* printer) const;
   void GenerateFixClonedCode(io::Printer* printer) const;
+  string MergeLengthVariable() const;
+  void GenerateMergeTrimCode(io::Printer* printer) const;
+  void GenerateMergeStartCode(io::Printer* printer) const;
+  bool SupportsArrayParsing() const { return true; }
+  void GenerateArrayMergingCode(io::Printer* printer) const;
+  void GenerateArrayMergingCodeFromPacked(io::Printer* printer) const;
+  bool SupportsReverseSerialization() const { return true; }
+  void GenerateReverseSerializationCode(io::Printer* printer) const;
+  int SerializedSizeUpperBoundConstant() const;
+  void GenerateSerializedSizeUpperBoundCode(io::Printer* printer) const;
 
  private:
+  // Whether the data size is kept for writeTo() in a private field.
+  bool CachesDataSize() const;
   void GenerateRepeatedDataSizeCode(io::Printer* printer) const;
+  void GenerateDataSizeSumCode(io::Printer* printer) const;
+  void GenerateSinglePassMergingCode(io::Printer* printer) const;
 
   const FieldDescriptor* descriptor_;
-  map<string, string> variables_;
+  TemplateVariables variables_;
 
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(RepeatedPrimitiveFieldGenerator);
 };
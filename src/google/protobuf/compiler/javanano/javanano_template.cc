@@ -0,0 +1,163 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// http://code.google.com/p/protobuf/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <string.h>
+#include <map>
+#include <mutex>
+
+#include <google/protobuf/compiler/javanano/javanano_template.h>
+#include <google/protobuf/io/printer.h>
+#include <google/protobuf/stubs/logging.h>
+
+namespace google {
+namespace protobuf {
+namespace compiler {
+namespace javanano {
+
+namespace {
+
+std::mutex* InternMutex() {
+  static std::mutex* mutex = new std::mutex;
+  return mutex;
+}
+
+}  // namespace
+
+int InternTemplateVariable(const string& name) {
+  // Each thread remembers the ids it has seen, so the lock is only taken for
+  // names that are new to the thread.
+  thread_local map<string, int> cached_ids;
+  map<string, int>::const_iterator cached = cached_ids.find(name);
+  if (cached != cached_ids.end()) {
+    return cached->second;
+  }
+
+  static map<string, int>* ids = new map<string, int>;
+  int id;
+  {
+    std::lock_guard<std::mutex> lock(*InternMutex());
+    map<string, int>::const_iterator it = ids->find(name);
+    if (it != ids->end()) {
+      id = it->second;
+    } else {
+      id = ids->size();
+      (*ids)[name] = id;
+    }
+  }
+  cached_ids[name] = id;
+  return id;
+}
+
+TemplateVariables::TemplateVariables() {}
+TemplateVariables::~TemplateVariables() {}
+
+string& TemplateVariables::operator[](int id) {
+  if (id >= values_.size()) {
+    values_.resize(id + 1);
+    defined_.resize(id + 1, false);
+  }
+  defined_[id] = true;
+  return values_[id];
+}
+
+Template::Template(const char* text) {
+  const char kDelimiter = '$';
+  string literal;
+  for (const char* p = text; *p != '\0'; p++) {
+    if (*p == '\n') {
+      if (!literal.empty()) {
+        Segment segment = { SEGMENT_TEXT, literal, -1 };
+        segments_.push_back(segment);
+        literal.clear();
+      }
+      Segment segment = { SEGMENT_NEWLINE, "", -1 };
+      segments_.push_back(segment);
+    } else if (*p == kDelimiter) {
+      const char* end = strchr(p + 1, kDelimiter);
+      if (end == NULL) {
+        GOOGLE_LOG(DFATAL) << " Unclosed variable name.";
+        break;
+      }
+      string name(p + 1, end);
+      p = end;
+      if (name.empty()) {
+        // Two delimiters in a row reduce to a literal delimiter character.
+        literal += kDelimiter;
+        continue;
+      }
+      if (!literal.empty()) {
+        Segment segment = { SEGMENT_TEXT, literal, -1 };
+        segments_.push_back(segment);
+        literal.clear();
+      }
+      Segment segment = {
+        SEGMENT_VARIABLE, name, InternTemplateVariable(name) };
+      segments_.push_back(segment);
+    } else {
+      literal += *p;
+    }
+  }
+  if (!literal.empty()) {
+    Segment segment = { SEGMENT_TEXT, literal, -1 };
+    segments_.push_back(segment);
+  }
+}
+
+Template::~Template() {}
+
+void Template::Print(const TemplateVariables& variables,
+                     io::Printer* printer) const {
+  for (int i = 0; i < segments_.size(); i++) {
+    const Segment& segment = segments_[i];
+    switch (segment.type) {
+      case SEGMENT_TEXT:
+        printer->WriteRaw(segment.text.data(), segment.text.size());
+        break;
+      case SEGMENT_VARIABLE: {
+        const string* value = variables.Find(segment.variable_id);
+        if (value == NULL) {
+          GOOGLE_LOG(DFATAL) << " Undefined variable: " << segment.text;
+        } else {
+          printer->WriteRaw(value->data(), value->size());
+        }
+        break;
+      }
+      case SEGMENT_NEWLINE:
+        // Goes through Print() so that the printer indents the next line.
+        printer->Print("\n");
+        break;
+    }
+  }
+}
+
+}  // namespace javanano
+}  // namespace compiler
+}  // namespace protobuf
+}  // namespace google
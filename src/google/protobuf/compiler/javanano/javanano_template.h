@@ -0,0 +1,147 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// http://code.google.com/p/protobuf/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Precompiled code templates for the field generators.  io::Printer::Print()
+// parses its template and looks every variable up in a map<string, string>
+// each time it is called; field generators print the same few snippets for
+// every field, so here the snippets are parsed once and the variables are
+// kept in a flat table indexed by interned variable names.
+
+#ifndef GOOGLE_PROTOBUF_COMPILER_JAVANANO_TEMPLATE_H__
+#define GOOGLE_PROTOBUF_COMPILER_JAVANANO_TEMPLATE_H__
+
+#include <string>
+#include <vector>
+#include <google/protobuf/stubs/common.h>
+#include <google/protobuf/compiler/javanano/javanano_params.h>
+
+namespace google {
+namespace protobuf {
+  namespace io {
+    class Printer;             // printer.h
+  }
+}
+
+namespace protobuf {
+namespace compiler {
+namespace javanano {
+
+// Returns a small integer identifying the given variable name.  The same
+// name always maps to the same id.  Thread-safe; only the first lookup of a
+// name on each thread takes the global lock.
+int InternTemplateVariable(const string& name);
+
+// The interned id of a variable name given as a string literal.  The name is
+// interned the first time the expression runs and the id is kept in a static
+// local of the call site, so later lookups are a plain load.
+#define JAVANANO_VAR(name)                                                    \
+  ([]() -> int {                                                              \
+    static const int javanano_variable_id =                                   \
+        ::google::protobuf::compiler::javanano::InternTemplateVariable(name); \
+    return javanano_variable_id;                                              \
+  }())
+
+// The variables of one field generator, indexed by interned name.  Setting a
+// variable works like with a map<string, string>, but call sites should pass
+// JAVANANO_VAR("name") rather than the name so that rendering files in
+// parallel doesn't serialize on the intern table.
+class TemplateVariables {
+ public:
+  TemplateVariables();
+  ~TemplateVariables();
+
+  // Returns the value of the variable with the given interned id, defining it
+  // (as the empty string) if needed.
+  string& operator[](int id);
+
+  // Like above, for names that are built at run time.
+  string& operator[](const string& name) {
+    return (*this)[InternTemplateVariable(name)];
+  }
+
+  bool has(int id) const {
+    return Find(id) != NULL;
+  }
+
+  // Returns the value of the variable with the given interned id, or NULL if
+  // it is not defined.
+  const string* Find(int id) const {
+    return id < defined_.size() && defined_[id] ? &values_[id] : NULL;
+  }
+
+ private:
+  vector<string> values_;
+  vector<bool> defined_;
+};
+
+// A template in the syntax of io::Printer::Print() with '$' as the variable
+// delimiter, split into literal text, variable references and line breaks.
+// Print() produces exactly the same output as io::Printer::Print() would,
+// including indentation.
+class Template {
+ public:
+  explicit Template(const char* text);
+  ~Template();
+
+  void Print(const TemplateVariables& variables, io::Printer* printer) const;
+
+ private:
+  enum SegmentType {
+    SEGMENT_TEXT,
+    SEGMENT_VARIABLE,
+    SEGMENT_NEWLINE,
+  };
+
+  struct Segment {
+    SegmentType type;
+    string text;      // the text, or the variable name for error messages
+    int variable_id;  // for SEGMENT_VARIABLE
+  };
+
+  vector<Segment> segments_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(Template);
+};
+
+// Equivalent to printer->Print(variables, text) for a string literal text,
+// which is parsed only the first time the statement runs.
+#define JAVANANO_PRINT(printer, variables, text)                              \
+  do {                                                                        \
+    static const ::google::protobuf::compiler::javanano::Template             \
+        javanano_template(text);                                              \
+    javanano_template.Print(variables, printer);                              \
+  } while (0)
+
+}  // namespace javanano
+}  // namespace compiler
+}  // namespace protobuf
+
+}  // namespace google
+#endif  // GOOGLE_PROTOBUF_COMPILER_JAVANANO_TEMPLATE_H__
@@ -0,0 +1,80 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// http://code.google.com/p/protobuf/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Helpers shared by javanano_generator_unittest and
+// javanano_generator_benchmark, which both run the generator in-process over
+// schemas they build themselves.
+
+#ifndef GOOGLE_PROTOBUF_COMPILER_JAVANANO_TEST_UTIL_H__
+#define GOOGLE_PROTOBUF_COMPILER_JAVANANO_TEST_UTIL_H__
+
+#include <map>
+#include <string>
+#include <google/protobuf/compiler/code_generator.h>
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/stubs/common.h>
+
+namespace google {
+namespace protobuf {
+namespace compiler {
+namespace javanano {
+
+// Collects all generated files in memory.
+class MemoryGeneratorContext : public GeneratorContext {
+ public:
+  MemoryGeneratorContext() {}
+
+  io::ZeroCopyOutputStream* Open(const string& filename);
+
+  int file_count() const { return files_.size(); }
+
+  // Total size of all generated files.
+  int64 total_bytes() const;
+
+  const string& contents(const string& filename) { return files_[filename]; }
+
+ private:
+  map<string, string> files_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(MemoryGeneratorContext);
+};
+
+// Adds a field with the given name, number, type and label to message.
+FieldDescriptorProto* AddField(
+    DescriptorProto* message, const string& name, int number,
+    FieldDescriptorProto::Type type,
+    FieldDescriptorProto::Label label = FieldDescriptorProto::LABEL_OPTIONAL);
+
+}  // namespace javanano
+}  // namespace compiler
+}  // namespace protobuf
+
+}  // namespace google
+#endif  // GOOGLE_PROTOBUF_COMPILER_JAVANANO_TEST_UTIL_H__